@@ -1,19 +1,40 @@
 #include "DeviceMgmt.hpp"
 
+#include "Tracing.hpp"
 #include "Utils.hpp"
 
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/container/flat_set.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <ios>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
+#include <stop_token>
 #include <string>
 #include <system_error>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -89,6 +110,24 @@ bool I2CDeviceParams::deviceStatic() const
     return fs::exists(ofNode, ec);
 }
 
+std::vector<fs::path> I2CDeviceParams::hwmonDirectories() const
+{
+    std::vector<fs::path> dirs;
+    if (!type->createsHWMon)
+    {
+        return dirs;
+    }
+
+    std::error_code ec;
+    fs::path hwmon = i2cBusPath(bus) / deviceDirName(bus, address) / "hwmon";
+    for (const auto& entry : fs::directory_iterator(hwmon, ec))
+    {
+        dirs.emplace_back(fs::path("/sys/class/hwmon") /
+                          entry.path().filename());
+    }
+    return dirs;
+}
+
 I2CDevice::I2CDevice(I2CDeviceParams params) : params(params)
 {
     if (create() != 0)
@@ -162,3 +201,259 @@ int I2CDevice::destroy() const
 
     return 0;
 }
+
+// {bus, address} of devices owned by an in-progress I2CDeviceInstantiator.
+// Only accessed from the io_context thread.
+static boost::container::flat_set<std::pair<uint64_t, uint64_t>>
+    pendingDevices;
+
+bool I2CDeviceInstantiator::pending(const I2CDeviceParams& params)
+{
+    return pendingDevices.contains({params.bus, params.address});
+}
+
+I2CDeviceInstantiator::I2CDeviceInstantiator(
+    boost::asio::io_context& io, I2CDeviceMap devices,
+    std::vector<Request> requests) :
+    io(io), devices(std::move(devices)), requests(std::move(requests)),
+    wakeup(io), drainTimer(io)
+{
+    boost::container::flat_map<uint64_t, size_t> busGroups;
+    for (size_t i = 0; i < this->requests.size(); i++)
+    {
+        const I2CDeviceParams& params = this->requests[i].params;
+        pendingDevices.emplace(params.bus, params.address);
+
+        auto [it, inserted] = busGroups.try_emplace(params.bus, groups.size());
+        if (inserted)
+        {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(i);
+    }
+}
+
+I2CDeviceInstantiator::~I2CDeviceInstantiator()
+{
+    for (const Request& request : requests)
+    {
+        pendingDevices.erase({request.params.bus, request.params.address});
+    }
+}
+
+void I2CDeviceInstantiator::start(ReadyCallback&& ready, DoneCallback&& done)
+{
+    onReady = std::move(ready);
+    onDone = std::move(done);
+
+    if (requests.empty())
+    {
+        boost::asio::post(io,
+                          [self = shared_from_this()]() { self->finish(); });
+        return;
+    }
+
+    wakeFd = ::eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0)
+    {
+        // Still make progress, just without the parallelism
+        std::cerr << "Failed to create eventfd, instantiating devices "
+                  << "synchronously: " << strerror(errno) << "\n";
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            results.push_back(instantiate(i));
+        }
+        boost::asio::post(io, [self = shared_from_this()]() {
+            self->processResults();
+            self->finish();
+        });
+        return;
+    }
+    wakeup.assign(wakeFd);
+
+    size_t nWorkers = std::min(groups.size(), maxWorkers);
+    running = nWorkers;
+    workers.reserve(nWorkers);
+    for (size_t i = 0; i < nWorkers; i++)
+    {
+        workers.emplace_back(
+            [this](const std::stop_token& stop) { runWorker(stop); });
+    }
+
+    waitResults();
+}
+
+// Runs on a worker thread: touch nothing but the request and the result queue
+I2CDeviceInstantiator::Result
+    I2CDeviceInstantiator::instantiate(size_t request) const
+{
+    const I2CDeviceParams& params = requests[request].params;
+    Result result{request, nullptr, false, tracing::Clock::now(), {}};
+
+    // There exist error cases in which a sensor device that we need is
+    // already instantiated, but needs to be destroyed and re-created in order
+    // to be useful (for example if we crash after instantiating a device and
+    // the sensor device's power is cut before we get restarted, leaving it
+    // "present" but not really usable).  To be on the safe side, instantiate
+    // a temporary device that's immediately destroyed so as to ensure that we
+    // end up with a fresh instance of it.
+    //
+    // Nothing may escape the worker thread, so a failure either way is
+    // reported from the event loop as the device failing to instantiate.
+    try
+    {
+        if (params.devicePresent())
+        {
+            result.clearedOut = true;
+            I2CDevice tmp(params);
+        }
+
+        result.device = std::make_shared<I2CDevice>(params);
+    }
+    catch (const std::exception&)
+    {
+        result.device = nullptr;
+    }
+
+    result.end = tracing::Clock::now();
+    return result;
+}
+
+void I2CDeviceInstantiator::runWorker(const std::stop_token& stop)
+{
+    for (size_t group = nextGroup++; group < groups.size();
+         group = nextGroup++)
+    {
+        for (size_t request : groups[group])
+        {
+            if (stop.stop_requested())
+            {
+                running--;
+                return;
+            }
+
+            Result result = instantiate(request);
+            {
+                std::lock_guard<std::mutex> lock(resultsLock);
+                results.push_back(std::move(result));
+            }
+
+            uint64_t count = 1;
+            if (::write(wakeFd, &count, sizeof(count)) < 0)
+            {
+                std::cerr << "Failed to signal device instantiation: "
+                          << strerror(errno) << "\n";
+            }
+        }
+    }
+    running--;
+}
+
+void I2CDeviceInstantiator::waitResults()
+{
+    wakeup.async_read_some(
+        boost::asio::buffer(wakeBuf),
+        [self = shared_from_this()](const boost::system::error_code& ec,
+                                    size_t /* bytes */) {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+            if (ec)
+            {
+                std::cerr << "Error waiting for device instantiation: "
+                          << ec.message() << "\n";
+                for (std::jthread& worker : self->workers)
+                {
+                    worker.request_stop();
+                }
+                self->drain();
+                return;
+            }
+
+            self->processResults();
+            if (self->completed < self->requests.size())
+            {
+                self->waitResults();
+                return;
+            }
+            self->finish();
+        });
+}
+
+void I2CDeviceInstantiator::drain()
+{
+    // A worker queues its results before it exits, so once they all have
+    // this picks up the last of them
+    bool exited = running == 0;
+    processResults();
+    if (!exited)
+    {
+        // Joining the workers here would block the event loop until the
+        // probes in progress complete
+        drainTimer.expires_after(drainPoll);
+        drainTimer.async_wait(
+            [self = shared_from_this()](const boost::system::error_code& ec) {
+                if (ec == boost::asio::error::operation_aborted)
+                {
+                    return;
+                }
+                self->drain();
+            });
+        return;
+    }
+
+    // The devices of the requests never started are left uninstantiated
+    finish();
+}
+
+void I2CDeviceInstantiator::processResults()
+{
+    std::deque<Result> ready;
+    {
+        std::lock_guard<std::mutex> lock(resultsLock);
+        ready.swap(results);
+    }
+
+    for (Result& result : ready)
+    {
+        const Request& request = requests[result.request];
+        const I2CDeviceParams& params = request.params;
+        completed++;
+
+        tracing::complete("I2CDevice", result.start, result.end, request.path);
+
+        if (result.clearedOut)
+        {
+            std::cerr << "Cleared out previous instance for " << request.path
+                      << "\n";
+        }
+
+        if (result.device == nullptr)
+        {
+            std::cerr << "Failed to instantiate " << params.type->name
+                      << " at address " << params.address << " on bus "
+                      << params.bus << "\n";
+            continue;
+        }
+
+        // New hwmon directories will have appeared under sysfs
+        invalidateDiscoveryCache();
+        devices.insert_or_assign(request.path,
+                                 std::make_pair(result.device, true));
+        if (onReady)
+        {
+            onReady(request.path, params, result.device);
+        }
+    }
+}
+
+void I2CDeviceInstantiator::finish()
+{
+    tracing::complete("instantiateDevices", started);
+
+    if (onDone)
+    {
+        onDone(devices);
+    }
+}
@@ -1,12 +1,30 @@
 #pragma once
 
+#include "Tracing.hpp"
 #include "Utils.hpp"
 
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/container/flat_map.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <stop_token>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 struct I2CDeviceType
 {
@@ -36,6 +54,9 @@ struct I2CDeviceParams
 
     bool devicePresent() const;
     bool deviceStatic() const;
+
+    // The /sys/class/hwmon/hwmonN directories bound to the device, if any
+    std::vector<std::filesystem::path> hwmonDirectories() const;
 };
 
 std::optional<I2CDeviceParams> getI2CDeviceParams(
@@ -72,20 +93,120 @@ inline size_t sensorNameFind(const std::string& fullName,
         .find(boost::replace_all_copy(partialName, " ", "_"));
 }
 
-// returns a {path: <I2CDevice, is_new>} map.  is_new indicates if the I2CDevice
-// is newly instantiated by this call (true) or was already there (false).
+// {path: <I2CDevice, is_new>}.  is_new indicates if the I2CDevice was newly
+// instantiated (true) or was already there (false).
+using I2CDeviceMap =
+    boost::container::flat_map<std::string,
+                               std::pair<std::shared_ptr<I2CDevice>, bool>>;
+
+// Instantiates a batch of i2c devices off the event loop.
+//
+// Writing new_device blocks for as long as the driver takes to probe, which
+// for PMBus devices is often tens of milliseconds.  Requests are grouped by
+// bus and handed to a small pool of worker threads: devices on the same bus
+// are created one after another, while separate buses probe concurrently.
+// Results are passed back to the io_context through an eventfd, so the
+// callbacks always run on the event loop:
+//
+//  - the ready callback runs for each device as soon as it (and its hwmon
+//    node, where the driver creates one) exists
+//  - the done callback runs once with the complete device map after every
+//    request has been processed, and so after every ready callback
+//
+// Should waiting on the eventfd fail, the workers are stopped after the
+// devices they are probing and the event loop polls for them to exit rather
+// than joining them.
+class I2CDeviceInstantiator :
+    public std::enable_shared_from_this<I2CDeviceInstantiator>
+{
+  public:
+    struct Request
+    {
+        std::string path;
+        I2CDeviceParams params;
+    };
+
+    using ReadyCallback = std::function<void(
+        const std::string& path, const I2CDeviceParams& params,
+        const std::shared_ptr<I2CDevice>& device)>;
+    using DoneCallback = std::function<void(const I2CDeviceMap& devices)>;
+
+    I2CDeviceInstantiator(boost::asio::io_context& io, I2CDeviceMap devices,
+                          std::vector<Request> requests);
+    ~I2CDeviceInstantiator();
+
+    I2CDeviceInstantiator(const I2CDeviceInstantiator&) = delete;
+    I2CDeviceInstantiator& operator=(const I2CDeviceInstantiator&) = delete;
+    I2CDeviceInstantiator(I2CDeviceInstantiator&&) = delete;
+    I2CDeviceInstantiator& operator=(I2CDeviceInstantiator&&) = delete;
+
+    void start(ReadyCallback&& onReady, DoneCallback&& onDone);
+
+    // Whether the device is being instantiated by an instantiator that has
+    // not yet completed
+    static bool pending(const I2CDeviceParams& params);
+
+  private:
+    struct Result
+    {
+        size_t request;
+        std::shared_ptr<I2CDevice> device;
+        bool clearedOut;
+        tracing::Clock::time_point start;
+        tracing::Clock::time_point end;
+    };
+
+    static constexpr size_t maxWorkers = 8;
+    static constexpr std::chrono::milliseconds drainPoll{10};
+
+    Result instantiate(size_t request) const;
+    void runWorker(const std::stop_token& stop);
+    void waitResults();
+    void drain();
+    void processResults();
+    void finish();
+
+    boost::asio::io_context& io;
+    I2CDeviceMap devices;
+    std::vector<Request> requests;
+    ReadyCallback onReady;
+    DoneCallback onDone;
+    size_t completed = 0;
+    tracing::Clock::time_point started = tracing::Clock::now();
+
+    // Indices into requests, one group per bus
+    std::vector<std::vector<size_t>> groups;
+    std::atomic<size_t> nextGroup = 0;
+    // Workers yet to exit
+    std::atomic<size_t> running = 0;
+
+    std::mutex resultsLock;
+    std::deque<Result> results;
+
+    int wakeFd = -1;
+    std::array<uint8_t, sizeof(uint64_t)> wakeBuf{};
+
+    // The workers must be joined before the eventfd they signal is closed,
+    // so declare them after the stream descriptor that owns it.
+    boost::asio::posix::stream_descriptor wakeup;
+    boost::asio::steady_timer drainTimer;
+    std::vector<std::jthread> workers;
+};
+
+// Instantiates the i2c devices described by sensorConfigs that aren't already
+// backing an active sensor.  onReady is invoked for each newly created device
+// and onDone with the full {path: <I2CDevice, is_new>} map once all devices
+// have been dealt with.  Both callbacks run on the io_context.
 template <class T>
-boost::container::flat_map<std::string,
-                           std::pair<std::shared_ptr<I2CDevice>, bool>>
-    instantiateDevices(
-        const ManagedObjectType& sensorConfigs,
-        const boost::container::flat_map<std::string, std::shared_ptr<T>>&
-            sensors,
-        const I2CDeviceTypeMap& sensorTypes)
+void instantiateDevices(
+    boost::asio::io_context& io, const ManagedObjectType& sensorConfigs,
+    const boost::container::flat_map<std::string, std::shared_ptr<T>>& sensors,
+    const I2CDeviceTypeMap& sensorTypes,
+    I2CDeviceInstantiator::ReadyCallback&& onReady,
+    I2CDeviceInstantiator::DoneCallback&& onDone)
 {
-    boost::container::flat_map<std::string,
-                               std::pair<std::shared_ptr<I2CDevice>, bool>>
-        devices;
+    I2CDeviceMap devices;
+    std::vector<I2CDeviceInstantiator::Request> requests;
     for (const auto& [path, sensor] : sensorConfigs)
     {
         for (const auto& [name, cfg] : sensor)
@@ -117,37 +238,20 @@ boost::container::flat_map<std::string,
                 getI2CDeviceParams(sensorTypes, cfg);
             if (params.has_value() && !params->deviceStatic())
             {
-                // There exist error cases in which a sensor device that we
-                // need is already instantiated, but needs to be destroyed and
-                // re-created in order to be useful (for example if we crash
-                // after instantiating a device and the sensor device's power
-                // is cut before we get restarted, leaving it "present" but
-                // not really usable).  To be on the safe side, instantiate a
-                // temporary device that's immediately destroyed so as to
-                // ensure that we end up with a fresh instance of it.
-                if (params->devicePresent())
+                // An earlier scan is still bringing this device up and will
+                // hand it to the sensor once it's ready.
+                if (I2CDeviceInstantiator::pending(*params))
                 {
-                    std::cerr << "Clearing out previous instance for "
-                              << path.str << "\n";
-                    I2CDevice tmp(*params);
-                }
-
-                try
-                {
-                    devices.emplace(
-                        path.str,
-                        std::make_pair(std::make_shared<I2CDevice>(*params),
-                                       true));
                     break;
                 }
-                catch (std::runtime_error&)
-                {
-                    std::cerr << "Failed to instantiate " << params->type->name
-                              << " at address " << params->address << " on bus "
-                              << params->bus << "\n";
-                }
+
+                requests.emplace_back(path.str, *params);
+                break;
             }
         }
     }
-    return devices;
+
+    auto instantiator = std::make_shared<I2CDeviceInstantiator>(
+        io, std::move(devices), std::move(requests));
+    instantiator->start(std::move(onReady), std::move(onDone));
 }
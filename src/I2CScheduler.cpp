@@ -0,0 +1,534 @@
+#include "I2CScheduler.hpp"
+
+#include "FileHandle.hpp"
+#include "Tracing.hpp"
+
+#include <linux/i2c.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include <i2c/smbus.h>
+#include <linux/i2c-dev.h>
+}
+
+namespace
+{
+
+class I2CDevAdapter : public I2CAdapter
+{
+  public:
+    void execute(const I2CTransaction& transaction, I2CResult& result) override
+    {
+        try
+        {
+            Bus& bus = open(transaction.bus);
+            if ((bus.funcs & requiredFuncs(transaction.op)) == 0U)
+            {
+                result.error = EOPNOTSUPP;
+                return;
+            }
+
+            int rc = select(bus, transaction);
+            if (rc >= 0)
+            {
+                rc = read(bus, transaction, result);
+            }
+            if (rc < 0)
+            {
+                result.error = errno;
+            }
+        }
+        catch (const std::out_of_range&)
+        {
+            result.error = ENOENT;
+        }
+
+        // The adapter has gone away, reopen it next time
+        if (result.error == ENODEV)
+        {
+            buses.erase(transaction.bus);
+        }
+    }
+
+  private:
+    struct Bus
+    {
+        explicit Bus(FileHandle&& file) : file(std::move(file))
+        {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+            if (::ioctl(this->file.handle(), I2C_FUNCS, &funcs) < 0)
+            {
+                funcs = 0;
+            }
+        }
+
+        FileHandle file;
+        // What the adapter supports, from I2C_FUNCS
+        unsigned long funcs = 0;
+        // The address and whether it was forced, last set on the descriptor
+        std::optional<std::pair<uint8_t, bool>> target;
+    };
+
+    static unsigned long requiredFuncs(I2CTransaction::Op op)
+    {
+        switch (op)
+        {
+            case I2CTransaction::Op::readByteData:
+                return I2C_FUNC_SMBUS_READ_BYTE_DATA;
+            case I2CTransaction::Op::readWordData:
+                return I2C_FUNC_SMBUS_READ_WORD_DATA;
+            case I2CTransaction::Op::readBlockData:
+                return I2C_FUNC_SMBUS_READ_BLOCK_DATA;
+        }
+        return 0;
+    }
+
+    // Throws std::out_of_range if the bus can't be opened
+    Bus& open(int bus)
+    {
+        auto findBus = buses.find(bus);
+        if (findBus != buses.end())
+        {
+            return findBus->second;
+        }
+        return buses
+            .try_emplace(bus, FileHandle("/dev/i2c-" + std::to_string(bus)))
+            .first->second;
+    }
+
+    static int select(Bus& bus, const I2CTransaction& transaction)
+    {
+        std::pair<uint8_t, bool> target{transaction.address,
+                                        transaction.force};
+        if (bus.target == target)
+        {
+            return 0;
+        }
+
+        bus.target.reset();
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+        int rc = ::ioctl(bus.file.handle(),
+                         transaction.force ? I2C_SLAVE_FORCE : I2C_SLAVE,
+                         transaction.address);
+        if (rc >= 0)
+        {
+            bus.target = target;
+        }
+        return rc;
+    }
+
+    static int read(Bus& bus, const I2CTransaction& transaction,
+                    I2CResult& result)
+    {
+        int fd = bus.file.handle();
+        int32_t rc = -1;
+        switch (transaction.op)
+        {
+            case I2CTransaction::Op::readByteData:
+                rc = i2c_smbus_read_byte_data(fd, transaction.command);
+                break;
+            case I2CTransaction::Op::readWordData:
+                rc = i2c_smbus_read_word_data(fd, transaction.command);
+                break;
+            case I2CTransaction::Op::readBlockData:
+                rc = i2c_smbus_read_block_data(fd, transaction.command,
+                                               result.block.data());
+                break;
+        }
+        if (rc < 0)
+        {
+            return rc;
+        }
+
+        if (transaction.op == I2CTransaction::Op::readBlockData)
+        {
+            result.size = std::min<size_t>(rc, result.block.size());
+        }
+        else
+        {
+            result.value = static_cast<uint16_t>(rc);
+        }
+        return 0;
+    }
+
+    std::map<int, Bus> buses;
+};
+
+} // namespace
+
+std::unique_ptr<I2CAdapter> makeI2CDevAdapter()
+{
+    return std::make_unique<I2CDevAdapter>();
+}
+
+std::vector<int> i2cMuxPath(int bus)
+{
+    // Mux channels are adapters nested under their parent adapter's device,
+    // e.g. /sys/devices/.../i2c-3/3-0070/i2c-16
+    std::error_code ec;
+    std::filesystem::path device = std::filesystem::canonical(
+        "/sys/bus/i2c/devices/i2c-" + std::to_string(bus), ec);
+
+    std::vector<int> path;
+    for (const std::filesystem::path& component : device)
+    {
+        std::string name = component.string();
+        std::string_view prefix = "i2c-";
+        if (!name.starts_with(prefix))
+        {
+            continue;
+        }
+
+        int adapter = 0;
+        const char* begin = name.data() + prefix.size();
+        const char* end = name.data() + name.size();
+        auto [ptr, err] = std::from_chars(begin, end, adapter);
+        if (err == std::errc() && ptr == end)
+        {
+            path.push_back(adapter);
+        }
+    }
+
+    if (path.empty() || path.back() != bus)
+    {
+        return {bus};
+    }
+    return path;
+}
+
+struct I2CScheduler::Tree
+{
+    struct Entry
+    {
+        I2CTransaction transaction;
+        std::shared_ptr<Request> request;
+        bool muxed;
+    };
+
+    std::mutex lock;
+    std::condition_variable_any ready;
+    std::deque<Entry> queue;
+    TreeMetrics metrics;
+
+    // Joined before the rest is destroyed
+    std::jthread worker;
+};
+
+std::shared_ptr<I2CScheduler> I2CScheduler::shared(boost::asio::io_context& io)
+{
+    static std::weak_ptr<I2CScheduler> instance;
+
+    std::shared_ptr<I2CScheduler> scheduler = instance.lock();
+    if (!scheduler)
+    {
+        scheduler = std::make_shared<I2CScheduler>(io);
+        instance = scheduler;
+    }
+    return scheduler;
+}
+
+I2CScheduler::I2CScheduler(boost::asio::io_context& io,
+                           AdapterFactory makeAdapter, Topology topology,
+                           size_t window, size_t maxBurst) :
+    makeAdapter(std::move(makeAdapter)),
+    topology(std::move(topology)), window(std::max<size_t>(window, 1)),
+    maxBurst(std::max<size_t>(maxBurst, 1)), wakeup(io)
+{
+    wakeFd = ::eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to create i2c completion eventfd");
+    }
+    wakeup.assign(wakeFd);
+}
+
+I2CScheduler::~I2CScheduler()
+{
+    // Stop and join the workers while the eventfd is still open
+    trees.clear();
+}
+
+size_t I2CScheduler::pickNext(std::span<const int> window, int current,
+                              size_t burst, size_t maxBurst)
+{
+    // Within a burst stay on the current bus, otherwise move off it
+    bool stay = burst < maxBurst;
+    for (size_t i = 0; i < window.size(); i++)
+    {
+        if ((window[i] == current) == stay)
+        {
+            return i;
+        }
+    }
+
+    // Nothing else to do, or nothing on any other bus
+    return 0;
+}
+
+I2CScheduler::Tree& I2CScheduler::treeFor(int bus)
+{
+    auto findRoot = roots.find(bus);
+    if (findRoot == roots.end())
+    {
+        std::vector<int> path = topology(bus);
+        findRoot = roots.emplace(bus, path.empty() ? bus : path.front()).first;
+    }
+
+    auto [findTree, inserted] = trees.try_emplace(findRoot->second);
+    if (inserted)
+    {
+        findTree->second = std::make_unique<Tree>();
+        Tree& tree = *findTree->second;
+        tree.worker = std::jthread([this, &tree](const std::stop_token& stop) {
+            runTree(tree, stop);
+        });
+    }
+    return *findTree->second;
+}
+
+void I2CScheduler::submit(const I2CTransaction& transaction,
+                          Completion&& completion,
+                          std::chrono::milliseconds timeout)
+{
+    auto request =
+        std::make_shared<Request>(wakeup.get_executor(), std::move(completion));
+    if (timeout > std::chrono::milliseconds::zero())
+    {
+        request->deadline.expires_after(timeout);
+        request->deadline.async_wait(
+            [weak{std::weak_ptr<Request>(request)}](
+                const boost::system::error_code& ec) {
+                if (ec == boost::asio::error::operation_aborted)
+                {
+                    return;
+                }
+                auto request = weak.lock();
+                if (!request || !request->completion)
+                {
+                    return;
+                }
+
+                // Whatever the worker gets to later is thrown away
+                request->expired = true;
+                I2CResult result;
+                result.error = ETIMEDOUT;
+                Completion completion = std::move(request->completion);
+                request->completion = nullptr;
+                completion(result);
+            });
+    }
+
+    Tree& tree = treeFor(transaction.bus);
+    bool muxed = roots[transaction.bus] != transaction.bus;
+    {
+        std::lock_guard<std::mutex> lock(tree.lock);
+        tree.queue.emplace_back(transaction, std::move(request), muxed);
+    }
+    tree.ready.notify_one();
+
+    if (!waiting)
+    {
+        waitResults();
+    }
+}
+
+// Runs on the tree's worker thread: touch nothing but the tree and the result
+// queue
+void I2CScheduler::runTree(Tree& tree, const std::stop_token& stop)
+{
+    std::unique_ptr<I2CAdapter> adapter = makeAdapter();
+    std::vector<int> buses;
+    int current = -1;
+    int channel = -1;
+    size_t burst = 0;
+
+    std::unique_lock<std::mutex> lock(tree.lock);
+    while (tree.ready.wait(lock, stop, [&tree]() {
+        return !tree.queue.empty();
+    }))
+    {
+        buses.clear();
+        size_t considered = std::min(window, tree.queue.size());
+        for (size_t i = 0; i < considered; i++)
+        {
+            buses.push_back(tree.queue[i].transaction.bus);
+        }
+
+        size_t next = pickNext(buses, current, burst, maxBurst);
+        Tree::Entry entry = std::move(tree.queue[next]);
+        tree.queue.erase(tree.queue.begin() + static_cast<ptrdiff_t>(next));
+        Done done{std::move(entry.request), {}};
+        if (done.request->expired)
+        {
+            // Already completed with a timeout, but hand it back so that it's
+            // destroyed on the event loop along with its timer
+            std::lock_guard<std::mutex> resultLock(resultsLock);
+            results.push_back(std::move(done));
+            continue;
+        }
+        lock.unlock();
+
+        int bus = entry.transaction.bus;
+        burst = (bus == current) ? burst + 1 : 1;
+        current = bus;
+        bool switched = entry.muxed && bus != channel;
+        if (entry.muxed)
+        {
+            channel = bus;
+        }
+
+        tracing::Clock::time_point start = tracing::Clock::now();
+        adapter->execute(entry.transaction, done.result);
+        tracing::Clock::duration busy = tracing::Clock::now() - start;
+
+        // Account for the transaction before its completion can run
+        lock.lock();
+        tree.metrics.transactions++;
+        tree.metrics.muxSwitches += switched ? 1 : 0;
+        BusMetrics& busMetrics = tree.metrics.buses[bus];
+        busMetrics.transactions++;
+        busMetrics.busy += busy;
+
+        {
+            std::lock_guard<std::mutex> resultLock(resultsLock);
+            results.push_back(std::move(done));
+        }
+
+        uint64_t count = 1;
+        if (::write(wakeFd, &count, sizeof(count)) < 0)
+        {
+            std::cerr << "Failed to signal i2c completion: " << strerror(errno)
+                      << "\n";
+        }
+    }
+}
+
+void I2CScheduler::waitResults()
+{
+    waiting = true;
+    wakeup.async_read_some(
+        boost::asio::buffer(wakeBuf),
+        [weak{weak_from_this()}](const boost::system::error_code& ec,
+                                 size_t /* bytes */) {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            auto self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+            self->waiting = false;
+
+            if (ec)
+            {
+                std::cerr << "Error waiting for i2c completions: "
+                          << ec.message() << "\n";
+                return;
+            }
+
+            self->processResults();
+            self->recordMetrics();
+            if (!self->waiting)
+            {
+                self->waitResults();
+            }
+        });
+}
+
+void I2CScheduler::processResults()
+{
+    std::deque<Done> ready;
+    {
+        std::lock_guard<std::mutex> lock(resultsLock);
+        ready.swap(results);
+    }
+
+    for (Done& done : ready)
+    {
+        Request& request = *done.request;
+        if (!request.completion)
+        {
+            continue;
+        }
+        request.deadline.cancel();
+        Completion completion = std::move(request.completion);
+        request.completion = nullptr;
+        completion(done.result);
+    }
+}
+
+std::map<int, I2CScheduler::TreeMetrics> I2CScheduler::metrics() const
+{
+    std::map<int, TreeMetrics> snapshot;
+    for (const auto& [root, tree] : trees)
+    {
+        std::lock_guard<std::mutex> lock(tree->lock);
+        snapshot.emplace(root, tree->metrics);
+    }
+    return snapshot;
+}
+
+void I2CScheduler::recordMetrics()
+{
+    tracing::Clock::time_point now = tracing::Clock::now();
+    tracing::Clock::duration elapsed = now - metricsRecorded;
+    if (elapsed < metricsPeriod)
+    {
+        return;
+    }
+    metricsRecorded = now;
+
+    for (const auto& [root, tree] : metrics())
+    {
+        tracing::counter("i2c-" + std::to_string(root) + " mux switches",
+                         static_cast<double>(tree.muxSwitches));
+
+        for (const auto& [bus, busMetrics] : tree.buses)
+        {
+            tracing::Clock::duration& recorded = busyRecorded[bus];
+            std::chrono::duration<double> busy = busMetrics.busy - recorded;
+            double utilization =
+                100.0 * busy.count() /
+                std::chrono::duration<double>(elapsed).count();
+            recorded = busMetrics.busy;
+            tracing::counter("i2c-" + std::to_string(bus) + " utilization %",
+                             utilization);
+        }
+    }
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "Tracing.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <utility>
+#include <vector>
+
+// An SMBus read from a device on an i2c bus, which may be behind any number
+// of muxes
+struct I2CTransaction
+{
+    enum class Op
+    {
+        readByteData,
+        readWordData,
+        readBlockData,
+    };
+
+    int bus;
+    uint8_t address;
+    Op op;
+    uint8_t command;
+    // Select the device with I2C_SLAVE_FORCE, for devices bound to a driver
+    bool force = false;
+};
+
+struct I2CResult
+{
+    // 0 on success, otherwise an errno value
+    int error = 0;
+    // The byte or word read
+    uint16_t value = 0;
+    // The first size bytes are the block read
+    std::array<uint8_t, 32> block{};
+    size_t size = 0;
+};
+
+// Carries out the transactions on the buses of one mux tree.  Only used from
+// the tree's worker thread.
+class I2CAdapter
+{
+  public:
+    virtual ~I2CAdapter() = default;
+    virtual void execute(const I2CTransaction& transaction,
+                         I2CResult& result) = 0;
+};
+
+// Through /dev/i2c-N, keeping the descriptors open
+std::unique_ptr<I2CAdapter> makeI2CDevAdapter();
+
+// The buses from the root adapter down to bus, one per mux level, from sysfs
+std::vector<int> i2cMuxPath(int bus);
+
+// Runs i2c transactions off the event loop, with a worker thread per root
+// bus so that the transactions on one mux tree are serialised while trees
+// proceed independently.
+//
+// Selecting a different mux channel costs a transaction of its own, so the
+// worker looks at a window of the oldest transactions queued and prefers one
+// on the channel already selected.  To keep the other channels from waiting
+// on a busy one, after a burst of transactions on one channel it prefers the
+// oldest transaction on any other.
+//
+// Completions are posted back to the io_context.  Mux switches and the busy
+// time of each bus are recorded as tracing counters.
+class I2CScheduler : public std::enable_shared_from_this<I2CScheduler>
+{
+  public:
+    using Completion = std::function<void(const I2CResult& result)>;
+    using AdapterFactory = std::function<std::unique_ptr<I2CAdapter>()>;
+    using Topology = std::function<std::vector<int>(int bus)>;
+
+    static constexpr size_t defaultWindow = 8;
+    static constexpr size_t defaultMaxBurst = 4;
+    static constexpr std::chrono::seconds metricsPeriod{10};
+
+    struct BusMetrics
+    {
+        uint64_t transactions = 0;
+        tracing::Clock::duration busy{};
+    };
+
+    struct TreeMetrics
+    {
+        uint64_t transactions = 0;
+        uint64_t muxSwitches = 0;
+        std::map<int, BusMetrics> buses;
+    };
+
+    // The scheduler shared by the backends in the process
+    static std::shared_ptr<I2CScheduler> shared(boost::asio::io_context& io);
+
+    // Throws std::system_error if the completion eventfd can't be created
+    explicit I2CScheduler(boost::asio::io_context& io,
+                          AdapterFactory makeAdapter = makeI2CDevAdapter,
+                          Topology topology = i2cMuxPath,
+                          size_t window = defaultWindow,
+                          size_t maxBurst = defaultMaxBurst);
+    ~I2CScheduler();
+
+    I2CScheduler(const I2CScheduler&) = delete;
+    I2CScheduler& operator=(const I2CScheduler&) = delete;
+    I2CScheduler(I2CScheduler&&) = delete;
+    I2CScheduler& operator=(I2CScheduler&&) = delete;
+
+    // Only call from the io_context thread, which completion is invoked on.
+    // With a timeout, completion is invoked with ETIMEDOUT if the transaction
+    // hasn't finished in time: a device holding the bus may hold up the
+    // worker, but not whoever is waiting on it.
+    void submit(const I2CTransaction& transaction, Completion&& completion,
+                std::chrono::milliseconds timeout = {});
+
+    // By root bus
+    std::map<int, TreeMetrics> metrics() const;
+
+    // The index of the transaction to run next, given the buses of the
+    // transactions in the window from oldest to newest, the bus of the last
+    // transaction and how many ran on it back to back
+    static size_t pickNext(std::span<const int> window, int current,
+                           size_t burst, size_t maxBurst);
+
+  private:
+    struct Tree;
+
+    // Destroyed on the io_context thread only
+    struct Request
+    {
+        Request(const boost::asio::any_io_executor& executor,
+                Completion&& completion) :
+            completion(std::move(completion)), deadline(executor)
+        {}
+
+        // Empty once invoked
+        Completion completion;
+        boost::asio::steady_timer deadline;
+        // Set when completion is invoked on timeout, for the worker to skip
+        // the transaction if it hasn't started it
+        std::atomic<bool> expired = false;
+    };
+
+    struct Done
+    {
+        std::shared_ptr<Request> request;
+        I2CResult result;
+    };
+
+    Tree& treeFor(int bus);
+    void runTree(Tree& tree, const std::stop_token& stop);
+    void waitResults();
+    void processResults();
+    void recordMetrics();
+
+    const AdapterFactory makeAdapter;
+    const Topology topology;
+    const size_t window;
+    const size_t maxBurst;
+    bool waiting = false;
+
+    // The root bus of each bus submitted to
+    std::map<int, int> roots;
+    tracing::Clock::time_point metricsRecorded = tracing::Clock::now();
+    std::map<int, tracing::Clock::duration> busyRecorded;
+
+    std::mutex resultsLock;
+    std::deque<Done> results;
+
+    int wakeFd = -1;
+    std::array<uint8_t, sizeof(uint64_t)> wakeBuf{};
+
+    // The workers must be joined before the eventfd they signal is closed,
+    // so declare them after the stream descriptor that owns it.
+    boost::asio::posix::stream_descriptor wakeup;
+    std::map<int, std::unique_ptr<Tree>> trees;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// A bounded, lock-free queue between exactly one producer thread and one
+// consumer thread.
+//
+// The slots are preallocated and handed out in place: the producer fills in
+// the slot returned by reserve() and publishes it with commit(), while the
+// consumer reads the slot returned by front() and releases it with pop().
+// Nothing is allocated or copied on the way through, and neither side ever
+// blocks; waking the other side is left to the user (e.g. an eventfd).
+template <typename T, size_t Capacity>
+class SPSCQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+  public:
+    static constexpr size_t capacity = Capacity;
+
+    SPSCQueue() = default;
+    ~SPSCQueue() = default;
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+    SPSCQueue(SPSCQueue&&) = delete;
+    SPSCQueue& operator=(SPSCQueue&&) = delete;
+
+    // Producer: the next free slot, or nullptr if the queue is full
+    T* reserve()
+    {
+        size_t next = tail.load(std::memory_order_relaxed);
+        if (next - head.load(std::memory_order_acquire) == Capacity)
+        {
+            return nullptr;
+        }
+        return &slots[next & (Capacity - 1)];
+    }
+
+    // Producer: publish the slot returned by reserve()
+    void commit()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+    }
+
+    // Producer: copy value into the queue, false if it's full
+    bool push(const T& value)
+    {
+        T* slot = reserve();
+        if (slot == nullptr)
+        {
+            return false;
+        }
+        *slot = value;
+        commit();
+        return true;
+    }
+
+    // Consumer: the oldest published slot, or nullptr if the queue is empty
+    T* front()
+    {
+        size_t first = head.load(std::memory_order_relaxed);
+        if (first == tail.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        return &slots[first & (Capacity - 1)];
+    }
+
+    // Consumer: release the slot returned by front()
+    void pop()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+    }
+
+    // Only exact when called from either the producer or the consumer
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t size() const
+    {
+        // head first: it never overtakes tail, so this can't underflow
+        size_t first = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - first;
+    }
+
+  private:
+    // Kept on separate cache lines so the two sides don't contend
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::array<T, Capacity> slots{};
+};
@@ -0,0 +1,315 @@
+#pragma once
+
+#include "Utils.hpp"
+#include "VariantVisitors.hpp"
+
+#include <boost/container/flat_map.hpp>
+
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Typed decoding of the configuration objects exposed by entity-manager.
+//
+// A backend describes its configuration as a plain struct and specialises
+// sensor_config::Schema with a constexpr table of the struct's fields:
+//
+//   struct FooConfig
+//   {
+//       std::string name;
+//       float pollRate = 1.0F;
+//
+//       bool operator==(const FooConfig&) const = default;
+//   };
+//
+//   template <>
+//   struct sensor_config::Schema<FooConfig>
+//   {
+//       static constexpr auto fields = std::make_tuple(
+//           sensor_config::required("Name", &FooConfig::name),
+//           sensor_config::optional("PollRate", &FooConfig::pollRate,
+//                                   sensor_config::positive<float>));
+//   };
+//
+// decode() then fills in the struct in a single pass over the table.  Missing
+// or invalid optional fields keep the struct's default, while a missing or
+// invalid required field fails the whole decode.  Integers are range checked
+// against the member's type rather than silently truncated.
+namespace sensor_config
+{
+
+template <typename Config>
+struct Schema;
+
+template <typename Config, typename T>
+struct Field
+{
+    const char* key;
+    T Config::*member;
+    bool required;
+    bool (*valid)(const T& value);
+};
+
+template <typename Config, typename T>
+constexpr Field<Config, T> required(const char* key, T Config::*member,
+                                    bool (*valid)(const T&) = nullptr)
+{
+    return {key, member, true, valid};
+}
+
+template <typename Config, typename T>
+constexpr Field<Config, T> optional(const char* key, T Config::*member,
+                                    bool (*valid)(const T&) = nullptr)
+{
+    return {key, member, false, valid};
+}
+
+template <typename T>
+bool positive(const T& value)
+{
+    return std::isfinite(value) && value > 0;
+}
+
+namespace details
+{
+
+template <std::integral T>
+struct VariantToIntegralVisitor
+{
+    template <typename V>
+    T operator()(const V& value) const
+    {
+        if constexpr (std::is_same_v<V, bool>)
+        {
+            return static_cast<T>(value);
+        }
+        else if constexpr (std::is_integral_v<V>)
+        {
+            if (!std::in_range<T>(value))
+            {
+                throw std::out_of_range("value out of range");
+            }
+            return static_cast<T>(value);
+        }
+        else if constexpr (std::is_floating_point_v<V>)
+        {
+            if (!std::isfinite(value) || std::trunc(value) != value ||
+                value < static_cast<V>(std::numeric_limits<T>::lowest()) ||
+                value > static_cast<V>(std::numeric_limits<T>::max()))
+            {
+                throw std::out_of_range("value out of range");
+            }
+            return static_cast<T>(value);
+        }
+        else
+        {
+            throw std::invalid_argument("value is not a number");
+        }
+    }
+};
+
+template <typename T>
+struct IsOptional : std::false_type
+{};
+
+template <typename T>
+struct IsOptional<std::optional<T>> : std::true_type
+{};
+
+} // namespace details
+
+template <typename T>
+T convert(const BasicVariantType& value)
+{
+    if constexpr (details::IsOptional<T>::value)
+    {
+        // For fields whose absence means something other than a default
+        return convert<typename T::value_type>(value);
+    }
+    else if constexpr (std::is_same_v<T, std::vector<std::string>>)
+    {
+        const auto* strings = std::get_if<std::vector<std::string>>(&value);
+        if (strings == nullptr)
+        {
+            throw std::invalid_argument("value is not a list of strings");
+        }
+        return *strings;
+    }
+    else if constexpr (std::is_same_v<T, std::string>)
+    {
+        return std::visit(VariantToStringVisitor(), value);
+    }
+    else if constexpr (std::is_same_v<T, PowerState>)
+    {
+        PowerState state = PowerState::always;
+        setReadState(std::visit(VariantToStringVisitor(), value), state);
+        return state;
+    }
+    else if constexpr (std::is_same_v<T, bool>)
+    {
+        return std::visit(details::VariantToIntegralVisitor<uint64_t>(),
+                          value) != 0;
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        return std::visit(::details::VariantToNumericVisitor<T>(), value);
+    }
+    else if constexpr (std::is_integral_v<T>)
+    {
+        return std::visit(details::VariantToIntegralVisitor<T>(), value);
+    }
+    else
+    {
+        static_assert(!std::is_same_v<T, T>, "Type Not Implemented");
+    }
+}
+
+template <typename Config, typename T>
+bool decodeField(const SensorBaseConfigMap& data,
+                 const Field<Config, T>& field, Config& config,
+                 std::string& error)
+{
+    auto findField = data.find(field.key);
+    if (findField == data.end())
+    {
+        if (field.required)
+        {
+            error = std::string("missing ") + field.key;
+            return false;
+        }
+        return true;
+    }
+
+    try
+    {
+        T value = convert<T>(findField->second);
+        if (field.valid != nullptr && !field.valid(value))
+        {
+            throw std::invalid_argument("invalid value");
+        }
+        config.*field.member = std::move(value);
+    }
+    catch (const std::logic_error& e)
+    {
+        if (field.required)
+        {
+            error = std::string(field.key) + ": " + e.what();
+            return false;
+        }
+        std::cerr << "Ignoring " << field.key << ": " << e.what() << "\n";
+    }
+    return true;
+}
+
+// Decode data as described by Schema<Config>.  On failure error describes the
+// offending field.
+template <typename Config>
+std::optional<Config> decode(const SensorBaseConfigMap& data,
+                             std::string& error)
+{
+    Config config{};
+    bool decoded = std::apply(
+        [&](const auto&... fields) {
+            return (decodeField(data, fields, config, error) && ...);
+        },
+        Schema<Config>::fields);
+    if (!decoded)
+    {
+        return std::nullopt;
+    }
+    return config;
+}
+
+namespace details
+{
+
+template <typename T>
+struct Value
+{
+    T value;
+};
+
+} // namespace details
+
+// Decode the single field key of data, for the helpers that look up one key
+// rather than a whole schema.  fallback is kept if the field is missing or
+// invalid.
+template <typename T>
+T decodeValue(const SensorBaseConfigMap& data, const char* key, T fallback,
+              bool (*valid)(const T&) = nullptr)
+{
+    details::Value<T> decoded{std::move(fallback)};
+    std::string error;
+    decodeField(data, optional(key, &details::Value<T>::value, valid), decoded,
+                error);
+    return decoded.value;
+}
+
+enum class Update
+{
+    unchanged,
+    changed,
+    invalid
+};
+
+// Decoded configuration by configuration path.  Comparing against the cached
+// struct tells a rescan whether the object backing a sensor actually changed.
+template <typename Config>
+class Cache
+{
+  public:
+    Update update(const std::string& path, const SensorBaseConfigMap& data)
+    {
+        std::string error;
+        std::optional<Config> config = decode<Config>(data, error);
+        if (!config)
+        {
+            std::cerr << "Invalid configuration " << path << ": " << error
+                      << "\n";
+            configs.erase(path);
+            return Update::invalid;
+        }
+
+        auto [it, inserted] = configs.try_emplace(path, *config);
+        if (inserted)
+        {
+            return Update::changed;
+        }
+        if (it->second == *config)
+        {
+            return Update::unchanged;
+        }
+        it->second = std::move(*config);
+        return Update::changed;
+    }
+
+    const Config* find(const std::string& path) const
+    {
+        auto findConfig = configs.find(path);
+        if (findConfig == configs.end())
+        {
+            return nullptr;
+        }
+        return &findConfig->second;
+    }
+
+    void erase(const std::string& path)
+    {
+        configs.erase(path);
+    }
+
+  private:
+    boost::container::flat_map<std::string, Config> configs;
+};
+
+} // namespace sensor_config
@@ -0,0 +1,141 @@
+#include "SensorDaemon.hpp"
+
+#include "Tracing.hpp"
+#include "Utils.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <sdbusplus/asio/connection.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+
+#include <algorithm>
+#include <coroutine>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+static std::vector<const SensorDaemon::Backend*>& registry()
+{
+    static std::vector<const SensorDaemon::Backend*> backends;
+    return backends;
+}
+
+SensorDaemon::Backend::Backend(const char* name, const char* process,
+                               Entry entry) :
+    name(name), process(process), entry(entry)
+{
+    registry().push_back(this);
+}
+
+SensorDaemon::SensorDaemon() :
+    systemBus(std::make_shared<sdbusplus::asio::connection>(io)),
+    objectServer(systemBus, true)
+{}
+
+int SensorDaemon::start(std::span<char*> names)
+{
+    std::vector<const Backend*>& backends = registry();
+    std::ranges::sort(backends, [](const Backend* a, const Backend* b) {
+        return std::strcmp(a->name, b->name) < 0;
+    });
+
+    if (names.empty())
+    {
+        selected = backends;
+    }
+    for (const char* name : names)
+    {
+        auto findBackend =
+            std::ranges::find_if(backends, [name](const Backend* backend) {
+                return std::strcmp(backend->name, name) == 0;
+            });
+        if (findBackend == backends.end())
+        {
+            std::cerr << "Unknown sensor backend " << name << "\n";
+            return EXIT_FAILURE;
+        }
+        if (std::ranges::find(selected, *findBackend) == selected.end())
+        {
+            selected.push_back(*findBackend);
+        }
+    }
+    if (selected.empty())
+    {
+        std::cerr << "No sensor backends to run\n";
+        return EXIT_FAILURE;
+    }
+
+    if (consolidated())
+    {
+        // Backends hosted together look at much the same sysfs trees and
+        // configuration, so let them share the work
+        enableDiscoveryCache(true);
+        enableConfigurationCache(true);
+    }
+    tracing::setupTraceInterface(
+        objectServer, consolidated() ? "sensord" : selected.front()->process);
+
+    for (const Backend* backend : selected)
+    {
+        Task task = backend->entry(*this);
+        if (task.done())
+        {
+            // The backend returned or threw without awaiting run(), so it
+            // failed to set itself up.  Carry on with the rest.
+            std::cerr << "Sensor backend " << backend->name
+                      << " failed to start";
+            try
+            {
+                if (std::exception_ptr e = task.exception())
+                {
+                    std::rethrow_exception(e);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << ": " << e.what();
+            }
+            std::cerr << "\n";
+            continue;
+        }
+        running.push_back(std::move(task));
+    }
+
+    if (running.empty())
+    {
+        return EXIT_FAILURE;
+    }
+
+    io.run();
+
+    // Unwind the backends in the reverse of the order they were set up in
+    while (!running.empty())
+    {
+        running.pop_back();
+    }
+    return EXIT_SUCCESS;
+}
+
+std::suspend_always SensorDaemon::run()
+{
+    return {};
+}
+
+void SensorDaemon::addManager(const std::string& path)
+{
+    if (managers.insert(path).second)
+    {
+        objectServer.add_manager(path);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    SensorDaemon daemon;
+    return daemon.start(std::span<char*>(argv + 1, argv + argc));
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <sdbusplus/asio/connection.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <set>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The event loop, bus connection and object server shared by the sensor
+// backends hosted in a process.
+//
+// Each backend registers its entry point through a SensorDaemon::Backend at
+// namespace scope.  The entry point is a coroutine: it sets up the backend's
+// state as locals and then does "co_await daemon.run()" where it would
+// previously have called io.run().  That suspends it with its locals kept
+// alive in the coroutine frame and returns to the daemon, which starts the
+// next selected backend and, once they're all set up, runs the event loop.
+// The frames are destroyed, last started first, when the event loop exits.
+//
+// The individual daemons each link a single backend.  sensord links all of
+// the enabled backends and hosts those named on its command line, or all of
+// them if none are named.
+class SensorDaemon
+{
+  public:
+    // The coroutine a backend's entry point returns
+    class Task
+    {
+      public:
+        struct promise_type
+        {
+            Task get_return_object()
+            {
+                return Task(
+                    std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+            std::suspend_always final_suspend() noexcept
+            {
+                return {};
+            }
+            void return_void() {}
+            void unhandled_exception()
+            {
+                exception = std::current_exception();
+            }
+
+            std::exception_ptr exception;
+        };
+
+        Task() = default;
+        ~Task()
+        {
+            if (handle)
+            {
+                handle.destroy();
+            }
+        }
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        Task(Task&& other) noexcept :
+            handle(std::exchange(other.handle, {}))
+        {}
+        Task& operator=(Task&& other) noexcept
+        {
+            std::swap(handle, other.handle);
+            return *this;
+        }
+
+        // Whether the backend returned or threw rather than awaiting run()
+        bool done() const
+        {
+            return !handle || handle.done();
+        }
+
+        // What the backend threw, if it did
+        std::exception_ptr exception() const
+        {
+            return handle ? handle.promise().exception : nullptr;
+        }
+
+      private:
+        explicit Task(std::coroutine_handle<promise_type> handle) :
+            handle(handle)
+        {}
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    using Entry = Task (*)(SensorDaemon& daemon);
+
+    struct Backend
+    {
+        // name selects the backend on the sensord command line, process
+        // names the daemon when it's hosted on its own
+        Backend(const char* name, const char* process, Entry entry);
+
+        const char* name;
+        const char* process;
+        Entry entry;
+    };
+
+    SensorDaemon();
+    ~SensorDaemon() = default;
+    SensorDaemon(const SensorDaemon&) = delete;
+    SensorDaemon& operator=(const SensorDaemon&) = delete;
+    SensorDaemon(SensorDaemon&&) = delete;
+    SensorDaemon& operator=(SensorDaemon&&) = delete;
+
+    // Set up the named backends (all registered backends if empty) and run
+    // the event loop
+    int start(std::span<char*> names);
+
+    // Awaited by a backend once it's set up, in place of io.run().  The
+    // backend isn't resumed: its frame is destroyed once the event loop
+    // exits.
+    std::suspend_always run();
+
+    // object_server::add_manager(), but only once per path as backends
+    // hosted together often want the same managers
+    void addManager(const std::string& path);
+
+    // Whether several backends share the process
+    bool consolidated() const
+    {
+        return selected.size() > 1;
+    }
+
+    boost::asio::io_context io;
+    std::shared_ptr<sdbusplus::asio::connection> systemBus;
+    sdbusplus::asio::object_server objectServer;
+
+  private:
+    std::vector<const Backend*> selected;
+    // The backends that are set up, in the order they were started
+    std::vector<Task> running;
+    std::set<std::string> managers;
+};
@@ -1,7 +1,7 @@
 #include "Thresholds.hpp"
 
+#include "SensorConfig.hpp"
 #include "Utils.hpp"
-#include "VariantVisitors.hpp"
 #include "sensor.hpp"
 
 #include <boost/algorithm/string/replace.hpp>
@@ -20,6 +20,7 @@
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -27,6 +28,35 @@
 #include <vector>
 
 static constexpr bool debug = false;
+
+namespace
+{
+
+// A Thresholds<N> interface of a sensor's configuration
+struct ThresholdConfig
+{
+    std::optional<std::string> label;
+    std::optional<int> index;
+    unsigned int severity = 0;
+    std::string direction;
+    double value = 0.0;
+    double hysteresis = std::numeric_limits<double>::quiet_NaN();
+};
+
+} // namespace
+
+template <>
+struct sensor_config::Schema<ThresholdConfig>
+{
+    static constexpr auto fields = std::make_tuple(
+        optional("Label", &ThresholdConfig::label),
+        optional("Index", &ThresholdConfig::index),
+        required("Severity", &ThresholdConfig::severity),
+        required("Direction", &ThresholdConfig::direction),
+        required("Value", &ThresholdConfig::value),
+        optional("Hysteresis", &ThresholdConfig::hysteresis));
+};
+
 namespace thresholds
 {
 Level findThresholdLevel(uint8_t sev)
@@ -65,72 +95,39 @@ bool parseThresholdsFromConfig(
         {
             continue;
         }
-        if (matchLabel != nullptr)
-        {
-            auto labelFind = cfg.find("Label");
-            if (labelFind == cfg.end())
-            {
-                continue;
-            }
-            if (std::visit(VariantToStringVisitor(), labelFind->second) !=
-                *matchLabel)
-            {
-                continue;
-            }
-        }
 
-        if (sensorIndex != nullptr)
+        std::string error;
+        std::optional<ThresholdConfig> threshold =
+            sensor_config::decode<ThresholdConfig>(cfg, error);
+        if (!threshold)
         {
-            auto indexFind = cfg.find("Index");
-
-            // If we're checking for index 1, a missing Index is OK.
-            if ((indexFind == cfg.end()) && (*sensorIndex != 1))
-            {
-                continue;
-            }
-
-            if ((indexFind != cfg.end()) &&
-                (std::visit(VariantToIntVisitor(), indexFind->second) !=
-                 *sensorIndex))
-            {
-                continue;
-            }
+            std::cerr << "Malformed threshold on configuration interface "
+                      << intf << ": " << error << "\n";
+            return false;
         }
 
-        double hysteresis = std::numeric_limits<double>::quiet_NaN();
-        auto hysteresisFind = cfg.find("Hysteresis");
-        if (hysteresisFind != cfg.end())
+        if (matchLabel != nullptr && threshold->label != *matchLabel)
         {
-            hysteresis =
-                std::visit(VariantToDoubleVisitor(), hysteresisFind->second);
+            continue;
         }
 
-        auto directionFind = cfg.find("Direction");
-        auto severityFind = cfg.find("Severity");
-        auto valueFind = cfg.find("Value");
-        if (valueFind == cfg.end() || severityFind == cfg.end() ||
-            directionFind == cfg.end())
+        // If we're checking for index 1, a missing Index is OK.
+        if (sensorIndex != nullptr &&
+            threshold->index.value_or(1) != *sensorIndex)
         {
-            std::cerr << "Malformed threshold on configuration interface "
-                      << intf << "\n";
-            return false;
+            continue;
         }
-        unsigned int severity =
-            std::visit(VariantToUnsignedIntVisitor(), severityFind->second);
 
-        std::string directions =
-            std::visit(VariantToStringVisitor(), directionFind->second);
-
-        Level level = findThresholdLevel(severity);
-        Direction direction = findThresholdDirection(directions);
+        Level level = findThresholdLevel(threshold->severity);
+        Direction direction = findThresholdDirection(threshold->direction);
 
         if ((level == Level::ERROR) || (direction == Direction::ERROR))
         {
             continue;
         }
-        double val = std::visit(VariantToDoubleVisitor(), valueFind->second);
 
-        thresholdVector.emplace_back(level, direction, val, hysteresis);
+        thresholdVector.emplace_back(level, direction, threshold->value,
+                                     threshold->hysteresis);
     }
     return true;
 }
@@ -153,38 +150,24 @@ void persistThreshold(const std::string& path, const std::string& baseInterface,
                     return; // threshold not supported
                 }
 
-                if (!labelMatch.empty())
+                std::string error;
+                std::optional<ThresholdConfig> config =
+                    sensor_config::decode<ThresholdConfig>(result, error);
+                if (!config)
                 {
-                    auto labelFind = result.find("Label");
-                    if (labelFind == result.end())
-                    {
-                        std::cerr << "No label in threshold configuration\n";
-                        return;
-                    }
-                    std::string label =
-                        std::visit(VariantToStringVisitor(), labelFind->second);
-                    if (label != labelMatch)
-                    {
-                        return;
-                    }
+                    std::cerr << "Malformed threshold in configuration: "
+                              << error << "\n";
+                    return;
                 }
 
-                auto directionFind = result.find("Direction");
-                auto severityFind = result.find("Severity");
-                auto valueFind = result.find("Value");
-                if (valueFind == result.end() || severityFind == result.end() ||
-                    directionFind == result.end())
+                if (!labelMatch.empty() && config->label != labelMatch)
                 {
-                    std::cerr << "Malformed threshold in configuration\n";
                     return;
                 }
-                unsigned int severity = std::visit(
-                    VariantToUnsignedIntVisitor(), severityFind->second);
 
-                std::string dir =
-                    std::visit(VariantToStringVisitor(), directionFind->second);
-                if ((findThresholdLevel(severity) != threshold.level) ||
-                    (findThresholdDirection(dir) != threshold.direction))
+                if ((findThresholdLevel(config->severity) != threshold.level) ||
+                    (findThresholdDirection(config->direction) !=
+                     threshold.direction))
                 {
                     return; // not the droid we're looking for
                 }
@@ -0,0 +1,279 @@
+#include "Tracing.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/container/flat_map.hpp>
+#include <nlohmann/json.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tracing
+{
+
+namespace
+{
+
+struct Event
+{
+    std::string name;
+    std::string detail;
+    char phase;
+    int64_t timestamp;
+    int64_t duration;
+    double value;
+};
+
+struct Aggregate
+{
+    uint64_t count = 0;
+    int64_t total = 0;
+    int64_t min = std::numeric_limits<int64_t>::max();
+    int64_t max = 0;
+    int64_t firstStart = std::numeric_limits<int64_t>::max();
+    int64_t lastEnd = 0;
+};
+
+struct Recorder
+{
+    std::string process = "sensors";
+    std::vector<Event> events;
+    size_t dropped = 0;
+    boost::container::flat_map<std::string, Aggregate, std::less<>> aggregates;
+    // The latest value of each counter, kept once the trace is full
+    boost::container::flat_map<std::string, double, std::less<>> counters;
+    std::shared_ptr<sdbusplus::asio::dbus_interface> interface;
+};
+
+Recorder& recorder()
+{
+    static Recorder rec;
+    return rec;
+}
+
+int64_t microseconds(Clock::time_point point)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               point.time_since_epoch())
+        .count();
+}
+
+void record(Event&& event)
+{
+    Recorder& rec = recorder();
+    if (rec.events.size() >= maxTraceEvents)
+    {
+        rec.dropped++;
+        return;
+    }
+    rec.events.emplace_back(std::move(event));
+}
+
+} // namespace
+
+void complete(std::string_view name, Clock::time_point start,
+              Clock::time_point end, std::string_view detail)
+{
+    int64_t startUs = microseconds(start);
+    int64_t duration = microseconds(end) - startUs;
+
+    auto& aggregates = recorder().aggregates;
+    auto it = aggregates.find(name);
+    if (it == aggregates.end())
+    {
+        it = aggregates.emplace(std::string(name), Aggregate{}).first;
+    }
+    Aggregate& agg = it->second;
+    agg.count++;
+    agg.total += duration;
+    agg.min = std::min(agg.min, duration);
+    agg.max = std::max(agg.max, duration);
+    agg.firstStart = std::min(agg.firstStart, startUs);
+    agg.lastEnd = std::max(agg.lastEnd, startUs + duration);
+
+    record({std::string(name), std::string(detail), 'X', startUs, duration,
+            0.0});
+}
+
+void counter(std::string_view name, double value)
+{
+    auto& counters = recorder().counters;
+    auto it = counters.find(name);
+    if (it == counters.end())
+    {
+        it = counters.emplace(std::string(name), value).first;
+    }
+    it->second = value;
+
+    record({std::string(name), {}, 'C', microseconds(Clock::now()), 0, value});
+}
+
+nlohmann::json chromeTrace()
+{
+    const Recorder& rec = recorder();
+    int pid = static_cast<int>(::getpid());
+
+    nlohmann::json traceEvents = nlohmann::json::array();
+    traceEvents.push_back({{"name", "process_name"},
+                           {"ph", "M"},
+                           {"pid", pid},
+                           {"tid", pid},
+                           {"args", {{"name", rec.process}}}});
+
+    for (const Event& event : rec.events)
+    {
+        nlohmann::json entry = {{"name", event.name},
+                                {"ph", std::string(1, event.phase)},
+                                {"ts", event.timestamp},
+                                {"pid", pid},
+                                {"tid", pid}};
+        if (event.phase == 'X')
+        {
+            entry["cat"] = rec.process;
+            entry["dur"] = event.duration;
+            if (!event.detail.empty())
+            {
+                entry["args"] = {{"detail", event.detail}};
+            }
+        }
+        else
+        {
+            entry["args"] = {{"value", event.value}};
+        }
+        traceEvents.push_back(std::move(entry));
+    }
+
+    return {{"traceEvents", std::move(traceEvents)},
+            {"displayTimeUnit", "ms"},
+            {"otherData", {{"dropped", rec.dropped}}}};
+}
+
+nlohmann::json summary()
+{
+    nlohmann::json phases = nlohmann::json::object();
+    for (const auto& [name, agg] : recorder().aggregates)
+    {
+        phases[name] = {{"count", agg.count},
+                        {"total_us", agg.total},
+                        {"min_us", agg.min},
+                        {"max_us", agg.max},
+                        {"first_start_us", agg.firstStart},
+                        {"last_end_us", agg.lastEnd}};
+    }
+    nlohmann::json counters = nlohmann::json::object();
+    for (const auto& [name, value] : recorder().counters)
+    {
+        counters[name] = value;
+    }
+    return {{"process", recorder().process},
+            {"dropped", recorder().dropped},
+            {"phases", std::move(phases)},
+            {"counters", std::move(counters)}};
+}
+
+bool dump(const std::string& path)
+{
+    // Never follow a symlink planted at path, nor leave the trace readable
+    // to others
+    int fd = ::open(path.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+                    S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open " << path
+                  << " for trace output: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    std::string trace = chromeTrace().dump();
+    std::string_view remaining = trace;
+    while (!remaining.empty())
+    {
+        ssize_t rc = ::write(fd, remaining.data(), remaining.size());
+        if (rc < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (rc <= 0)
+        {
+            std::cerr << "Failed to write trace to " << path << "\n";
+            ::close(fd);
+            return false;
+        }
+        remaining.remove_prefix(static_cast<size_t>(rc));
+    }
+    ::close(fd);
+    return true;
+}
+
+std::optional<std::string> dumpDirectory(std::string_view process)
+{
+    std::string directory = "/run/" + std::string(process);
+    if (::mkdir(directory.c_str(), S_IRWXU) != 0 && errno != EEXIST)
+    {
+        std::cerr << "Failed to create " << directory << ": "
+                  << std::strerror(errno) << "\n";
+        return std::nullopt;
+    }
+
+    // Only use a directory of our own, not whatever else has the name
+    struct stat status{};
+    if (::lstat(directory.c_str(), &status) != 0 ||
+        !S_ISDIR(status.st_mode) || status.st_uid != ::geteuid())
+    {
+        std::cerr << directory << " isn't a directory of ours\n";
+        return std::nullopt;
+    }
+    return directory;
+}
+
+void setupTraceInterface(sdbusplus::asio::object_server& objectServer,
+                         std::string_view process)
+{
+    Recorder& rec = recorder();
+    if (rec.interface)
+    {
+        // Several backends sharing a process; keep the first registration
+        return;
+    }
+    rec.process = process;
+    rec.interface =
+        objectServer.add_interface(traceObjectPath, traceInterfaceName);
+
+    // The output location is fixed rather than caller-provided, and under
+    // /run where only root can create it, so that the method can't be used
+    // to overwrite other files.
+    rec.interface->register_method("Dump", []() {
+        std::optional<std::string> directory =
+            dumpDirectory(recorder().process);
+        if (!directory)
+        {
+            return std::string();
+        }
+        std::string path = *directory + "/trace.json";
+        if (!dump(path))
+        {
+            return std::string();
+        }
+        return path;
+    });
+    rec.interface->register_method("Summary",
+                                   []() { return summary().dump(); });
+    rec.interface->initialize();
+}
+
+} // namespace tracing
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <sdbusplus/asio/object_server.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Lightweight span recording for profiling where the daemons spend their time
+// at startup.
+//
+// Completed spans and counter samples are kept in a bounded in-memory buffer,
+// together with per-name span aggregates and the latest value of each
+// counter.  The buffer can be written out on demand as a Chrome trace
+// (loadable in Perfetto or chrome://tracing), and the aggregates and counters
+// queried through the D-Bus interface installed by setupTraceInterface().
+// Once the buffer is full only the aggregates and counters keep updating.
+// Timestamps are CLOCK_MONOTONIC, so traces from the different daemons line
+// up when loaded together.
+//
+// Recording isn't thread-safe: only record from the io_context thread.
+namespace tracing
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr const char* traceObjectPath = "/xyz/openbmc_project/sensors_trace";
+constexpr const char* traceInterfaceName = "xyz.openbmc_project.Sensor.Trace";
+
+// Events beyond this are dropped from the trace, but still aggregated
+constexpr size_t maxTraceEvents = 16384;
+
+// Record a completed span.  detail, if provided, is attached to the event
+// (e.g. the object path or sensor the span relates to) but doesn't split the
+// aggregate.
+void complete(std::string_view name, Clock::time_point start,
+              Clock::time_point end = Clock::now(),
+              std::string_view detail = {});
+
+// Record the current value of a counter.  The latest value is reported by
+// summary() even once the trace is full.
+void counter(std::string_view name, double value);
+
+// Records the lifetime of the object as a span
+class Span
+{
+  public:
+    explicit Span(std::string_view name, std::string_view detail = {}) :
+        name(name), detail(detail), start(Clock::now())
+    {}
+
+    ~Span()
+    {
+        complete(name, start, Clock::now(), detail);
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+    Span(Span&&) = delete;
+    Span& operator=(Span&&) = delete;
+
+  private:
+    std::string name;
+    std::string detail;
+    Clock::time_point start;
+};
+
+// Chrome trace event format, {"traceEvents": [...]}
+nlohmann::json chromeTrace();
+
+// {process, dropped,
+//  phases: {name: {count, total_us, min_us, max_us, first_start_us,
+//                  last_end_us}},
+//  counters: {name: latest value}}
+nlohmann::json summary();
+
+// Write chromeTrace() to path, returns false on failure.  A symlink at path
+// is refused rather than followed.
+bool dump(const std::string& path);
+
+// /run/<process>, created if needed, where Dump() writes the trace.  Empty if
+// it can't be created or isn't a directory owned by the daemon.
+std::optional<std::string> dumpDirectory(std::string_view process);
+
+// Expose Dump() and Summary() methods at traceObjectPath.  process names the
+// daemon in the trace and its dump directory.
+void setupTraceInterface(sdbusplus::asio::object_server& objectServer,
+                         std::string_view process);
+
+} // namespace tracing
@@ -19,9 +19,12 @@
 #include "dbus-sensor_config.h"
 
 #include "DeviceMgmt.hpp"
+#include "SensorConfig.hpp"
+#include "Tracing.hpp"
 #include "VariantVisitors.hpp"
 
 #include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/container/flat_map.hpp>
 #include <sdbusplus/asio/connection.hpp>
@@ -36,12 +39,14 @@
 #include <array>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <memory>
 #include <optional>
 #include <regex>
@@ -76,6 +81,9 @@ static std::vector<powerMatchPair> chassisMatchVec;
 static std::vector<std::shared_ptr<boost::asio::steady_timer>> timerVec;
 static std::vector<std::shared_ptr<boost::asio::steady_timer>>
     timerChassisStatusVec;
+static std::vector<std::function<void(PowerState type, bool state)>>
+    hostStatusCallbacks;
+static bool powerMatchesCreated = false;
 
 /**
  * return the contents of a file
@@ -163,6 +171,298 @@ std::set<std::string> getPermitSet(const SensorBaseConfigMap& config)
     return permitSet;
 }
 
+PowerState getPowerState(const SensorBaseConfigMap& cfg)
+{
+    return sensor_config::decodeValue(cfg, "PowerState", PowerState::always);
+}
+
+float getPollRate(const SensorBaseConfigMap& cfg, float dflt)
+{
+    return sensor_config::decodeValue(cfg, "PollRate", dflt,
+                                      sensor_config::positive<float>);
+}
+
+std::chrono::milliseconds GetSensorConfiguration::backoff(size_t attempt)
+{
+    std::chrono::milliseconds delay =
+        retryBase * (1U << std::min<size_t>(attempt, 16));
+    return std::min(delay, retryMax);
+}
+
+void GetSensorConfiguration::retryAfter(size_t attempt,
+                                        std::function<void()>&& retry)
+{
+    auto timer = std::make_shared<boost::asio::steady_timer>(
+        dbusConnection->get_io_context());
+    timer->expires_after(backoff(attempt));
+    timer->async_wait([self = shared_from_this(), timer,
+                       retry{std::move(retry)}](boost::system::error_code ec) {
+        if (ec)
+        {
+            std::cerr << "Timer error!\n";
+            return;
+        }
+        retry();
+    });
+}
+
+void GetSensorConfiguration::getConfiguration(
+    const std::vector<std::string>& types, size_t retries)
+{
+    interfaces.clear();
+    for (const auto& type : types)
+    {
+        interfaces.push_back(configInterfaceName(type));
+    }
+
+    getSubTree(std::min(retries, maxRetries), 0);
+}
+
+void GetSensorConfiguration::getSubTree(size_t retries, size_t attempt)
+{
+    dbusConnection->async_method_call(
+        [self = shared_from_this(), retries, attempt,
+         start{tracing::Clock::now()}](const boost::system::error_code ec,
+                                       const GetSubTreeType& ret) {
+            tracing::complete("GetSubTree", start);
+            if (ec)
+            {
+                std::cerr << "Error calling mapper\n";
+                if (attempt >= retries)
+                {
+                    return;
+                }
+                self->retryAfter(attempt, [self, retries, attempt]() {
+                    self->getSubTree(retries, attempt + 1);
+                });
+                return;
+            }
+
+            boost::container::flat_map<std::string, std::vector<Request>>
+                owners;
+            for (const auto& [path, objDict] : ret)
+            {
+                if (objDict.empty())
+                {
+                    continue;
+                }
+                const std::string& owner = objDict.begin()->first;
+
+                for (const std::string& interface : objDict.begin()->second)
+                {
+                    // anything that starts with a requested configuration
+                    // is good
+                    if (std::ranges::none_of(
+                            self->interfaces,
+                            [&interface](const std::string& possible) {
+                                return interface.starts_with(possible);
+                            }))
+                    {
+                        continue;
+                    }
+                    owners[owner].emplace_back(path, interface, owner);
+                    self->respData.expect(path);
+                }
+            }
+
+            for (const auto& [owner, requests] : owners)
+            {
+                self->getManagedObjects(owner, requests);
+            }
+        },
+        mapper::busName, mapper::path, mapper::interface, mapper::subtree, "/",
+        0, interfaces);
+}
+
+namespace
+{
+
+struct CachedObjects
+{
+    // Bumped whenever the owner signals a change, so that replies to calls
+    // issued before the change aren't cached
+    uint64_t generation = 0;
+    std::optional<ManagedObjectType> objects;
+    std::unique_ptr<sdbusplus::bus::match_t> changed;
+};
+
+} // namespace
+
+static bool configurationCacheEnabled = false;
+static boost::container::flat_map<std::string, CachedObjects>
+    configurationCache;
+
+void enableConfigurationCache(bool enable)
+{
+    configurationCacheEnabled = enable;
+    if (!enable)
+    {
+        configurationCache.clear();
+    }
+}
+
+void GetSensorConfiguration::getManagedObjects(
+    const std::string& owner, const std::vector<Request>& requests)
+{
+    uint64_t generation = 0;
+    if (configurationCacheEnabled)
+    {
+        CachedObjects& cached = configurationCache[owner];
+        if (cached.objects)
+        {
+            tracing::counter("GetManagedObjects cached", 1);
+            ManagedObjectType objects = *cached.objects;
+            boost::asio::post(dbusConnection->get_io_context(),
+                              [self = shared_from_this(), requests,
+                               objects{std::move(objects)}]() mutable {
+                                  self->collect(requests, true, objects);
+                              });
+            return;
+        }
+        if (!cached.changed)
+        {
+            // Installed before the call so no change can slip in between
+            cached.changed = std::make_unique<sdbusplus::bus::match_t>(
+                static_cast<sdbusplus::bus_t&>(*dbusConnection),
+                "type='signal',sender='" + owner + "',path_namespace='" +
+                    inventoryPath + "'",
+                [owner](sdbusplus::message_t&) {
+                    auto findCache = configurationCache.find(owner);
+                    if (findCache != configurationCache.end())
+                    {
+                        findCache->second.generation++;
+                        findCache->second.objects.reset();
+                    }
+                });
+        }
+        generation = cached.generation;
+    }
+
+    dbusConnection->async_method_call(
+        [self = shared_from_this(), owner, requests, generation,
+         start{tracing::Clock::now()}](const boost::system::error_code ec,
+                                       ManagedObjectType& objects) {
+            tracing::complete("GetManagedObjects", start,
+                              tracing::Clock::now(), owner);
+            if (!ec && configurationCacheEnabled)
+            {
+                auto findCache = configurationCache.find(owner);
+                if (findCache != configurationCache.end() &&
+                    findCache->second.generation == generation)
+                {
+                    findCache->second.objects = objects;
+                }
+            }
+            self->collect(requests, !ec, objects);
+        },
+        owner, inventoryPath, "org.freedesktop.DBus.ObjectManager",
+        "GetManagedObjects");
+}
+
+void GetSensorConfiguration::collect(const std::vector<Request>& requests,
+                                     bool found, ManagedObjectType& objects)
+{
+    // Without an ObjectManager on the inventory path every object is fetched
+    // individually; otherwise only those that were missing from the reply,
+    // e.g. because they appeared in the meantime.
+    std::vector<std::string> ready;
+    for (const Request& request : requests)
+    {
+        if (found)
+        {
+            auto findObj =
+                objects.find(sdbusplus::message::object_path(request.path));
+            if (findObj != objects.end())
+            {
+                auto findIntf = findObj->second.find(request.interface);
+                if (findIntf != findObj->second.end())
+                {
+                    if (respData.add(request.path, request.interface,
+                                     std::move(findIntf->second)))
+                    {
+                        ready.push_back(request.path);
+                    }
+                    continue;
+                }
+            }
+        }
+        window.push(Request(request));
+    }
+
+    deliver(ready);
+    dispatch();
+}
+
+void GetSensorConfiguration::getPath(const Request& request)
+{
+    dbusConnection->async_method_call(
+        [self = shared_from_this(), request,
+         start{tracing::Clock::now()}](const boost::system::error_code ec,
+                                       SensorBaseConfigMap& data) {
+            self->window.done();
+            if (ec)
+            {
+                std::cerr << "Error getting " << request.path
+                          << ": retries left " << maxRetries - request.attempt
+                          << "\n";
+                if (request.attempt < maxRetries)
+                {
+                    Request retry = request;
+                    retry.attempt++;
+                    self->retryAfter(request.attempt, [self, retry]() {
+                        self->window.push(Request(retry));
+                        self->dispatch();
+                    });
+                }
+                else if (self->respData.abandon(request.path))
+                {
+                    self->deliver({request.path});
+                }
+                self->dispatch();
+                return;
+            }
+
+            tracing::complete("GetAll", start, tracing::Clock::now(),
+                              request.path);
+            if (self->respData.add(request.path, request.interface,
+                                   std::move(data)))
+            {
+                self->deliver({request.path});
+            }
+            self->dispatch();
+        },
+        request.owner, request.path, properties::interface, "GetAll",
+        request.interface);
+}
+
+void GetSensorConfiguration::dispatch()
+{
+    while (std::optional<Request> request = window.next())
+    {
+        getPath(*request);
+    }
+}
+
+void GetSensorConfiguration::deliver(const std::vector<std::string>& ready)
+{
+    if (!partial || ready.empty())
+    {
+        return;
+    }
+
+    ManagedObjectType objects;
+    for (const std::string& path : ready)
+    {
+        auto findObj = respData.collected().find(path);
+        if (findObj != respData.collected().end())
+        {
+            objects.emplace(*findObj);
+        }
+    }
+    tracing::Span span("GetSensorConfiguration partial");
+    partial(objects);
+}
+
 bool getSensorConfiguration(
     const std::string& type,
     const std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
@@ -207,9 +507,77 @@ bool getSensorConfiguration(
     return true;
 }
 
+namespace
+{
+
+struct DiscoveryWalk
+{
+    std::chrono::steady_clock::time_point walked;
+    std::vector<fs::path> files;
+};
+
+} // namespace
+
+// Long enough to cover the backends of a process starting up together, short
+// enough that a missed invalidation heals itself
+constexpr std::chrono::seconds discoveryCacheLifetime{2};
+
+static bool discoveryCacheEnabled = false;
+static std::map<std::pair<fs::path, int>, DiscoveryWalk> discoveryCache;
+
+void enableDiscoveryCache(bool enable)
+{
+    discoveryCacheEnabled = enable;
+    discoveryCache.clear();
+}
+
+void invalidateDiscoveryCache()
+{
+    discoveryCache.clear();
+}
+
+// Every file under dirPath, following symlinks down to symlinkDepth
+static std::vector<fs::path> walkFiles(const fs::path& dirPath,
+                                       int symlinkDepth)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (discoveryCacheEnabled)
+    {
+        auto findWalk = discoveryCache.find({dirPath, symlinkDepth});
+        if (findWalk != discoveryCache.end() &&
+            now - findWalk->second.walked < discoveryCacheLifetime)
+        {
+            return findWalk->second.files;
+        }
+    }
+
+    std::vector<fs::path> files;
+    for (auto p = fs::recursive_directory_iterator(
+             dirPath, fs::directory_options::follow_directory_symlink);
+         p != fs::recursive_directory_iterator(); ++p)
+    {
+        if (!is_directory(*p))
+        {
+            files.emplace_back(p->path());
+        }
+        if (p.depth() >= symlinkDepth)
+        {
+            p.disable_recursion_pending();
+        }
+    }
+
+    if (discoveryCacheEnabled)
+    {
+        discoveryCache[{dirPath, symlinkDepth}] = {now, files};
+    }
+    return files;
+}
+
 bool findFiles(const fs::path& dirPath, std::string_view matchString,
                std::vector<fs::path>& foundPaths, int symlinkDepth)
 {
+    tracing::Span span("findFiles", dirPath.string());
+
     std::error_code ec;
     if (!fs::exists(dirPath, ec))
     {
@@ -235,21 +603,12 @@ bool findFiles(const fs::path& dirPath, std::string_view matchString,
     {
         std::regex search(std::string{matchString});
         std::smatch match;
-        for (auto p = fs::recursive_directory_iterator(
-                 dirPath, fs::directory_options::follow_directory_symlink);
-             p != fs::recursive_directory_iterator(); ++p)
+        for (const fs::path& file : walkFiles(dirPath, symlinkDepth))
         {
-            std::string path = p->path().string();
-            if (!is_directory(*p))
+            std::string path = file.string();
+            if (std::regex_search(path, match, search))
             {
-                if (std::regex_search(path, match, search))
-                {
-                    foundPaths.emplace_back(p->path());
-                }
-            }
-            if (p.depth() >= symlinkDepth)
-            {
-                p.disable_recursion_pending();
+                foundPaths.emplace_back(file);
             }
         }
         return true;
@@ -512,13 +871,30 @@ static void
         chassis::interface, chassis::property);
 }
 
+// Power state changes are fanned out to every registered callback, as several
+// backends may share the process (and hence the matches)
+static void notifyHostStatus(PowerState type, bool state)
+{
+    // Copied as a callback may register further callbacks
+    auto callbacks = hostStatusCallbacks;
+    for (const auto& callback : callbacks)
+    {
+        callback(type, state);
+    }
+}
+
 void setupPowerMatchCallback(
     const std::shared_ptr<sdbusplus::asio::connection>& conn,
     std::function<void(PowerState type, bool state)>&& hostStatusCallback)
 {
+    if (hostStatusCallback)
+    {
+        hostStatusCallbacks.emplace_back(std::move(hostStatusCallback));
+    }
+
     // create a match for powergood changes, first time do a method call to
     // cache the correct value
-    if (powerMatch)
+    if (powerMatchesCreated)
     {
         return;
     }
@@ -542,6 +918,7 @@ void setupPowerMatchCallback(
         std::cerr << "Error getting host subtree paths: " << e.what() << "\n";
         return;
     }
+    powerMatchesCreated = true;
 
     for (const auto& path : hostSubTreePaths)
     {
@@ -558,7 +935,7 @@ void setupPowerMatchCallback(
             "type='signal',interface='" + std::string(properties::interface) +
                 "',path='" + std::string(path) + "',arg0='" +
                 std::string(power::interface) + "'",
-            [hostStatusCallback, path, timer](sdbusplus::message_t& message) {
+            [path, timer](sdbusplus::message_t& message) {
                 std::string objectName;
                 boost::container::flat_map<std::string,
                                            std::variant<std::string>>
@@ -574,13 +951,12 @@ void setupPowerMatchCallback(
                     {
                         timer->cancel();
                         it->second = false;
-                        hostStatusCallback(PowerState::on, it->second);
+                        notifyHostStatus(PowerState::on, it->second);
                         return;
                     }
                     // on comes too quickly
                     timer->expires_after(std::chrono::seconds(10));
-                    timer->async_wait([hostStatusCallback,
-                                       it](boost::system::error_code ec) {
+                    timer->async_wait([it](boost::system::error_code ec) {
                         if (ec == boost::asio::error::operation_aborted)
                         {
                             return;
@@ -591,7 +967,7 @@ void setupPowerMatchCallback(
                             return;
                         }
                         it->second = true;
-                        hostStatusCallback(PowerState::on, it->second);
+                        notifyHostStatus(PowerState::on, it->second);
                     });
                 }
             });
@@ -604,7 +980,7 @@ void setupPowerMatchCallback(
             "type='signal',interface='" + std::string(properties::interface) +
                 "',path='" + std::string(path) + "',arg0='" +
                 std::string(post::interface) + "'",
-            [hostStatusCallback, path](sdbusplus::message_t& message) {
+            [path](sdbusplus::message_t& message) {
                 std::string objectName;
                 boost::container::flat_map<std::string,
                                            std::variant<std::string>>
@@ -619,7 +995,7 @@ void setupPowerMatchCallback(
                         (value != "Inactive") &&
                         (value != "xyz.openbmc_project.State.OperatingSystem."
                                   "Status.OSStatus.Inactive");
-                    hostStatusCallback(PowerState::biosPost, it->second);
+                    notifyHostStatus(PowerState::biosPost, it->second);
                 }
             });
         postMatchVec.emplace_back(
@@ -662,8 +1038,7 @@ void setupPowerMatchCallback(
             "type='signal',interface='" + std::string(properties::interface) +
                 "',path='" + std::string(path) + "',arg0='" +
                 std::string(chassis::interface) + "'",
-            [hostStatusCallback, slotNumber, timerChassisOn,
-             path](sdbusplus::message_t& message) {
+            [slotNumber, timerChassisOn, path](sdbusplus::message_t& message) {
                 std::string objectName;
                 boost::container::flat_map<std::string,
                                            std::variant<std::string>>
@@ -679,14 +1054,13 @@ void setupPowerMatchCallback(
                     {
                         timerChassisOn->cancel();
                         it->second = false;
-                        hostStatusCallback(PowerState::chassisOn, it->second);
+                        notifyHostStatus(PowerState::chassisOn, it->second);
                         return;
                     }
                     // on comes too quickly
                     timerChassisOn->expires_after(std::chrono::seconds(10));
                     timerChassisOn->async_wait(
-                        [hostStatusCallback, slotNumber,
-                         it](boost::system::error_code ec) {
+                        [slotNumber, it](boost::system::error_code ec) {
                             if (ec == boost::asio::error::operation_aborted)
                             {
                                 return;
@@ -698,8 +1072,8 @@ void setupPowerMatchCallback(
                                 return;
                             }
                             it->second = true;
-                            hostStatusCallback(PowerState::chassisOn,
-                                               it->second);
+                            notifyHostStatus(PowerState::chassisOn,
+                                             it->second);
                         });
                 }
             });
@@ -711,7 +1085,7 @@ void setupPowerMatchCallback(
 
 void setupPowerMatch(const std::shared_ptr<sdbusplus::asio::connection>& conn)
 {
-    setupPowerMatchCallback(conn, [](PowerState, bool) {});
+    setupPowerMatchCallback(conn, nullptr);
 }
 
 // replaces limits if MinReading and MaxReading are found.
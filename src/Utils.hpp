@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Tracing.hpp"
 #include "VariantVisitors.hpp"
 
 #include <boost/algorithm/string/replace.hpp>
@@ -9,6 +10,8 @@
 #include <sdbusplus/asio/object_server.hpp>
 #include <sdbusplus/message/types.hpp>
 
+#include <chrono>
+#include <deque>
 #include <filesystem>
 #include <functional>
 #include <iostream>
@@ -68,6 +71,14 @@ bool findFiles(const std::filesystem::path& dirPath,
                std::string_view matchString,
                std::vector<std::filesystem::path>& foundPaths,
                int symlinkDepth = 1);
+// Reuse the directory walks done by findFiles() for a short while, so that
+// several backends scanning the same sysfs trees only walk them once.  The
+// cache is dropped by invalidateDiscoveryCache(), e.g. when devices are added.
+void enableDiscoveryCache(bool enable);
+void invalidateDiscoveryCache();
+// Share GetManagedObjects replies between GetSensorConfiguration instances
+// until the owning service signals a change under the inventory
+void enableConfigurationCache(bool enable);
 bool isPowerOn(const size_t& slotId = 0);
 bool hasBiosPost(const size_t& slotId = 0);
 bool isChassisOn(const size_t& slotId = 0);
@@ -193,18 +204,8 @@ inline void setReadState(const std::string& str, PowerState& val)
     }
 }
 
-inline PowerState getPowerState(const SensorBaseConfigMap& cfg)
-{
-    PowerState state = PowerState::always;
-    auto findPowerState = cfg.find("PowerState");
-    if (findPowerState != cfg.end())
-    {
-        std::string powerState =
-            std::visit(VariantToStringVisitor(), findPowerState->second);
-        setReadState(powerState, state);
-    }
-    return state;
-}
+// The PowerState key of cfg, decoded as the sensor_config schemas do
+PowerState getPowerState(const SensorBaseConfigMap& cfg);
 
 inline size_t getSlotId(const SensorBaseConfigMap& cfg)
 {
@@ -219,20 +220,8 @@ inline size_t getSlotId(const SensorBaseConfigMap& cfg)
     return slotId;
 }
 
-inline float getPollRate(const SensorBaseConfigMap& cfg, float dflt)
-{
-    float pollRate = dflt;
-    auto findPollRate = cfg.find("PollRate");
-    if (findPollRate != cfg.end())
-    {
-        pollRate = std::visit(VariantToFloatVisitor(), findPollRate->second);
-        if (!std::isfinite(pollRate) || pollRate <= 0.0F)
-        {
-            pollRate = dflt; // poll time invalid, fall back to default
-        }
-    }
-    return pollRate;
-}
+// The PollRate key of cfg, or dflt if it's missing or not a positive number
+float getPollRate(const SensorBaseConfigMap& cfg, float dflt);
 
 inline void setLed(const std::shared_ptr<sdbusplus::asio::connection>& conn,
                    const std::string& name, bool on)
@@ -255,133 +244,188 @@ void createInventoryAssoc(
     const std::shared_ptr<sdbusplus::asio::dbus_interface>& association,
     const std::string& path);
 
-struct GetSensorConfiguration :
-    std::enable_shared_from_this<GetSensorConfiguration>
+// A FIFO of requests of which at most `limit` may be outstanding at once.
+template <typename Request>
+class RequestWindow
 {
-    GetSensorConfiguration(
-        std::shared_ptr<sdbusplus::asio::connection> connection,
-        std::function<void(ManagedObjectType& resp)>&& callbackFunc) :
-        dbusConnection(std::move(connection)),
-        callback(std::move(callbackFunc))
-    {}
+  public:
+    explicit RequestWindow(size_t limit) : limit(limit) {}
+
+    void push(Request&& request)
+    {
+        pending.push_back(std::move(request));
+    }
 
-    void getPath(const std::string& path, const std::string& interface,
-                 const std::string& owner, size_t retries = 5)
+    // Hands out the oldest queued request if the window has room for it.
+    // Each request handed out must be matched by a call to done().
+    std::optional<Request> next()
     {
-        if (retries > 5)
+        if (inFlight >= limit || pending.empty())
         {
-            retries = 5;
+            return std::nullopt;
         }
-        std::shared_ptr<GetSensorConfiguration> self = shared_from_this();
-
-        self->dbusConnection->async_method_call(
-            [self, path, interface, owner, retries](
-                const boost::system::error_code ec, SensorBaseConfigMap& data) {
-                if (ec)
-                {
-                    std::cerr << "Error getting " << path << ": retries left"
-                              << retries - 1 << "\n";
-                    if (retries == 0U)
-                    {
-                        return;
-                    }
-                    auto timer = std::make_shared<boost::asio::steady_timer>(
-                        self->dbusConnection->get_io_context());
-                    timer->expires_after(std::chrono::seconds(10));
-                    timer->async_wait([self, timer, path, interface, owner,
-                                       retries](boost::system::error_code ec) {
-                        if (ec)
-                        {
-                            std::cerr << "Timer error!\n";
-                            return;
-                        }
-                        self->getPath(path, interface, owner, retries - 1);
-                    });
-                    return;
-                }
-
-                self->respData[path][interface] = std::move(data);
-            },
-            owner, path, "org.freedesktop.DBus.Properties", "GetAll",
-            interface);
+        Request request = std::move(pending.front());
+        pending.pop_front();
+        inFlight++;
+        return request;
     }
 
-    void getConfiguration(const std::vector<std::string>& types,
-                          size_t retries = 0)
+    void done()
+    {
+        inFlight--;
+    }
+
+    size_t outstanding() const
+    {
+        return inFlight;
+    }
+
+    size_t queued() const
     {
-        if (retries > 5)
+        return pending.size();
+    }
+
+  private:
+    size_t limit;
+    std::deque<Request> pending;
+    size_t inFlight = 0;
+};
+
+// Gathers the interfaces of configuration objects as they arrive, and tells
+// which objects have everything expected of them.
+class ObjectCollector
+{
+  public:
+    // One more interface of path is on its way
+    void expect(const std::string& path)
+    {
+        awaiting[path]++;
+    }
+
+    // An expected interface of path arrived.  Returns true once nothing more
+    // is expected of path.
+    bool add(const std::string& path, const std::string& interface,
+             SensorBaseConfigMap&& config)
+    {
+        objects[path][interface] = std::move(config);
+        return settle(path);
+    }
+
+    // An expected interface of path won't arrive after all.  Returns true if
+    // that leaves path with nothing more expected but something to deliver.
+    bool abandon(const std::string& path)
+    {
+        return settle(path) && objects.contains(path);
+    }
+
+    const ManagedObjectType& collected() const
+    {
+        return objects;
+    }
+
+    ManagedObjectType& collected()
+    {
+        return objects;
+    }
+
+  private:
+    bool settle(const std::string& path)
+    {
+        auto findPath = awaiting.find(path);
+        if (findPath == awaiting.end())
         {
-            retries = 5;
+            return false;
         }
-
-        std::vector<std::string> interfaces(types.size());
-        for (const auto& type : types)
+        if (--findPath->second > 0)
         {
-            interfaces.push_back(configInterfaceName(type));
+            return false;
         }
-
-        std::shared_ptr<GetSensorConfiguration> self = shared_from_this();
-        dbusConnection->async_method_call(
-            [self, interfaces, retries](const boost::system::error_code ec,
-                                        const GetSubTreeType& ret) {
-                if (ec)
-                {
-                    std::cerr << "Error calling mapper\n";
-                    if (retries == 0U)
-                    {
-                        return;
-                    }
-                    auto timer = std::make_shared<boost::asio::steady_timer>(
-                        self->dbusConnection->get_io_context());
-                    timer->expires_after(std::chrono::seconds(10));
-                    timer->async_wait([self, timer, interfaces,
-                                       retries](boost::system::error_code ec) {
-                        if (ec)
-                        {
-                            std::cerr << "Timer error!\n";
-                            return;
-                        }
-                        self->getConfiguration(interfaces, retries - 1);
-                    });
-
-                    return;
-                }
-                for (const auto& [path, objDict] : ret)
-                {
-                    if (objDict.empty())
-                    {
-                        return;
-                    }
-                    const std::string& owner = objDict.begin()->first;
-
-                    for (const std::string& interface : objDict.begin()->second)
-                    {
-                        // anything that starts with a requested configuration
-                        // is good
-                        if (std::find_if(
-                                interfaces.begin(), interfaces.end(),
-                                [interface](const std::string& possible) {
-                                    return interface.starts_with(possible);
-                                }) == interfaces.end())
-                        {
-                            continue;
-                        }
-                        self->getPath(path, interface, owner);
-                    }
-                }
-            },
-            mapper::busName, mapper::path, mapper::interface, mapper::subtree,
-            "/", 0, interfaces);
+        awaiting.erase(findPath);
+        return true;
     }
 
+    ManagedObjectType objects;
+    boost::container::flat_map<std::string, size_t> awaiting;
+};
+
+// Fetches the configuration objects implementing any of the requested types.
+//
+// The owners of the matching objects are found through the mapper.  Each
+// owner is first asked for everything at once through GetManagedObjects on
+// the inventory path, and only the objects missing from its reply (all of
+// them, for owners without an ObjectManager there) are fetched individually
+// with GetAll.  At most maxInFlight GetAll calls are outstanding at once, and
+// each failed call is retried with exponential backoff.
+//
+// The accumulated configuration is passed to the callback once the last
+// reference to the object is released, i.e. once all outstanding calls have
+// completed.  If a partial callback is provided, it's additionally passed
+// each object as soon as all of its requested interfaces are in, so that
+// sensors can be created without waiting for the slowest GetAll.
+struct GetSensorConfiguration :
+    std::enable_shared_from_this<GetSensorConfiguration>
+{
+    using PartialCallback = std::function<void(const ManagedObjectType& ready)>;
+
+    static constexpr size_t maxInFlight = 8;
+    static constexpr size_t maxRetries = 5;
+    static constexpr std::chrono::milliseconds retryBase{250};
+    static constexpr std::chrono::milliseconds retryMax{10000};
+
+    GetSensorConfiguration(
+        std::shared_ptr<sdbusplus::asio::connection> connection,
+        std::function<void(ManagedObjectType& resp)>&& callbackFunc,
+        PartialCallback&& partialFunc = nullptr) :
+        dbusConnection(std::move(connection)),
+        callback(std::move(callbackFunc)), partial(std::move(partialFunc))
+    {}
+
+    GetSensorConfiguration(const GetSensorConfiguration&) = delete;
+    GetSensorConfiguration& operator=(const GetSensorConfiguration&) = delete;
+    GetSensorConfiguration(GetSensorConfiguration&&) = delete;
+    GetSensorConfiguration& operator=(GetSensorConfiguration&&) = delete;
+
+    void getConfiguration(const std::vector<std::string>& types,
+                          size_t retries = 0);
+
     ~GetSensorConfiguration()
     {
-        callback(respData);
+        tracing::complete("GetSensorConfiguration", started);
+        tracing::Span span("GetSensorConfiguration callback");
+        callback(respData.collected());
     }
 
     std::shared_ptr<sdbusplus::asio::connection> dbusConnection;
     std::function<void(ManagedObjectType& resp)> callback;
-    ManagedObjectType respData;
+    PartialCallback partial;
+    ObjectCollector respData;
+    tracing::Clock::time_point started = tracing::Clock::now();
+
+    // Delay before the retry following the given failed attempt
+    static std::chrono::milliseconds backoff(size_t attempt);
+
+  private:
+    struct Request
+    {
+        std::string path;
+        std::string interface;
+        std::string owner;
+        size_t attempt = 0;
+    };
+
+    void getSubTree(size_t retries, size_t attempt);
+    void getManagedObjects(const std::string& owner,
+                           const std::vector<Request>& requests);
+    void collect(const std::vector<Request>& requests, bool found,
+                 ManagedObjectType& objects);
+    void getPath(const Request& request);
+    void retryAfter(size_t attempt, std::function<void()>&& retry);
+    void dispatch();
+    // Passes the objects at the ready paths to the partial callback
+    void deliver(const std::vector<std::string>& ready);
+
+    std::vector<std::string> interfaces;
+    RequestWindow<Request> window{maxInFlight};
 };
 
 // The common scheme for sysfs files naming is: <type><number>_<item>.
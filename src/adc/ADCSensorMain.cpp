@@ -15,6 +15,7 @@
 */
 
 #include "ADCSensor.hpp"
+#include "SensorDaemon.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
 #include "VariantVisitors.hpp"
@@ -317,12 +318,12 @@ void createSensors(
         std::vector<std::string>{sensorTypes.begin(), sensorTypes.end()});
 }
 
-int main()
+static SensorDaemon::Task adcSensorMain(SensorDaemon& daemon)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
-    sdbusplus::asio::object_server objectServer(systemBus, true);
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
+    daemon.addManager("/xyz/openbmc_project/sensors");
 
     systemBus->request_name("xyz.openbmc_project.ADCSensor");
     boost::container::flat_map<std::string, std::shared_ptr<ADCSensor>> sensors;
@@ -423,5 +424,7 @@ int main()
         cpuPresenceHandler));
 
     setupManufacturingModeMatch(*systemBus);
-    io.run();
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("adc", "adcsensor", adcSensorMain);
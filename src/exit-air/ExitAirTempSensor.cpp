@@ -16,6 +16,7 @@
 
 #include "ExitAirTempSensor.hpp"
 
+#include "SensorDaemon.hpp"
 #include "SensorPaths.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
@@ -946,12 +947,12 @@ void createSensor(sdbusplus::asio::object_server& objectServer,
         std::vector<std::string>(monitorTypes.begin(), monitorTypes.end()));
 }
 
-int main()
+static SensorDaemon::Task exitAirSensorMain(SensorDaemon& daemon)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
-    sdbusplus::asio::object_server objectServer(systemBus, true);
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
+    daemon.addManager("/xyz/openbmc_project/sensors");
     systemBus->request_name("xyz.openbmc_project.ExitAirTempSensor");
     std::shared_ptr<ExitAirTempSensor> sensor =
         nullptr; // wait until we find the config
@@ -981,6 +982,8 @@ int main()
         setupPropertiesChangedMatches(*systemBus, monitorTypes, eventHandler);
 
     setupManufacturingModeMatch(*systemBus);
-    io.run();
-    return 0;
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("exit-air", "exitairtempsensor",
+                                           exitAirSensorMain);
@@ -1,4 +1,5 @@
 #include "ExternalSensor.hpp"
+#include "SensorDaemon.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
 #include "VariantVisitors.hpp"
@@ -340,18 +341,18 @@ void createSensors(
     getter->getConfiguration(std::vector<std::string>{sensorType});
 }
 
-int main()
+static SensorDaemon::Task externalSensorMain(SensorDaemon& daemon)
 {
     if constexpr (debug)
     {
         std::cerr << "ExternalSensor service starting up\n";
     }
 
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
-    sdbusplus::asio::object_server objectServer(systemBus, true);
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
 
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
+    daemon.addManager("/xyz/openbmc_project/sensors");
     systemBus->request_name("xyz.openbmc_project.ExternalSensor");
 
     boost::container::flat_map<std::string, std::shared_ptr<ExternalSensor>>
@@ -413,5 +414,8 @@ int main()
         std::cerr << "ExternalSensor service entering main loop\n";
     }
 
-    io.run();
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("external", "externalsensor",
+                                           externalSensorMain);
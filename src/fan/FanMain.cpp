@@ -16,6 +16,7 @@
 
 #include "PresenceGpio.hpp"
 #include "PwmSensor.hpp"
+#include "SensorDaemon.hpp"
 #include "TachSensor.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
@@ -640,15 +641,15 @@ void createSensors(
         retries);
 }
 
-int main()
+static SensorDaemon::Task fanSensorMain(SensorDaemon& daemon)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
-    sdbusplus::asio::object_server objectServer(systemBus, true);
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
 
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
-    objectServer.add_manager("/xyz/openbmc_project/control");
-    objectServer.add_manager("/xyz/openbmc_project/inventory");
+    daemon.addManager("/xyz/openbmc_project/sensors");
+    daemon.addManager("/xyz/openbmc_project/control");
+    daemon.addManager("/xyz/openbmc_project/inventory");
     systemBus->request_name("xyz.openbmc_project.FanSensor");
     boost::container::flat_map<std::string, std::shared_ptr<TachSensor>>
         tachSensors;
@@ -709,6 +710,7 @@ int main()
     matches.emplace_back(std::move(match));
 
     setupManufacturingModeMatch(*systemBus);
-    io.run();
-    return 0;
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("fan", "fansensor", fanSensorMain);
@@ -16,6 +16,7 @@
 
 #include "DeviceMgmt.hpp"
 #include "HwmonTempSensor.hpp"
+#include "SensorDaemon.hpp"
 #include "SensorPaths.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
@@ -264,272 +265,304 @@ static SensorConfigMap
     return configMap;
 }
 
-void createSensors(
+static void createSensorsFromPaths(
     boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
     boost::container::flat_map<std::string, std::shared_ptr<HwmonTempSensor>>&
         sensors,
     std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    SensorConfigMap& configMap, const std::vector<fs::path>& paths,
+    const I2CDeviceMap& devices,
     const std::shared_ptr<boost::container::flat_set<std::string>>&
         sensorsChanged,
     bool activateOnly)
 {
-    auto getter = std::make_shared<GetSensorConfiguration>(
-        dbusConnection,
-        [&io, &objectServer, &sensors, &dbusConnection, sensorsChanged,
-         activateOnly](const ManagedObjectType& sensorConfigurations) {
-            bool firstScan = sensorsChanged == nullptr;
-
-            SensorConfigMap configMap =
-                buildSensorConfigMap(sensorConfigurations);
-
-            auto devices =
-                instantiateDevices(sensorConfigurations, sensors, sensorTypes);
-
-            // IIO _raw devices look like this on sysfs:
-            //     /sys/bus/iio/devices/iio:device0/in_temp_raw
-            //     /sys/bus/iio/devices/iio:device0/in_temp_offset
-            //     /sys/bus/iio/devices/iio:device0/in_temp_scale
-            //
-            // Other IIO devices look like this on sysfs:
-            //     /sys/bus/iio/devices/iio:device1/in_temp_input
-            //     /sys/bus/iio/devices/iio:device1/in_pressure_input
-            std::vector<fs::path> paths;
-            fs::path root("/sys/bus/iio/devices");
-            findFiles(root, R"(in_temp\d*_(input|raw))", paths);
-            findFiles(root, R"(in_pressure\d*_(input|raw))", paths);
-            findFiles(root, R"(in_humidityrelative\d*_(input|raw))", paths);
-            findFiles(fs::path("/sys/class/hwmon"), R"(temp\d+_input)", paths);
-
-            // iterate through all found temp and pressure sensors,
-            // and try to match them with configuration
-            for (auto& path : paths)
+    bool firstScan = sensorsChanged == nullptr;
+
+    // iterate through all found temp and pressure sensors,
+    // and try to match them with configuration
+    for (auto& path : paths)
+    {
+        std::smatch match;
+        const std::string pathStr = path.string();
+        auto directory = path.parent_path();
+        fs::path device;
+
+        std::string deviceName;
+        std::error_code ec;
+        if (pathStr.starts_with("/sys/bus/iio/devices"))
+        {
+            device = fs::canonical(directory, ec);
+            if (ec)
             {
-                std::smatch match;
-                const std::string pathStr = path.string();
-                auto directory = path.parent_path();
-                fs::path device;
-
-                std::string deviceName;
-                std::error_code ec;
-                if (pathStr.starts_with("/sys/bus/iio/devices"))
-                {
-                    device = fs::canonical(directory, ec);
-                    if (ec)
-                    {
-                        std::cerr << "Fail to find device in path [" << pathStr
-                                  << "]\n";
-                        continue;
-                    }
-                    deviceName = device.parent_path().stem();
-                }
-                else
-                {
-                    device = fs::canonical(directory / "device", ec);
-                    if (ec)
-                    {
-                        std::cerr << "Fail to find device in path [" << pathStr
-                                  << "]\n";
-                        continue;
-                    }
-                    deviceName = device.stem();
-                }
+                std::cerr << "Fail to find device in path [" << pathStr
+                          << "]\n";
+                continue;
+            }
+            deviceName = device.parent_path().stem();
+        }
+        else
+        {
+            device = fs::canonical(directory / "device", ec);
+            if (ec)
+            {
+                std::cerr << "Fail to find device in path [" << pathStr
+                          << "]\n";
+                continue;
+            }
+            deviceName = device.stem();
+        }
 
-                uint64_t bus = 0;
-                uint64_t addr = 0;
-                if (!getDeviceBusAddr(deviceName, bus, addr))
-                {
-                    continue;
-                }
+        uint64_t bus = 0;
+        uint64_t addr = 0;
+        if (!getDeviceBusAddr(deviceName, bus, addr))
+        {
+            continue;
+        }
 
-                auto thisSensorParameters = getSensorParameters(path);
-                auto findSensorCfg = configMap.find({bus, addr});
-                if (findSensorCfg == configMap.end())
-                {
-                    continue;
-                }
+        auto thisSensorParameters = getSensorParameters(path);
+        auto findSensorCfg = configMap.find({bus, addr});
+        if (findSensorCfg == configMap.end())
+        {
+            continue;
+        }
 
-                const std::string& interfacePath =
-                    findSensorCfg->second.sensorPath;
-                auto findI2CDev = devices.find(interfacePath);
+        const std::string& interfacePath = findSensorCfg->second.sensorPath;
+        auto findI2CDev = devices.find(interfacePath);
 
-                std::shared_ptr<I2CDevice> i2cDev;
-                if (findI2CDev != devices.end())
-                {
-                    // If we're only looking to activate newly-instantiated i2c
-                    // devices and this sensor's underlying device was already
-                    // there before this call, there's nothing more to do here.
-                    if (activateOnly && !findI2CDev->second.second)
-                    {
-                        continue;
-                    }
-                    i2cDev = findI2CDev->second.first;
-                }
+        std::shared_ptr<I2CDevice> i2cDev;
+        if (findI2CDev != devices.end())
+        {
+            // If we're only looking to activate newly-instantiated i2c
+            // devices and this sensor's underlying device was already
+            // there before this call, there's nothing more to do here.
+            if (activateOnly && !findI2CDev->second.second)
+            {
+                continue;
+            }
+            i2cDev = findI2CDev->second.first;
+        }
 
-                const SensorData& sensorData = findSensorCfg->second.sensorData;
-                std::string sensorType = findSensorCfg->second.interface;
-                auto pos = sensorType.find_last_of('.');
-                if (pos != std::string::npos)
-                {
-                    sensorType = sensorType.substr(pos + 1);
-                }
-                const SensorBaseConfigMap& baseConfigMap =
-                    findSensorCfg->second.config;
-                std::vector<std::string>& hwmonName =
-                    findSensorCfg->second.name;
-
-                // Temperature has "Name", pressure has "Name1"
-                auto findSensorName = baseConfigMap.find("Name");
-                int index = 1;
-                if (thisSensorParameters.typeName == "pressure" ||
-                    thisSensorParameters.typeName == "humidity")
-                {
-                    findSensorName = baseConfigMap.find("Name1");
-                    index = 2;
-                }
+        const SensorData& sensorData = findSensorCfg->second.sensorData;
+        std::string sensorType = findSensorCfg->second.interface;
+        auto pos = sensorType.find_last_of('.');
+        if (pos != std::string::npos)
+        {
+            sensorType = sensorType.substr(pos + 1);
+        }
+        const SensorBaseConfigMap& baseConfigMap = findSensorCfg->second.config;
+        std::vector<std::string>& hwmonName = findSensorCfg->second.name;
+
+        // Temperature has "Name", pressure has "Name1"
+        auto findSensorName = baseConfigMap.find("Name");
+        int index = 1;
+        if (thisSensorParameters.typeName == "pressure" ||
+            thisSensorParameters.typeName == "humidity")
+        {
+            findSensorName = baseConfigMap.find("Name1");
+            index = 2;
+        }
 
-                if (findSensorName == baseConfigMap.end())
-                {
-                    std::cerr << "could not determine configuration name for "
-                              << deviceName << "\n";
-                    continue;
-                }
-                std::string sensorName =
-                    std::get<std::string>(findSensorName->second);
-                // on rescans, only update sensors we were signaled by
-                auto findSensor = sensors.find(sensorName);
-                if (!firstScan && findSensor != sensors.end())
+        if (findSensorName == baseConfigMap.end())
+        {
+            std::cerr << "could not determine configuration name for "
+                      << deviceName << "\n";
+            continue;
+        }
+        std::string sensorName = std::get<std::string>(findSensorName->second);
+        // on rescans, only update sensors we were signaled by
+        auto findSensor = sensors.find(sensorName);
+        if (!firstScan && findSensor != sensors.end())
+        {
+            bool found = false;
+            auto it = sensorsChanged->begin();
+            while (it != sensorsChanged->end())
+            {
+                if (it->ends_with(findSensor->second->name))
                 {
-                    bool found = false;
-                    auto it = sensorsChanged->begin();
-                    while (it != sensorsChanged->end())
-                    {
-                        if (it->ends_with(findSensor->second->name))
-                        {
-                            it = sensorsChanged->erase(it);
-                            findSensor->second = nullptr;
-                            found = true;
-                            break;
-                        }
-                        ++it;
-                    }
-                    if (!found)
-                    {
-                        continue;
-                    }
+                    it = sensorsChanged->erase(it);
+                    findSensor->second = nullptr;
+                    found = true;
+                    break;
                 }
+                ++it;
+            }
+            if (!found)
+            {
+                continue;
+            }
+        }
+
+        std::vector<thresholds::Threshold> sensorThresholds;
+
+        if (!parseThresholdsFromConfig(sensorData, sensorThresholds, nullptr,
+                                       &index))
+        {
+            std::cerr << "error populating thresholds for " << sensorName
+                      << " index " << index << "\n";
+        }
 
-                std::vector<thresholds::Threshold> sensorThresholds;
+        float pollRate = getPollRate(baseConfigMap, pollRateDefault);
+        PowerState readState = getPowerState(baseConfigMap);
+
+        auto permitSet = getPermitSet(baseConfigMap);
+        auto& sensor = sensors[sensorName];
+        if (!activateOnly)
+        {
+            sensor = nullptr;
+        }
+        auto hwmonFile =
+            getFullHwmonFilePath(directory.string(), "temp1", permitSet);
+        if (pathStr.starts_with("/sys/bus/iio/devices"))
+        {
+            hwmonFile = pathStr;
+        }
+        if (hwmonFile)
+        {
+            if (sensor != nullptr)
+            {
+                sensor->activate(*hwmonFile, i2cDev);
+            }
+            else
+            {
+                sensor = std::make_shared<HwmonTempSensor>(
+                    *hwmonFile, sensorType, objectServer, dbusConnection, io,
+                    sensorName, std::move(sensorThresholds),
+                    thisSensorParameters, pollRate, interfacePath, readState,
+                    i2cDev);
+                sensor->setupRead();
+            }
+        }
+        hwmonName.erase(remove(hwmonName.begin(), hwmonName.end(), sensorName),
+                        hwmonName.end());
 
-                if (!parseThresholdsFromConfig(sensorData, sensorThresholds,
+        // Looking for keys like "Name1" for temp2_input,
+        // "Name2" for temp3_input, etc.
+        int i = 0;
+        while (true)
+        {
+            ++i;
+            auto findKey = baseConfigMap.find("Name" + std::to_string(i));
+            if (findKey == baseConfigMap.end())
+            {
+                break;
+            }
+            std::string sensorName = std::get<std::string>(findKey->second);
+            hwmonFile = getFullHwmonFilePath(
+                directory.string(), "temp" + std::to_string(i + 1), permitSet);
+            if (pathStr.starts_with("/sys/bus/iio/devices"))
+            {
+                continue;
+            }
+            if (hwmonFile)
+            {
+                // To look up thresholds for these additional sensors,
+                // match on the Index property in the threshold data
+                // where the index comes from the sysfs file we're on,
+                // i.e. index = 2 for temp2_input.
+                int index = i + 1;
+                std::vector<thresholds::Threshold> thresholds;
+
+                if (!parseThresholdsFromConfig(sensorData, thresholds,
                                                nullptr, &index))
                 {
                     std::cerr << "error populating thresholds for "
                               << sensorName << " index " << index << "\n";
                 }
 
-                float pollRate = getPollRate(baseConfigMap, pollRateDefault);
-                PowerState readState = getPowerState(baseConfigMap);
-
-                auto permitSet = getPermitSet(baseConfigMap);
                 auto& sensor = sensors[sensorName];
                 if (!activateOnly)
                 {
                     sensor = nullptr;
                 }
-                auto hwmonFile = getFullHwmonFilePath(directory.string(),
-                                                      "temp1", permitSet);
-                if (pathStr.starts_with("/sys/bus/iio/devices"))
+
+                if (sensor != nullptr)
                 {
-                    hwmonFile = pathStr;
+                    sensor->activate(*hwmonFile, i2cDev);
                 }
-                if (hwmonFile)
+                else
                 {
-                    if (sensor != nullptr)
-                    {
-                        sensor->activate(*hwmonFile, i2cDev);
-                    }
-                    else
-                    {
-                        sensor = std::make_shared<HwmonTempSensor>(
-                            *hwmonFile, sensorType, objectServer,
-                            dbusConnection, io, sensorName,
-                            std::move(sensorThresholds), thisSensorParameters,
-                            pollRate, interfacePath, readState, i2cDev);
-                        sensor->setupRead();
-                    }
+                    sensor = std::make_shared<HwmonTempSensor>(
+                        *hwmonFile, sensorType, objectServer, dbusConnection,
+                        io, sensorName, std::move(thresholds),
+                        thisSensorParameters, pollRate, interfacePath,
+                        readState, i2cDev);
+                    sensor->setupRead();
                 }
-                hwmonName.erase(
-                    remove(hwmonName.begin(), hwmonName.end(), sensorName),
-                    hwmonName.end());
+            }
 
-                // Looking for keys like "Name1" for temp2_input,
-                // "Name2" for temp3_input, etc.
-                int i = 0;
-                while (true)
-                {
-                    ++i;
-                    auto findKey =
-                        baseConfigMap.find("Name" + std::to_string(i));
-                    if (findKey == baseConfigMap.end())
-                    {
-                        break;
-                    }
-                    std::string sensorName =
-                        std::get<std::string>(findKey->second);
-                    hwmonFile = getFullHwmonFilePath(
-                        directory.string(), "temp" + std::to_string(i + 1),
-                        permitSet);
-                    if (pathStr.starts_with("/sys/bus/iio/devices"))
-                    {
-                        continue;
-                    }
-                    if (hwmonFile)
+            hwmonName.erase(
+                remove(hwmonName.begin(), hwmonName.end(), sensorName),
+                hwmonName.end());
+        }
+        if (hwmonName.empty())
+        {
+            configMap.erase(findSensorCfg);
+        }
+    }
+}
+
+void createSensors(
+    boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
+    boost::container::flat_map<std::string, std::shared_ptr<HwmonTempSensor>>&
+        sensors,
+    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    const std::shared_ptr<boost::container::flat_set<std::string>>&
+        sensorsChanged,
+    bool activateOnly)
+{
+    auto getter = std::make_shared<GetSensorConfiguration>(
+        dbusConnection,
+        [&io, &objectServer, &sensors, &dbusConnection, sensorsChanged,
+         activateOnly](const ManagedObjectType& sensorConfigurations) {
+            // Entries are removed from the map as their sensors are created,
+            // which keeps the final scan from revisiting devices that were
+            // already set up as they became ready.
+            auto configMap = std::make_shared<SensorConfigMap>(
+                buildSensorConfigMap(sensorConfigurations));
+
+            instantiateDevices(
+                io, sensorConfigurations, sensors, sensorTypes,
+                [&io, &objectServer, &sensors, &dbusConnection, sensorsChanged,
+                 activateOnly,
+                 configMap](const std::string& path,
+                            const I2CDeviceParams& params,
+                            const std::shared_ptr<I2CDevice>& device) {
+                    std::vector<fs::path> paths;
+                    for (const auto& hwmonDir : params.hwmonDirectories())
                     {
-                        // To look up thresholds for these additional sensors,
-                        // match on the Index property in the threshold data
-                        // where the index comes from the sysfs file we're on,
-                        // i.e. index = 2 for temp2_input.
-                        int index = i + 1;
-                        std::vector<thresholds::Threshold> thresholds;
-
-                        if (!parseThresholdsFromConfig(sensorData, thresholds,
-                                                       nullptr, &index))
-                        {
-                            std::cerr
-                                << "error populating thresholds for "
-                                << sensorName << " index " << index << "\n";
-                        }
-
-                        auto& sensor = sensors[sensorName];
-                        if (!activateOnly)
-                        {
-                            sensor = nullptr;
-                        }
-
-                        if (sensor != nullptr)
-                        {
-                            sensor->activate(*hwmonFile, i2cDev);
-                        }
-                        else
-                        {
-                            sensor = std::make_shared<HwmonTempSensor>(
-                                *hwmonFile, sensorType, objectServer,
-                                dbusConnection, io, sensorName,
-                                std::move(thresholds), thisSensorParameters,
-                                pollRate, interfacePath, readState, i2cDev);
-                            sensor->setupRead();
-                        }
+                        findFiles(hwmonDir, R"(temp\d+_input)", paths, 0);
                     }
-
-                    hwmonName.erase(
-                        remove(hwmonName.begin(), hwmonName.end(), sensorName),
-                        hwmonName.end());
-                }
-                if (hwmonName.empty())
-                {
-                    configMap.erase(findSensorCfg);
-                }
-            }
+                    I2CDeviceMap devices;
+                    devices.emplace(path, std::make_pair(device, true));
+                    createSensorsFromPaths(io, objectServer, sensors,
+                                           dbusConnection, *configMap, paths,
+                                           devices, sensorsChanged,
+                                           activateOnly);
+                },
+                [&io, &objectServer, &sensors, &dbusConnection, sensorsChanged,
+                 activateOnly, configMap](const I2CDeviceMap& devices) {
+                    // IIO _raw devices look like this on sysfs:
+                    //     /sys/bus/iio/devices/iio:device0/in_temp_raw
+                    //     /sys/bus/iio/devices/iio:device0/in_temp_offset
+                    //     /sys/bus/iio/devices/iio:device0/in_temp_scale
+                    //
+                    // Other IIO devices look like this on sysfs:
+                    //     /sys/bus/iio/devices/iio:device1/in_temp_input
+                    //     /sys/bus/iio/devices/iio:device1/in_pressure_input
+                    std::vector<fs::path> paths;
+                    fs::path root("/sys/bus/iio/devices");
+                    findFiles(root, R"(in_temp\d*_(input|raw))", paths);
+                    findFiles(root, R"(in_pressure\d*_(input|raw))", paths);
+                    findFiles(root, R"(in_humidityrelative\d*_(input|raw))",
+                              paths);
+                    findFiles(fs::path("/sys/class/hwmon"), R"(temp\d+_input)",
+                              paths);
+
+                    createSensorsFromPaths(io, objectServer, sensors,
+                                           dbusConnection, *configMap, paths,
+                                           devices, sensorsChanged,
+                                           activateOnly);
+                });
         });
     std::vector<std::string> types(sensorTypes.size());
     for (const auto& [type, dt] : sensorTypes)
@@ -600,12 +633,12 @@ static void powerStateChanged(
     }
 }
 
-int main()
+static SensorDaemon::Task hwmonTempSensorMain(SensorDaemon& daemon)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
-    sdbusplus::asio::object_server objectServer(systemBus, true);
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
+    daemon.addManager("/xyz/openbmc_project/sensors");
     systemBus->request_name("xyz.openbmc_project.HwmonTempSensor");
 
     boost::container::flat_map<std::string, std::shared_ptr<HwmonTempSensor>>
@@ -667,5 +700,8 @@ int main()
 
     matches.emplace_back(std::move(ifaceRemovedMatch));
 
-    io.run();
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("hwmon-temp", "hwmontempsensor",
+                                           hwmonTempSensorMain);
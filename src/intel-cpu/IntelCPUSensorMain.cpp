@@ -15,6 +15,7 @@
 */
 
 #include "IntelCPUSensor.hpp"
+#include "SensorDaemon.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
 #include "VariantVisitors.hpp"
@@ -798,14 +799,14 @@ bool getCpuConfig(const std::shared_ptr<sdbusplus::asio::connection>& systemBus,
     return false;
 }
 
-int main()
+static SensorDaemon::Task intelCPUSensorMain(SensorDaemon& daemon)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
     boost::container::flat_set<CPUConfig> cpuConfigs;
 
-    sdbusplus::asio::object_server objectServer(systemBus, true);
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
+    daemon.addManager("/xyz/openbmc_project/sensors");
     boost::asio::steady_timer pingTimer(io);
     boost::asio::steady_timer creationTimer(io);
     boost::asio::steady_timer filterTimer(io);
@@ -861,6 +862,8 @@ int main()
     systemBus->request_name("xyz.openbmc_project.IntelCPUSensor");
 
     setupManufacturingModeMatch(*systemBus);
-    io.run();
-    return 0;
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("intel-cpu", "intelcpusensor",
+                                           intelCPUSensorMain);
@@ -17,8 +17,6 @@
 #include "ChassisIntrusionSensor.hpp"
 
 #include <fcntl.h>
-#include <linux/i2c.h>
-#include <sys/ioctl.h>
 #include <sys/syslog.h>
 #include <systemd/sd-journal.h>
 #include <unistd.h>
@@ -30,11 +28,14 @@
 #include <gpiod.hpp>
 #include <sdbusplus/asio/object_server.hpp>
 
+#include <array>
+#include <cerrno>
+#include <charconv>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
@@ -42,17 +43,12 @@
 #include <utility>
 #include <vector>
 
-extern "C"
-{
-#include <i2c/smbus.h>
-#include <linux/i2c-dev.h>
-}
-
 static constexpr bool debug = false;
 
 static constexpr unsigned int defaultPollSec = 1;
 static constexpr unsigned int sensorFailedPollSec = 5;
 static unsigned int intrusionSensorPollSec = defaultPollSec;
+static constexpr std::chrono::milliseconds pchReadTimeout{500};
 static constexpr const char* hwIntrusionValStr =
     "xyz.openbmc_project.Chassis.Intrusion.Status.HardwareIntrusion";
 static constexpr const char* normalValStr =
@@ -121,31 +117,23 @@ void ChassisIntrusionSensor::updateValue(const size_t& value)
     mValue = newValue;
 }
 
-int ChassisIntrusionPchSensor::readSensor()
+void ChassisIntrusionPchSensor::handleResponse(const I2CResult& result)
 {
-    int32_t statusMask = pchRegMaskIntrusion;
-    int32_t statusReg = pchStatusRegIntrusion;
-
-    int32_t value = i2c_smbus_read_byte_data(mBusFd, statusReg);
-    if constexpr (debug)
+    if (result.error != 0)
     {
-        std::cout << "Pch type: raw value is " << value << "\n";
-    }
-
-    if (value < 0)
-    {
-        std::cerr << "i2c_smbus_read_byte_data failed \n";
-        return -1;
+        std::cerr << "Failed to read intrusion status from i2c-" << mBusId
+                  << ": " << std::strerror(result.error) << "\n";
+        intrusionSensorPollSec = sensorFailedPollSec;
+        return;
     }
 
-    // Get status value with mask
-    value &= statusMask;
-
     if constexpr (debug)
     {
-        std::cout << "Pch type: masked raw value is " << value << "\n";
+        std::cout << "Pch type: raw value is " << result.value << "\n";
     }
-    return value;
+
+    intrusionSensorPollSec = defaultPollSec;
+    updateValue(result.value & pchRegMaskIntrusion);
 }
 
 void ChassisIntrusionPchSensor::pollSensorStatus()
@@ -170,19 +158,23 @@ void ChassisIntrusionPchSensor::pollSensorStatus()
             return;
         }
 
-        int value = self->readSensor();
-        if (value < 0)
-        {
-            intrusionSensorPollSec = sensorFailedPollSec;
-        }
-        else
-        {
-            intrusionSensorPollSec = defaultPollSec;
-            self->updateValue(value);
-        }
+        self->mScheduler->submit(
+            {self->mBusId, static_cast<uint8_t>(self->mSlaveAddr),
+             I2CTransaction::Op::readByteData, pchStatusRegIntrusion, true},
+            [weakRef](const I2CResult& result) {
+                std::shared_ptr<ChassisIntrusionPchSensor> self =
+                    weakRef.lock();
+                if (!self)
+                {
+                    return;
+                }
 
-        // trigger next polling
-        self->pollSensorStatus();
+                self->handleResponse(result);
+
+                // trigger next polling
+                self->pollSensorStatus();
+            },
+            pchReadTimeout);
     });
 }
 
@@ -229,43 +221,55 @@ int ChassisIntrusionHwmonSensor::readSensor()
 {
     int value = 0;
 
-    std::fstream stream(mHwmonPath, std::ios::in | std::ios::out);
-    if (!stream.good())
+    // Reading from the start also rearms the POLLPRI notification
+    std::array<char, 16> buf{};
+    ssize_t len = ::pread(mHwmonFd.native_handle(), buf.data(), buf.size(), 0);
+    if (len <= 0)
     {
         std::cerr << "Error reading status at " << mHwmonPath << "\n";
         return -1;
     }
 
-    std::string line;
-    if (!std::getline(stream, line))
+    auto [_, ec] = std::from_chars(buf.data(), buf.data() + len, value);
+    if (ec != std::errc())
     {
-        std::cerr << "Error reading status at " << mHwmonPath << "\n";
+        std::cerr << "Error reading status at " << mHwmonPath << " : "
+                  << std::make_error_code(ec).message() << "\n";
         return -1;
     }
 
-    try
+    if constexpr (debug)
     {
-        value = std::stoi(line);
-        if constexpr (debug)
-        {
-            std::cout << "Hwmon type: raw value is " << value << "\n";
-        }
+        std::cout << "Hwmon type: raw value is " << value << "\n";
     }
-    catch (const std::invalid_argument& e)
+
+    // Reset chassis intrusion status after every reading of an intrusion.
+    // Clearing it may be notified too, but leaves nothing to clear after.
+    std::string clear = std::to_string(intrusionStatusHwmonClearValue);
+    if (value != 0 &&
+        ::pwrite(mHwmonFd.native_handle(), clear.data(), clear.size(), 0) < 0)
     {
-        std::cerr << "Error reading status at " << mHwmonPath << " : "
-                  << e.what() << "\n";
-        return -1;
+        std::cerr << "Error clearing status at " << mHwmonPath << ": "
+                  << std::strerror(errno) << "\n";
     }
 
-    // Reset chassis intrusion status after every reading
-    stream << intrusionStatusHwmonClearValue;
-
     return value;
 }
 
 void ChassisIntrusionHwmonSensor::pollSensorStatus()
 {
+    if (mNotify)
+    {
+        // Catch up on anything that happened before we were waiting
+        int value = readSensor();
+        if (value >= 0)
+        {
+            updateValue(value);
+        }
+        waitForNotification();
+        return;
+    }
+
     std::weak_ptr<ChassisIntrusionHwmonSensor> weakRef = weak_from_this();
 
     // setting a new experation implicitly cancels any pending async wait
@@ -302,6 +306,36 @@ void ChassisIntrusionHwmonSensor::pollSensorStatus()
     });
 }
 
+void ChassisIntrusionHwmonSensor::waitForNotification()
+{
+    std::weak_ptr<ChassisIntrusionHwmonSensor> weakRef = weak_from_this();
+
+    // sysfs_notify() raises POLLPRI | POLLERR on the attribute
+    mHwmonFd.async_wait(
+        boost::asio::posix::stream_descriptor::wait_error,
+        [weakRef](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            std::shared_ptr<ChassisIntrusionHwmonSensor> self = weakRef.lock();
+            if (!self)
+            {
+                return;
+            }
+
+            if (ec)
+            {
+                std::cerr << "Error waiting on " << self->mHwmonPath << ": "
+                          << ec.message() << "\n";
+                return;
+            }
+
+            self->pollSensorStatus();
+        });
+}
+
 int ChassisIntrusionSensor::setSensorValue(const std::string& req,
                                            std::string& propertyValue)
 {
@@ -370,44 +404,18 @@ ChassisIntrusionSensor::ChassisIntrusionSensor(
 ChassisIntrusionPchSensor::ChassisIntrusionPchSensor(
     bool autoRearm, boost::asio::io_context& io,
     sdbusplus::asio::object_server& objServer, int busId, int slaveAddr) :
-    ChassisIntrusionSensor(autoRearm, objServer), mPollTimer(io)
+    ChassisIntrusionSensor(autoRearm, objServer), mPollTimer(io),
+    mScheduler(I2CScheduler::shared(io))
 {
-    if (busId < 0 || slaveAddr <= 0)
+    if (busId < 0 || slaveAddr <= 0 || slaveAddr > 0x7f)
     {
         throw std::invalid_argument(
             "Invalid i2c bus " + std::to_string(busId) + " address " +
             std::to_string(slaveAddr) + "\n");
     }
 
+    mBusId = busId;
     mSlaveAddr = slaveAddr;
-
-    std::string devPath = "/dev/i2c-" + std::to_string(busId);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-    mBusFd = open(devPath.c_str(), O_RDWR | O_CLOEXEC);
-    if (mBusFd < 0)
-    {
-        throw std::invalid_argument("Unable to open " + devPath + "\n");
-    }
-
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-    if (ioctl(mBusFd, I2C_SLAVE_FORCE, mSlaveAddr) < 0)
-    {
-        throw std::runtime_error("Unable to set device address\n");
-    }
-
-    unsigned long funcs = 0;
-
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-    if (ioctl(mBusFd, I2C_FUNCS, &funcs) < 0)
-    {
-        throw std::runtime_error("Don't support I2C_FUNCS\n");
-    }
-
-    if ((funcs & I2C_FUNC_SMBUS_READ_BYTE_DATA) == 0U)
-    {
-        throw std::runtime_error(
-            "Do not have I2C_FUNC_SMBUS_READ_BYTE_DATA \n");
-    }
 }
 
 ChassisIntrusionGpioSensor::ChassisIntrusionGpioSensor(
@@ -437,9 +445,11 @@ ChassisIntrusionGpioSensor::ChassisIntrusionGpioSensor(
 
 ChassisIntrusionHwmonSensor::ChassisIntrusionHwmonSensor(
     bool autoRearm, boost::asio::io_context& io,
-    sdbusplus::asio::object_server& objServer, std::string hwmonName) :
+    sdbusplus::asio::object_server& objServer, std::string hwmonName,
+    bool notify) :
     ChassisIntrusionSensor(autoRearm, objServer),
-    mHwmonName(std::move(hwmonName)), mPollTimer(io)
+    mHwmonName(std::move(hwmonName)), mNotify(notify), mPollTimer(io),
+    mHwmonFd(io)
 {
     std::vector<fs::path> paths;
 
@@ -469,6 +479,14 @@ ChassisIntrusionHwmonSensor::ChassisIntrusionHwmonSensor(
                   << " paths for intrusion status \n"
                   << " The first path is: " << mHwmonPath << "\n";
     }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    int fd = ::open(mHwmonPath.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::invalid_argument("Unable to open " + mHwmonPath + "\n");
+    }
+    mHwmonFd.assign(fd);
 }
 
 ChassisIntrusionSensor::~ChassisIntrusionSensor()
@@ -479,10 +497,6 @@ ChassisIntrusionSensor::~ChassisIntrusionSensor()
 ChassisIntrusionPchSensor::~ChassisIntrusionPchSensor()
 {
     mPollTimer.cancel();
-    if (close(mBusFd) < 0)
-    {
-        std::cerr << "Failed to close fd " << std::to_string(mBusFd);
-    }
 }
 
 ChassisIntrusionGpioSensor::~ChassisIntrusionGpioSensor()
@@ -497,4 +511,5 @@ ChassisIntrusionGpioSensor::~ChassisIntrusionGpioSensor()
 ChassisIntrusionHwmonSensor::~ChassisIntrusionHwmonSensor()
 {
     mPollTimer.cancel();
+    mHwmonFd.close();
 }
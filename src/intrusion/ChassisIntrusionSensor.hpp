@@ -1,6 +1,9 @@
 #pragma once
 
+#include "I2CScheduler.hpp"
+
 #include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <gpiod.hpp>
 #include <sdbusplus/asio/object_server.hpp>
@@ -21,7 +24,6 @@ class ChassisIntrusionSensor
     void start();
 
   protected:
-    virtual int readSensor() = 0;
     virtual void pollSensorStatus() = 0;
     void updateValue(const size_t& value);
 
@@ -50,11 +52,12 @@ class ChassisIntrusionPchSensor :
     ~ChassisIntrusionPchSensor() override;
 
   private:
-    int mBusFd{-1};
+    int mBusId{-1};
     int mSlaveAddr{-1};
     boost::asio::steady_timer mPollTimer;
-    int readSensor() override;
+    std::shared_ptr<I2CScheduler> mScheduler;
     void pollSensorStatus() override;
+    void handleResponse(const I2CResult& result);
 };
 
 class ChassisIntrusionGpioSensor :
@@ -73,7 +76,7 @@ class ChassisIntrusionGpioSensor :
     std::string mPinName = "CHASSIS_INTRUSION";
     gpiod::line mGpioLine;
     boost::asio::posix::stream_descriptor mGpioFd;
-    int readSensor() override;
+    int readSensor();
     void pollSensorStatus() override;
 };
 
@@ -84,14 +87,20 @@ class ChassisIntrusionHwmonSensor :
   public:
     ChassisIntrusionHwmonSensor(bool autoRearm, boost::asio::io_context& io,
                                 sdbusplus::asio::object_server& objServer,
-                                std::string hwmonName);
+                                std::string hwmonName, bool notify);
 
     ~ChassisIntrusionHwmonSensor() override;
 
   private:
     std::string mHwmonName;
     std::string mHwmonPath;
+    // Whether the driver calls sysfs_notify() on the status attribute, in
+    // which case we wait for POLLPRI rather than polling
+    bool mNotify;
     boost::asio::steady_timer mPollTimer;
-    int readSensor() override;
+    // Open for as long as the sensor is
+    boost::asio::posix::stream_descriptor mHwmonFd;
+    int readSensor();
     void pollSensorStatus() override;
+    void waitForNotification();
 };
@@ -15,6 +15,9 @@
 */
 
 #include "ChassisIntrusionSensor.hpp"
+#include "LinkMonitor.hpp"
+#include "SensorConfig.hpp"
+#include "SensorDaemon.hpp"
 #include "Utils.hpp"
 
 #include <boost/asio/error.hpp>
@@ -34,13 +37,13 @@
 #include <cstdint>
 #include <ctime>
 #include <exception>
-#include <filesystem>
-#include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <system_error>
 #include <utility>
 #include <variant>
@@ -168,10 +171,15 @@ static void createSensorsFromConfig(
 
                 hwmonName = compatIterator->second;
 
+                // Whether the driver notifies changes to the status, so it
+                // needn't be polled.  A malformed value falls back to polling.
+                bool notify = sensor_config::decodeValue(
+                    baseConfiguration->second, "Notify", false);
+
                 try
                 {
                     pSensor = std::make_shared<ChassisIntrusionHwmonSensor>(
-                        autoRearm, io, objServer, hwmonName);
+                        autoRearm, io, objServer, hwmonName, notify);
                     pSensor->start();
                     return;
                 }
@@ -234,9 +242,7 @@ static void createSensorsFromConfig(
 }
 
 static constexpr bool debugLanLeash = false;
-boost::container::flat_map<int, bool> lanStatusMap;
 boost::container::flat_map<int, std::string> lanInfoMap;
-boost::container::flat_map<std::string, int> pathSuffixMap;
 
 static void getNicNameInfo(
     const std::shared_ptr<sdbusplus::asio::connection>& dbusConnection)
@@ -290,63 +296,42 @@ static void getNicNameInfo(
         std::vector<std::string>{nicTypes.begin(), nicTypes.end()});
 }
 
-static void processLanStatusChange(sdbusplus::message_t& message)
+// The eth number of a LAN port's interface name, ethN
+static std::optional<int> parseEthNum(const std::string& name)
 {
-    const std::string& pathName = message.get_path();
-    std::string interfaceName;
-    SensorBaseConfigMap properties;
-    message.read(interfaceName, properties);
-
-    auto findStateProperty = properties.find("OperationalState");
-    if (findStateProperty == properties.end())
-    {
-        return;
-    }
-    std::string* pState =
-        std::get_if<std::string>(&(findStateProperty->second));
-    if (pState == nullptr)
-    {
-        std::cerr << "invalid OperationalState \n";
-        return;
-    }
-
-    bool newLanConnected = (*pState == "routable" || *pState == "carrier" ||
-                            *pState == "degraded");
-
-    // get ethNum from path. /org/freedesktop/network1/link/_32 for eth0
-    size_t pos = pathName.find("/_");
-    if (pos == std::string::npos || pathName.length() <= pos + 2)
+    std::string_view prefix = "eth";
+    if (!name.starts_with(prefix) || name.size() == prefix.size())
     {
-        std::cerr << "unexpected path name " << pathName << "\n";
-        return;
+        return std::nullopt;
     }
-    std::string suffixStr = pathName.substr(pos + 2);
 
-    auto findEthNum = pathSuffixMap.find(suffixStr);
-    if (findEthNum == pathSuffixMap.end())
+    int ethNum = 0;
+    const char* begin = name.data() + prefix.size();
+    const char* end = name.data() + name.size();
+    std::from_chars_result r = std::from_chars(begin, end, ethNum);
+    if (r.ec != std::errc() || r.ptr != end)
     {
-        std::cerr << "unexpected eth for suffixStr " << suffixStr << "\n";
-        return;
+        return std::nullopt;
     }
-    int ethNum = findEthNum->second;
+    return ethNum;
+}
 
-    // get lan status from map
-    auto findLanStatus = lanStatusMap.find(ethNum);
-    if (findLanStatus == lanStatusMap.end())
+static void processLanStatusChange(const LinkEvent& link)
+{
+    std::optional<int> ethNum = parseEthNum(link.name);
+    if (!ethNum)
     {
-        std::cerr << "unexpected eth " << ethNum << " in lanStatusMap \n";
         return;
     }
-    bool oldLanConnected = findLanStatus->second;
 
     // get lan info from map
     std::string lanInfo;
     if (!lanInfoMap.empty())
     {
-        auto findLanInfo = lanInfoMap.find(ethNum);
+        auto findLanInfo = lanInfoMap.find(*ethNum);
         if (findLanInfo == lanInfoMap.end())
         {
-            std::cerr << "unexpected eth " << ethNum << " in lanInfoMap \n";
+            std::cerr << "unexpected eth " << *ethNum << " in lanInfoMap \n";
         }
         else
         {
@@ -356,136 +341,35 @@ static void processLanStatusChange(sdbusplus::message_t& message)
 
     if (debugLanLeash)
     {
-        std::cout << "ethNum = " << ethNum << ", state = " << *pState
-                  << ", oldLanConnected = "
-                  << (oldLanConnected ? "true" : "false")
+        std::cout << "ethNum = " << *ethNum << ", ifindex = " << link.ifindex
                   << ", newLanConnected = "
-                  << (newLanConnected ? "true" : "false") << "\n";
+                  << (link.connected ? "true" : "false") << "\n";
     }
 
-    if (oldLanConnected != newLanConnected)
-    {
-        std::string strEthNum = "eth" + std::to_string(ethNum) + lanInfo;
-        const auto* strState = newLanConnected ? "connected" : "lost";
-        const auto* strMsgId =
-            newLanConnected ? "OpenBMC.0.1.LanRegained" : "OpenBMC.0.1.LanLost";
-
-        lg2::info("{ETHDEV} LAN leash {STATE}", "ETHDEV", strEthNum, "STATE",
-                  strState, "REDFISH_MESSAGE_ID", strMsgId,
-                  "REDFISH_MESSAGE_ARGS", strEthNum);
-
-        lanStatusMap[ethNum] = newLanConnected;
-    }
-}
-
-/** @brief Initialize the lan status.
- *
- * @return true on success and false on failure
- */
-static bool initializeLanStatus(
-    const std::shared_ptr<sdbusplus::asio::connection>& conn)
-{
-    // init lan port name from configuration
-    getNicNameInfo(conn);
-
-    // get eth info from sysfs
-    std::vector<fs::path> files;
-    if (!findFiles(fs::path("/sys/class/net/"), R"(eth\d+/ifindex)", files))
-    {
-        std::cerr << "No eth in system\n";
-        return false;
-    }
-
-    // iterate through all found eth files, and save ifindex
-    for (const fs::path& fileName : files)
-    {
-        if (debugLanLeash)
-        {
-            std::cout << "Reading " << fileName << "\n";
-        }
-        std::ifstream sysFile(fileName);
-        if (!sysFile.good())
-        {
-            std::cerr << "Failure reading " << fileName << "\n";
-            continue;
-        }
-        std::string line;
-        getline(sysFile, line);
-        const uint8_t ifindex = std::stoi(line);
-        // pathSuffix is ASCII of ifindex
-        const std::string& pathSuffix = std::to_string(ifindex + 30);
-
-        // extract ethNum
-        const std::string& fileStr = fileName.string();
-        const int pos = fileStr.find("eth");
-        const std::string& ethNumStr = fileStr.substr(pos + 3);
-        int ethNum = 0;
-        std::from_chars_result r = std::from_chars(
-            ethNumStr.data(), ethNumStr.data() + ethNumStr.size(), ethNum);
-        if (r.ec != std::errc())
-        {
-            std::cerr << "invalid ethNum string: " << ethNumStr << "\n";
-            continue;
-        }
-
-        // save pathSuffix
-        pathSuffixMap[pathSuffix] = ethNum;
-        if (debugLanLeash)
-        {
-            std::cout << "ethNum = " << std::to_string(ethNum) << ", ifindex = "
-                      << line << ", pathSuffix = " << pathSuffix << "\n";
-        }
+    std::string strEthNum = "eth" + std::to_string(*ethNum) + lanInfo;
+    const auto* strState = link.connected ? "connected" : "lost";
+    const auto* strMsgId =
+        link.connected ? "OpenBMC.0.1.LanRegained" : "OpenBMC.0.1.LanLost";
 
-        // init lan connected status from networkd
-        conn->async_method_call(
-            [ethNum](boost::system::error_code ec,
-                     const std::variant<std::string>& property) {
-                lanStatusMap[ethNum] = false;
-                if (ec)
-                {
-                    std::cerr
-                        << "Error reading init status of eth" << ethNum << "\n";
-                    return;
-                }
-                const std::string* pState = std::get_if<std::string>(&property);
-                if (pState == nullptr)
-                {
-                    std::cerr << "Unable to read lan status value\n";
-                    return;
-                }
-                bool isLanConnected =
-                    (*pState == "routable" || *pState == "carrier" ||
-                     *pState == "degraded");
-                if (debugLanLeash)
-                {
-                    std::cout << "ethNum = " << std::to_string(ethNum)
-                              << ", init LAN status = "
-                              << (isLanConnected ? "true" : "false") << "\n";
-                }
-                lanStatusMap[ethNum] = isLanConnected;
-            },
-            "org.freedesktop.network1",
-            "/org/freedesktop/network1/link/_" + pathSuffix,
-            "org.freedesktop.DBus.Properties", "Get",
-            "org.freedesktop.network1.Link", "OperationalState");
-    }
-    return true;
+    lg2::info("{ETHDEV} LAN leash {STATE}", "ETHDEV", strEthNum, "STATE",
+              strState, "REDFISH_MESSAGE_ID", strMsgId, "REDFISH_MESSAGE_ARGS",
+              strEthNum);
 }
 
-int main()
+static SensorDaemon::Task intrusionSensorMain(SensorDaemon& daemon)
 {
     std::shared_ptr<ChassisIntrusionSensor> intrusionSensor;
 
     // setup connection to dbus
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
 
     // setup object server, define interface
     systemBus->request_name("xyz.openbmc_project.IntrusionSensor");
 
-    sdbusplus::asio::object_server objServer(systemBus, true);
+    sdbusplus::asio::object_server& objServer = daemon.objectServer;
 
-    objServer.add_manager("/xyz/openbmc_project/Chassis");
+    daemon.addManager("/xyz/openbmc_project/Chassis");
 
     createSensorsFromConfig(io, objServer, systemBus, intrusionSensor);
 
@@ -516,33 +400,39 @@ int main()
         setupPropertiesChangedMatches(
             *systemBus, std::to_array<const char*>({sensorType}), eventHandler);
 
-    if (initializeLanStatus(systemBus))
+    // init lan port name from configuration
+    getNicNameInfo(systemBus);
+
+    // monitor lan status change, straight from the kernel
+    std::shared_ptr<LinkMonitor> linkMonitor;
+    try
     {
-        // add match to monitor lan status change
-        sdbusplus::bus::match_t lanStatusMatch(
-            static_cast<sdbusplus::bus_t&>(*systemBus),
-            "type='signal', member='PropertiesChanged',"
-            "arg0namespace='org.freedesktop.network1.Link'",
-            [](sdbusplus::message_t& msg) { processLanStatusChange(msg); });
-
-        // add match to monitor entity manager signal about nic name config
-        // change
-        sdbusplus::bus::match_t lanConfigMatch(
-            static_cast<sdbusplus::bus_t&>(*systemBus),
-            "type='signal', member='PropertiesChanged',path_namespace='" +
-                std::string(inventoryPath) + "',arg0namespace='" +
-                configInterfaceName(nicType) + "'",
-            [&systemBus](sdbusplus::message_t& msg) {
-                if (msg.is_method_error())
-                {
-                    std::cerr << "callback method error\n";
-                    return;
-                }
-                getNicNameInfo(systemBus);
-            });
+        linkMonitor = std::make_shared<LinkMonitor>(io, processLanStatusChange);
+        linkMonitor->start();
+    }
+    catch (const std::system_error& e)
+    {
+        std::cerr << "Unable to monitor LAN status: " << e.what() << "\n";
     }
 
-    io.run();
+    // add match to monitor entity manager signal about nic name config
+    // change
+    sdbusplus::bus::match_t lanConfigMatch(
+        static_cast<sdbusplus::bus_t&>(*systemBus),
+        "type='signal', member='PropertiesChanged',path_namespace='" +
+            std::string(inventoryPath) + "',arg0namespace='" +
+            configInterfaceName(nicType) + "'",
+        [&systemBus](sdbusplus::message_t& msg) {
+            if (msg.is_method_error())
+            {
+                std::cerr << "callback method error\n";
+                return;
+            }
+            getNicNameInfo(systemBus);
+        });
 
-    return 0;
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("intrusion", "intrusionsensor",
+                                           intrusionSensorMain);
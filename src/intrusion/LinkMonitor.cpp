@@ -0,0 +1,287 @@
+#include "LinkMonitor.hpp"
+
+#include <linux/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// Big enough for a page of dump messages, as the kernel recommends
+static constexpr size_t receiveBufferSize = 32 * 1024;
+
+static std::string parseLinkName(std::span<const uint8_t> attributes)
+{
+    while (attributes.size() >= sizeof(rtattr))
+    {
+        rtattr attribute{};
+        std::memcpy(&attribute, attributes.data(), sizeof(attribute));
+        if (attribute.rta_len < sizeof(attribute) ||
+            attribute.rta_len > attributes.size())
+        {
+            break;
+        }
+
+        if (attribute.rta_type == IFLA_IFNAME)
+        {
+            std::span<const uint8_t> value = attributes.subspan(
+                RTA_LENGTH(0), attribute.rta_len - RTA_LENGTH(0));
+            auto end = std::find(value.begin(), value.end(), '\0');
+            return {value.begin(), end};
+        }
+
+        attributes = attributes.subspan(
+            std::min<size_t>(RTA_ALIGN(attribute.rta_len), attributes.size()));
+    }
+
+    return {};
+}
+
+std::vector<LinkEvent> parseLinkMessages(std::span<const uint8_t> buffer)
+{
+    std::vector<LinkEvent> events;
+
+    while (buffer.size() >= sizeof(nlmsghdr))
+    {
+        nlmsghdr header{};
+        std::memcpy(&header, buffer.data(), sizeof(header));
+        if (header.nlmsg_len < sizeof(header) ||
+            header.nlmsg_len > buffer.size())
+        {
+            break;
+        }
+
+        std::span<const uint8_t> message = buffer.first(header.nlmsg_len);
+        buffer = buffer.subspan(
+            std::min<size_t>(NLMSG_ALIGN(header.nlmsg_len), buffer.size()));
+
+        if (header.nlmsg_type != RTM_NEWLINK &&
+            header.nlmsg_type != RTM_DELLINK)
+        {
+            continue;
+        }
+
+        std::span<const uint8_t> payload = message.subspan(
+            std::min<size_t>(NLMSG_HDRLEN, message.size()));
+        if (payload.size() < sizeof(ifinfomsg))
+        {
+            continue;
+        }
+
+        ifinfomsg info{};
+        std::memcpy(&info, payload.data(), sizeof(info));
+        unsigned int carrier = static_cast<unsigned int>(IFF_UP) |
+                               static_cast<unsigned int>(IFF_LOWER_UP);
+        events.emplace_back(
+            info.ifi_index,
+            parseLinkName(payload.subspan(std::min<size_t>(
+                NLMSG_ALIGN(sizeof(info)), payload.size()))),
+            (info.ifi_flags & carrier) == carrier,
+            header.nlmsg_type == RTM_DELLINK);
+    }
+
+    return events;
+}
+
+bool endsDump(std::span<const uint8_t> buffer, uint32_t sequence)
+{
+    while (buffer.size() >= sizeof(nlmsghdr))
+    {
+        nlmsghdr header{};
+        std::memcpy(&header, buffer.data(), sizeof(header));
+        if (header.nlmsg_len < sizeof(header) ||
+            header.nlmsg_len > buffer.size())
+        {
+            break;
+        }
+        buffer = buffer.subspan(
+            std::min<size_t>(NLMSG_ALIGN(header.nlmsg_len), buffer.size()));
+
+        if (header.nlmsg_seq == sequence &&
+            (header.nlmsg_type == NLMSG_DONE ||
+             header.nlmsg_type == NLMSG_ERROR))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+LinkMonitor::LinkMonitor(boost::asio::io_context& io, Handler&& handler) :
+    socket(io), handler(std::move(handler)), buffer(receiveBufferSize)
+{
+    int fd = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                      NETLINK_ROUTE);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to create rtnetlink socket");
+    }
+
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::system_category(),
+                                "Failed to subscribe to link changes");
+    }
+
+    socket.assign(fd);
+}
+
+void LinkMonitor::start()
+{
+    requestDump();
+    receive();
+}
+
+void LinkMonitor::requestDump()
+{
+    if (dumping)
+    {
+        dumpPending = true;
+        return;
+    }
+
+    struct
+    {
+        nlmsghdr header;
+        rtgenmsg message;
+    } request{};
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.message));
+    request.header.nlmsg_type = RTM_GETLINK;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++sequence;
+    request.message.rtgen_family = AF_UNSPEC;
+
+    sockaddr_nl kernel{};
+    kernel.nl_family = AF_NETLINK;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (::sendto(socket.native_handle(), &request, request.header.nlmsg_len, 0,
+                 reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0)
+    {
+        if (errno == EBUSY)
+        {
+            // The previous dump is still running, ask again once it's done
+            --sequence;
+            dumping = true;
+            dumpPending = true;
+            return;
+        }
+        std::cerr << "Failed to request the links: " << std::strerror(errno)
+                  << "\n";
+        return;
+    }
+    dumping = true;
+}
+
+void LinkMonitor::receive()
+{
+    socket.async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [weak{weak_from_this()}](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            auto self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+
+            if (ec)
+            {
+                std::cerr << "Error waiting for link changes: " << ec.message()
+                          << "\n";
+                return;
+            }
+
+            while (true)
+            {
+                ssize_t rc = ::recv(self->socket.native_handle(),
+                                    self->buffer.data(), self->buffer.size(),
+                                    MSG_DONTWAIT);
+                if (rc > 0)
+                {
+                    self->process(std::span(self->buffer).first(rc));
+                    continue;
+                }
+
+                if (rc < 0 && errno == ENOBUFS)
+                {
+                    // Changes were dropped, catch up with the current state
+                    std::cerr << "Link changes overran, resynchronising\n";
+                    self->requestDump();
+                    continue;
+                }
+
+                if (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    std::cerr << "Failed to receive link changes: "
+                              << std::strerror(errno) << "\n";
+                }
+                break;
+            }
+
+            self->receive();
+        });
+}
+
+void LinkMonitor::process(std::span<const uint8_t> messages)
+{
+    if (dumping && endsDump(messages, sequence))
+    {
+        dumping = false;
+    }
+
+    for (LinkEvent& event : parseLinkMessages(messages))
+    {
+        if (event.removed)
+        {
+            state.erase(event.ifindex);
+            continue;
+        }
+
+        auto [link, inserted] = state.try_emplace(event.ifindex, event);
+        if (inserted)
+        {
+            continue;
+        }
+
+        bool changed = link->second.connected != event.connected;
+        link->second = std::move(event);
+        if (changed && handler)
+        {
+            handler(link->second);
+        }
+    }
+
+    if (!dumping && dumpPending)
+    {
+        dumpPending = false;
+        requestDump();
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/container/flat_map.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// The state of a network interface as reported in RTM_NEWLINK / RTM_DELLINK
+struct LinkEvent
+{
+    int ifindex;
+    std::string name;
+    // Administratively up with a carrier, as systemd-networkd's carrier,
+    // degraded and routable operational states all require
+    bool connected;
+    bool removed;
+};
+
+// The link events in a buffer of rtnetlink messages.  Anything else, and
+// anything malformed, is skipped.
+std::vector<LinkEvent> parseLinkMessages(std::span<const uint8_t> buffer);
+
+// Whether buffer holds the NLMSG_DONE, or the error, that ends the dump
+// requested with sequence
+bool endsDump(std::span<const uint8_t> buffer, uint32_t sequence);
+
+// Tracks the carrier state of each network interface straight from the
+// kernel, with an rtnetlink socket subscribed to RTMGRP_LINK.  The links
+// present are dumped when the monitor starts, and again should the socket
+// overrun, so that no change is missed.  The kernel runs one dump at a time
+// per socket, so an overrun during a dump asks for another once it's done.
+class LinkMonitor : public std::enable_shared_from_this<LinkMonitor>
+{
+  public:
+    // Invoked when a link known to the monitor gains or loses its carrier
+    using Handler = std::function<void(const LinkEvent& link)>;
+
+    // Throws std::system_error if the socket can't be set up
+    LinkMonitor(boost::asio::io_context& io, Handler&& handler);
+
+    LinkMonitor(const LinkMonitor&) = delete;
+    LinkMonitor& operator=(const LinkMonitor&) = delete;
+    LinkMonitor(LinkMonitor&&) = delete;
+    LinkMonitor& operator=(LinkMonitor&&) = delete;
+    ~LinkMonitor() = default;
+
+    void start();
+
+    // The links seen so far, by ifindex
+    const boost::container::flat_map<int, LinkEvent>& links() const
+    {
+        return state;
+    }
+
+  private:
+    void requestDump();
+    void receive();
+    void process(std::span<const uint8_t> buffer);
+
+    boost::asio::posix::stream_descriptor socket;
+    Handler handler;
+    boost::container::flat_map<int, LinkEvent> state;
+    uint32_t sequence = 0;
+    // A dump is under way, and another is wanted once it completes
+    bool dumping = false;
+    bool dumpPending = false;
+    std::vector<uint8_t> buffer;
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+
+enum class ReadingFormat
+{
+    byte0,
+    byte3,
+    nineBit,
+    tenBit,
+    elevenBit,
+    elevenBitShift,
+    linearElevenBit,
+    fifteenBit
+};
+
+// Decoders for the readings in IPMB responses, one per ReadingFormat, and for
+// the linear conversion of SDR type 1 readings.  Everything is constexpr, so
+// a sensor binds to its decoder once when configured and each reading is a
+// single indirect call.
+namespace ipmb_reading
+{
+
+// The reading in a response of an accepted length, or nullopt if the
+// response says there's no reading
+using DecodeFn = std::optional<double> (*)(std::span<const uint8_t> data);
+
+struct Decoder
+{
+    // The response lengths the reading can be decoded from
+    size_t minLength;
+    size_t maxLength;
+    DecodeFn decode;
+};
+
+namespace details
+{
+
+constexpr size_t anyLength = std::numeric_limits<size_t>::max();
+
+constexpr int signExtend(unsigned int value, unsigned int bits)
+{
+    unsigned int sign = 1U << (bits - 1);
+    value &= (1U << bits) - 1;
+    return (value & sign) != 0 ? static_cast<int>(value) - (1 << bits)
+                               : static_cast<int>(value);
+}
+
+constexpr unsigned int word(std::span<const uint8_t> data, size_t low)
+{
+    return data[low] | (data[low + 1] << 8);
+}
+
+template <ReadingFormat format>
+constexpr std::optional<double> decode(std::span<const uint8_t> data)
+{
+    if constexpr (format == ReadingFormat::byte0)
+    {
+        return data[0];
+    }
+    else if constexpr (format == ReadingFormat::byte3)
+    {
+        return data[3];
+    }
+    else if constexpr (format == ReadingFormat::elevenBit)
+    {
+        return signExtend(word(data, 3), 16);
+    }
+    else if constexpr (format == ReadingFormat::elevenBitShift)
+    {
+        return word(data, 3) >> 3;
+    }
+    else if constexpr (format == ReadingFormat::linearElevenBit)
+    {
+        return signExtend(word(data, 3), 11);
+    }
+    else
+    {
+        // From the Altra Family SoC BMC Interface Specification:
+        // 0xFFFF – This sensor data is either missing or is not supported
+        // by the device.
+        if (word(data, 0) == 0xffff)
+        {
+            return std::nullopt;
+        }
+
+        if constexpr (format == ReadingFormat::nineBit)
+        {
+            return signExtend(word(data, 0), 9);
+        }
+        else if constexpr (format == ReadingFormat::tenBit)
+        {
+            return word(data, 0) & 0x3ff;
+        }
+        else
+        {
+            // Convert mV to V
+            return (word(data, 0) & 0x7fff) / 1000.0;
+        }
+    }
+}
+
+// byte0 of a Get Sensor Reading response
+constexpr std::optional<double> decodeSensorReading(
+    std::span<const uint8_t> data)
+{
+    constexpr uint8_t readingUnavailableBit = 5;
+
+    // Proper 'Get Sensor Reading' response has at least 4 bytes, including
+    // Completion Code. Our IPMB stack strips Completion Code from payload so
+    // we compare here against the rest of payload
+    if (data.size() < 3 || (data[1] & (1 << readingUnavailableBit)) != 0)
+    {
+        return std::nullopt;
+    }
+    return data[0];
+}
+
+} // namespace details
+
+// In ReadingFormat order
+inline constexpr std::array<Decoder, 8> decoders{{
+    {1, details::anyLength, details::decode<ReadingFormat::byte0>},
+    {4, details::anyLength, details::decode<ReadingFormat::byte3>},
+    {2, 2, details::decode<ReadingFormat::nineBit>},
+    {2, 2, details::decode<ReadingFormat::tenBit>},
+    {5, details::anyLength, details::decode<ReadingFormat::elevenBit>},
+    {5, details::anyLength, details::decode<ReadingFormat::elevenBitShift>},
+    {5, details::anyLength, details::decode<ReadingFormat::linearElevenBit>},
+    {2, 2, details::decode<ReadingFormat::fifteenBit>},
+}};
+
+inline constexpr Decoder sensorReadingDecoder{1, details::anyLength,
+                                              details::decodeSensorReading};
+
+// sensorReading for responses to Get Sensor Reading, whose second byte says
+// whether the reading is available.  Throws std::out_of_range for an unknown
+// format.
+constexpr const Decoder& decoderFor(ReadingFormat format, bool sensorReading)
+{
+    if (format == ReadingFormat::byte0 && sensorReading)
+    {
+        return sensorReadingDecoder;
+    }
+    return decoders.at(static_cast<size_t>(format));
+}
+
+// Up to the first 8 bytes of a response as a little-endian integer, for
+// logging the reading as received
+constexpr uint64_t rawReading(std::span<const uint8_t> data)
+{
+    uint64_t raw = 0;
+    for (size_t i = 0; i < data.size() && i < sizeof(raw); i++)
+    {
+        raw |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    return raw;
+}
+
+constexpr double pow10(int exponent)
+{
+    double value = 1;
+    for (int i = 0; i < exponent; i++)
+    {
+        value *= 10;
+    }
+    for (int i = 0; i > exponent; i--)
+    {
+        value *= 10;
+    }
+    return exponent < 0 ? 1 / value : value;
+}
+
+// The conversion of an SDR type 1 reading x, y = (M * x + B * 10^K1) * 10^K2
+struct Linearization
+{
+    int m = 1;
+    // B * 10^K1
+    double b = 0;
+    // 10^K2
+    double scale = 1;
+
+    constexpr double operator()(double raw) const
+    {
+        return ((m * raw) + b) * scale;
+    }
+
+    bool operator==(const Linearization&) const = default;
+};
+
+// From the M, M tolerance, B, B accuracy and R/B exponent bytes of the record.
+// M and B are 10 bit and the exponents 4 bit two's complement.
+constexpr Linearization linearization(uint8_t mLSB, uint8_t mMSB, uint8_t bLSB,
+                                      uint8_t bMSB, uint8_t exponents)
+{
+    int m = details::signExtend(((mMSB & 0xc0U) << 2) | mLSB, 10);
+    int b = details::signExtend(((bMSB & 0xc0U) << 2) | bLSB, 10);
+    int k1 = details::signExtend(exponents & 0xfU, 4);
+    int k2 = details::signExtend(exponents >> 4, 4);
+    return {m, b * pow10(k1), pow10(k2)};
+}
+
+} // namespace ipmb_reading
@@ -0,0 +1,337 @@
+#include "IpmbRequestScheduler.hpp"
+
+#include "IpmbTransport.hpp"
+#include "Tracing.hpp"
+
+#include <boost/system/error_code.hpp>
+#include <sdbusplus/asio/connection.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+std::optional<IpmbPriority> parseIpmbPriority(std::string_view name)
+{
+    if (name == "High")
+    {
+        return IpmbPriority::high;
+    }
+    if (name == "Normal")
+    {
+        return IpmbPriority::normal;
+    }
+    if (name == "Low")
+    {
+        return IpmbPriority::low;
+    }
+    return std::nullopt;
+}
+
+std::shared_ptr<IpmbRequestScheduler> IpmbRequestScheduler::shared(
+    const std::shared_ptr<sdbusplus::asio::connection>& conn)
+{
+    static std::weak_ptr<IpmbRequestScheduler> instance;
+
+    std::shared_ptr<IpmbRequestScheduler> scheduler = instance.lock();
+    if (!scheduler)
+    {
+        scheduler = std::make_shared<IpmbRequestScheduler>(
+            [transport{IpmbChannelTransport::shared(conn)}](
+                const IpmbRequest& request, Reply&& reply) {
+                transport->send(request, std::move(reply));
+            });
+        instance = scheduler;
+    }
+    return scheduler;
+}
+
+IpmbRequestScheduler::IpmbRequestScheduler(
+    Sender&& sender, tracing::Clock::duration joinWindow) :
+    sender(std::move(sender)), joinWindow(joinWindow)
+{}
+
+void IpmbRequestScheduler::submit(const IpmbTarget& target,
+                                  IpmbPriority priority, IpmbRequest&& request,
+                                  Reply&& reply)
+{
+    Target& entry = targets[target];
+    if (coalesce(entry, priority, request, reply))
+    {
+        entry.metrics.coalesced++;
+        return;
+    }
+
+    std::vector<Reply> replies;
+    replies.emplace_back(std::move(reply));
+    entry.queues[static_cast<size_t>(priority)].emplace_back(
+        std::move(request), std::move(replies), tracing::Clock::now());
+    entry.metrics.queued++;
+    dispatch(target, entry);
+}
+
+bool IpmbRequestScheduler::coalesce(Target& target, IpmbPriority priority,
+                                    const IpmbRequest& request,
+                                    Reply& reply) const
+{
+    for (size_t level = 0; level < target.queues.size(); level++)
+    {
+        std::deque<Pending>& queue = target.queues[level];
+        auto pending = std::ranges::find(queue, request, &Pending::request);
+        if (pending == queue.end())
+        {
+            continue;
+        }
+
+        pending->replies.emplace_back(std::move(reply));
+        auto wanted = static_cast<size_t>(priority);
+        if (wanted < level)
+        {
+            // Goes at the priority of the most urgent submission
+            target.queues[wanted].emplace_back(std::move(*pending));
+            queue.erase(pending);
+        }
+        return true;
+    }
+
+    // One sent longer ago than the window may be answered with a reading
+    // from before the submission
+    tracing::Clock::time_point now = tracing::Clock::now();
+    for (const std::shared_ptr<Pending>& pending : target.inFlight)
+    {
+        if (now - pending->sent < joinWindow && pending->request == request)
+        {
+            pending->replies.emplace_back(std::move(reply));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void IpmbRequestScheduler::setInFlightLimit(const IpmbTarget& target,
+                                            size_t limit)
+{
+    Target& entry = targets[target];
+    entry.limit = std::max<size_t>(limit, 1);
+    dispatch(target, entry);
+}
+
+std::chrono::milliseconds IpmbRequestScheduler::phase(
+    const IpmbTarget& target, std::chrono::milliseconds period,
+    const IpmbRequest& read)
+{
+    std::vector<Phase>& phases = targets[target].phases;
+    for (const Phase& phase : phases)
+    {
+        if (phase.period == period && phase.read == read)
+        {
+            return phase.offset;
+        }
+    }
+
+    // The golden ratio sequence puts each offset in the largest gap left by
+    // the ones before it.  It's shared by all the targets, so that the hosts
+    // of a multi-host platform don't all poll their first sensors together.
+    constexpr double goldenRatio = 0.6180339887498949;
+    double fraction =
+        std::fmod(static_cast<double>(phasesGiven++) * goldenRatio, 1.0);
+    std::chrono::milliseconds offset(
+        static_cast<int64_t>(fraction * static_cast<double>(period.count())));
+    phases.emplace_back(read, period, offset);
+    return offset;
+}
+
+IpmbRequestScheduler::SweepMember IpmbRequestScheduler::joinSweep(
+    uint8_t host)
+{
+    SweepMember member = nextSweepMember++;
+    Sweep& sweep = sweeps[host];
+    if (sweep.members.empty())
+    {
+        sweep.started = tracing::Clock::now();
+    }
+    sweep.members.insert(member);
+    sweep.waiting.insert(member);
+    return member;
+}
+
+void IpmbRequestScheduler::leaveSweep(uint8_t host, SweepMember member)
+{
+    auto findSweep = sweeps.find(host);
+    if (findSweep == sweeps.end())
+    {
+        return;
+    }
+    Sweep& sweep = findSweep->second;
+    sweep.members.erase(member);
+    if (sweep.waiting.erase(member) != 0 && sweep.waiting.empty())
+    {
+        // Not a full sweep, so start over without counting it
+        sweep.waiting = sweep.members;
+        sweep.started = tracing::Clock::now();
+    }
+}
+
+void IpmbRequestScheduler::polled(uint8_t host, SweepMember member)
+{
+    auto findSweep = sweeps.find(host);
+    if (findSweep == sweeps.end())
+    {
+        return;
+    }
+    Sweep& sweep = findSweep->second;
+    if (sweep.waiting.erase(member) == 0 || !sweep.waiting.empty())
+    {
+        return;
+    }
+
+    tracing::Clock::time_point now = tracing::Clock::now();
+    SweepMetrics& metrics = sweep.metrics;
+    metrics.sweeps++;
+    metrics.last = now - sweep.started;
+    metrics.max = std::max(metrics.max, metrics.last);
+    sweep.waiting = sweep.members;
+    sweep.started = now;
+}
+
+std::map<uint8_t, IpmbRequestScheduler::SweepMetrics>
+    IpmbRequestScheduler::sweepMetrics() const
+{
+    std::map<uint8_t, SweepMetrics> snapshot;
+    for (const auto& [host, sweep] : sweeps)
+    {
+        snapshot.emplace(host, sweep.metrics);
+    }
+    return snapshot;
+}
+
+std::map<IpmbTarget, IpmbRequestScheduler::Metrics>
+    IpmbRequestScheduler::metrics() const
+{
+    std::map<IpmbTarget, Metrics> snapshot;
+    for (const auto& [key, target] : targets)
+    {
+        snapshot.emplace(key, target.metrics);
+    }
+    return snapshot;
+}
+
+void IpmbRequestScheduler::dispatch(const IpmbTarget& key, Target& target)
+{
+    while (target.inFlight.size() < target.limit)
+    {
+        auto queue = std::ranges::find_if(
+            target.queues, [](const auto& queue) { return !queue.empty(); });
+        if (queue == target.queues.end())
+        {
+            return;
+        }
+
+        auto pending = std::make_shared<Pending>(std::move(queue->front()));
+        queue->pop_front();
+        pending->sent = tracing::Clock::now();
+        target.inFlight.emplace_back(pending);
+        target.metrics.queued--;
+        target.metrics.inFlight++;
+
+        sender(pending->request,
+               [weak{weak_from_this()}, key,
+                pending](const boost::system::error_code& ec,
+                         const IpmbMethodType& response) {
+                   std::shared_ptr<IpmbRequestScheduler> self = weak.lock();
+                   if (!self)
+                   {
+                       for (const Reply& reply : pending->replies)
+                       {
+                           reply(ec, response);
+                       }
+                       return;
+                   }
+                   self->complete(key, pending, ec, response);
+               });
+    }
+}
+
+void IpmbRequestScheduler::complete(const IpmbTarget& key,
+                                    const std::shared_ptr<Pending>& pending,
+                                    const boost::system::error_code& ec,
+                                    const IpmbMethodType& response)
+{
+    Target& target = targets[key];
+    std::erase(target.inFlight, pending);
+
+    Metrics& metrics = target.metrics;
+    tracing::Clock::duration latency =
+        tracing::Clock::now() - pending->submitted;
+    metrics.inFlight--;
+    metrics.requests++;
+    if (ec || std::get<0>(response) != 0)
+    {
+        metrics.errors++;
+    }
+    metrics.totalLatency += latency;
+    metrics.maxLatency = std::max(metrics.maxLatency, latency);
+    recordMetrics();
+
+    // A submission from a reply is sent afresh
+    for (const Reply& reply : pending->replies)
+    {
+        reply(ec, response);
+    }
+    dispatch(key, target);
+}
+
+void IpmbRequestScheduler::recordMetrics()
+{
+    tracing::Clock::time_point now = tracing::Clock::now();
+    if (now - metricsRecorded < metricsPeriod)
+    {
+        return;
+    }
+    metricsRecorded = now;
+
+    for (auto& [key, target] : targets)
+    {
+        std::string name = "ipmb " + std::to_string(key.bus) + ":" +
+                           std::to_string(key.commandAddress);
+        const Metrics& metrics = target.metrics;
+        Metrics& recorded = target.recorded;
+
+        tracing::counter(name + " queued", static_cast<double>(metrics.queued));
+        tracing::counter(name + " in flight",
+                         static_cast<double>(metrics.inFlight));
+        tracing::counter(name + " coalesced",
+                         static_cast<double>(metrics.coalesced));
+
+        // The mean over the requests since the last record
+        uint64_t requests = metrics.requests - recorded.requests;
+        if (requests != 0)
+        {
+            std::chrono::duration<double, std::milli> latency =
+                metrics.totalLatency - recorded.totalLatency;
+            tracing::counter(name + " latency ms",
+                             latency.count() / static_cast<double>(requests));
+        }
+        recorded = metrics;
+    }
+
+    for (const auto& [host, sweep] : sweeps)
+    {
+        if (sweep.metrics.sweeps == 0)
+        {
+            continue;
+        }
+        std::chrono::duration<double, std::milli> last = sweep.metrics.last;
+        tracing::counter("ipmb host " + std::to_string(host) + " sweep ms",
+                         last.count());
+    }
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "IpmbTransport.hpp"
+#include "Tracing.hpp"
+
+#include <boost/system/error_code.hpp>
+#include <sdbusplus/asio/connection.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <vector>
+
+// Where a request is answered: the responder at commandAddress, which holds
+// the bus index in its upper six bits and the channel on the bus in its lower
+// two.  Requests bridged through the ME all queue on the ME.
+struct IpmbTarget
+{
+    uint8_t bus;
+    uint8_t commandAddress;
+
+    auto operator<=>(const IpmbTarget&) const = default;
+};
+
+enum class IpmbPriority
+{
+    high,
+    normal,
+    low,
+};
+
+// "High", "Normal" or "Low"
+std::optional<IpmbPriority> parseIpmbPriority(std::string_view name);
+
+// Queues the IPMB requests of the sensors per target, so that a slow target
+// has at most a window of requests outstanding rather than one per sensor,
+// with the rest waiting their turn in priority order.  Everything runs on the
+// io_context thread.
+//
+// A request identical to one still queued for the target joins it rather
+// than costing a transaction of its own, and the reply is handed to each
+// submitter.  So does one identical to a request sent within the join window,
+// as sensors given the same phase submit together and the first of them is
+// sent straight away; the reply to one sent longer ago may be too stale to
+// stand for the submission.  Several sensors reading the same register of a
+// device bridged through the ME thus share one bridge transaction.
+//
+// The queue depth, requests outstanding and the latency from submission to
+// reply of each target are recorded as tracing counters.
+//
+// On multi-host platforms the one scheduler serves every host, with the
+// sensors of each host joining a sweep of it.  A sweep completes once each
+// of them has polled, and the time the last sweep of each host took is
+// recorded with the other counters.
+class IpmbRequestScheduler :
+    public std::enable_shared_from_this<IpmbRequestScheduler>
+{
+  public:
+    using Reply = IpmbTransport::Reply;
+    using Sender = std::function<void(const IpmbRequest& request,
+                                      Reply&& reply)>;
+
+    static constexpr size_t defaultInFlight = 2;
+    static constexpr std::chrono::milliseconds defaultJoinWindow{50};
+    static constexpr std::chrono::seconds metricsPeriod{10};
+
+    struct Metrics
+    {
+        size_t queued = 0;
+        size_t inFlight = 0;
+        uint64_t requests = 0;
+        uint64_t errors = 0;
+        // Requests that joined an identical one
+        uint64_t coalesced = 0;
+        tracing::Clock::duration totalLatency{};
+        tracing::Clock::duration maxLatency{};
+    };
+
+    struct SweepMetrics
+    {
+        uint64_t sweeps = 0;
+        tracing::Clock::duration last{};
+        tracing::Clock::duration max{};
+    };
+
+    using SweepMember = uint64_t;
+
+    // The scheduler shared by the sensors in the process, sending on the
+    // transport of each channel
+    static std::shared_ptr<IpmbRequestScheduler> shared(
+        const std::shared_ptr<sdbusplus::asio::connection>& conn);
+
+    explicit IpmbRequestScheduler(
+        Sender&& sender,
+        tracing::Clock::duration joinWindow = defaultJoinWindow);
+
+    void submit(const IpmbTarget& target, IpmbPriority priority,
+                IpmbRequest&& request, Reply&& reply);
+
+    // Requests outstanding to target at once, at least 1
+    void setInFlightLimit(const IpmbTarget& target, size_t limit);
+
+    // The offset into period to first poll a sensor sending read to target
+    // at.  Successive offsets fill the period evenly however many sensors
+    // there turn out to be, across all the targets as well as on each, so
+    // their requests don't arrive together, except that sensors sending the
+    // same read every period are given the same offset, for their reads to be
+    // coalesced.
+    std::chrono::milliseconds phase(const IpmbTarget& target,
+                                    std::chrono::milliseconds period,
+                                    const IpmbRequest& read);
+
+    std::map<IpmbTarget, Metrics> metrics() const;
+
+    // A sensor polling host joins its sweeps, and leaves them when it stops
+    // polling
+    SweepMember joinSweep(uint8_t host);
+    void leaveSweep(uint8_t host, SweepMember member);
+    // Each poll of the sensor, whether or not it got a reading
+    void polled(uint8_t host, SweepMember member);
+
+    std::map<uint8_t, SweepMetrics> sweepMetrics() const;
+
+  private:
+    struct Pending
+    {
+        IpmbRequest request;
+        // One for each submission the request stands for
+        std::vector<Reply> replies;
+        tracing::Clock::time_point submitted;
+        tracing::Clock::time_point sent{};
+    };
+
+    struct Phase
+    {
+        IpmbRequest read;
+        std::chrono::milliseconds period;
+        std::chrono::milliseconds offset;
+    };
+
+    struct Target
+    {
+        std::array<std::deque<Pending>, 3> queues;
+        std::vector<std::shared_ptr<Pending>> inFlight;
+        size_t limit = defaultInFlight;
+        std::vector<Phase> phases;
+        Metrics metrics;
+        Metrics recorded;
+    };
+
+    struct Sweep
+    {
+        std::set<SweepMember> members;
+        // Those yet to poll in this sweep
+        std::set<SweepMember> waiting;
+        tracing::Clock::time_point started;
+        SweepMetrics metrics;
+    };
+
+    bool coalesce(Target& target, IpmbPriority priority,
+                  const IpmbRequest& request, Reply& reply) const;
+    void dispatch(const IpmbTarget& key, Target& target);
+    void complete(const IpmbTarget& key,
+                  const std::shared_ptr<Pending>& pending,
+                  const boost::system::error_code& ec,
+                  const IpmbMethodType& response);
+    void recordMetrics();
+
+    const Sender sender;
+    const tracing::Clock::duration joinWindow;
+    std::map<IpmbTarget, Target> targets;
+    size_t phasesGiven = 0;
+    std::map<uint8_t, Sweep> sweeps;
+    SweepMember nextSweepMember = 0;
+    tracing::Clock::time_point metricsRecorded = tracing::Clock::now();
+};
@@ -0,0 +1,168 @@
+#include "IpmbSDRCache.hpp"
+
+#include "IpmbSDRSensor.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+static constexpr const char* sdrCacheDir = "/var/cache/ipmbsensor";
+
+// Bumped whenever the layout of the cache changes
+static constexpr int sdrCacheVersion = 2;
+
+static constexpr uint32_t timestampUnspecified = 0xffffffff;
+
+bool SDRRepositoryStamp::cacheable() const
+{
+    return additionTimestamp != timestampUnspecified &&
+           eraseTimestamp != timestampUnspecified &&
+           (additionTimestamp != 0 || eraseTimestamp != 0);
+}
+
+std::filesystem::path sdrCachePath(int hostIndex)
+{
+    return std::filesystem::path(sdrCacheDir) /
+           ("sdr-host" + std::to_string(hostIndex) + ".json");
+}
+
+bool loadSDRCache(const std::filesystem::path& path,
+                  const SDRRepositoryStamp& stamp, SDRRecords& records)
+{
+    if (!stamp.cacheable())
+    {
+        return false;
+    }
+
+    std::ifstream file(path);
+    if (!file.good())
+    {
+        return false;
+    }
+
+    nlohmann::json cache = nlohmann::json::parse(file, nullptr, false);
+    if (cache.is_discarded())
+    {
+        std::cerr << "Ignoring corrupt SDR cache " << path << "\n";
+        return false;
+    }
+
+    try
+    {
+        if (cache.at("version").get<int>() != sdrCacheVersion ||
+            cache.at("recordCount").get<uint16_t>() != stamp.recordCount ||
+            cache.at("additionTimestamp").get<uint32_t>() !=
+                stamp.additionTimestamp ||
+            cache.at("eraseTimestamp").get<uint32_t>() != stamp.eraseTimestamp)
+        {
+            return false;
+        }
+
+        SDRRecords loaded;
+        for (const nlohmann::json& sensor : cache.at("sensors"))
+        {
+            SensorInfo& info = loaded.sensors.emplace_back();
+            info.sensorReadName = sensor.at("name").get<std::string>();
+            info.sensorUnit = sensor.at("unit").get<uint8_t>();
+            info.thresUpperCri = sensor.at("upperCritical").get<double>();
+            info.thresLowerCri = sensor.at("lowerCritical").get<double>();
+            info.sensorNumber = sensor.at("number").get<uint8_t>();
+            info.sensCap = sensor.at("capability").get<uint8_t>();
+        }
+        for (const nlohmann::json& conversion : cache.at("conversions"))
+        {
+            SensorValConversion& value =
+                loaded.conversions[conversion.at("number").get<uint8_t>()];
+            value.mValue = conversion.at("m").get<int16_t>();
+            value.bValue = conversion.at("b").get<double>();
+            value.expoVal = conversion.at("exponent").get<double>();
+            value.negRead = conversion.at("negative").get<uint8_t>();
+        }
+        records = std::move(loaded);
+    }
+    catch (const nlohmann::json::exception& e)
+    {
+        std::cerr << "Ignoring invalid SDR cache " << path << ": " << e.what()
+                  << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool saveSDRCache(const std::filesystem::path& path,
+                  const SDRRepositoryStamp& stamp, const SDRRecords& records)
+{
+    if (!stamp.cacheable())
+    {
+        return false;
+    }
+
+    nlohmann::json sensors = nlohmann::json::array();
+    for (const SensorInfo& info : records.sensors)
+    {
+        sensors.push_back({{"name", info.sensorReadName},
+                           {"unit", info.sensorUnit},
+                           {"upperCritical", info.thresUpperCri},
+                           {"lowerCritical", info.thresLowerCri},
+                           {"number", info.sensorNumber},
+                           {"capability", info.sensCap}});
+    }
+
+    nlohmann::json conversions = nlohmann::json::array();
+    for (const auto& [number, value] : records.conversions)
+    {
+        conversions.push_back({{"number", number},
+                               {"m", value.mValue},
+                               {"b", value.bValue},
+                               {"exponent", value.expoVal},
+                               {"negative", value.negRead}});
+    }
+
+    nlohmann::json cache = {{"version", sdrCacheVersion},
+                            {"recordCount", stamp.recordCount},
+                            {"additionTimestamp", stamp.additionTimestamp},
+                            {"eraseTimestamp", stamp.eraseTimestamp},
+                            {"sensors", std::move(sensors)},
+                            {"conversions", std::move(conversions)}};
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec)
+    {
+        std::cerr << "Failed to create " << path.parent_path() << ": "
+                  << ec.message() << "\n";
+        return false;
+    }
+
+    // Write a temporary file and rename it over the cache, so that a crash
+    // part way through can't leave a truncated cache behind
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << cache.dump();
+        if (!file.good())
+        {
+            std::cerr << "Failed to write " << temporary << "\n";
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporary, path, ec);
+    if (ec)
+    {
+        std::cerr << "Failed to replace " << path << ": " << ec.message()
+                  << "\n";
+        std::filesystem::remove(temporary, ec);
+        return false;
+    }
+
+    return true;
+}
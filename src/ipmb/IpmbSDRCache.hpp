@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Identifies the contents of a host's SDR repository, from Get SDR
+// Repository Info.  The timestamps change whenever a record is added or the
+// repository is erased.
+struct SDRRepositoryStamp
+{
+    uint16_t recordCount = 0;
+    uint32_t additionTimestamp = 0;
+    uint32_t eraseTimestamp = 0;
+
+    bool operator==(const SDRRepositoryStamp&) const = default;
+
+    // Controllers without a clock report the timestamps as unspecified, in
+    // which case there's no telling whether the records changed
+    bool cacheable() const;
+};
+
+// Defined with the records themselves, in IpmbSDRSensor.hpp
+struct SDRRecords;
+
+std::filesystem::path sdrCachePath(int hostIndex);
+
+// False if there's no cache at path for a repository matching stamp
+bool loadSDRCache(const std::filesystem::path& path,
+                  const SDRRepositoryStamp& stamp, SDRRecords& records);
+
+bool saveSDRCache(const std::filesystem::path& path,
+                  const SDRRepositoryStamp& stamp, const SDRRecords& records);
@@ -1,27 +1,31 @@
 #include "IpmbSDRSensor.hpp"
 
+#include "IpmbReadingDecoders.hpp"
+#include "IpmbRequestScheduler.hpp"
+#include "IpmbSDRCache.hpp"
+#include "IpmbTransport.hpp"
+
 #include <sdbusplus/asio/connection.hpp>
 
-#include <cmath>
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
 
-const constexpr char* ipmbService = "xyz.openbmc_project.Ipmi.Channel.Ipmb";
-const constexpr char* ipmbDbusPath = "/xyz/openbmc_project/Ipmi/Channel/Ipmb";
-const constexpr char* ipmbInterface = "org.openbmc.Ipmb";
-const constexpr char* ipmbMethod = "sendRequest";
 static constexpr uint8_t lun = 0;
 
 IpmbSDRDevice::IpmbSDRDevice(
     std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
     uint8_t cmdAddr) :
-    commandAddress(cmdAddr << 2), hostIndex(cmdAddr + 1), conn(dbusConnection)
+    commandAddress(cmdAddr << 2), hostIndex(cmdAddr + 1), conn(dbusConnection),
+    scheduler(IpmbRequestScheduler::shared(dbusConnection)),
+    target{cmdAddr, commandAddress}
 {}
 
 bool validateStatus(boost::system::error_code ec,
@@ -42,13 +46,22 @@ bool validateStatus(boost::system::error_code ec,
     return true;
 }
 
+static uint32_t readTimestamp(const std::vector<uint8_t>& data, size_t offset)
+{
+    return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) |
+           (static_cast<uint32_t>(data[offset + 3]) << 24);
+}
+
 /* This function will store the record count of the SDR sensors for each IPMB
  * bus */
 void IpmbSDRDevice::getSDRRepositoryInfo()
 {
     std::weak_ptr<IpmbSDRDevice> weakRef = weak_from_this();
 
-    conn->async_method_call(
+    scheduler->submit(
+        target, IpmbPriority::low,
+        {commandAddress, sdr::netfnStorageReq, lun, sdr::cmdStorageGetSdrInfo,
+         sdrCommandData},
         [weakRef](boost::system::error_code ec,
                   const IpmbMethodType& response) {
             auto self = weakRef.lock();
@@ -80,10 +93,28 @@ void IpmbSDRDevice::getSDRRepositoryInfo()
             uint16_t recordCount = (data[recordCountMSB] << 8) |
                                    data[recordCountLSB];
 
+            /* The records are only downloaded again once a record has been
+             * added or the repository erased since they were cached */
+            constexpr size_t additionTimestamp = 5;
+            constexpr size_t eraseTimestamp = 9;
+
+            self->repositoryStamp = {recordCount,
+                                     readTimestamp(data, additionTimestamp),
+                                     readTimestamp(data, eraseTimestamp)};
+
+            int busIndex = self->hostIndex - 1;
+            SDRRecords records;
+            if (loadSDRCache(sdrCachePath(self->hostIndex),
+                             self->repositoryStamp, records))
+            {
+                sdrRecords[busIndex] = shareSDRRecords(std::move(records));
+                return;
+            }
+
+            sdrRecords.erase(busIndex);
+            self->restarts = 0;
             self->reserveSDRRepository(recordCount);
-        },
-        ipmbService, ipmbDbusPath, ipmbInterface, ipmbMethod, commandAddress,
-        sdr::netfnStorageReq, lun, sdr::cmdStorageGetSdrInfo, sdrCommandData);
+        });
 }
 
 /* This function will store the reserve ID for each IPMB bus index */
@@ -91,7 +122,10 @@ void IpmbSDRDevice::reserveSDRRepository(uint16_t recordCount)
 {
     std::weak_ptr<IpmbSDRDevice> weakRef = weak_from_this();
 
-    conn->async_method_call(
+    scheduler->submit(
+        target, IpmbPriority::low,
+        {commandAddress, sdr::netfnStorageReq, lun, sdr::cmdStorageReserveSdr,
+         sdrCommandData},
         [weakRef, recordCount](boost::system::error_code ec,
                                const IpmbMethodType& response) {
             auto self = weakRef.lock();
@@ -116,213 +150,340 @@ void IpmbSDRDevice::reserveSDRRepository(uint16_t recordCount)
                     << self->hostIndex << "\n";
                 return;
             }
-            uint8_t resrvIDLSB = data[0];
-            uint8_t resrvIDMSB = data[1];
+            uint16_t reservationID = data[0] | (data[1] << 8);
+
+            self->startDownload(recordCount, reservationID);
+        });
+}
+
+/* This function will start reading the records from the first, with the
+ * reservation taken */
+void IpmbSDRDevice::startDownload(uint16_t recordCount, uint16_t reservationID)
+{
+    download++;
+    this->recordCount = recordCount;
+    this->reservationID = reservationID;
+    records.clear();
+    pendingChunks.clear();
+    inFlight = 0;
+    lastRecordQueued = false;
+
+    if (recordCount == 0)
+    {
+        finishDownload();
+        return;
+    }
+    queueRecord(0);
+    requestChunks();
+}
+
+void IpmbSDRDevice::queueRecord(uint16_t id)
+{
+    records.emplace_back(id);
+    lastRecordQueued = records.size() >= recordCount;
 
-            self->getSDRSensorData(recordCount, resrvIDLSB, resrvIDMSB);
-        },
-        ipmbService, ipmbDbusPath, ipmbInterface, ipmbMethod, commandAddress,
-        sdr::netfnStorageReq, lun, sdr::cmdStorageReserveSdr, sdrCommandData);
+    /* The header has to come first, to know how long the record is */
+    pendingChunks.emplace_back(records.size() - 1, 0, chunkSize);
+}
+
+/* This function will keep up to sdr::maxInFlight Get SDR requests
+ * submitted, sent on the scheduler's terms with the rest of the target's
+ * traffic */
+void IpmbSDRDevice::requestChunks()
+{
+    while (inFlight < sdr::maxInFlight && !pendingChunks.empty())
+    {
+        SDRChunk chunk = pendingChunks.front();
+        pendingChunks.pop_front();
+        inFlight++;
+        getSDRSensorData(chunk);
+    }
 }
 
 /* This function will read all the information related to the sensor
  * such as name, threshold value, unit, device address, SDR type */
-void IpmbSDRDevice::getSDRSensorData(uint16_t recordCount, uint8_t resrvIDLSB,
-                                     uint8_t resrvIDMSB)
+void IpmbSDRDevice::getSDRSensorData(const SDRChunk& chunk)
 {
     std::weak_ptr<IpmbSDRDevice> weakRef = weak_from_this();
 
-    uint8_t loopCount = sdr::perCountByte * iCnt;
-    std::vector<uint8_t> commandData = {resrvIDLSB,      resrvIDMSB,
-                                        nextRecordIDLSB, nextRecordIDMSB,
-                                        loopCount,       sdr::perCountByte};
-
-    conn->async_method_call(
-        [weakRef, recordCount, resrvIDLSB, resrvIDMSB](
-            boost::system::error_code ec, const IpmbMethodType& response) {
+    uint16_t recordID = records[chunk.record].id;
+    std::vector<uint8_t> commandData = {
+        static_cast<uint8_t>(reservationID & 0xff),
+        static_cast<uint8_t>(reservationID >> 8),
+        static_cast<uint8_t>(recordID & 0xff),
+        static_cast<uint8_t>(recordID >> 8),
+        chunk.offset,
+        chunk.size};
+
+    scheduler->submit(
+        target, IpmbPriority::low,
+        {commandAddress, sdr::netfnStorageReq, lun, sdr::cmdStorageGetSdr,
+         std::move(commandData)},
+        [weakRef, chunk, download{download}](boost::system::error_code ec,
+                                             const IpmbMethodType& response) {
             auto self = weakRef.lock();
-            if (!self)
+            if (!self || self->download != download)
             {
                 return;
             }
+            self->inFlight--;
 
             auto status = std::bind_front(validateStatus, ec, response);
             if (!status(self->hostIndex))
             {
+                self->failDownload();
                 return;
             }
 
-            const std::vector<uint8_t>& data = std::get<5>(response);
-            const size_t sdrSensorDataSize = 18;
+            self->handleSDRData(chunk, response);
+        });
+}
 
-            if (data.size() < sdrSensorDataSize)
+/* This function will handle the sensor data received by IPMB response */
+void IpmbSDRDevice::handleSDRData(const SDRChunk& chunk,
+                                  const IpmbMethodType& response)
+{
+    uint8_t completionCode = std::get<4>(response);
+    if (completionCode == sdr::ccCannotReturnBytes)
+    {
+        /* The target can't return that many bytes at once, so ask for the
+         * chunk in smaller pieces from now on.  Several requests may be
+         * refused for the one size, so only shrink it on a refusal of a
+         * request no larger than the current size. */
+        if (chunk.size <= chunkSize)
+        {
+            if (chunkSize <= 1)
             {
-                std::cerr << "IPMB SDR sensor data is empty for host "
-                          << self->hostIndex << "\n";
+                failDownload();
                 return;
             }
+            chunkSize = chunkSize == sdr::readWholeRecord
+                            ? sdr::maxChunkSize
+                            : static_cast<uint8_t>(chunkSize / 2);
+        }
+
+        /* Until the record is sized, the rest is asked for after the header
+         * comes in */
+        size_t size = records[chunk.record].sized
+                          ? chunk.size
+                          : std::min(chunk.size, chunkSize);
+        std::vector<SDRChunk> pieces;
+        for (size_t offset = 0; offset < size; offset += chunkSize)
+        {
+            pieces.emplace_back(chunk.record,
+                                static_cast<uint8_t>(chunk.offset + offset),
+                                static_cast<uint8_t>(std::min<size_t>(
+                                    chunkSize, size - offset)));
+        }
+        pendingChunks.insert(pendingChunks.begin(), pieces.begin(),
+                             pieces.end());
+        requestChunks();
+        return;
+    }
+    if (completionCode == sdr::ccReservationCancelled &&
+        restarts < sdr::maxRestarts)
+    {
+        /* Something changed the repository, start over */
+        restarts++;
+        download++;
+        reserveSDRRepository(recordCount);
+        return;
+    }
+    if (completionCode != 0)
+    {
+        std::cerr << "Get SDR failed with completion code 0x" << std::hex
+                  << static_cast<int>(completionCode) << std::dec
+                  << " for host " << hostIndex << "\n";
+        failDownload();
+        return;
+    }
+
+    const std::vector<uint8_t>& data = std::get<5>(response);
+    if (data.size() <= sdr::nextRecordIDSize)
+    {
+        std::cerr << "IPMB SDR sensor data is empty for host " << hostIndex
+                  << "\n";
+        failDownload();
+        return;
+    }
+    std::span<const uint8_t> bytes =
+        std::span(data).subspan(sdr::nextRecordIDSize);
+
+    SDRRecord& record = records[chunk.record];
+    if (!record.sized)
+    {
+        /* Until the header is in, the chunks of the record are read one at
+         * a time, in order */
+        record.data.insert(record.data.end(), bytes.begin(), bytes.end());
+        record.received = record.data.size();
+        if (record.received < sdr::headerSize)
+        {
+            pendingChunks.emplace_front(
+                chunk.record, static_cast<uint8_t>(record.received),
+                std::min<uint8_t>(chunkSize,
+                                  sdr::headerSize - record.received));
+            requestChunks();
+            return;
+        }
+
+        size_t length = sdr::headerSize + record.data[sdr::dataLengthByte];
+        record.data.resize(length);
+        record.received = std::min(record.received, length);
+        record.sized = true;
+
+        /* The rest of the record can be read all at once, along with the
+         * next record, now the response has said which that is */
+        for (size_t offset = record.received; offset < length;)
+        {
+            size_t size = std::min<size_t>(
+                chunkSize == sdr::readWholeRecord ? length - offset : chunkSize,
+                length - offset);
+            pendingChunks.emplace_back(chunk.record,
+                                       static_cast<uint8_t>(offset),
+                                       static_cast<uint8_t>(size));
+            offset += size;
+        }
+
+        uint16_t nextRecordID = data[0] | (data[1] << 8);
+        if (nextRecordID == sdr::lastRecordID)
+        {
+            lastRecordQueued = true;
+        }
+        else if (!lastRecordQueued && chunk.record == records.size() - 1)
+        {
+            queueRecord(nextRecordID);
+        }
+    }
+    else
+    {
+        size_t size = std::min<size_t>(bytes.size(), chunk.size);
+        std::copy_n(bytes.begin(), size, record.data.begin() + chunk.offset);
+        record.received += size;
+        if (size < chunk.size)
+        {
+            pendingChunks.emplace_front(chunk.record, chunk.offset + size,
+                                        chunk.size - size);
+        }
+    }
+
+    requestChunks();
 
-            self->handleSDRData(data, recordCount, resrvIDLSB, resrvIDMSB);
-        },
-        ipmbService, ipmbDbusPath, ipmbInterface, ipmbMethod, commandAddress,
-        sdr::netfnStorageReq, lun, sdr::cmdStorageGetSdr, commandData);
+    if (lastRecordQueued && inFlight == 0 && pendingChunks.empty())
+    {
+        finishDownload();
+    }
 }
 
-/* This function will handle the sensor data received by IPMB response */
-void IpmbSDRDevice::handleSDRData(const std::vector<uint8_t>& data,
-                                  uint16_t recordCount, uint8_t resrvIDLSB,
-                                  uint8_t resrvIDMSB)
+void IpmbSDRDevice::failDownload()
 {
-    sdrData.insert(sdrData.end(), data.begin(), data.end());
-
-    /* dataLength represents the size of data for SDR types */
-    uint8_t dataLength = sdrData[sdr::dataLengthByte] + sdr::dataLengthByte + 1;
+    download++;
+    records.clear();
+    pendingChunks.clear();
+    inFlight = 0;
+}
 
-    /*  If sdrData size is less than dataLength, it will call getSDRSensorData
-     *  function recursively till all the data is received.
-     */
-    if (sdrData.size() < dataLength)
+/* This function will parse the records downloaded, in one pass, and cache
+ * them */
+void IpmbSDRDevice::finishDownload()
+{
+    SDRRecords parsed;
+    for (const SDRRecord& record : records)
     {
-        iCnt++;
-        getSDRSensorData(recordCount, resrvIDLSB, resrvIDMSB);
+        checkSDRData(record.data, parsed);
     }
-    else
+    records.clear();
+
+    saveSDRCache(sdrCachePath(hostIndex), repositoryStamp, parsed);
+    sdrRecords[hostIndex - 1] = shareSDRRecords(std::move(parsed));
+}
+
+std::shared_ptr<const SDRRecords> shareSDRRecords(SDRRecords&& records)
+{
+    static std::vector<std::weak_ptr<const SDRRecords>> tables;
+
+    std::erase_if(tables, [](const auto& table) { return table.expired(); });
+    for (const std::weak_ptr<const SDRRecords>& table : tables)
     {
-        /*  After all the data is received, it is passed to checkSDRData
-         *  function. Next sensor record ID is stored based on the previous
-         *  record ID. Vector of sdrData is cleared to store next sensor data.
-         *  validRecordCount is incremented and getSDRSensorData function is
-         *  called to proceed with next set of sensors.
-         */
-        checkSDRData(sdrData, dataLength);
-        iCnt = 0;
-        nextRecordIDLSB = sdrData[sdr::sdrNxtRecLSB];
-        nextRecordIDMSB = sdrData[sdr::sdrNxtRecMSB];
-        sdrData.clear();
-
-        if (validRecordCount == recordCount)
+        std::shared_ptr<const SDRRecords> shared = table.lock();
+        if (*shared == records)
         {
-            /* Once all the sensors are read and recordCount matched, it will
-             * return. */
-            nextRecordIDLSB = 0;
-            nextRecordIDMSB = 0;
-            return;
+            return shared;
         }
-        validRecordCount++;
-        getSDRSensorData(recordCount, resrvIDLSB, resrvIDMSB);
     }
+
+    auto shared = std::make_shared<const SDRRecords>(std::move(records));
+    tables.emplace_back(shared);
+    return shared;
 }
 
 /* This function will convert the SDR sensor data such as sensor unit, name, ID,
  * type from decimal to readable format */
-void IpmbSDRDevice::checkSDRData(std::vector<uint8_t>& sdrDataBytes,
-                                 uint8_t dataLength) const
+void IpmbSDRDevice::checkSDRData(const std::vector<uint8_t>& sdrDataBytes,
+                                 SDRRecords& parsed)
 {
-    if (sdrDataBytes.size() < dataLength)
+    if (sdrDataBytes.size() <= sdrtype01::nameLengthByte)
     {
         return;
     }
 
-    /* sdrType represents the SDR Type (Byte 5) such as 1, 2, 3 */
+    /* sdrType represents the SDR Type (Byte 4) such as 1, 2, 3 */
     uint8_t sdrType = sdrDataBytes[sdr::sdrType];
     if (sdrType != static_cast<uint8_t>(SDRType::sdrType01))
     {
         return;
     }
 
-    /*  dataLen represents the data length (Byte 6) for SDR sensor */
-    int dataLen = sdrDataBytes[sdr::dataLengthByte];
-
-    /* iStrLen represents the length of the sensor name for SDR Type 1 */
+    /* strLen represents the length of the sensor name for SDR Type 1, which
+     * starts at byte 49 */
     const uint8_t sdrLenBit = 0x1F;
-    int strLen = (sdrDataBytes[sdrtype01::nameLengthByte]) & (sdrLenBit);
-
-    /* iStrAddr represents the starting byte (Byte 56) for SDR sensor name */
-    int strAddr = dataLen + ((dataLen / (sdr::perCountByte)) * 4) -
-                  (strLen - 1);
+    size_t strLen = (sdrDataBytes[sdrtype01::nameLengthByte]) & (sdrLenBit);
+    strLen = std::min(strLen, sdrDataBytes.size() - sdrtype01::nameByte);
 
-    /* Below for loop will convert the bytes to string and form a sensor name */
+    std::string tempName(sdrDataBytes.begin() + sdrtype01::nameByte,
+                         sdrDataBytes.begin() + sdrtype01::nameByte + strLen);
 
-    std::string tempName(sdrDataBytes.begin() + strAddr,
-                         sdrDataBytes.begin() + strAddr + strLen);
-
-    checkSDRType01Threshold(sdrDataBytes, (hostIndex - 1), tempName);
+    checkSDRType01Threshold(sdrDataBytes, parsed, tempName);
 }
 
 /* This function will convert the raw value of threshold for each sensor */
-void IpmbSDRDevice::checkSDRType01Threshold(std::vector<uint8_t>& sdrDataBytes,
-                                            int busIndex, std::string tempName)
+void IpmbSDRDevice::checkSDRType01Threshold(
+    const std::vector<uint8_t>& sdrDataBytes, SDRRecords& parsed,
+    std::string tempName)
 {
-    const uint8_t bitShiftMsb = 2;
     const uint8_t sdrThresAccess = 0x0C;
 
-    /* linear represents the sensor's linearization (Byte 27) */
-    uint8_t linear = sdrDataBytes[sdrtype01::sdrLinearByte];
-    if (linear != 0)
+    /* linearization (Byte 24) other than linear isn't supported */
+    if (sdrDataBytes[sdrtype01::sdrLinearByte] != 0)
     {
         return;
     }
 
-    /* sdrSensCapability (Byte 13) and(&) with sdrThresAccess(0x0C) will declare
+    /* sdrSensCapability (Byte 12) and(&) with sdrThresAccess(0x0C) will declare
      * whether threshold is present for each sensor */
     int threshold = (sdrDataBytes[sdrtype01::sensorCapability]) &
                     (sdrThresAccess);
 
-    /* mData        - 10 bits
-     * mDataByte    - Byte 28 - 8 bits LSB
-     * mTolDataByte - Byte 29 - 2 bits MSB [7-6]
-     */
-    uint16_t mData =
-        ((sdrDataBytes[sdrtype01::mTolDataByte] & 0xC0) << bitShiftMsb) |
-        sdrDataBytes[sdrtype01::mDataByte];
-
-    /* bData        - 10 bits
-     * bDataByte    - Byte 30 - 8 bits LSB
-     * bAcuDataByte - Byte 31 - 2 bits MSB [7-6]
-     */
-    uint16_t bData =
-        ((sdrDataBytes[sdrtype01::bAcuDataByte] & 0xC0) << bitShiftMsb) |
-        sdrDataBytes[sdrtype01::bDataByte];
-
-    /* rbExpDataByte (Byte 33) represents the exponent value
-     *  Bit [3-0] - B Exponent 2's complement signed bit.
-     *  Bit [7-4] - R Exponent 2's complement signed bit.
-     */
-    int8_t bExpVal = sdrDataBytes[sdrtype01::rbExpDataByte] & 0xF;
-    if (bExpVal > 7)
-    {
-        bExpVal = (~bExpVal + 1) & 0xF;
-    }
-
-    /* Shifting the data to right by 4, since rExpVal has 4 bits from 4 to 7 in
-     * byte 33 */
-    int8_t rExpVal = (sdrDataBytes[sdrtype01::rbExpDataByte] >> 4) & 0xF;
-    if (rExpVal > 7)
-    {
-        rExpVal = (~rExpVal + 1) & 0xF;
-        rExpVal = -rExpVal;
-    }
-
     /* Sensor Threshold Reading Conversion
      *
      *  Y = ((Mx + (B * 10^K1)) * (10^K2))
      *
      *  X  - Raw value of threshold
-     *  M  - mData Value
-     *  B  - bData Value
-     *  K1 - Signed Exponent of bExpVal
-     *  K2 - Signed Exponent of rExpVal
+     *  M  - 10 bits, LSB in Byte 25 and MSB [7-6] of Byte 26
+     *  B  - 10 bits, LSB in Byte 27 and MSB [7-6] of Byte 28
+     *  K1 - B Exponent, Bit [3-0] of Byte 30
+     *  K2 - R Exponent, Bit [7-4] of Byte 30
      */
-
-    double bDataVal = bData * pow(10, bExpVal);
-    double expVal = pow(10, rExpVal);
+    ipmb_reading::Linearization linear = ipmb_reading::linearization(
+        sdrDataBytes[sdrtype01::mDataByte],
+        sdrDataBytes[sdrtype01::mTolDataByte],
+        sdrDataBytes[sdrtype01::bDataByte],
+        sdrDataBytes[sdrtype01::bAcuDataByte],
+        sdrDataBytes[sdrtype01::rbExpDataByte]);
 
     double thresUpCri =
-        sensorValCalculation(mData, bDataVal, expVal,
-                             sdrDataBytes[sdrtype01::upperCriticalThreshold]);
+        linear(sdrDataBytes[sdrtype01::upperCriticalThreshold]);
     double thresLoCri =
-        sensorValCalculation(mData, bDataVal, expVal,
-                             sdrDataBytes[sdrtype01::lowerCriticalThreshold]);
+        linear(sdrDataBytes[sdrtype01::lowerCriticalThreshold]);
 
     struct SensorInfo temp;
 
@@ -335,18 +496,11 @@ void IpmbSDRDevice::checkSDRType01Threshold(std::vector<uint8_t>& sdrDataBytes,
     temp.sensorNumber = sdrDataBytes[sdr::sdrSensorNum];
     temp.sensCap = threshold;
 
-    sensorRecord[busIndex].emplace_back(std::move(temp));
+    parsed.sensors.emplace_back(std::move(temp));
 
-    SensorValConversion val = {mData, bDataVal, expVal,
+    SensorValConversion val = {static_cast<int16_t>(linear.m), linear.b,
+                               linear.scale,
                                sdrDataBytes[sdrtype01::sdrNegHandle]};
 
-    sensorValRecord[busIndex][sdrDataBytes[sdr::sdrSensorNum]] = val;
-}
-
-/* This function will calculate the sensor's threshold value */
-double IpmbSDRDevice::sensorValCalculation(uint16_t mValue, double bValue,
-                                           double expValue, double value)
-{
-    double sensorValue = ((mValue * value) + bValue) * expValue;
-    return sensorValue;
+    parsed.conversions[sdrDataBytes[sdr::sdrSensorNum]] = val;
 }
@@ -1,9 +1,17 @@
 #pragma once
 
+#include "IpmbRequestScheduler.hpp"
+#include "IpmbSDRCache.hpp"
+#include "IpmbTransport.hpp"
+
 #include <sensor.hpp>
 
-using IpmbMethodType =
-    std::tuple<int, uint8_t, uint8_t, uint8_t, uint8_t, std::vector<uint8_t>>;
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
 
 enum class SDRType
 {
@@ -20,15 +28,28 @@ static constexpr uint8_t cmdStorageGetSdrInfo = 0x20;
 static constexpr uint8_t cmdStorageReserveSdr = 0x22;
 static constexpr uint8_t cmdStorageGetSdr = 0x23;
 
-// Get SDR Commands
-static constexpr uint8_t sdrNxtRecLSB = 0;
-static constexpr uint8_t sdrNxtRecMSB = 1;
-static constexpr uint8_t perCountByte = 16;
+// Completion Codes
+static constexpr uint8_t ccReservationCancelled = 0xc5;
+static constexpr uint8_t ccCannotReturnBytes = 0xca;
 
-// Sensor Record Bytes
-static constexpr uint8_t sdrType = 5;
-static constexpr uint8_t dataLengthByte = 6;
-static constexpr uint8_t sdrSensorNum = 9;
+// Get SDR Commands
+static constexpr uint16_t lastRecordID = 0xffff;
+static constexpr uint8_t readWholeRecord = 0xff;
+// The next record ID ahead of the record bytes in the response
+static constexpr size_t nextRecordIDSize = 2;
+// The chunk tried once reading whole records is refused, halved from there
+static constexpr uint8_t maxChunkSize = 32;
+// Get SDR requests submitted at once, of which the scheduler sends as many
+// as the target's in-flight limit allows
+static constexpr size_t maxInFlight = 4;
+// Downloads restarted on the reservation being cancelled before giving up
+static constexpr unsigned int maxRestarts = 3;
+
+// Sensor Record Bytes, as offsets into the record
+static constexpr uint8_t headerSize = 5;
+static constexpr uint8_t sdrType = 3;
+static constexpr uint8_t dataLengthByte = 4;
+static constexpr uint8_t sdrSensorNum = 7;
 
 } // namespace sdr
 
@@ -40,20 +61,21 @@ static constexpr uint8_t twosCompVal = 128;
 static constexpr double thermalConst = 256;
 
 static constexpr uint8_t sdrSensNoThres = 0;
-static constexpr uint8_t sensorCapability = 13;
-static constexpr uint8_t sdrNegHandle = 24;
-static constexpr uint8_t sdrUnitType = 25;
-static constexpr uint8_t sdrLinearByte = 27;
+static constexpr uint8_t sensorCapability = 11;
+static constexpr uint8_t sdrNegHandle = 20;
+static constexpr uint8_t sdrUnitType = 21;
+static constexpr uint8_t sdrLinearByte = 23;
 
 // SDR Type 1 Thresholds Commands
-static constexpr uint8_t mDataByte = 28;
-static constexpr uint8_t mTolDataByte = 29;
-static constexpr uint8_t bDataByte = 30;
-static constexpr uint8_t bAcuDataByte = 31;
-static constexpr uint8_t rbExpDataByte = 33;
-static constexpr uint8_t upperCriticalThreshold = 43;
-static constexpr uint8_t lowerCriticalThreshold = 46;
-static constexpr uint8_t nameLengthByte = 53;
+static constexpr uint8_t mDataByte = 24;
+static constexpr uint8_t mTolDataByte = 25;
+static constexpr uint8_t bDataByte = 26;
+static constexpr uint8_t bAcuDataByte = 27;
+static constexpr uint8_t rbExpDataByte = 29;
+static constexpr uint8_t upperCriticalThreshold = 37;
+static constexpr uint8_t lowerCriticalThreshold = 40;
+static constexpr uint8_t nameLengthByte = 47;
+static constexpr uint8_t nameByte = 48;
 
 } // namespace sdrtype01
 
@@ -65,18 +87,35 @@ struct SensorInfo
     double thresLowerCri = 0;
     uint8_t sensorNumber = 0;
     uint8_t sensCap = 0;
+
+    bool operator==(const SensorInfo&) const = default;
 };
 
 struct SensorValConversion
 {
-    uint16_t mValue = 0;
+    int16_t mValue = 0;
     double bValue = 0;
     double expoVal = 0;
     uint8_t negRead = 0;
+
+    bool operator==(const SensorValConversion&) const = default;
 };
 
-inline std::map<int, std::vector<SensorInfo>> sensorRecord;
-inline std::map<int, std::map<uint8_t, SensorValConversion>> sensorValRecord;
+// The records parsed from a host's SDR repository
+struct SDRRecords
+{
+    std::vector<SensorInfo> sensors;
+    std::map<uint8_t, SensorValConversion> conversions;
+
+    bool operator==(const SDRRecords&) const = default;
+};
+
+// The records of each host by bus index.  The hosts of a multi-host platform
+// mostly have identical SDRs, and those share a single table.
+inline std::map<int, std::shared_ptr<const SDRRecords>> sdrRecords;
+
+// A table equal to records already held by some host, else records
+std::shared_ptr<const SDRRecords> shareSDRRecords(SDRRecords&& records);
 
 class IpmbSDRDevice : public std::enable_shared_from_this<IpmbSDRDevice>
 {
@@ -88,31 +127,66 @@ class IpmbSDRDevice : public std::enable_shared_from_this<IpmbSDRDevice>
     int hostIndex = 0;
 
     std::shared_ptr<sdbusplus::asio::connection> conn;
-
-    std::vector<uint8_t> sdrData;
-    uint16_t validRecordCount = 1;
-    uint8_t iCnt = 0;
-    uint8_t nextRecordIDLSB = 0;
-    uint8_t nextRecordIDMSB = 0;
+    std::shared_ptr<IpmbRequestScheduler> scheduler;
+    IpmbTarget target;
 
     std::vector<uint8_t> sdrCommandData;
+    SDRRepositoryStamp repositoryStamp;
 
     void getSDRRepositoryInfo();
 
     void reserveSDRRepository(uint16_t recordCount);
 
-    void getSDRSensorData(uint16_t recordCount, uint8_t resrvIDLSB,
-                          uint8_t resrvIDMSB);
-
-    void handleSDRData(const std::vector<uint8_t>& data, uint16_t recordCount,
-                       uint8_t resrvIDLSB, uint8_t resrvIDMSB);
-
-    void checkSDRData(std::vector<uint8_t>& sdrDataBytes,
-                      uint8_t dataLength) const;
-
-    static void checkSDRType01Threshold(std::vector<uint8_t>& sdrDataBytes,
-                                        int busIndex, std::string tempName);
-
-    inline static double sensorValCalculation(uint16_t mValue, double bValue,
-                                              double expValue, double value);
+    /* A record being downloaded.  Its bytes are read into place, sized once
+     * the record header is known. */
+    struct SDRRecord
+    {
+        uint16_t id = 0;
+        std::vector<uint8_t> data;
+        size_t received = 0;
+        bool sized = false;
+    };
+
+    /* The bytes of a record asked for by one Get SDR request */
+    struct SDRChunk
+    {
+        size_t record;
+        uint8_t offset;
+        uint8_t size;
+    };
+
+    void startDownload(uint16_t recordCount, uint16_t reservationID);
+
+    void requestChunks();
+
+    void getSDRSensorData(const SDRChunk& chunk);
+
+    void handleSDRData(const SDRChunk& chunk, const IpmbMethodType& response);
+
+    void finishDownload();
+
+    static void checkSDRData(const std::vector<uint8_t>& sdrDataBytes,
+                             SDRRecords& parsed);
+
+    static void checkSDRType01Threshold(
+        const std::vector<uint8_t>& sdrDataBytes, SDRRecords& parsed,
+        std::string tempName);
+
+  private:
+    void queueRecord(uint16_t id);
+    void failDownload();
+
+    uint16_t recordCount = 0;
+    uint16_t reservationID = 0;
+    std::vector<SDRRecord> records;
+    std::deque<SDRChunk> pendingChunks;
+    size_t inFlight = 0;
+    // Bytes asked for per Get SDR, shrunk whenever the target refuses
+    uint8_t chunkSize = sdr::readWholeRecord;
+    // Bumped by each download so that the replies to an abandoned one are
+    // ignored
+    unsigned int download = 0;
+    // Restarts of the download in progress
+    unsigned int restarts = 0;
+    bool lastRecordQueued = false;
 };
@@ -16,7 +16,11 @@
 
 #include "IpmbSensor.hpp"
 
+#include "IpmbReadingDecoders.hpp"
+#include "IpmbRequestScheduler.hpp"
 #include "IpmbSDRSensor.hpp"
+#include "IpmbTransport.hpp"
+#include "SensorConfig.hpp"
 #include "SensorPaths.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
@@ -27,6 +31,7 @@
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
 #include <sdbusplus/asio/connection.hpp>
 #include <sdbusplus/asio/object_server.hpp>
 #include <sdbusplus/message.hpp>
@@ -37,11 +42,15 @@
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <system_error>
 #include <tuple>
 #include <utility>
 #include <variant>
@@ -54,9 +63,6 @@ static constexpr double ipmbMinReading = 0;
 
 static constexpr uint8_t meAddress = 1;
 static constexpr uint8_t lun = 0;
-static constexpr uint8_t hostSMbusIndexDefault = 0x03;
-static constexpr uint8_t ipmbBusIndexDefault = 0;
-static constexpr float pollRateDefault = 1; // in seconds
 
 static constexpr const char* sensorPathPrefix = "/xyz/openbmc_project/sensors/";
 
@@ -72,7 +78,7 @@ IpmbSensor::IpmbSensor(
            ipmbMinReading, conn, PowerState::on),
     deviceAddress(deviceAddress), hostSMbusIndex(hostSMbusIndex),
     sensorPollMs(static_cast<int>(pollRate * 1000)), objectServer(objectServer),
-    waitTimer(io)
+    scheduler(IpmbRequestScheduler::shared(conn)), waitTimer(io)
 {
     std::string dbusPath = sensorPathPrefix + sensorTypeName + "/" + name;
 
@@ -91,6 +97,10 @@ IpmbSensor::IpmbSensor(
 IpmbSensor::~IpmbSensor()
 {
     waitTimer.cancel();
+    if (sweepMember)
+    {
+        scheduler->leaveSweep(busIndex, *sweepMember);
+    }
     for (const auto& iface : thresholdInterfaces)
     {
         objectServer.remove_interface(iface);
@@ -122,6 +132,79 @@ void IpmbSensor::init()
 {
     loadDefaults();
     setInitialProperties(getSubTypeUnits());
+
+    // The bridge picks the bus by the upper bits of the commandAddress and the
+    // channel on it by the lower two, as for an IpmbChannel
+    commandAddress = static_cast<uint8_t>((busIndex << 2) | commandAddress);
+    target = {busIndex, commandAddress};
+    if (!priority)
+    {
+        // The VR temperatures feed fan control, so they shouldn't wait behind
+        // slower reads on the ME
+        bool vrTemp = type == IpmbType::PXE1410CVR ||
+                      type == IpmbType::IR38363VR || type == IpmbType::mpsVR;
+        priority = vrTemp ? IpmbPriority::high : IpmbPriority::normal;
+    }
+    if (maxInFlight != 0)
+    {
+        scheduler->setInFlightLimit(target, maxInFlight);
+    }
+
+    if (hostDependent() && !readyTargets.contains(target))
+    {
+        // Resumed by the daemon once the target answers
+        suspended = true;
+        return;
+    }
+    resume(std::chrono::milliseconds(0));
+}
+
+bool IpmbSensor::hostDependent() const
+{
+    return readState == PowerState::on || readState == PowerState::biosPost;
+}
+
+bool IpmbSensor::readingStateGood() const
+{
+    // The daemon follows host power itself, resuming the sensor as soon as the
+    // ME answers rather than after the settle time readingStateGood() allows
+    if (hostDependent())
+    {
+        return !suspended &&
+               (readState != PowerState::biosPost || hasBiosPost(slotId));
+    }
+    return Sensor::readingStateGood();
+}
+
+void IpmbSensor::suspend()
+{
+    if (suspended)
+    {
+        return;
+    }
+    suspended = true;
+    waitTimer.cancel();
+    if (sweepMember)
+    {
+        scheduler->leaveSweep(busIndex, *sweepMember);
+        sweepMember.reset();
+    }
+    updateValue(std::numeric_limits<double>::quiet_NaN());
+}
+
+void IpmbSensor::resume(std::chrono::milliseconds delay)
+{
+    suspended = false;
+    if (!sweepMember)
+    {
+        sweepMember = scheduler->joinSweep(busIndex);
+    }
+    std::chrono::milliseconds period(sensorPollMs);
+    nextPoll = std::chrono::steady_clock::now() + delay +
+               scheduler->phase(target, period,
+                                {commandAddress, netfn, lun, command,
+                                 commandData});
+
     if (initCommand)
     {
         runInitCmd();
@@ -152,14 +235,14 @@ void IpmbSensor::runInitCmd()
     {
         return;
     }
-    dbusConnection->async_method_call(
+    // Ahead of the reads queued, which depend on it
+    scheduler->submit(
+        target, IpmbPriority::high,
+        {commandAddress, netfn, lun, *initCommand, initData},
         [weakRef{weak_from_this()}](const boost::system::error_code& ec,
                                     const IpmbMethodType& response) {
             initCmdCb(weakRef, ec, response);
-        },
-        "xyz.openbmc_project.Ipmi.Channel.Ipmb",
-        "/xyz/openbmc_project/Ipmi/Channel/Ipmb", "org.openbmc.Ipmb",
-        "sendRequest", commandAddress, netfn, lun, *initCommand, initData);
+        });
 }
 
 void IpmbSensor::loadDefaults()
@@ -280,6 +363,9 @@ void IpmbSensor::loadDefaults()
         throw std::runtime_error("Invalid sensor type");
     }
 
+    decoder = &ipmb_reading::decoderFor(
+        readingFormat, command == ipmi::sensor::getSensorReading);
+
     if (subType == IpmbSubType::util)
     {
         // Utilization need to be scaled to percent
@@ -293,135 +379,45 @@ void IpmbSensor::checkThresholds()
     thresholds::checkThresholds(this);
 }
 
-bool IpmbSensor::processReading(ReadingFormat readingFormat, uint8_t command,
-                                const std::vector<uint8_t>& data, double& resp,
-                                size_t errCount)
+static bool decodeReading(const ipmb_reading::Decoder& decoder,
+                          std::span<const uint8_t> data, double& resp,
+                          size_t errCount)
 {
-    switch (readingFormat)
+    if (data.size() < decoder.minLength || data.size() > decoder.maxLength)
     {
-        case (ReadingFormat::byte0):
-        {
-            if (command == ipmi::sensor::getSensorReading &&
-                !ipmi::sensor::isValid(data))
-            {
-                return false;
-            }
-            resp = data[0];
-            return true;
-        }
-        case (ReadingFormat::byte3):
-        {
-            if (data.size() < 4)
-            {
-                if (errCount == 0U)
-                {
-                    std::cerr << "Invalid data length returned\n";
-                }
-                return false;
-            }
-            resp = data[3];
-            return true;
-        }
-        case (ReadingFormat::nineBit):
-        case (ReadingFormat::tenBit):
-        case (ReadingFormat::fifteenBit):
+        if (errCount == 0U)
         {
-            if (data.size() != 2)
-            {
-                if (errCount == 0U)
-                {
-                    std::cerr << "Invalid data length returned\n";
-                }
-                return false;
-            }
-
-            // From the Altra Family SoC BMC Interface Specification:
-            // 0xFFFF – This sensor data is either missing or is not supported
-            // by the device.
-            if ((data[0] == 0xff) && (data[1] == 0xff))
-            {
-                return false;
-            }
-
-            if (readingFormat == ReadingFormat::nineBit)
-            {
-                int16_t value = data[0];
-                if ((data[1] & 0x1) != 0)
-                {
-                    // Sign extend to 16 bits
-                    value |= 0xFF00;
-                }
-                resp = value;
-            }
-            else if (readingFormat == ReadingFormat::tenBit)
-            {
-                uint16_t value = ((data[1] & 0x3) << 8) + data[0];
-                resp = value;
-            }
-            else if (readingFormat == ReadingFormat::fifteenBit)
-            {
-                uint16_t value = ((data[1] & 0x7F) << 8) + data[0];
-                // Convert mV to V
-                resp = value / 1000.0;
-            }
-
-            return true;
+            std::cerr << "Invalid data length returned\n";
         }
-        case (ReadingFormat::elevenBit):
-        {
-            if (data.size() < 5)
-            {
-                if (errCount == 0U)
-                {
-                    std::cerr << "Invalid data length returned\n";
-                }
-                return false;
-            }
-
-            int16_t value = ((data[4] << 8) | data[3]);
-            resp = value;
-            return true;
-        }
-        case (ReadingFormat::elevenBitShift):
-        {
-            if (data.size() < 5)
-            {
-                if (errCount == 0U)
-                {
-                    std::cerr << "Invalid data length returned\n";
-                }
-                return false;
-            }
-
-            resp = ((data[4] << 8) | data[3]) >> 3;
-            return true;
-        }
-        case (ReadingFormat::linearElevenBit):
-        {
-            if (data.size() < 5)
-            {
-                if (errCount == 0U)
-                {
-                    std::cerr << "Invalid data length returned\n";
-                }
-                return false;
-            }
+        return false;
+    }
 
-            int16_t value = ((data[4] << 8) | data[3]);
-            constexpr const size_t shift = 16 - 11; // 11bit into 16bit
-            value <<= shift;
-            value >>= shift;
-            resp = value;
-            return true;
-        }
-        default:
-            throw std::runtime_error("Invalid reading type");
+    std::optional<double> reading = decoder.decode(data);
+    if (!reading)
+    {
+        return false;
     }
+    resp = *reading;
+    return true;
+}
+
+bool IpmbSensor::processReading(ReadingFormat readingFormat, uint8_t command,
+                                const std::vector<uint8_t>& data, double& resp,
+                                size_t errCount)
+{
+    return decodeReading(
+        ipmb_reading::decoderFor(readingFormat,
+                                 command == ipmi::sensor::getSensorReading),
+        data, resp, errCount);
 }
 
 void IpmbSensor::ipmbRequestCompletionCb(const boost::system::error_code& ec,
                                          const IpmbMethodType& response)
 {
+    if (sweepMember)
+    {
+        scheduler->polled(busIndex, *sweepMember);
+    }
     const int& status = std::get<0>(response);
     if (ec || (status != 0))
     {
@@ -448,7 +444,7 @@ void IpmbSensor::ipmbRequestCompletionCb(const boost::system::error_code& ec,
 
     double value = 0;
 
-    if (!processReading(readingFormat, command, data, value, errCount))
+    if (!decodeReading(*decoder, data, value, errCount))
     {
         incrementError();
         read();
@@ -457,14 +453,7 @@ void IpmbSensor::ipmbRequestCompletionCb(const boost::system::error_code& ec,
 
     // rawValue only used in debug logging
     // up to 5th byte in data are used to derive value
-    size_t end = std::min(sizeof(uint64_t), data.size());
-    uint64_t rawData = 0;
-    for (size_t i = 0; i < end; i++)
-    {
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-        reinterpret_cast<uint8_t*>(&rawData)[i] = data[i];
-    }
-    rawValue = static_cast<double>(rawData);
+    rawValue = static_cast<double>(ipmb_reading::rawReading(data));
 
     /* Adjust value as per scale and offset */
     value = (value * scaleVal) + offsetVal;
@@ -474,7 +463,20 @@ void IpmbSensor::ipmbRequestCompletionCb(const boost::system::error_code& ec,
 
 void IpmbSensor::read()
 {
-    waitTimer.expires_after(std::chrono::milliseconds(sensorPollMs));
+    if (suspended)
+    {
+        return;
+    }
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    std::chrono::milliseconds period(sensorPollMs);
+    if (nextPoll <= now)
+    {
+        // Skip the polls missed waiting on the reply
+        nextPoll += ((now - nextPoll) / period + 1) * period;
+    }
+
+    waitTimer.expires_at(nextPoll);
     waitTimer.async_wait(
         [weakRef{weak_from_this()}](const boost::system::error_code& ec) {
             if (ec == boost::asio::error::operation_aborted)
@@ -492,14 +494,23 @@ void IpmbSensor::read()
 
 void IpmbSensor::sendIpmbRequest()
 {
+    if (suspended)
+    {
+        return;
+    }
     if (!readingStateGood())
     {
+        if (sweepMember)
+        {
+            scheduler->polled(busIndex, *sweepMember);
+        }
         updateValue(std::numeric_limits<double>::quiet_NaN());
         read();
         return;
     }
-    dbusConnection->async_method_call(
-        [weakRef{weak_from_this()}](boost::system::error_code ec,
+    scheduler->submit(
+        target, *priority, {commandAddress, netfn, lun, command, commandData},
+        [weakRef{weak_from_this()}](const boost::system::error_code& ec,
                                     const IpmbMethodType& response) {
             std::shared_ptr<IpmbSensor> self = weakRef.lock();
             if (!self)
@@ -507,10 +518,7 @@ void IpmbSensor::sendIpmbRequest()
                 return;
             }
             self->ipmbRequestCompletionCb(ec, response);
-        },
-        "xyz.openbmc_project.Ipmi.Channel.Ipmb",
-        "/xyz/openbmc_project/Ipmi/Channel/Ipmb", "org.openbmc.Ipmb",
-        "sendRequest", commandAddress, netfn, lun, command, commandData);
+        });
 }
 
 bool IpmbSensor::sensorClassType(const std::string& sensorClass)
@@ -571,28 +579,127 @@ void IpmbSensor::sensorSubType(const std::string& sensorTypeName)
     }
 }
 
-void IpmbSensor::parseConfigValues(const SensorBaseConfigMap& entry)
+void IpmbSensor::parseConfigValues(const IpmbSensorConfig& config)
 {
-    auto findScaleVal = entry.find("ScaleValue");
-    if (findScaleVal != entry.end())
-    {
-        scaleVal = std::visit(VariantToDoubleVisitor(), findScaleVal->second);
+    scaleVal = config.scaleValue;
+    offsetVal = config.offsetValue;
+    readState = config.readState;
+    busIndex = config.busIndex;
+    maxInFlight = config.maxInFlight;
+    if (!config.priority.empty())
+    {
+        priority = parseIpmbPriority(config.priority);
+        if (!priority)
+        {
+            std::cerr << "Invalid priority " << config.priority << " for "
+                      << name << "\n";
+        }
     }
+}
 
-    auto findOffsetVal = entry.find("OffsetValue");
-    if (findOffsetVal != entry.end())
+// Decoded IpmbSensor configuration by configuration path
+static sensor_config::Cache<IpmbSensorConfig> configCache;
+
+static void createSensorsFromConfigurations(
+    boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
+    boost::container::flat_map<std::string, std::shared_ptr<IpmbSensor>>&
+        sensors,
+    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    const ManagedObjectType& configurations)
+{
+    for (const auto& [path, interfaces] : configurations)
     {
-        offsetVal = std::visit(VariantToDoubleVisitor(), findOffsetVal->second);
-    }
+        auto findConfig = interfaces.find(configInterfaceName(sensorType));
+        if (findConfig == interfaces.end())
+        {
+            continue;
+        }
+        sensor_config::Update update =
+            configCache.update(path, findConfig->second);
+        if (update == sensor_config::Update::invalid)
+        {
+            continue;
+        }
+        const IpmbSensorConfig& config = *configCache.find(path);
+
+        std::vector<thresholds::Threshold> sensorThresholds;
+        if (!parseThresholdsFromConfig(interfaces, sensorThresholds))
+        {
+            std::cerr << "error populating thresholds " << config.name << "\n";
+        }
+
+        auto& sensor = sensors[config.name];
+        if (update == sensor_config::Update::unchanged && sensor &&
+            sensor->thresholds == sensorThresholds)
+        {
+            // Nothing the sensor was built from has changed
+            continue;
+        }
+
+        if (config.busIndex != ipmbBusIndexDefault)
+        {
+            std::cerr << "Ipmb Bus Index for " << config.name << " is "
+                      << static_cast<int>(config.busIndex) << "\n";
+        }
+
+        std::string sensorTypeName = config.sensorTypeName;
+        sensor = nullptr;
+        sensor = std::make_shared<IpmbSensor>(
+            dbusConnection, io, config.name, path, objectServer,
+            std::move(sensorThresholds), config.deviceAddress,
+            config.hostSMbusIndex, config.pollRate, sensorTypeName);
 
-    readState = getPowerState(entry);
+        sensor->parseConfigValues(config);
+        if (!(sensor->sensorClassType(config.sensorClass)))
+        {
+            sensor = nullptr;
+            continue;
+        }
+        sensor->sensorSubType(sensorTypeName);
+        sensor->init();
+    }
 }
 
 void createSensors(
     boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
     boost::container::flat_map<std::string, std::shared_ptr<IpmbSensor>>&
         sensors,
-    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection)
+    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    std::function<void()>&& created)
+{
+    if (!dbusConnection)
+    {
+        std::cerr << "Connection not created\n";
+        return;
+    }
+
+    // Each sensor is created as soon as its configuration is in, the final
+    // callback only has to say they all are
+    auto getter = std::make_shared<GetSensorConfiguration>(
+        dbusConnection,
+        [created{std::move(created)}](const ManagedObjectType&) {
+            if (created)
+            {
+                created();
+            }
+        },
+        [&io, &objectServer, &sensors,
+         &dbusConnection](const ManagedObjectType& ready) {
+            createSensorsFromConfigurations(io, objectServer, sensors,
+                                            dbusConnection, ready);
+        });
+    getter->getConfiguration(std::vector<std::string>{sensorType});
+}
+
+// Decoded IpmbChannel configuration by configuration path
+static sensor_config::Cache<IpmbChannelConfig> channelCache;
+// The channel set up from each configuration path
+static boost::container::flat_map<std::string, uint8_t> channelPaths;
+
+void createChannels(
+    boost::asio::io_context& io,
+    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    const std::shared_ptr<IpmbChannelTransport>& transport)
 {
     if (!dbusConnection)
     {
@@ -600,80 +707,122 @@ void createSensors(
         return;
     }
     dbusConnection->async_method_call(
-        [&](boost::system::error_code ec, const ManagedObjectType& resp) {
+        [&io, transport](boost::system::error_code ec,
+                         const ManagedObjectType& resp) {
             if (ec)
             {
                 std::cerr << "Error contacting entity manager\n";
                 return;
             }
+
+            // Each channel's configurations, to reject those that clash
+            boost::container::flat_map<uint8_t, std::vector<std::string>>
+                claims;
+            boost::container::flat_set<std::string> claimed;
+            boost::container::flat_set<std::string> unchanged;
             for (const auto& [path, interfaces] : resp)
             {
-                for (const auto& [intf, cfg] : interfaces)
+                auto findChannel =
+                    interfaces.find(configInterfaceName(channelType));
+                if (findChannel == interfaces.end())
                 {
-                    if (intf != configInterfaceName(sensorType))
-                    {
-                        continue;
-                    }
-                    std::string name = loadVariant<std::string>(cfg, "Name");
-
-                    std::vector<thresholds::Threshold> sensorThresholds;
-                    if (!parseThresholdsFromConfig(interfaces,
-                                                   sensorThresholds))
-                    {
-                        std::cerr
-                            << "error populating thresholds " << name << "\n";
-                    }
-                    uint8_t deviceAddress =
-                        loadVariant<uint8_t>(cfg, "Address");
-
-                    std::string sensorClass =
-                        loadVariant<std::string>(cfg, "Class");
-
-                    uint8_t hostSMbusIndex = hostSMbusIndexDefault;
-                    auto findSmType = cfg.find("HostSMbusIndex");
-                    if (findSmType != cfg.end())
-                    {
-                        hostSMbusIndex = std::visit(
-                            VariantToUnsignedIntVisitor(), findSmType->second);
-                    }
-
-                    float pollRate = getPollRate(cfg, pollRateDefault);
+                    continue;
+                }
+                sensor_config::Update update =
+                    channelCache.update(path, findChannel->second);
+                if (update == sensor_config::Update::invalid)
+                {
+                    continue;
+                }
+                if (update == sensor_config::Update::unchanged)
+                {
+                    unchanged.insert(path);
+                }
+                claimed.insert(path);
+                claims[channelCache.find(path)->commandAddress()].emplace_back(
+                    path);
+            }
 
-                    uint8_t ipmbBusIndex = ipmbBusIndexDefault;
-                    auto findBusType = cfg.find("Bus");
-                    if (findBusType != cfg.end())
-                    {
-                        ipmbBusIndex = std::visit(VariantToUnsignedIntVisitor(),
-                                                  findBusType->second);
-                        std::cerr << "Ipmb Bus Index for " << name << " is "
-                                  << static_cast<int>(ipmbBusIndex) << "\n";
-                    }
+            // Channels set up before go back to the bridge, unless set up
+            // from the same configuration as before
+            boost::container::flat_map<std::string, uint8_t> found;
+            for (const auto& [path, channel] : channelPaths)
+            {
+                auto findClaim = claims.find(channel);
+                if (findClaim != claims.end() &&
+                    findClaim->second == std::vector<std::string>{path} &&
+                    unchanged.contains(path))
+                {
+                    found.emplace(path, channel);
+                    continue;
+                }
+                transport->setChannel(channel, nullptr);
+                if (!claimed.contains(path))
+                {
+                    channelCache.erase(path);
+                }
+            }
 
-                    /* Default sensor type is "temperature" */
-                    std::string sensorTypeName = "temperature";
-                    auto findType = cfg.find("SensorType");
-                    if (findType != cfg.end())
+            for (const auto& [channel, paths] : claims)
+            {
+                if (paths.size() > 1)
+                {
+                    std::cerr << "IPMB channel " << static_cast<int>(channel)
+                              << " is configured more than once, by";
+                    for (const std::string& path : paths)
                     {
-                        sensorTypeName = std::visit(VariantToStringVisitor(),
-                                                    findType->second);
+                        std::cerr << " " << path;
+                        channelCache.erase(path);
                     }
+                    std::cerr << ", sending it through the bridge\n";
+                    continue;
+                }
 
-                    auto& sensor = sensors[name];
-                    sensor = nullptr;
-                    sensor = std::make_shared<IpmbSensor>(
-                        dbusConnection, io, name, path, objectServer,
-                        std::move(sensorThresholds), deviceAddress,
-                        hostSMbusIndex, pollRate, sensorTypeName);
+                const std::string& path = paths.front();
+                if (found.contains(path))
+                {
+                    continue;
+                }
 
-                    sensor->parseConfigValues(cfg);
-                    if (!(sensor->sensorClassType(sensorClass)))
-                    {
-                        continue;
-                    }
-                    sensor->sensorSubType(sensorTypeName);
-                    sensor->init();
+                const IpmbChannelConfig& config = *channelCache.find(path);
+                try
+                {
+                    std::shared_ptr<IpmbDeviceTransport> device =
+                        IpmbDeviceTransport::open(
+                            io, config.device,
+                            {config.requesterAddress, config.address},
+                            std::chrono::milliseconds(
+                                static_cast<int>(config.timeout * 1000)));
+                    device->setFailureHandler(
+                        [weakTransport{std::weak_ptr(transport)}, path,
+                         channel, device{device.get()}](
+                            const boost::system::error_code&) {
+                            auto transport = weakTransport.lock();
+                            if (!transport ||
+                                !transport->dropChannel(channel, device))
+                            {
+                                return; // replaced in the meantime
+                            }
+                            std::cerr << "Sending IPMB channel "
+                                      << static_cast<int>(channel)
+                                      << " through the bridge\n";
+                            // Opened again on the next rescan
+                            channelCache.erase(path);
+                        });
+                    transport->setChannel(channel, device);
+                    found.emplace(path, channel);
+                }
+                catch (const std::system_error& e)
+                {
+                    // Tried again on the next rescan
+                    std::cerr << e.what() << ", sending IPMB channel "
+                              << static_cast<int>(channel)
+                              << " through the bridge\n";
+                    channelCache.erase(path);
                 }
             }
+
+            channelPaths = std::move(found);
         },
         entityManagerName, "/xyz/openbmc_project/inventory",
         "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
@@ -700,7 +849,8 @@ void interfaceRemoved(
     auto sensorIt = sensors.begin();
     while (sensorIt != sensors.end())
     {
-        if ((sensorIt->second->configurationPath == removedPath) &&
+        if (sensorIt->second &&
+            (sensorIt->second->configurationPath == removedPath) &&
             (std::find(interfaces.begin(), interfaces.end(),
                        configInterfaceName(sdrInterface)) != interfaces.end()))
         {
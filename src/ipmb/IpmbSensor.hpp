@@ -1,17 +1,125 @@
 #pragma once
+#include "IpmbReadingDecoders.hpp"
+#include "IpmbRequestScheduler.hpp"
+#include "IpmbTransport.hpp"
+#include "SensorConfig.hpp"
+#include "Utils.hpp"
+
 #include <boost/asio/steady_timer.hpp>
 #include <boost/container/flat_map.hpp>
 #include <sensor.hpp>
 
 #include <chrono>
+#include <cstdint>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <optional>
+#include <set>
 #include <string>
 #include <vector>
 
 constexpr const char* sensorType = "IpmbSensor";
 constexpr const char* sdrInterface = "IpmbDevice";
+constexpr const char* channelType = "IpmbChannel";
+
+constexpr uint8_t hostSMbusIndexDefault = 0x03;
+constexpr uint8_t ipmbBusIndexDefault = 0;
+constexpr float pollRateDefault = 1; // in seconds
+
+// The targets that answered since the host was powered on, kept by the daemon
+// and cleared as soon as the host powers off.  Sensors depending on host power
+// stay suspended, with no timer armed, until their target is in here.
+inline std::set<IpmbTarget> readyTargets;
+
+struct IpmbSensorConfig
+{
+    std::string name;
+    uint8_t deviceAddress = 0;
+    std::string sensorClass;
+    uint8_t hostSMbusIndex = hostSMbusIndexDefault;
+    float pollRate = pollRateDefault;
+    uint8_t busIndex = ipmbBusIndexDefault;
+    std::string sensorTypeName = "temperature";
+    double scaleValue = 1.0;
+    double offsetValue = 0.0;
+    PowerState readState = PowerState::always;
+    // "High", "Normal" or "Low", defaulting by sensor class
+    std::string priority;
+    // Requests outstanding to the sensor's target at once, 0 for the default
+    uint8_t maxInFlight = 0;
+
+    // The bus index goes in the upper six bits of the commandAddress
+    static bool validBus(const uint8_t& bus)
+    {
+        return bus < (1U << 6);
+    }
+
+    bool operator==(const IpmbSensorConfig&) const = default;
+};
+
+template <>
+struct sensor_config::Schema<IpmbSensorConfig>
+{
+    static constexpr auto fields = std::make_tuple(
+        required("Name", &IpmbSensorConfig::name),
+        required("Address", &IpmbSensorConfig::deviceAddress),
+        required("Class", &IpmbSensorConfig::sensorClass),
+        optional("HostSMbusIndex", &IpmbSensorConfig::hostSMbusIndex),
+        optional("PollRate", &IpmbSensorConfig::pollRate, positive<float>),
+        optional("Bus", &IpmbSensorConfig::busIndex,
+                 IpmbSensorConfig::validBus),
+        optional("SensorType", &IpmbSensorConfig::sensorTypeName),
+        optional("ScaleValue", &IpmbSensorConfig::scaleValue),
+        optional("OffsetValue", &IpmbSensorConfig::offsetValue),
+        optional("PowerState", &IpmbSensorConfig::readState),
+        optional("Priority", &IpmbSensorConfig::priority),
+        optional("MaxInFlight", &IpmbSensorConfig::maxInFlight,
+                 positive<uint8_t>));
+};
+
+// A channel the daemon talks to over an ipmb-dev device rather than through
+// the IPMB bridge.  The bridge must not be given the device as well, and each
+// channel may only be configured once.
+struct IpmbChannelConfig
+{
+    // The bus index, as given for the sensors on the channel
+    uint8_t bus = 0;
+    // Which of the bus's channels, as the low two bits of the commandAddress
+    // the bridge picks its channel by
+    uint8_t type = 0;
+    std::string device;
+    // 7 bit slave addresses
+    uint8_t address = 0;
+    uint8_t requesterAddress = 0x10;
+    float timeout = 0.25F; // in seconds
+
+    // The commandAddress of the requests sent on the channel
+    uint8_t commandAddress() const
+    {
+        return static_cast<uint8_t>((bus << 2) | type);
+    }
+
+    static bool validType(const uint8_t& type)
+    {
+        return type < (1U << 2);
+    }
+
+    bool operator==(const IpmbChannelConfig&) const = default;
+};
+
+template <>
+struct sensor_config::Schema<IpmbChannelConfig>
+{
+    static constexpr auto fields = std::make_tuple(
+        required("Bus", &IpmbChannelConfig::bus, IpmbSensorConfig::validBus),
+        optional("ChannelType", &IpmbChannelConfig::type,
+                 IpmbChannelConfig::validType),
+        required("Device", &IpmbChannelConfig::device),
+        required("Address", &IpmbChannelConfig::address),
+        optional("RequesterAddress", &IpmbChannelConfig::requesterAddress),
+        optional("Timeout", &IpmbChannelConfig::timeout, positive<float>));
+};
 
 enum class IpmbType
 {
@@ -34,46 +142,17 @@ enum class IpmbSubType
     util
 };
 
-enum class ReadingFormat
-{
-    byte0,
-    byte3,
-    nineBit,
-    tenBit,
-    elevenBit,
-    elevenBitShift,
-    linearElevenBit,
-    fifteenBit
-};
-
 namespace ipmi
 {
+namespace app
+{
+constexpr uint8_t netFn = 0x06;
+constexpr uint8_t getDeviceId = 0x01;
+} // namespace app
 namespace sensor
 {
 constexpr uint8_t netFn = 0x04;
 constexpr uint8_t getSensorReading = 0x2d;
-
-static inline bool isValid(const std::vector<uint8_t>& data)
-{
-    constexpr auto readingUnavailableBit = 5;
-
-    // Proper 'Get Sensor Reading' response has at least 4 bytes, including
-    // Completion Code. Our IPMB stack strips Completion Code from payload so we
-    // compare here against the rest of payload
-    if (data.size() < 3)
-    {
-        return false;
-    }
-
-    // Per IPMI 'Get Sensor Reading' specification
-    if ((data[1] & (1 << readingUnavailableBit)) != 0)
-    {
-        return false;
-    }
-
-    return true;
-}
-
 } // namespace sensor
 namespace me_bridge
 {
@@ -82,9 +161,6 @@ constexpr uint8_t sendRawPmbus = 0xd9;
 } // namespace me_bridge
 } // namespace ipmi
 
-using IpmbMethodType =
-    std::tuple<int, uint8_t, uint8_t, uint8_t, uint8_t, std::vector<uint8_t>>;
-
 struct IpmbSensor :
     public Sensor,
     public std::enable_shared_from_this<IpmbSensor>
@@ -99,15 +175,20 @@ struct IpmbSensor :
     ~IpmbSensor() override;
 
     void checkThresholds() override;
+    bool readingStateGood() const override;
     void read();
     void init();
+    bool hostDependent() const;
+    void suspend();
+    // Runs the init command and polls again, the first poll after delay
+    void resume(std::chrono::milliseconds delay);
     std::string getSubTypeUnits() const;
     void loadDefaults();
     void runInitCmd();
     static bool processReading(ReadingFormat readingFormat, uint8_t command,
                                const std::vector<uint8_t>& data, double& resp,
                                size_t errCount);
-    void parseConfigValues(const SensorBaseConfigMap& entry);
+    void parseConfigValues(const IpmbSensorConfig& config);
     bool sensorClassType(const std::string& sensorClass);
     void sensorSubType(const std::string& sensorTypeName);
 
@@ -121,26 +202,48 @@ struct IpmbSensor :
     uint8_t deviceAddress = 0;
     uint8_t errorCount = 0;
     uint8_t hostSMbusIndex = 0;
+    uint8_t busIndex = ipmbBusIndexDefault;
+    std::optional<IpmbPriority> priority;
+    uint8_t maxInFlight = 0;
     std::vector<uint8_t> commandData;
     std::optional<uint8_t> initCommand;
     std::vector<uint8_t> initData;
     int sensorPollMs;
 
+    bool suspended = false;
+
     ReadingFormat readingFormat = ReadingFormat::byte0;
+    // Bound to readingFormat and command by loadDefaults()
+    const ipmb_reading::Decoder* decoder = nullptr;
 
   private:
     void sendIpmbRequest();
     sdbusplus::asio::object_server& objectServer;
+    std::shared_ptr<IpmbRequestScheduler> scheduler;
+    IpmbTarget target{};
+    // While the sensor is polling
+    std::optional<IpmbRequestScheduler::SweepMember> sweepMember;
     boost::asio::steady_timer waitTimer;
+    // Polls keep the phase the scheduler gave the sensor
+    std::chrono::steady_clock::time_point nextPoll;
     void ipmbRequestCompletionCb(const boost::system::error_code& ec,
                                  const IpmbMethodType& response);
 };
 
+// created, if set, is called once the configured sensors have been created
 void createSensors(
     boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
     boost::container::flat_map<std::string, std::shared_ptr<IpmbSensor>>&
         sensors,
-    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection);
+    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    std::function<void()>&& created = nullptr);
+
+// Sends the requests of each IpmbChannel configured over its device, and
+// those of any other channel through the bridge
+void createChannels(
+    boost::asio::io_context& io,
+    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    const std::shared_ptr<IpmbChannelTransport>& transport);
 
 void interfaceRemoved(
     sdbusplus::message_t& message,
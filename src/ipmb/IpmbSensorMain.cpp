@@ -1,5 +1,8 @@
+#include "IpmbRequestScheduler.hpp"
 #include "IpmbSDRSensor.hpp"
 #include "IpmbSensor.hpp"
+#include "IpmbTransport.hpp"
+#include "SensorDaemon.hpp"
 #include "Utils.hpp"
 
 #include <boost/asio/error.hpp>
@@ -13,20 +16,23 @@
 #include <sdbusplus/bus/match.hpp>
 #include <sdbusplus/message.hpp>
 
+#include <algorithm>
 #include <array>
 #include <chrono>
-#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
+#include <tuple>
 #include <variant>
 #include <vector>
 
-std::unique_ptr<boost::asio::steady_timer> initCmdTimer;
-boost::container::flat_map<std::string, std::shared_ptr<IpmbSensor>> sensors;
-boost::container::flat_map<uint8_t, std::shared_ptr<IpmbSDRDevice>> sdrsensor;
+static boost::container::flat_map<std::string, std::shared_ptr<IpmbSensor>>
+    sensors;
+static boost::container::flat_map<uint8_t, std::shared_ptr<IpmbSDRDevice>>
+    sdrsensor;
 
 void sdrHandler(
     boost::container::flat_map<uint8_t, std::shared_ptr<IpmbSDRDevice>>
@@ -52,60 +58,222 @@ void sdrHandler(
     sdrsen->getSDRRepositoryInfo();
 }
 
-void reinitSensors(sdbusplus::message_t& message)
+// Sensors resumed together are spread out by this much, so that their init
+// commands and first reads don't all reach the ME at once
+static constexpr std::chrono::milliseconds resumeStep(20);
+static constexpr std::chrono::milliseconds probeInterval(500);
+// Probes failed before saying so, about a minute, after which the target is
+// probed less often
+static constexpr unsigned int probesLogged = 120;
+static constexpr std::chrono::seconds probeIdleInterval(10);
+
+// Bumped on each host power change, so that probes from before it are dropped
+static unsigned int powerGeneration = 0;
+static bool hostOn = false;
+// The targets probed since the host was powered on, that haven't answered yet
+static std::set<IpmbTarget> probing;
+
+static void suspendSensors()
 {
-    constexpr const size_t reinitWaitSeconds = 2;
-    std::string objectName;
-    boost::container::flat_map<std::string, std::variant<std::string>> values;
-    message.read(objectName, values);
+    readyTargets.clear();
+    probing.clear();
+    for (const auto& [name, sensor] : sensors)
+    {
+        if (sensor && sensor->hostDependent())
+        {
+            sensor->suspend();
+        }
+    }
+}
 
-    auto findStatus = values.find(power::property);
-    if (findStatus != values.end())
+// Resumes the sensors suspended on target, most urgent first
+static void resumeSensors(const IpmbTarget& target)
+{
+    std::vector<std::shared_ptr<IpmbSensor>> wave;
+    for (const auto& [name, sensor] : sensors)
     {
-        bool powerStatus =
-            std::get<std::string>(findStatus->second).ends_with(".Running");
-        if (powerStatus)
+        if (sensor && sensor->suspended && sensor->busIndex == target.bus &&
+            sensor->commandAddress == target.commandAddress)
         {
-            if (!initCmdTimer)
+            wave.emplace_back(sensor);
+        }
+    }
+    std::ranges::stable_sort(wave, {}, [](const auto& sensor) {
+        return sensor->priority.value_or(IpmbPriority::normal);
+    });
+
+    std::chrono::milliseconds delay(0);
+    for (const auto& sensor : wave)
+    {
+        sensor->resume(delay);
+        delay += resumeStep;
+    }
+}
+
+// Asks the target for its device ID until it answers, which is when the
+// sensors behind it can be read again
+static void probeTarget(
+    const std::shared_ptr<sdbusplus::asio::connection>& conn,
+    const IpmbTarget& target, unsigned int generation, unsigned int attempt)
+{
+    IpmbRequestScheduler::shared(conn)->submit(
+        target, IpmbPriority::high,
+        {target.commandAddress, ipmi::app::netFn, 0, ipmi::app::getDeviceId,
+         {}},
+        [conn, target, generation,
+         attempt](const boost::system::error_code& ec,
+                  const IpmbMethodType& response) {
+            if (generation != powerGeneration)
+            {
+                return; // the host changed state since
+            }
+            if (!ec && std::get<0>(response) == 0 &&
+                std::get<4>(response) == 0)
             {
-                // this should be impossible
+                probing.erase(target);
+                readyTargets.insert(target);
+                resumeSensors(target);
                 return;
             }
-            // we seem to send this command too fast sometimes, wait before
-            // sending
-            initCmdTimer->expires_after(
-                std::chrono::seconds(reinitWaitSeconds));
+            if (attempt + 1 == probesLogged)
+            {
+                std::cerr << "IPMB target " << static_cast<int>(target.bus)
+                          << ":" << static_cast<int>(target.commandAddress)
+                          << " not answering since power on\n";
+            }
 
-            initCmdTimer->async_wait([](const boost::system::error_code ec) {
+            auto timer = std::make_shared<boost::asio::steady_timer>(
+                conn->get_io_context());
+            if (attempt + 1 < probesLogged)
+            {
+                timer->expires_after(probeInterval);
+            }
+            else
+            {
+                timer->expires_after(probeIdleInterval);
+            }
+            timer->async_wait([timer, conn, target, generation,
+                               attempt](const boost::system::error_code& ec) {
                 if (ec == boost::asio::error::operation_aborted)
                 {
                     return; // we're being canceled
                 }
-
-                for (const auto& [name, sensor] : sensors)
+                if (generation == powerGeneration)
                 {
-                    if (sensor)
-                    {
-                        sensor->runInitCmd();
-                    }
+                    probeTarget(conn, target, generation, attempt + 1);
                 }
             });
+        });
+}
+
+// Probes the targets with sensors suspended on them, unless already probing
+static void probeSuspended(
+    const std::shared_ptr<sdbusplus::asio::connection>& conn)
+{
+    if (!hostOn)
+    {
+        return;
+    }
+
+    for (const auto& [name, sensor] : sensors)
+    {
+        if (!sensor || !sensor->suspended)
+        {
+            continue;
         }
+        IpmbTarget target{sensor->busIndex, sensor->commandAddress};
+        if (!readyTargets.contains(target) && probing.insert(target).second)
+        {
+            probeTarget(conn, target, powerGeneration, 0);
+        }
+    }
+}
+
+static void hostPowerChanged(
+    const std::shared_ptr<sdbusplus::asio::connection>& conn, bool on)
+{
+    powerGeneration++;
+    hostOn = on;
+    if (!on)
+    {
+        suspendSensors();
+        return;
     }
+
+    probing.clear();
+    probeSuspended(conn);
 }
 
-int main()
+// Only the initial state is read here, changes are followed through the
+// power matches shared with the other backends.  We commonly come up before
+// power control, so the read is retried as the targets are probed, the
+// sensors staying suspended meanwhile: the ME answers with the host off too.
+static void getPowerState(
+    const std::shared_ptr<sdbusplus::asio::connection>& conn,
+    unsigned int attempt = 0)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
-    sdbusplus::asio::object_server objectServer(systemBus, true);
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
+    unsigned int generation = powerGeneration;
+    conn->async_method_call(
+        [conn, generation, attempt](const boost::system::error_code& ec,
+                                    const std::variant<std::string>& state) {
+            if (generation != powerGeneration)
+            {
+                return; // a power match told us the state since
+            }
+            if (!ec)
+            {
+                hostPowerChanged(
+                    conn, std::get<std::string>(state).ends_with(".Running"));
+                return;
+            }
+            if (attempt == 0 || attempt + 1 == probesLogged)
+            {
+                std::cerr << "error getting power status " << ec.message()
+                          << "\n";
+            }
+
+            auto timer = std::make_shared<boost::asio::steady_timer>(
+                conn->get_io_context());
+            if (attempt + 1 < probesLogged)
+            {
+                timer->expires_after(probeInterval);
+            }
+            else
+            {
+                timer->expires_after(probeIdleInterval);
+            }
+            timer->async_wait([timer, conn, generation,
+                               attempt](const boost::system::error_code& ec) {
+                if (ec == boost::asio::error::operation_aborted)
+                {
+                    return; // we're being canceled
+                }
+                if (generation == powerGeneration)
+                {
+                    getPowerState(conn, attempt + 1);
+                }
+            });
+        },
+        std::string(power::busname) + "0", std::string(power::path) + "0",
+        properties::interface, properties::get, power::interface,
+        power::property);
+}
+
+static SensorDaemon::Task ipmbSensorMain(SensorDaemon& daemon)
+{
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
+    daemon.addManager("/xyz/openbmc_project/sensors");
     systemBus->request_name("xyz.openbmc_project.IpmbSensor");
 
-    initCmdTimer = std::make_unique<boost::asio::steady_timer>(io);
+    std::shared_ptr<IpmbChannelTransport> transport =
+        IpmbChannelTransport::shared(systemBus);
 
     boost::asio::post(io, [&]() {
-        createSensors(io, objectServer, sensors, systemBus);
+        createChannels(io, systemBus, transport);
+        createSensors(io, objectServer, sensors, systemBus,
+                      [&systemBus]() { probeSuspended(systemBus); });
     });
 
     boost::asio::steady_timer configTimer(io);
@@ -119,7 +287,9 @@ int main()
                 {
                     return; // we're being canceled
                 }
-                createSensors(io, objectServer, sensors, systemBus);
+                createChannels(io, systemBus, transport);
+                createSensors(io, objectServer, sensors, systemBus,
+                              [&systemBus]() { probeSuspended(systemBus); });
                 if (sensors.empty())
                 {
                     std::cout << "Configuration not detected\n";
@@ -129,14 +299,17 @@ int main()
 
     std::vector<std::unique_ptr<sdbusplus::bus::match_t>> matches =
         setupPropertiesChangedMatches(
-            *systemBus, std::to_array<const char*>({sensorType}), eventHandler);
+            *systemBus, std::to_array<const char*>({sensorType, channelType}),
+            eventHandler);
 
-    sdbusplus::bus::match_t powerChangeMatch(
-        static_cast<sdbusplus::bus_t&>(*systemBus),
-        "type='signal',interface='" + std::string(properties::interface) +
-            "',path='" + std::string(power::path) + "',arg0='" +
-            std::string(power::interface) + "'",
-        reinitSensors);
+    setupPowerMatchCallback(systemBus,
+                            [&systemBus](PowerState type, bool state) {
+                                if (type == PowerState::on)
+                                {
+                                    hostPowerChanged(systemBus, state);
+                                }
+                            });
+    getPowerState(systemBus);
 
     auto matchSignal = std::make_shared<sdbusplus::bus::match_t>(
         static_cast<sdbusplus::bus_t&>(*systemBus),
@@ -156,6 +329,8 @@ int main()
         [](sdbusplus::message_t& msg) { interfaceRemoved(msg, sensors); });
 
     setupManufacturingModeMatch(*systemBus);
-    io.run();
-    return 0;
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("ipmb", "ipmbsensor",
+                                           ipmbSensorMain);
@@ -0,0 +1,388 @@
+#include "IpmbTransport.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/system/error_code.hpp>
+#include <sdbusplus/asio/connection.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+IpmbBridgeTransport::IpmbBridgeTransport(
+    const std::shared_ptr<sdbusplus::asio::connection>& conn) : conn(conn)
+{}
+
+void IpmbBridgeTransport::send(const IpmbRequest& request, Reply&& reply)
+{
+    conn->async_method_call(
+        std::move(reply), "xyz.openbmc_project.Ipmi.Channel.Ipmb",
+        "/xyz/openbmc_project/Ipmi/Channel/Ipmb", "org.openbmc.Ipmb",
+        "sendRequest", request.commandAddress, request.netfn, request.lun,
+        request.command, request.data);
+}
+
+namespace ipmb_frame
+{
+
+// Where the parts of a request and a response sit in a frame, after the
+// length byte
+static constexpr size_t lengthIndex = 0;
+static constexpr size_t addressIndex = 1;
+static constexpr size_t netfnIndex = 2;
+static constexpr size_t headerChecksumIndex = 3;
+static constexpr size_t senderIndex = 4;
+static constexpr size_t sequenceIndex = 5;
+static constexpr size_t commandIndex = 6;
+static constexpr size_t completionCodeIndex = 7;
+// Up to and including the completion code and the final checksum
+static constexpr size_t minResponseSize = 9;
+
+static uint8_t checksum(std::span<const uint8_t> bytes)
+{
+    // Sums to zero with the bytes it covers
+    return static_cast<uint8_t>(
+        -std::accumulate(bytes.begin(), bytes.end(), 0U));
+}
+
+std::vector<uint8_t> encodeRequest(const IpmbAddresses& addresses,
+                                   uint8_t sequence, const IpmbRequest& request)
+{
+    std::vector<uint8_t> frame;
+    frame.reserve(commandIndex + request.data.size() + 2);
+    frame.push_back(0);
+    frame.push_back(addresses.responder << 1);
+    frame.push_back((request.netfn << 2) | (request.lun & 0x03));
+    frame.push_back(checksum(std::span(frame).subspan(addressIndex)));
+    frame.push_back(addresses.requester << 1);
+    frame.push_back(sequence << 2);
+    frame.push_back(request.command);
+    frame.insert(frame.end(), request.data.begin(), request.data.end());
+    frame.push_back(checksum(std::span(frame).subspan(senderIndex)));
+    frame[lengthIndex] = static_cast<uint8_t>(frame.size() - 1);
+    return frame;
+}
+
+std::optional<Response> decodeResponse(const IpmbAddresses& addresses,
+                                       std::span<const uint8_t> frame)
+{
+    if (frame.size() < minResponseSize ||
+        frame[lengthIndex] + 1U > frame.size())
+    {
+        return std::nullopt;
+    }
+    frame = frame.first(frame[lengthIndex] + 1U);
+    if (frame.size() < minResponseSize)
+    {
+        return std::nullopt;
+    }
+
+    auto sum = [](std::span<const uint8_t> bytes) {
+        return static_cast<uint8_t>(
+            std::accumulate(bytes.begin(), bytes.end(), 0U));
+    };
+    if (sum(frame.subspan(addressIndex, headerChecksumIndex)) != 0 ||
+        sum(frame.subspan(senderIndex)) != 0)
+    {
+        return std::nullopt;
+    }
+
+    uint8_t netfn = frame[netfnIndex] >> 2;
+    if (frame[addressIndex] != (addresses.requester << 1) ||
+        frame[senderIndex] != (addresses.responder << 1) || (netfn & 1) == 0)
+    {
+        return std::nullopt;
+    }
+
+    return Response{netfn,
+                    static_cast<uint8_t>(frame[sequenceIndex] & 0x03),
+                    static_cast<uint8_t>(frame[sequenceIndex] >> 2),
+                    frame[commandIndex],
+                    frame[completionCodeIndex],
+                    {frame.begin() + completionCodeIndex + 1, frame.end() - 1}};
+}
+
+} // namespace ipmb_frame
+
+IpmbDeviceTransport::IpmbDeviceTransport(boost::asio::io_context& io, int fd,
+                                         const IpmbAddresses& addresses,
+                                         std::chrono::milliseconds timeout) :
+    io(io), device(io, fd), addresses(addresses), timeout(timeout)
+{}
+
+std::shared_ptr<IpmbDeviceTransport> IpmbDeviceTransport::open(
+    boost::asio::io_context& io, const std::string& path,
+    const IpmbAddresses& addresses, std::chrono::milliseconds timeout)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to open " + path);
+    }
+    auto transport =
+        std::make_shared<IpmbDeviceTransport>(io, fd, addresses, timeout);
+    transport->start();
+    return transport;
+}
+
+void IpmbDeviceTransport::start()
+{
+    receive();
+}
+
+void IpmbDeviceTransport::setFailureHandler(FailureHandler&& handler)
+{
+    failureHandler = std::move(handler);
+}
+
+void IpmbDeviceTransport::send(const IpmbRequest& request, Reply&& reply)
+{
+    // The reply always comes from the event loop, as it would from the bridge
+    auto fail = [this, &reply](const boost::system::error_code& ec) {
+        boost::asio::post(io, [reply{std::move(reply)}, ec]() {
+            reply(ec, IpmbMethodType{});
+        });
+    };
+
+    if (failure)
+    {
+        fail(failure);
+        return;
+    }
+    if (pending.size() == sequences)
+    {
+        fail(boost::asio::error::no_buffer_space);
+        return;
+    }
+    while (pending.contains(nextSequence))
+    {
+        nextSequence = (nextSequence + 1) % sequences;
+    }
+    uint8_t sequence = nextSequence;
+    nextSequence = (nextSequence + 1) % sequences;
+
+    std::vector<uint8_t> frame =
+        ipmb_frame::encodeRequest(addresses, sequence, request);
+    ssize_t rc = ::write(device.native_handle(), frame.data(), frame.size());
+    if (rc != static_cast<ssize_t>(frame.size()))
+    {
+        fail({rc < 0 ? errno : EIO, boost::system::system_category()});
+        return;
+    }
+
+    auto timer = std::make_unique<boost::asio::steady_timer>(io);
+    timer->expires_after(timeout);
+    timer->async_wait([weak{weak_from_this()}, sequence, timer{timer.get()}](
+                          const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+        std::shared_ptr<IpmbDeviceTransport> self = weak.lock();
+        if (!self)
+        {
+            return;
+        }
+        // The sequence number may have been answered and reused since the
+        // timer expired
+        auto findPending = self->pending.find(sequence);
+        if (findPending == self->pending.end() ||
+            findPending->second.timer.get() != timer)
+        {
+            return;
+        }
+        self->complete(sequence, boost::asio::error::timed_out, {});
+    });
+    pending.emplace(sequence, Pending{request, std::move(reply),
+                                      std::move(timer)});
+}
+
+void IpmbDeviceTransport::receive()
+{
+    device.async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [weak{weak_from_this()}](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            std::shared_ptr<IpmbDeviceTransport> self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+
+            if (ec)
+            {
+                std::cerr << "Error waiting for IPMB responses: "
+                          << ec.message() << "\n";
+                self->shutdown(ec);
+                return;
+            }
+
+            while (true)
+            {
+                // Each read returns a single message
+                ssize_t rc = ::read(self->device.native_handle(),
+                                    self->buffer.data(), self->buffer.size());
+                if (rc > 0)
+                {
+                    self->process(std::span(self->buffer).first(rc));
+                    continue;
+                }
+                if (rc < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    break;
+                }
+
+                // Waiting again would only wake straight back up
+                boost::system::error_code error = boost::asio::error::eof;
+                if (rc < 0)
+                {
+                    error = {errno, boost::system::system_category()};
+                }
+                std::cerr << "Error reading IPMB responses: "
+                          << error.message() << "\n";
+                self->shutdown(error);
+                return;
+            }
+            self->receive();
+        });
+}
+
+void IpmbDeviceTransport::shutdown(const boost::system::error_code& ec)
+{
+    failure = ec;
+    boost::system::error_code ignored;
+    device.close(ignored);
+
+    std::map<uint8_t, Pending> failed = std::move(pending);
+    pending.clear();
+    for (auto& [sequence, request] : failed)
+    {
+        request.timer->cancel();
+        request.reply(ec, {});
+    }
+
+    if (failureHandler)
+    {
+        FailureHandler handler = std::move(failureHandler);
+        failureHandler = nullptr;
+        handler(ec);
+    }
+}
+
+void IpmbDeviceTransport::process(std::span<const uint8_t> frame)
+{
+    std::optional<ipmb_frame::Response> response =
+        ipmb_frame::decodeResponse(addresses, frame);
+    if (!response)
+    {
+        // Requests from the responder, and anything garbled
+        return;
+    }
+
+    auto findPending = pending.find(response->sequence);
+    if (findPending == pending.end())
+    {
+        return; // answered too late
+    }
+    const IpmbRequest& request = findPending->second.request;
+    if (response->netfn != (request.netfn | 1) ||
+        response->command != request.command)
+    {
+        return;
+    }
+
+    complete(response->sequence, {},
+             {0, response->netfn, response->lun, response->command,
+              response->completionCode, std::move(response->data)});
+}
+
+void IpmbDeviceTransport::complete(uint8_t sequence,
+                                   const boost::system::error_code& ec,
+                                   const IpmbMethodType& response)
+{
+    auto findPending = pending.find(sequence);
+    Pending done = std::move(findPending->second);
+    pending.erase(findPending);
+    done.timer->cancel();
+    done.reply(ec, response);
+}
+
+std::shared_ptr<IpmbChannelTransport> IpmbChannelTransport::shared(
+    const std::shared_ptr<sdbusplus::asio::connection>& conn)
+{
+    static std::weak_ptr<IpmbChannelTransport> instance;
+
+    std::shared_ptr<IpmbChannelTransport> transport = instance.lock();
+    if (!transport)
+    {
+        transport = std::make_shared<IpmbChannelTransport>(
+            std::make_shared<IpmbBridgeTransport>(conn));
+        instance = transport;
+    }
+    return transport;
+}
+
+IpmbChannelTransport::IpmbChannelTransport(
+    std::shared_ptr<IpmbTransport> fallback) : fallback(std::move(fallback))
+{}
+
+void IpmbChannelTransport::setChannel(uint8_t channel,
+                                      std::shared_ptr<IpmbTransport> transport)
+{
+    if (transport)
+    {
+        channels[channel] = std::move(transport);
+    }
+    else
+    {
+        channels.erase(channel);
+    }
+}
+
+bool IpmbChannelTransport::dropChannel(uint8_t channel,
+                                       const IpmbTransport* transport)
+{
+    auto findChannel = channels.find(channel);
+    if (findChannel == channels.end() || findChannel->second.get() != transport)
+    {
+        return false;
+    }
+    channels.erase(findChannel);
+    return true;
+}
+
+void IpmbChannelTransport::send(const IpmbRequest& request, Reply&& reply)
+{
+    auto findChannel = channels.find(request.commandAddress);
+    if (findChannel != channels.end())
+    {
+        findChannel->second->send(request, std::move(reply));
+        return;
+    }
+    fallback->send(request, std::move(reply));
+}
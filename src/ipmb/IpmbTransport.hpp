@@ -0,0 +1,197 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/system/error_code.hpp>
+#include <sdbusplus/asio/connection.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// status, netfn, lun, command, completion code and data, as returned by
+// org.openbmc.Ipmb.sendRequest
+using IpmbMethodType =
+    std::tuple<int, uint8_t, uint8_t, uint8_t, uint8_t, std::vector<uint8_t>>;
+
+// The arguments of org.openbmc.Ipmb.sendRequest.  commandAddress selects the
+// channel the request goes out on.
+struct IpmbRequest
+{
+    uint8_t commandAddress;
+    uint8_t netfn;
+    uint8_t lun;
+    uint8_t command;
+    std::vector<uint8_t> data;
+
+    bool operator==(const IpmbRequest&) const = default;
+};
+
+// Carries IPMB requests to their responder and the responses back.  Everything
+// runs on the io_context thread.
+class IpmbTransport
+{
+  public:
+    using Reply = std::function<void(const boost::system::error_code& ec,
+                                     const IpmbMethodType& response)>;
+
+    IpmbTransport() = default;
+    virtual ~IpmbTransport() = default;
+    IpmbTransport(const IpmbTransport&) = delete;
+    IpmbTransport& operator=(const IpmbTransport&) = delete;
+    IpmbTransport(IpmbTransport&&) = delete;
+    IpmbTransport& operator=(IpmbTransport&&) = delete;
+
+    virtual void send(const IpmbRequest& request, Reply&& reply) = 0;
+};
+
+// Sends through the sendRequest method of the ipmbbridge daemon
+class IpmbBridgeTransport : public IpmbTransport
+{
+  public:
+    explicit IpmbBridgeTransport(
+        const std::shared_ptr<sdbusplus::asio::connection>& conn);
+
+    void send(const IpmbRequest& request, Reply&& reply) override;
+
+  private:
+    std::shared_ptr<sdbusplus::asio::connection> conn;
+};
+
+// The slave addresses of the two ends of a channel, 7 bit
+struct IpmbAddresses
+{
+    uint8_t requester;
+    uint8_t responder;
+};
+
+namespace ipmb_frame
+{
+
+// The frame written to an ipmb-dev device for request: a length byte followed
+// by the IPMB request message, checksums included
+std::vector<uint8_t> encodeRequest(const IpmbAddresses& addresses,
+                                   uint8_t sequence,
+                                   const IpmbRequest& request);
+
+struct Response
+{
+    uint8_t netfn;
+    uint8_t lun;
+    uint8_t sequence;
+    uint8_t command;
+    uint8_t completionCode;
+    std::vector<uint8_t> data;
+};
+
+// The response in a frame read from an ipmb-dev device, or nullopt if the
+// frame is malformed, fails its checksums, isn't a response or isn't from
+// addresses.responder
+std::optional<Response> decodeResponse(const IpmbAddresses& addresses,
+                                       std::span<const uint8_t> frame);
+
+} // namespace ipmb_frame
+
+// Talks IPMB over an ipmb-dev character device (/dev/ipmb-N, from the kernel's
+// ipmb_dev_int driver) rather than through the bridge daemon.  Requests are
+// matched to their responses by sequence number, and fail with timed_out
+// unless answered within the timeout.
+//
+// The device only hands each response to a single reader, so a channel must
+// not be given to both the bridge and this transport.
+//
+// A read error other than having nothing to read, e.g. because the device
+// went away, stops the transport for good: the requests outstanding fail
+// with the error, as does every request sent from then on, and the failure
+// handler is called.
+class IpmbDeviceTransport :
+    public IpmbTransport,
+    public std::enable_shared_from_this<IpmbDeviceTransport>
+{
+  public:
+    static constexpr std::chrono::milliseconds defaultTimeout{250};
+
+    // Takes ownership of fd, which must be non-blocking
+    IpmbDeviceTransport(boost::asio::io_context& io, int fd,
+                        const IpmbAddresses& addresses,
+                        std::chrono::milliseconds timeout = defaultTimeout);
+
+    // Throws std::system_error if the device can't be opened
+    static std::shared_ptr<IpmbDeviceTransport> open(
+        boost::asio::io_context& io, const std::string& path,
+        const IpmbAddresses& addresses,
+        std::chrono::milliseconds timeout = defaultTimeout);
+
+    using FailureHandler =
+        std::function<void(const boost::system::error_code& ec)>;
+
+    // Starts reading responses
+    void start();
+
+    // handler is called once, should the transport stop on an error
+    void setFailureHandler(FailureHandler&& handler);
+
+    void send(const IpmbRequest& request, Reply&& reply) override;
+
+  private:
+    struct Pending
+    {
+        IpmbRequest request;
+        Reply reply;
+        std::unique_ptr<boost::asio::steady_timer> timer;
+    };
+
+    // IPMB sequence numbers are 6 bit
+    static constexpr size_t sequences = 64;
+
+    void receive();
+    void shutdown(const boost::system::error_code& ec);
+    void process(std::span<const uint8_t> frame);
+    void complete(uint8_t sequence, const boost::system::error_code& ec,
+                  const IpmbMethodType& response);
+
+    boost::asio::io_context& io;
+    boost::asio::posix::stream_descriptor device;
+    IpmbAddresses addresses;
+    std::chrono::milliseconds timeout;
+    std::map<uint8_t, Pending> pending;
+    uint8_t nextSequence = 0;
+    std::array<uint8_t, 256> buffer{};
+    FailureHandler failureHandler;
+    // Set once the transport has stopped
+    boost::system::error_code failure;
+};
+
+// Sends each request on the transport given for its channel, falling back to
+// the bridge for the rest
+class IpmbChannelTransport : public IpmbTransport
+{
+  public:
+    // The transport shared by the IPMB users in the process
+    static std::shared_ptr<IpmbChannelTransport> shared(
+        const std::shared_ptr<sdbusplus::asio::connection>& conn);
+
+    explicit IpmbChannelTransport(std::shared_ptr<IpmbTransport> fallback);
+
+    // Sends the requests of channel on transport, or the fallback if null
+    void setChannel(uint8_t channel, std::shared_ptr<IpmbTransport> transport);
+    // Sends the requests of channel on the fallback again if they're sent on
+    // transport, returning whether they were
+    bool dropChannel(uint8_t channel, const IpmbTransport* transport);
+
+    void send(const IpmbRequest& request, Reply&& reply) override;
+
+  private:
+    std::shared_ptr<IpmbTransport> fallback;
+    std::map<uint8_t, std::shared_ptr<IpmbTransport>> channels;
+};
@@ -5,14 +5,9 @@
 class MCTPDeviceRepository
 {
   private:
-    // FIXME: Ugh, hack. Figure out a better data structure?
     std::map<std::string, std::shared_ptr<MCTPDevice>> devices;
-
-    auto lookup(const std::shared_ptr<MCTPDevice>& device)
-    {
-        auto pred = [&device](const auto& it) { return it.second == device; };
-        return std::ranges::find_if(devices, pred);
-    }
+    // The reverse of devices, inventory path by device
+    std::map<std::shared_ptr<MCTPDevice>, std::string> inventory;
 
   public:
     MCTPDeviceRepository() = default;
@@ -23,46 +18,61 @@ class MCTPDeviceRepository
     MCTPDeviceRepository& operator=(const MCTPDeviceRepository&) = delete;
     MCTPDeviceRepository& operator=(MCTPDeviceRepository&&) = delete;
 
-    void add(const std::string& inventory,
-             const std::shared_ptr<MCTPDevice>& device)
+    void add(const std::string& path, const std::shared_ptr<MCTPDevice>& device)
     {
-        auto [entry, fresh] = devices.emplace(inventory, device);
-        if (!fresh && entry->second.get() != device.get())
+        // A device is held under one path, so that the two maps agree
+        auto known = inventory.find(device);
+        if (known != inventory.end() && known->second != path)
         {
             throw std::system_error(
                 std::make_error_code(std::errc::device_or_resource_busy),
-                std::format("Tried to add entry for existing device: {}",
+                std::format("Tried to add existing device under new path: {}",
                             device->describe()));
         }
+
+        auto [entry, fresh] = devices.emplace(path, device);
+        if (!fresh)
+        {
+            if (entry->second.get() != device.get())
+            {
+                throw std::system_error(
+                    std::make_error_code(std::errc::device_or_resource_busy),
+                    std::format("Tried to add entry for existing device: {}",
+                                device->describe()));
+            }
+            return;
+        }
+        inventory.emplace(device, path);
     }
 
     void remove(const std::shared_ptr<MCTPDevice>& device)
     {
-        auto entry = lookup(device);
-        if (entry == devices.end())
+        auto entry = inventory.find(device);
+        if (entry == inventory.end())
         {
             throw std::system_error(
                 std::make_error_code(std::errc::no_such_device),
                 std::format("Trying to remove unknown device: {}",
-                            entry->second->describe()));
+                            device->describe()));
         }
-        devices.erase(entry);
+        devices.erase(entry->second);
+        inventory.erase(entry);
     }
 
     bool contains(const std::shared_ptr<MCTPDevice>& device)
     {
-        return lookup(device) != devices.end();
+        return inventory.contains(device);
     }
 
     std::optional<std::string>
         inventoryFor(const std::shared_ptr<MCTPDevice>& device)
     {
-        auto entry = lookup(device);
-        if (entry == devices.end())
+        auto entry = inventory.find(device);
+        if (entry == inventory.end())
         {
             return {};
         }
-        return entry->first;
+        return entry->second;
     }
 
     std::shared_ptr<MCTPDevice> deviceFor(const std::string& inventory)
@@ -177,6 +177,11 @@ std::string MCTPDDevice::describe() const
     return description;
 }
 
+std::string MCTPDDevice::link() const
+{
+    return interface;
+}
+
 std::string MCTPDEndpoint::path(const std::shared_ptr<MCTPEndpoint>& ep)
 {
     return std::format("{}/networks/{}/endpoints/{}", mctpdControlPath,
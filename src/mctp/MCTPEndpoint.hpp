@@ -171,6 +171,12 @@ class MCTPDevice
      *         address properties.
      */
     virtual std::string describe() const = 0;
+
+    /**
+     * @return The name of the network interface through which the device is
+     *         reached. Setup of the devices on an interface is serialised.
+     */
+    virtual std::string link() const = 0;
 };
 
 class MCTPDDevice;
@@ -270,6 +276,7 @@ class MCTPDDevice :
                    added) override;
     void remove() override;
     std::string describe() const override;
+    std::string link() const override;
 
   private:
     static void onEndpointInterfacesRemoved(
@@ -2,14 +2,20 @@
 
 #include "MCTPDeviceRepository.hpp"
 #include "MCTPEndpoint.hpp"
+#include "Tracing.hpp"
 #include "Utils.hpp"
 
 #include <boost/system/detail/error_code.hpp>
 #include <phosphor-logging/lg2.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <cstdlib>
+#include <deque>
 #include <memory>
 #include <optional>
+#include <random>
 #include <string>
 #include <system_error>
 #include <utility>
@@ -17,12 +23,40 @@
 
 PHOSPHOR_LOG2_USING;
 
+MCTPReactor::Clock::duration MCTPReactor::retryDelay(unsigned failed)
+{
+    // Retry the first failure straight away, it's most likely the device
+    // wasn't quite ready
+    if (failed <= 1)
+    {
+        return {};
+    }
+
+    Clock::duration delay = maxRetryDelay;
+    if (failed - 2 < 16)
+    {
+        delay = std::min<Clock::duration>(
+            initialRetryDelay * (1U << (failed - 2)), maxRetryDelay);
+    }
+
+    // Only ever shorten the delay, so that devices failing together spread
+    // out without any waiting longer than the cap
+    std::uniform_real_distribution<double> spread(0.75, 1.0);
+    return std::chrono::duration_cast<Clock::duration>(delay * spread(jitter));
+}
+
 void MCTPReactor::deferSetup(const std::shared_ptr<MCTPDevice>& dev)
 {
-    debug("Deferring setup for MCTP device at [ {MCTP_DEVICE} ]", "MCTP_DEVICE",
-          dev->describe());
+    auto failed = failures.find(dev);
+    Clock::duration delay =
+        retryDelay(failed == failures.end() ? 0 : failed->second);
 
-    deferred.emplace(dev);
+    debug(
+        "Deferring setup for MCTP device at [ {MCTP_DEVICE} ] by {DELAY_MS}ms",
+        "MCTP_DEVICE", dev->describe(), "DELAY_MS",
+        std::chrono::duration_cast<std::chrono::milliseconds>(delay).count());
+
+    deferred.insert_or_assign(dev, now() + delay);
 }
 
 void MCTPReactor::untrackEndpoint(const std::shared_ptr<MCTPEndpoint>& ep)
@@ -89,13 +123,91 @@ void MCTPReactor::trackEndpoint(const std::shared_ptr<MCTPEndpoint>& ep)
 }
 
 void MCTPReactor::setupEndpoint(const std::shared_ptr<MCTPDevice>& dev)
+{
+    if (!pending.emplace(dev).second)
+    {
+        return; // Already queued or being set up
+    }
+
+    std::string link = dev->link();
+    std::deque<std::shared_ptr<MCTPDevice>>& waiting = queued[link];
+    if (waiting.empty() && !busy.contains(link))
+    {
+        ready.push_back(link);
+    }
+    waiting.push_back(dev);
+    setupMetrics.queued++;
+
+    dispatch();
+}
+
+void MCTPReactor::dispatch()
+{
+    // Setups may complete before returning, in which case this loop starts the
+    // next rather than a nested one
+    if (dispatching)
+    {
+        return;
+    }
+    dispatching = true;
+
+    while (setupMetrics.inFlight < setupLimit && !ready.empty())
+    {
+        std::string link = std::move(ready.front());
+        ready.pop_front();
+
+        // The queued devices may have since been unmanaged, and the interface
+        // queued again behind another turn of its own
+        auto waiting = queued.find(link);
+        if (waiting == queued.end() || busy.contains(link))
+        {
+            continue;
+        }
+
+        std::shared_ptr<MCTPDevice> dev = std::move(waiting->second.front());
+        waiting->second.pop_front();
+        if (waiting->second.empty())
+        {
+            queued.erase(waiting);
+        }
+        setupMetrics.queued--;
+
+        startSetup(dev, link);
+    }
+
+    dispatching = false;
+}
+
+void MCTPReactor::setupDone(const std::shared_ptr<MCTPDevice>& dev,
+                            const std::string& link)
+{
+    pending.erase(dev);
+    busy.erase(link);
+    setupMetrics.inFlight--;
+    if (queued.contains(link))
+    {
+        ready.push_back(link);
+    }
+}
+
+void MCTPReactor::setSetupLimit(size_t limit)
+{
+    setupLimit = std::max<size_t>(limit, 1);
+    dispatch();
+}
+
+void MCTPReactor::startSetup(const std::shared_ptr<MCTPDevice>& dev,
+                             const std::string& link)
 {
     debug(
         "Attempting to setup up MCTP endpoint for device at [ {MCTP_DEVICE} ]",
         "MCTP_DEVICE", dev->describe());
-    dev->setup([weak{weak_from_this()},
-                dev](const std::error_code& ec,
-                     const std::shared_ptr<MCTPEndpoint>& ep) mutable {
+    busy.insert(link);
+    setupMetrics.inFlight++;
+    setupMetrics.attempts++;
+    dev->setup([weak{weak_from_this()}, dev, link, started{now()}](
+                   const std::error_code& ec,
+                   const std::shared_ptr<MCTPEndpoint>& ep) mutable {
         auto self = weak.lock();
         if (!self)
         {
@@ -105,13 +217,24 @@ void MCTPReactor::setupEndpoint(const std::shared_ptr<MCTPDevice>& dev)
             return;
         }
 
+        self->setupDone(dev, link);
+
+        Clock::time_point completed = self->now();
+        Clock::duration latency = completed - started;
+        self->setupMetrics.totalLatency += latency;
+        self->setupMetrics.maxLatency =
+            std::max(self->setupMetrics.maxLatency, latency);
+        tracing::complete("MCTPEndpointSetup", started, completed,
+                          dev->describe());
+
         if (ec)
         {
             debug(
                 "Setup failed for MCTP device at [ {MCTP_DEVICE} ]: {ERROR_MESSAGE}",
                 "MCTP_DEVICE", dev->describe(), "ERROR_MESSAGE", ec.message());
 
-            self->deferSetup(dev);
+            self->setupFailed(dev);
+            self->dispatch();
             return;
         }
 
@@ -123,18 +246,99 @@ void MCTPReactor::setupEndpoint(const std::shared_ptr<MCTPDevice>& dev)
         {
             error("Failed to track endpoint '{MCTP_ENDPOINT}': {EXCEPTION}",
                   "MCTP_ENDPOINT", ep->describe(), "EXCEPTION", e);
-            self->deferSetup(dev);
+            self->setupFailed(dev);
+            self->dispatch();
+            return;
         }
+
+        self->setupMetrics.successes++;
+        self->failures.erase(dev);
+        self->dispatch();
     });
 }
 
+void MCTPReactor::setupFailed(const std::shared_ptr<MCTPDevice>& dev)
+{
+    setupMetrics.failures++;
+    // The device may have been unmanaged while its setup was outstanding
+    if (!devices.contains(dev))
+    {
+        return;
+    }
+    failures[dev]++;
+    deferSetup(dev);
+}
+
 void MCTPReactor::tick()
 {
-    auto toSetup = std::exchange(deferred, {});
+    Clock::time_point current = now();
+    std::vector<std::shared_ptr<MCTPDevice>> toSetup;
+    for (auto it = deferred.begin(); it != deferred.end();)
+    {
+        if (it->second <= current)
+        {
+            toSetup.emplace_back(it->first);
+            it = deferred.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
     for (const auto& entry : toSetup)
     {
         setupEndpoint(entry);
     }
+    recordMetrics(current);
+}
+
+void MCTPReactor::recordMetrics(Clock::time_point current)
+{
+    if (current - metricsRecorded < metricsPeriod)
+    {
+        return;
+    }
+    metricsRecorded = current;
+
+    tracing::counter("mctp setup attempts",
+                     static_cast<double>(setupMetrics.attempts));
+    tracing::counter("mctp setup successes",
+                     static_cast<double>(setupMetrics.successes));
+    tracing::counter("mctp setup failures",
+                     static_cast<double>(setupMetrics.failures));
+    tracing::counter("mctp setup queued",
+                     static_cast<double>(setupMetrics.queued));
+    tracing::counter("mctp setup in flight",
+                     static_cast<double>(setupMetrics.inFlight));
+
+    // The mean over the setups completed since the last record
+    uint64_t completed = setupMetrics.successes + setupMetrics.failures -
+                         recorded.successes - recorded.failures;
+    if (completed != 0)
+    {
+        std::chrono::duration<double, std::milli> latency =
+            setupMetrics.totalLatency - recorded.totalLatency;
+        tracing::counter("mctp setup latency ms",
+                         latency.count() / static_cast<double>(completed));
+    }
+    recorded = setupMetrics;
+}
+
+void MCTPReactor::retryNow()
+{
+    if (deferred.empty())
+    {
+        return;
+    }
+
+    debug("Retrying setup for {COUNT} deferred MCTP devices", "COUNT",
+          deferred.size());
+
+    auto toSetup = std::exchange(deferred, {});
+    for (const auto& [dev, _] : toSetup)
+    {
+        setupEndpoint(dev);
+    }
 }
 
 void MCTPReactor::manageMCTPDevice(const std::string& path,
@@ -197,6 +401,19 @@ void MCTPReactor::unmanageMCTPDevice(const std::string& path)
           "INVENTORY_PATH", path);
 
     deferred.erase(device);
+    failures.erase(device);
+    if (pending.erase(device) != 0)
+    {
+        auto waiting = queued.find(device->link());
+        if (waiting != queued.end())
+        {
+            setupMetrics.queued -= std::erase(waiting->second, device);
+            if (waiting->second.empty())
+            {
+                queued.erase(waiting);
+            }
+        }
+    }
 
     // Remove the device from the repository before notifying the device itself
     // of removal so we don't defer its setup
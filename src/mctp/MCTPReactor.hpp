@@ -2,9 +2,21 @@
 
 #include "MCTPDeviceRepository.hpp"
 #include "MCTPEndpoint.hpp"
+#include "Tracing.hpp"
 #include "Utils.hpp"
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 struct AssociationServer
@@ -16,6 +28,20 @@ struct AssociationServer
     virtual void disassociate(const std::string& path) = 0;
 };
 
+// Sets up the MCTP endpoints for the devices described by the inventory.
+//
+// A device whose setup fails is retried at the next tick(), and after that
+// with an exponentially growing, jittered delay up to maxRetryDelay so that
+// devices which aren't there don't keep mctpd busy.  retryNow() retries them
+// all at once, for when something they may have been waiting on appears.
+//
+// Setups are queued so that at most a limited number are outstanding with
+// mctpd at once, and at most one for each network interface, as those on an
+// interface contend for its bus anyway.  The interfaces take turns at the
+// queue, so one with many devices doesn't hold up the rest.
+//
+// The setup attempts, their outcomes and latency, and the queue depth are
+// recorded as tracing counters from tick(), at most once per metricsPeriod.
 class MCTPReactor : public std::enable_shared_from_this<MCTPReactor>
 {
     using MCTPDeviceFactory = std::function<std::shared_ptr<MCTPDevice>(
@@ -23,15 +49,50 @@ class MCTPReactor : public std::enable_shared_from_this<MCTPReactor>
         std::optional<std::uint8_t> eid)>;
 
   public:
+    using Clock = tracing::Clock;
+    using Now = std::function<Clock::time_point()>;
+
+    static constexpr std::chrono::seconds initialRetryDelay{5};
+    static constexpr std::chrono::seconds maxRetryDelay{300};
+    static constexpr size_t defaultSetupLimit = 8;
+    static constexpr std::chrono::seconds metricsPeriod{10};
+
+    struct Metrics
+    {
+        uint64_t attempts = 0;
+        uint64_t successes = 0;
+        uint64_t failures = 0;
+        // From starting the setup of a device to its completion
+        Clock::duration totalLatency{};
+        Clock::duration maxLatency{};
+        // Setups waiting their turn, and outstanding
+        size_t queued = 0;
+        size_t inFlight = 0;
+    };
+
     MCTPReactor() = delete;
     MCTPReactor(const MCTPReactor&) = delete;
     MCTPReactor(MCTPReactor&&) = delete;
-    explicit MCTPReactor(AssociationServer& server) : server(server) {}
+    explicit MCTPReactor(AssociationServer& server, Now now = Clock::now) :
+        server(server), now(std::move(now)), jitter(std::random_device{}()),
+        metricsRecorded(this->now())
+    {}
     ~MCTPReactor() = default;
     MCTPReactor& operator=(const MCTPReactor&) = delete;
     MCTPReactor& operator=(MCTPReactor&&) = delete;
 
+    // Retries the setup of the deferred devices that are due
     void tick();
+    // Retries the setup of all the deferred devices
+    void retryNow();
+
+    // Setups outstanding at once, at least 1
+    void setSetupLimit(size_t limit);
+
+    const Metrics& metrics() const
+    {
+        return setupMetrics;
+    }
 
     void manageMCTPDevice(const std::string& path,
                           const std::shared_ptr<MCTPDevice>& device);
@@ -41,13 +102,40 @@ class MCTPReactor : public std::enable_shared_from_this<MCTPReactor>
     static std::optional<std::string> findSMBusInterface(int bus);
 
     AssociationServer& server;
+    Now now;
     MCTPDeviceRepository devices;
 
-    // Tracks MCTP devices that have failed their setup
-    std::set<std::shared_ptr<MCTPDevice>> deferred;
+    // Tracks MCTP devices that have failed their setup, and when to retry it
+    std::map<std::shared_ptr<MCTPDevice>, Clock::time_point> deferred;
+    // Consecutive setup failures of each device
+    std::map<std::shared_ptr<MCTPDevice>, unsigned> failures;
+    std::minstd_rand jitter;
+    Metrics setupMetrics;
+    // As of the last record, to report the latency since
+    Metrics recorded;
+    Clock::time_point metricsRecorded;
+
+    // Devices waiting to be set up, by interface
+    std::map<std::string, std::deque<std::shared_ptr<MCTPDevice>>> queued;
+    // Interfaces with devices queued and no setup outstanding, in turn
+    std::deque<std::string> ready;
+    // Interfaces with a setup outstanding
+    std::set<std::string> busy;
+    // Devices queued or being set up
+    std::set<std::shared_ptr<MCTPDevice>> pending;
+    size_t setupLimit = defaultSetupLimit;
+    bool dispatching = false;
 
+    Clock::duration retryDelay(unsigned failed);
     void deferSetup(const std::shared_ptr<MCTPDevice>& dev);
     void setupEndpoint(const std::shared_ptr<MCTPDevice>& dev);
+    void dispatch();
+    void startSetup(const std::shared_ptr<MCTPDevice>& dev,
+                    const std::string& link);
+    void setupDone(const std::shared_ptr<MCTPDevice>& dev,
+                   const std::string& link);
+    void setupFailed(const std::shared_ptr<MCTPDevice>& dev);
     void trackEndpoint(const std::shared_ptr<MCTPEndpoint>& ep);
     void untrackEndpoint(const std::shared_ptr<MCTPEndpoint>& ep);
+    void recordMetrics(Clock::time_point current);
 };
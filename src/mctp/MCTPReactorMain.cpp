@@ -1,5 +1,6 @@
 #include "MCTPEndpoint.hpp"
 #include "MCTPReactor.hpp"
+#include "SensorDaemon.hpp"
 #include "Utils.hpp"
 
 #include <boost/asio/io_context.hpp>
@@ -22,6 +23,7 @@
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <string>
 #include <system_error>
 #include <vector>
 
@@ -176,80 +178,182 @@ static void manageMCTPEntity(
     }
 }
 
-static void exitReactor(boost::asio::io_context* io, sdbusplus::message_t& msg)
+static void mctpInterfaceAdded(const std::shared_ptr<MCTPReactor>& reactor,
+                               sdbusplus::message_t& msg)
 {
-    auto name = msg.unpack<std::string>();
-    info("Shutting down mctpreactor, lost dependency '{SERVICE_NAME}'",
-         "SERVICE_NAME", name);
-    io->stop();
+    auto path = msg.unpack<sdbusplus::message::object_path>();
+    debug("MCTP interface added at '{INTERFACE_PATH}'", "INTERFACE_PATH",
+          path.str);
+    reactor->retryNow();
 }
 
-int main()
+// Only the deferred setups that are due are retried on each tick, see
+// MCTPReactor::retryDelay()
+static constexpr std::chrono::seconds tickPeriod(1);
+
+// The reactor and everything feeding it.  Under sensord this is torn down
+// when entity-manager or mctpd goes away, and set up again when it returns,
+// as stopping the event loop would take the other backends down with it.
+class ReactorInstance
 {
-    constexpr std::chrono::seconds period(5);
+  public:
+    explicit ReactorInstance(SensorDaemon& daemon) :
+        associationServer(daemon.systemBus),
+        reactor(std::make_shared<MCTPReactor>(associationServer)),
+        clock(daemon.io)
+    {
+        auto& systemBus = daemon.systemBus;
+        using namespace sdbusplus::bus::match;
+
+        // mctpd publishes an object for each MCTP-capable link as it
+        // appears, e.g. once the driver for an I2C or I3C bus binds.
+        // Endpoints deferred for the lack of one can be set up straight away.
+        const std::string mctpInterfacesAddedSpec =
+            rules::sender("au.com.codeconstruct.MCTP1") +
+            rules::interfacesAddedAtPath(
+                "/au/com/codeconstruct/mctp1/interfaces/");
+
+        mctpInterfacesAddedMatch = std::make_unique<sdbusplus::bus::match_t>(
+            static_cast<sdbusplus::bus_t&>(*systemBus), mctpInterfacesAddedSpec,
+            std::bind_front(mctpInterfaceAdded, reactor));
+
+        const std::string interfacesRemovedMatchSpec =
+            rules::sender("xyz.openbmc_project.EntityManager") +
+            // Trailing slash on path: Listen for signals on the inventory
+            // subtree
+            rules::interfacesRemovedAtPath("/xyz/openbmc_project/inventory/");
+
+        interfacesRemovedMatch = std::make_unique<sdbusplus::bus::match_t>(
+            static_cast<sdbusplus::bus_t&>(*systemBus),
+            interfacesRemovedMatchSpec,
+            std::bind_front(removeInventory, reactor));
+
+        const std::string interfacesAddedMatchSpec =
+            rules::sender("xyz.openbmc_project.EntityManager") +
+            // Trailing slash on path: Listen for signals on the inventory
+            // subtree
+            rules::interfacesAddedAtPath("/xyz/openbmc_project/inventory/");
+
+        interfacesAddedMatch = std::make_unique<sdbusplus::bus::match_t>(
+            static_cast<sdbusplus::bus_t&>(*systemBus),
+            interfacesAddedMatchSpec,
+            std::bind_front(addInventory, systemBus, reactor));
+
+        alarm();
 
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
-    DBusAssociationServer associationServer(systemBus);
-    auto reactor = std::make_shared<MCTPReactor>(associationServer);
-    boost::asio::steady_timer clock(io);
+        // The reactor refers to the association server, so mustn't be kept
+        // alive beyond the instance
+        boost::asio::post(daemon.io, [weak{std::weak_ptr(reactor)},
+                                      systemBus]() {
+            auto gsc = std::make_shared<GetSensorConfiguration>(
+                systemBus, [weak, systemBus](ManagedObjectType& entities) {
+                    if (auto reactor = weak.lock())
+                    {
+                        manageMCTPEntity(systemBus, reactor, entities);
+                    }
+                });
+            gsc->getConfiguration({"MCTPI2CTarget", "MCTPI3CTarget"});
+        });
+    }
+
+    ~ReactorInstance() = default;
+    ReactorInstance(const ReactorInstance&) = delete;
+    ReactorInstance& operator=(const ReactorInstance&) = delete;
+    ReactorInstance(ReactorInstance&&) = delete;
+    ReactorInstance& operator=(ReactorInstance&&) = delete;
+
+    void retryNow()
+    {
+        reactor->retryNow();
+    }
 
-    std::function<void(const boost::system::error_code&)> alarm =
-        [&](const boost::system::error_code& ec) {
+  private:
+    void alarm()
+    {
+        clock.expires_after(tickPeriod);
+        clock.async_wait([this](const boost::system::error_code& ec) {
             if (ec)
             {
                 return;
             }
-            clock.expires_after(period);
-            clock.async_wait(alarm);
+            alarm();
             reactor->tick();
-        };
-    clock.expires_after(period);
-    clock.async_wait(alarm);
+        });
+    }
 
-    using namespace sdbusplus::bus::match;
+    DBusAssociationServer associationServer;
+    std::shared_ptr<MCTPReactor> reactor;
+    boost::asio::steady_timer clock;
+    std::unique_ptr<sdbusplus::bus::match_t> mctpInterfacesAddedMatch;
+    std::unique_ptr<sdbusplus::bus::match_t> interfacesRemovedMatch;
+    std::unique_ptr<sdbusplus::bus::match_t> interfacesAddedMatch;
+};
 
-    const std::string entityManagerNameLostSpec =
-        rules::nameOwnerChanged("xyz.openbmc_project.EntityManager");
+static void dependencyOwnerChanged(SensorDaemon& daemon,
+                                   std::unique_ptr<ReactorInstance>& instance,
+                                   sdbusplus::message_t& msg)
+{
+    auto [name, oldOwner,
+          newOwner] = msg.unpack<std::string, std::string, std::string>();
+    if (newOwner.empty())
+    {
+        if (!daemon.consolidated())
+        {
+            info("Shutting down mctpreactor, lost dependency '{SERVICE_NAME}'",
+                 "SERVICE_NAME", name);
+            daemon.io.stop();
+            return;
+        }
 
-    auto entityManagerNameLostMatch = sdbusplus::bus::match_t(
-        static_cast<sdbusplus::bus_t&>(*systemBus), entityManagerNameLostSpec,
-        std::bind_front(exitReactor, &io));
+        info("Stopping mctpreactor backend, lost dependency '{SERVICE_NAME}'",
+             "SERVICE_NAME", name);
+        instance.reset();
+        return;
+    }
 
-    const std::string mctpdNameLostSpec =
-        rules::nameOwnerChanged("au.com.codeconstruct.MCTP1");
+    if (!instance)
+    {
+        info("Restarting mctpreactor backend, '{SERVICE_NAME}' appeared",
+             "SERVICE_NAME", name);
+        instance = std::make_unique<ReactorInstance>(daemon);
+        return;
+    }
 
-    auto mctpdNameLostMatch = sdbusplus::bus::match_t(
-        static_cast<sdbusplus::bus_t&>(*systemBus), mctpdNameLostSpec,
-        std::bind_front(exitReactor, &io));
+    if (name == "au.com.codeconstruct.MCTP1")
+    {
+        info("'{SERVICE_NAME}' appeared, retrying deferred endpoint setup",
+             "SERVICE_NAME", name);
+        instance->retryNow();
+    }
+}
 
-    const std::string interfacesRemovedMatchSpec =
-        rules::sender("xyz.openbmc_project.EntityManager") +
-        // Trailing slash on path: Listen for signals on the inventory subtree
-        rules::interfacesRemovedAtPath("/xyz/openbmc_project/inventory/");
+static SensorDaemon::Task mctpReactorMain(SensorDaemon& daemon)
+{
+    auto& systemBus = daemon.systemBus;
+    auto instance = std::make_unique<ReactorInstance>(daemon);
 
-    auto interfacesRemovedMatch = sdbusplus::bus::match_t(
-        static_cast<sdbusplus::bus_t&>(*systemBus), interfacesRemovedMatchSpec,
-        std::bind_front(removeInventory, reactor));
+    using namespace sdbusplus::bus::match;
 
-    const std::string interfacesAddedMatchSpec =
-        rules::sender("xyz.openbmc_project.EntityManager") +
-        // Trailing slash on path: Listen for signals on the inventory subtree
-        rules::interfacesAddedAtPath("/xyz/openbmc_project/inventory/");
+    const std::string entityManagerNameOwnerSpec =
+        rules::nameOwnerChanged("xyz.openbmc_project.EntityManager");
 
-    auto interfacesAddedMatch = sdbusplus::bus::match_t(
-        static_cast<sdbusplus::bus_t&>(*systemBus), interfacesAddedMatchSpec,
-        std::bind_front(addInventory, systemBus, reactor));
+    auto entityManagerNameOwnerMatch = sdbusplus::bus::match_t(
+        static_cast<sdbusplus::bus_t&>(*systemBus), entityManagerNameOwnerSpec,
+        std::bind_front(dependencyOwnerChanged, std::ref(daemon),
+                        std::ref(instance)));
 
-    systemBus->request_name("xyz.openbmc_project.MCTPReactor");
+    const std::string mctpdNameOwnerSpec =
+        rules::nameOwnerChanged("au.com.codeconstruct.MCTP1");
 
-    boost::asio::post(io, [reactor, systemBus]() {
-        auto gsc = std::make_shared<GetSensorConfiguration>(
-            systemBus, std::bind_front(manageMCTPEntity, systemBus, reactor));
-        gsc->getConfiguration({"MCTPI2CTarget","MCTPI3CTarget"});
-    });
+    auto mctpdNameOwnerMatch = sdbusplus::bus::match_t(
+        static_cast<sdbusplus::bus_t&>(*systemBus), mctpdNameOwnerSpec,
+        std::bind_front(dependencyOwnerChanged, std::ref(daemon),
+                        std::ref(instance)));
 
-    io.run();
+    systemBus->request_name("xyz.openbmc_project.MCTPReactor");
 
-    return EXIT_SUCCESS;
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("mctp", "mctpreactor",
+                                           mctpReactorMain);
@@ -16,16 +16,14 @@
 
 #include "MCUTempSensor.hpp"
 
+#include "I2CScheduler.hpp"
+#include "SensorConfig.hpp"
+#include "SensorDaemon.hpp"
 #include "SensorPaths.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
 #include "sensor.hpp"
 
-#include <fcntl.h>
-#include <linux/i2c.h>
-#include <sys/ioctl.h>
-#include <unistd.h>
-
 #include <boost/asio/error.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/post.hpp>
@@ -40,6 +38,7 @@
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -47,19 +46,45 @@
 #include <utility>
 #include <vector>
 
-extern "C"
-{
-#include <i2c/smbus.h>
-#include <linux/i2c-dev.h>
-}
-
 constexpr const bool debug = false;
 
 constexpr const char* sensorType = "MCUTempSensor";
 static constexpr double mcuTempMaxReading = 0xFF;
 static constexpr double mcuTempMinReading = 0;
+// Well short of the poll period, so a wedged MCU doesn't back reads up
+static constexpr std::chrono::milliseconds readTimeout{500};
 
-boost::container::flat_map<std::string, std::unique_ptr<MCUTempSensor>> sensors;
+static boost::container::flat_map<std::string, std::shared_ptr<MCUTempSensor>>
+    sensors;
+
+namespace
+{
+
+struct MCUTempConfig
+{
+    std::string name;
+    uint8_t busId = 0;
+    uint8_t mcuAddress = 0;
+    uint8_t tempReg = 0;
+    std::string sensorClass;
+
+    bool operator==(const MCUTempConfig&) const = default;
+};
+
+} // namespace
+
+template <>
+struct sensor_config::Schema<MCUTempConfig>
+{
+    static constexpr auto fields = std::make_tuple(
+        required("Name", &MCUTempConfig::name),
+        required("Bus", &MCUTempConfig::busId),
+        required("Address", &MCUTempConfig::mcuAddress),
+        required("Reg", &MCUTempConfig::tempReg),
+        required("Class", &MCUTempConfig::sensorClass));
+};
+
+static sensor_config::Cache<MCUTempConfig> configCache;
 
 MCUTempSensor::MCUTempSensor(
     std::shared_ptr<sdbusplus::asio::connection>& conn,
@@ -72,7 +97,8 @@ MCUTempSensor::MCUTempSensor(
            sensorConfiguration, "MCUTempSensor", false, false,
            mcuTempMaxReading, mcuTempMinReading, conn),
     busId(busId), mcuAddress(mcuAddress), tempReg(tempReg),
-    objectServer(objectServer), waitTimer(io)
+    objectServer(objectServer), waitTimer(io),
+    scheduler(I2CScheduler::shared(io))
 {
     sensorInterface = objectServer.add_interface(
         "/xyz/openbmc_project/sensors/temperature/" + name,
@@ -112,62 +138,13 @@ void MCUTempSensor::checkThresholds()
     thresholds::checkThresholds(this);
 }
 
-int MCUTempSensor::getMCURegsInfoWord(uint8_t regs, int32_t* pu32data) const
-{
-    std::string i2cBus = "/dev/i2c-" + std::to_string(busId);
-
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-    int fd = open(i2cBus.c_str(), O_RDWR);
-    if (fd < 0)
-    {
-        std::cerr << " unable to open i2c device" << i2cBus << "  err=" << fd
-                  << "\n";
-        return -1;
-    }
-
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-    if (ioctl(fd, I2C_SLAVE_FORCE, mcuAddress) < 0)
-    {
-        std::cerr << " unable to set device address\n";
-        close(fd);
-        return -1;
-    }
-
-    unsigned long funcs = 0;
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-    if (ioctl(fd, I2C_FUNCS, &funcs) < 0)
-    {
-        std::cerr << " not support I2C_FUNCS\n";
-        close(fd);
-        return -1;
-    }
-
-    if ((funcs & I2C_FUNC_SMBUS_READ_WORD_DATA) == 0U)
-    {
-        std::cerr << " not support I2C_FUNC_SMBUS_READ_WORD_DATA\n";
-        close(fd);
-        return -1;
-    }
-
-    *pu32data = i2c_smbus_read_word_data(fd, regs);
-    close(fd);
-
-    if (*pu32data < 0)
-    {
-        std::cerr << " read word data failed at " << static_cast<int>(regs)
-                  << "\n";
-        return -1;
-    }
-
-    return 0;
-}
-
 void MCUTempSensor::read()
 {
     static constexpr size_t pollTime = 1; // in seconds
 
+    std::weak_ptr<MCUTempSensor> weakRef = weak_from_this();
     waitTimer.expires_after(std::chrono::seconds(pollTime));
-    waitTimer.async_wait([this](const boost::system::error_code& ec) {
+    waitTimer.async_wait([weakRef](const boost::system::error_code& ec) {
         if (ec == boost::asio::error::operation_aborted)
         {
             return; // we're being cancelled
@@ -178,30 +155,53 @@ void MCUTempSensor::read()
             std::cerr << "timer error\n";
             return;
         }
-        int32_t temp = 0;
-        int ret = getMCURegsInfoWord(tempReg, &temp);
-        if (ret >= 0)
+        std::shared_ptr<MCUTempSensor> self = weakRef.lock();
+        if (!self)
         {
-            double v = static_cast<double>(temp) / 1000;
-            if constexpr (debug)
-            {
-                std::cerr << "Value update to " << v << "raw reading "
-                          << static_cast<int>(temp) << "\n";
-            }
-            updateValue(v);
+            return;
         }
-        else
+        // The MCU is typically claimed by a driver, hence forcing the address
+        self->scheduler->submit(
+            {self->busId, self->mcuAddress,
+             I2CTransaction::Op::readWordData, self->tempReg, true},
+            [weakRef](const I2CResult& result) {
+                std::shared_ptr<MCUTempSensor> self = weakRef.lock();
+                if (self)
+                {
+                    self->handleResponse(result);
+                }
+            },
+            readTimeout);
+    });
+}
+
+void MCUTempSensor::handleResponse(const I2CResult& result)
+{
+    if (result.error == 0)
+    {
+        double v = static_cast<double>(result.value) / 1000;
+        if constexpr (debug)
         {
-            std::cerr << "Invalid read getMCURegsInfoWord\n";
-            incrementError();
+            std::cerr << "Value update to " << v << "raw reading "
+                      << static_cast<int>(result.value) << "\n";
         }
-        read();
-    });
+        updateValue(v);
+    }
+    else
+    {
+        std::cerr << "Failed to read " << name << " from i2c-"
+                  << static_cast<int>(busId) << " address "
+                  << static_cast<int>(mcuAddress) << " register "
+                  << static_cast<int>(tempReg) << ": "
+                  << std::strerror(result.error) << "\n";
+        incrementError();
+    }
+    read();
 }
 
 void createSensors(
     boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
-    boost::container::flat_map<std::string, std::unique_ptr<MCUTempSensor>>&
+    boost::container::flat_map<std::string, std::shared_ptr<MCUTempSensor>>&
         sensors,
     std::shared_ptr<sdbusplus::asio::connection>& dbusConnection)
 {
@@ -227,42 +227,49 @@ void createSensors(
                     {
                         continue;
                     }
-                    std::string name = loadVariant<std::string>(cfg, "Name");
+                    sensor_config::Update update =
+                        configCache.update(path, cfg);
+                    if (update == sensor_config::Update::invalid)
+                    {
+                        continue;
+                    }
+                    const MCUTempConfig& config = *configCache.find(path);
 
                     std::vector<thresholds::Threshold> sensorThresholds;
                     if (!parseThresholdsFromConfig(interfaces,
                                                    sensorThresholds))
                     {
-                        std::cerr << "error populating thresholds for " << name
-                                  << "\n";
+                        std::cerr << "error populating thresholds for "
+                                  << config.name << "\n";
                     }
 
-                    uint8_t busId = loadVariant<uint8_t>(cfg, "Bus");
-                    uint8_t mcuAddress = loadVariant<uint8_t>(cfg, "Address");
-                    uint8_t tempReg = loadVariant<uint8_t>(cfg, "Reg");
-
-                    std::string sensorClass =
-                        loadVariant<std::string>(cfg, "Class");
-
                     if constexpr (debug)
                     {
                         std::cerr
                             << "Configuration parsed for \n\t" << intf << "\n"
                             << "with\n"
-                            << "\tName: " << name << "\n"
-                            << "\tBus: " << static_cast<int>(busId) << "\n"
-                            << "\tAddress: " << static_cast<int>(mcuAddress)
+                            << "\tName: " << config.name << "\n"
+                            << "\tBus: " << static_cast<int>(config.busId)
                             << "\n"
-                            << "\tReg: " << static_cast<int>(tempReg) << "\n"
-                            << "\tClass: " << sensorClass << "\n";
+                            << "\tAddress: "
+                            << static_cast<int>(config.mcuAddress) << "\n"
+                            << "\tReg: " << static_cast<int>(config.tempReg)
+                            << "\n"
+                            << "\tClass: " << config.sensorClass << "\n";
                     }
 
-                    auto& sensor = sensors[name];
+                    auto& sensor = sensors[config.name];
+                    if (update == sensor_config::Update::unchanged && sensor &&
+                        sensor->thresholds == sensorThresholds)
+                    {
+                        // Nothing the sensor was built from has changed
+                        continue;
+                    }
 
-                    sensor = std::make_unique<MCUTempSensor>(
-                        dbusConnection, io, name, path, objectServer,
-                        std::move(sensorThresholds), busId, mcuAddress,
-                        tempReg);
+                    sensor = std::make_shared<MCUTempSensor>(
+                        dbusConnection, io, config.name, path, objectServer,
+                        std::move(sensorThresholds), config.busId,
+                        config.mcuAddress, config.tempReg);
 
                     sensor->init();
                 }
@@ -272,12 +279,12 @@ void createSensors(
         "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
 }
 
-int main()
+static SensorDaemon::Task mcuTempSensorMain(SensorDaemon& daemon)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
-    sdbusplus::asio::object_server objectServer(systemBus, true);
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
+    daemon.addManager("/xyz/openbmc_project/sensors");
 
     systemBus->request_name("xyz.openbmc_project.MCUTempSensor");
 
@@ -314,6 +321,8 @@ int main()
         setupPropertiesChangedMatches(
             *systemBus, std::to_array<const char*>({sensorType}), eventHandler);
     setupManufacturingModeMatch(*systemBus);
-    io.run();
-    return 0;
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("mcu", "mcutempsensor",
+                                           mcuTempSensorMain);
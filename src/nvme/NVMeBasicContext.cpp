@@ -2,22 +2,22 @@
 
 #include "NVMeContext.hpp"
 #include "NVMeSensor.hpp"
+#include "SPSCQueue.hpp"
+#include "Tracing.hpp"
 
-#include <endian.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
 #include <FileHandle.hpp>
-#include <boost/asio/buffer.hpp>
 #include <boost/asio/error.hpp>
 #include <boost/asio/io_context.hpp>
-#include <boost/asio/read.hpp>
-#include <boost/asio/streambuf.hpp>
-#include <boost/asio/write.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
-#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
@@ -25,20 +25,22 @@
 #include <filesystem>
 #include <ios>
 #include <iostream>
-#include <iterator>
 #include <limits>
+#include <list>
 #include <memory>
+#include <optional>
 #include <stdexcept>
+#include <stop_token>
 #include <string>
 #include <system_error>
 #include <thread>
 #include <utility>
-#include <vector>
 
 extern "C"
 {
 #include <i2c/smbus.h>
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
 }
 
 /*
@@ -47,211 +49,282 @@ extern "C"
  * https://nvmexpress.org/wp-content/uploads/NVMe_Management_-_Technical_Note_on_Basic_Management_Command.pdf
  */
 
-static std::shared_ptr<std::array<uint8_t, 6>>
-    encodeBasicQuery(int bus, uint8_t device, uint8_t offset)
+namespace
 {
-    if (bus < 0)
+
+// The basic query thread's open i2c bus descriptors, most recently used
+// first.  Drives are polled round-robin, so keeping the descriptors and the
+// selected target address saves an open(), ioctl() and close() on each query.
+class I2CBusCache
+{
+  public:
+    struct Bus
+    {
+        Bus(int bus, FileHandle&& file, unsigned long funcs) :
+            bus(bus), file(std::move(file)), funcs(funcs)
+        {}
+
+        int bus;
+        FileHandle file;
+        unsigned long funcs;
+        // The address last set with I2C_SLAVE, if any
+        std::optional<uint8_t> target;
+
+        // An SMBus block read as a single combined I2C_RDWR transfer, rather
+        // than the I2C_SLAVE/I2C_SMBUS pair
+        bool combinedTransfers() const
+        {
+            return ((funcs & I2C_FUNC_I2C) != 0U) &&
+                   ((funcs & I2C_FUNC_SMBUS_READ_BLOCK_DATA) != 0U);
+        }
+    };
+
+    // Enough for a fully populated backplane behind per-slot mux channels
+    static constexpr size_t maxOpenBuses = 32;
+
+    // Throws std::out_of_range if the bus can't be opened
+    Bus& get(int bus)
     {
-        throw std::domain_error("Invalid bus argument");
+        auto findBus = std::ranges::find(buses, bus, &Bus::bus);
+        if (findBus != buses.end())
+        {
+            buses.splice(buses.begin(), buses, findBus);
+            return buses.front();
+        }
+
+        if (buses.size() >= maxOpenBuses)
+        {
+            buses.pop_back();
+        }
+
+        FileHandle file("/dev/i2c-" + std::to_string(bus));
+        unsigned long funcs = 0;
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+        if (::ioctl(file.handle(), I2C_FUNCS, &funcs) == -1)
+        {
+            funcs = 0;
+        }
+        return buses.emplace_front(bus, std::move(file), funcs);
     }
 
-    /* bus + address + command */
-    uint32_t busle = htole32(static_cast<uint32_t>(bus));
-    auto command =
-        std::make_shared<std::array<uint8_t, sizeof(busle) + 1 + 1>>();
-    memcpy(command->data(), &busle, sizeof(busle));
-    (*command)[sizeof(busle) + 0] = device;
-    (*command)[sizeof(busle) + 1] = offset;
+    void evict(int bus)
+    {
+        buses.remove_if([bus](const Bus& entry) { return entry.bus == bus; });
+    }
 
-    return command;
-}
+  private:
+    std::list<Bus> buses;
+};
 
-static void decodeBasicQuery(const std::array<uint8_t, 6>& req, int& bus,
-                             uint8_t& device, uint8_t& offset)
+struct BasicQuery
 {
-    uint32_t busle = 0;
+    int bus;
+    uint8_t device;
+    uint8_t offset;
+};
 
-    memcpy(&busle, req.data(), sizeof(busle));
-    bus = le32toh(busle);
-    device = req[sizeof(busle) + 0];
-    offset = req[sizeof(busle) + 1];
-}
+struct BasicResponse
+{
+    // The length of the block data that follows, zero if the query failed
+    std::array<uint8_t, I2C_SMBUS_BLOCK_MAX + 1> block;
+};
+
+} // namespace
 
-static void execBasicQuery(int bus, uint8_t addr, uint8_t cmd,
-                           std::vector<uint8_t>& resp)
+// Queries and their responses are passed in place between the event loop and
+// the basic query thread, each direction signalled through an eventfd.  The
+// event loop never has more than maxQueueDepth queries outstanding, so
+// neither ring can overflow.
+struct BasicQueryChannel
 {
-    int32_t size = 0;
-    std::filesystem::path devpath = "/dev/i2c-" + std::to_string(bus);
+    explicit BasicQueryChannel(int responseEvent) :
+        requestEvent(::eventfd(0, EFD_CLOEXEC)),
+        responseEvent(::fcntl(responseEvent, F_DUPFD_CLOEXEC, 0))
+    {}
 
-    try
+    SPSCQueue<BasicQuery, NVMeBasicContext::maxQueueDepth> requests;
+    SPSCQueue<BasicResponse, NVMeBasicContext::maxQueueDepth> responses;
+
+    // Blocking, read by the basic query thread
+    FileHandle requestEvent;
+    // The basic query thread's duplicate of respStream's descriptor
+    FileHandle responseEvent;
+};
+
+static void signalEvent(const FileHandle& event)
+{
+    uint64_t count = 1;
+    if (::write(event.handle(), &count, sizeof(count)) < 0)
     {
-        FileHandle fileHandle(devpath);
+        std::cerr << "Failed to signal basic query event: " << strerror(errno)
+                  << "\n";
+    }
+}
 
-        /* Select the target device */
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
-        if (::ioctl(fileHandle.handle(), I2C_SLAVE, addr) == -1)
-        {
-            std::cerr << "Failed to configure device address 0x" << std::hex
-                      << (int)addr << " for bus " << std::dec << bus << ": "
-                      << strerror(errno) << "\n";
-            resp.resize(0);
-            return;
-        }
+static int readBlockCombined(I2CBusCache::Bus& bus, uint8_t addr, uint8_t cmd,
+                             BasicResponse& resp)
+{
+    // The first byte read is the block length.  With I2C_M_RECV_LEN, i2c-dev
+    // takes the first byte of the buffer as the number of bytes to read
+    // before the block data, here just the length byte itself.
+    resp.block[0] = 1;
+
+    std::array<i2c_msg, 2> msgs{};
+    msgs[0].addr = addr;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &cmd;
+    msgs[1].addr = addr;
+    msgs[1].flags = I2C_M_RD | I2C_M_RECV_LEN;
+    msgs[1].len = resp.block.size();
+    msgs[1].buf = resp.block.data();
+
+    i2c_rdwr_ioctl_data transfer{msgs.data(), msgs.size()};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    if (::ioctl(bus.file.handle(), I2C_RDWR, &transfer) == -1)
+    {
+        return -1;
+    }
 
-        resp.resize(UINT8_MAX + 1);
+    resp.block[0] = std::min<uint8_t>(resp.block[0], I2C_SMBUS_BLOCK_MAX);
+    return resp.block[0];
+}
 
-        /* Issue the NVMe MI basic command */
-        size = i2c_smbus_read_block_data(fileHandle.handle(), cmd, resp.data());
-        if (size < 0)
-        {
-            std::cerr << "Failed to read block data from device 0x" << std::hex
-                      << (int)addr << " on bus " << std::dec << bus << ": "
-                      << strerror(errno) << "\n";
-            resp.resize(0);
-        }
-        else if (size > UINT8_MAX + 1)
-        {
-            std::cerr << "Unexpected message length from device 0x" << std::hex
-                      << (int)addr << " on bus " << std::dec << bus << ": "
-                      << size << " (" << UINT8_MAX << ")\n";
-            resp.resize(0);
-        }
-        else
+static int readBlockSMBus(I2CBusCache::Bus& bus, uint8_t addr, uint8_t cmd,
+                          BasicResponse& resp)
+{
+    /* Select the target device */
+    if (bus.target != addr)
+    {
+        bus.target.reset();
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+        if (::ioctl(bus.file.handle(), I2C_SLAVE, addr) == -1)
         {
-            resp.resize(size);
+            return -1;
         }
+        bus.target = addr;
     }
-    catch (const std::out_of_range& e)
+
+    /* Issue the NVMe MI basic command */
+    int32_t size = i2c_smbus_read_block_data(bus.file.handle(), cmd,
+                                             resp.block.data() + 1);
+    if (size > I2C_SMBUS_BLOCK_MAX)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (size >= 0)
     {
-        std::cerr << "Failed to create file handle for bus " << std::dec << bus
-                  << ": " << e.what() << "\n";
-        resp.resize(0);
+        resp.block[0] = static_cast<uint8_t>(size);
     }
+    return size;
 }
 
-static ssize_t processBasicQueryStream(FileHandle& in, FileHandle& out)
+static void execBasicQuery(I2CBusCache& cache, const BasicQuery& query,
+                           BasicResponse& resp)
 {
-    std::vector<uint8_t> resp{};
-    ssize_t rc = 0;
+    resp.block[0] = 0;
 
-    while (true)
+    try
     {
-        uint8_t device = 0;
-        uint8_t offset = 0;
-        uint8_t len = 0;
-        int bus = 0;
-
-        /* bus + address + command */
-        std::array<uint8_t, sizeof(uint32_t) + 1 + 1> req{};
+        I2CBusCache::Bus& entry = cache.get(query.bus);
 
-        /* Read the command parameters */
-        ssize_t rc = ::read(in.handle(), req.data(), req.size());
-        if (rc != static_cast<ssize_t>(req.size()))
+        int size = entry.combinedTransfers()
+                       ? readBlockCombined(entry, query.device, query.offset,
+                                           resp)
+                       : readBlockSMBus(entry, query.device, query.offset,
+                                        resp);
+        if (size < 0)
         {
-            std::cerr << "Failed to read request from in descriptor "
-                      << strerror(errno) << "\n";
-            if (rc != 0)
+            int err = errno;
+            std::cerr << "Failed to read block data from device 0x" << std::hex
+                      << (int)query.device << " on bus " << std::dec
+                      << query.bus << ": " << strerror(err) << "\n";
+            resp.block[0] = 0;
+
+            // The adapter has gone away, reopen it next time
+            if (err == ENODEV)
             {
-                return -errno;
+                cache.evict(query.bus);
             }
-            return -EIO;
         }
+    }
+    catch (const std::out_of_range& e)
+    {
+        std::cerr << "Failed to create file handle for bus " << std::dec
+                  << query.bus << ": " << e.what() << "\n";
+    }
+}
 
-        decodeBasicQuery(req, bus, device, offset);
-
-        /* Execute the query */
-        execBasicQuery(bus, device, offset, resp);
+static void processBasicQueries(BasicQueryChannel& channel,
+                                const std::stop_token& stop)
+{
+    I2CBusCache buses;
 
-        /* Write out the response length */
-        len = resp.size();
-        rc = ::write(out.handle(), &len, sizeof(len));
-        if (rc != sizeof(len))
+    while (!stop.stop_requested())
+    {
+        uint64_t count = 0;
+        if (::read(channel.requestEvent.handle(), &count, sizeof(count)) < 0)
         {
-            std::cerr << "Failed to write block (" << std::dec << len
-                      << ") length to out descriptor: "
-                      << strerror(static_cast<int>(-rc)) << "\n";
-            if (rc != 0)
+            if (errno == EINTR)
             {
-                return -errno;
+                continue;
             }
-            return -EIO;
+            std::cerr << "Failed to wait for basic queries: "
+                      << strerror(errno) << "\n";
+            return;
         }
 
-        /* Write out the response data */
-        std::vector<uint8_t>::iterator cursor = resp.begin();
-        while (cursor != resp.end())
+        while (const BasicQuery* query = channel.requests.front())
         {
-            size_t lenRemaining = std::distance(cursor, resp.end());
-            ssize_t egress = ::write(out.handle(), &(*cursor), lenRemaining);
-            if (egress == -1)
+            if (stop.stop_requested())
             {
-                std::cerr << "Failed to write block data of length " << std::dec
-                          << lenRemaining << " to out pipe: " << strerror(errno)
-                          << "\n";
-                if (rc != 0)
-                {
-                    return -errno;
-                }
-                return -EIO;
+                return;
             }
 
-            cursor += egress;
+            /* Execute the query straight into the response slot */
+            BasicResponse* response = channel.responses.reserve();
+            execBasicQuery(buses, *query, *response);
+            channel.requests.pop();
+            channel.responses.commit();
+            signalEvent(channel.responseEvent);
         }
     }
-
-    return rc;
 }
 
 /* Throws std::error_code on failure */
 /* FIXME: Probably shouldn't do fallible stuff in a constructor */
-NVMeBasicContext::NVMeBasicContext(boost::asio::io_context& io, int rootBus) :
-    NVMeContext::NVMeContext(io, rootBus), io(io), reqStream(io), respStream(io)
+NVMeBasicContext::NVMeBasicContext(boost::asio::io_context& io, int rootBus,
+                                   size_t maxInFlight) :
+    NVMeContext::NVMeContext(io, rootBus), io(io),
+    maxInFlight(std::clamp<size_t>(maxInFlight, 1, maxQueueDepth)),
+    respStream(io)
 {
-    std::array<int, 2> responsePipe{};
-    std::array<int, 2> requestPipe{};
-
     /* Set up inter-thread communication */
-    if (::pipe(requestPipe.data()) == -1)
+    int responseEvent = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (responseEvent == -1)
     {
-        std::cerr << "Failed to create request pipe: " << strerror(errno)
+        std::cerr << "Failed to create response eventfd: " << strerror(errno)
                   << "\n";
         throw std::error_code(errno, std::system_category());
     }
+    respStream.assign(responseEvent);
 
-    if (::pipe(responsePipe.data()) == -1)
+    channel = std::make_shared<BasicQueryChannel>(responseEvent);
+    if (channel->requestEvent.handle() == -1 ||
+        channel->responseEvent.handle() == -1)
     {
-        std::cerr << "Failed to create response pipe: " << strerror(errno)
+        std::cerr << "Failed to create request eventfd: " << strerror(errno)
                   << "\n";
-
-        if (::close(requestPipe[0]) == -1)
-        {
-            std::cerr << "Failed to close write fd of request pipe: "
-                      << strerror(errno) << "\n";
-        }
-
-        if (::close(requestPipe[1]) == -1)
-        {
-            std::cerr << "Failed to close read fd of request pipe: "
-                      << strerror(errno) << "\n";
-        }
-
         throw std::error_code(errno, std::system_category());
     }
 
-    reqStream.assign(requestPipe[1]);
-    FileHandle streamIn(requestPipe[0]);
-    FileHandle streamOut(responsePipe[1]);
-    respStream.assign(responsePipe[0]);
-
-    thread = std::jthread([streamIn{std::move(streamIn)},
-                           streamOut{std::move(streamOut)}]() mutable {
-        ssize_t rc = processBasicQueryStream(streamIn, streamOut);
+    thread = std::jthread([channel{channel}](const std::stop_token& stop) {
+        /* Runs on the destructing thread, wake us up to notice */
+        std::stop_callback wake(
+            stop, [&channel]() { signalEvent(channel->requestEvent); });
 
-        if (rc < 0)
-        {
-            std::cerr << "Failure while processing query stream: "
-                      << strerror(static_cast<int>(-rc)) << "\n";
-        }
+        processBasicQueries(*channel, stop);
 
         std::cerr << "Terminating basic query thread\n";
     });
@@ -259,137 +332,115 @@ NVMeBasicContext::NVMeBasicContext(boost::asio::io_context& io, int rootBus) :
 
 void NVMeBasicContext::readAndProcessNVMeSensor()
 {
-    if (pollCursor == sensors.end())
+    bool issued = false;
+
+    /* Keep up to maxInFlight queries queued with the basic query thread */
+    while (inFlight.size() < maxInFlight && pollCursor != sensors.end())
     {
+        std::shared_ptr<NVMeSensor> sensor = *pollCursor++;
+
+        /* Drives poll at their own rates, only some are due each sweep */
+        if (!sensor->due(sweepStarted))
+        {
+            continue;
+        }
+
+        if (!sensor->readingStateGood())
+        {
+            sensor->markAvailable(false);
+            sensor->updateValue(std::numeric_limits<double>::quiet_NaN());
+            continue;
+        }
+
+        /* Skip empty slots, and back off drives in error or not responding */
+        if (!sensor->sample())
+        {
+            continue;
+        }
+
+        /* Every query in either ring is counted in inFlight, so this fits */
+        BasicQuery* query = channel->requests.reserve();
+        query->bus = sensor->bus;
+        query->device = sensor->address;
+        query->offset = 0x00;
+        channel->requests.commit();
+        inFlight.push(std::move(sensor));
+        issued = true;
+    }
+
+    if (inFlight.empty())
+    {
+        tracing::complete("NVMeSweep", sweepStarted, tracing::Clock::now(),
+                          "i2c-" + std::to_string(rootBus));
         this->pollNVMeDevices();
         return;
     }
 
-    std::shared_ptr<NVMeSensor> sensor = *pollCursor++;
-
-    if (!sensor->readingStateGood())
+    /* Issue the requests */
+    if (issued)
     {
-        sensor->markAvailable(false);
-        sensor->updateValue(std::numeric_limits<double>::quiet_NaN());
-        readAndProcessNVMeSensor();
-        return;
+        signalEvent(channel->requestEvent);
     }
 
-    /* Potentially defer sampling the sensor sensor if it is in error */
-    if (!sensor->sample())
+    if (!reading)
     {
-        readAndProcessNVMeSensor();
-        return;
+        readResponse();
     }
+}
 
-    auto command = encodeBasicQuery(sensor->bus, sensor->address, 0x00);
+void NVMeBasicContext::readResponse()
+{
+    reading = true;
 
-    /* Issue the request */
-    boost::asio::async_write(
-        reqStream, boost::asio::buffer(command->data(), command->size()),
-        [command](boost::system::error_code ec, std::size_t) {
-            if (ec)
+    respStream.async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [weakSelf{weak_from_this()}](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
             {
-                std::cerr << "Got error writing basic query: " << ec << "\n";
+                return;
             }
-        });
-
-    auto response = std::make_shared<boost::asio::streambuf>();
-    response->prepare(1);
 
-    /* Gather the response and dispatch for parsing */
-    boost::asio::async_read(
-        respStream, *response,
-        [response](const boost::system::error_code& ec, std::size_t n) {
             if (ec)
             {
-                std::cerr << "Got error completing basic query: " << ec << "\n";
-                return static_cast<std::size_t>(0);
-            }
-
-            if (n == 0)
-            {
-                return static_cast<std::size_t>(1);
-            }
-
-            std::istream is(response.get());
-            size_t len = static_cast<std::size_t>(is.peek());
-
-            if (n > len + 1)
-            {
-                std::cerr << "Query stream has become unsynchronised: "
-                          << "n: " << n << ", "
-                          << "len: " << len << "\n";
-                return static_cast<std::size_t>(0);
-            }
-
-            if (n == len + 1)
-            {
-                return static_cast<std::size_t>(0);
-            }
-
-            if (n > 1)
-            {
-                return len + 1 - n;
+                std::cerr << "Got error waiting for basic query: " << ec
+                          << "\n";
+                return;
             }
 
-            response->prepare(len);
-            return len;
-        },
-        [weakSelf{weak_from_this()}, sensor, response](
-            const boost::system::error_code& ec, std::size_t length) mutable {
-            if (ec)
+            auto self =
+                std::static_pointer_cast<NVMeBasicContext>(weakSelf.lock());
+            if (!self)
             {
-                std::cerr << "Got error reading basic query: " << ec << "\n";
                 return;
             }
+            self->reading = false;
 
-            if (length == 0)
+            /* Reset the eventfd, the ring says how many responses are ready */
+            uint64_t count = 0;
+            if (::read(self->respStream.native_handle(), &count,
+                       sizeof(count)) < 0 &&
+                errno != EAGAIN)
             {
-                std::cerr << "Invalid message length: " << length << "\n";
-                return;
+                std::cerr << "Failed to read response eventfd: "
+                          << strerror(errno) << "\n";
             }
 
-            if (auto self = weakSelf.lock())
+            while (BasicResponse* response = self->channel->responses.front())
             {
-                /* Deserialise the response */
-                response->consume(1); /* Drop the length byte */
-                std::istream is(response.get());
-                std::vector<char> data(response->size());
-                is.read(data.data(), response->size());
-
-                /* Update the sensor */
-                self->processResponse(sensor, data.data(), data.size());
-
-                /* Enqueue processing of the next sensor */
-                self->readAndProcessNVMeSensor();
+                /* Responses arrive in the order the queries were issued */
+                std::shared_ptr<NVMeSensor> sensor =
+                    std::move(*self->inFlight.front());
+                self->inFlight.pop();
+
+                /* Update the sensor straight from the response slot */
+                self->processResponse(sensor, response->block.data() + 1,
+                                      response->block[0]);
+                self->channel->responses.pop();
             }
-        });
-}
-
-void NVMeBasicContext::pollNVMeDevices()
-{
-    pollCursor = sensors.begin();
-
-    scanTimer.expires_after(std::chrono::seconds(1));
-    scanTimer.async_wait([weakSelf{weak_from_this()}](
-                             const boost::system::error_code errorCode) {
-        if (errorCode == boost::asio::error::operation_aborted)
-        {
-            return;
-        }
-
-        if (errorCode)
-        {
-            std::cerr << errorCode.message() << "\n";
-            return;
-        }
 
-        if (auto self = weakSelf.lock())
-        {
+            /* Top up the queue and wait for the next response */
             self->readAndProcessNVMeSensor();
-        }
-    });
+        });
 }
 
 static double getTemperatureReading(int8_t reading)
@@ -408,7 +459,16 @@ static double getTemperatureReading(int8_t reading)
 void NVMeBasicContext::processResponse(std::shared_ptr<NVMeSensor>& sensor,
                                        void* msg, size_t len)
 {
-    if (msg == nullptr || len < 6)
+    /* Nothing came back from the drive: back off querying its slot */
+    if (msg == nullptr || len == 0)
+    {
+        sensor->missed();
+        sensor->incrementError();
+        return;
+    }
+    sensor->responded();
+
+    if (len < 6)
     {
         sensor->incrementError();
         return;
@@ -1,43 +1,62 @@
 #pragma once
 
 #include "NVMeContext.hpp"
+#include "SPSCQueue.hpp"
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
 
+#include <cstddef>
+#include <memory>
 #include <thread>
 
+// The request and response rings shared with the basic query thread
+struct BasicQueryChannel;
+
 class NVMeBasicContext : public NVMeContext
 {
   public:
-    NVMeBasicContext(boost::asio::io_context& io, int rootBus);
+    // Queries queued with the basic query thread at any one time.  Keeping a
+    // few queued hides the round trip through the event loop between drives.
+    static constexpr size_t defaultMaxInFlight = 4;
+    // The number of slots in each ring, and so the limit on the above
+    static constexpr size_t maxQueueDepth = 16;
+
+    NVMeBasicContext(boost::asio::io_context& io, int rootBus,
+                     size_t maxInFlight = defaultMaxInFlight);
     ~NVMeBasicContext() override = default;
-    void pollNVMeDevices() override;
     void readAndProcessNVMeSensor() override;
     void processResponse(std::shared_ptr<NVMeSensor>& sensor, void* msg,
                          size_t len) override;
 
   private:
-    NVMeBasicContext(boost::asio::io_context& io, int rootBus, int cmdOut,
-                     int streamIn, int streamOut, int cmdIn);
+    void readResponse();
+
     boost::asio::io_context& io;
 
-    // The IO thread must be destructed after the stream descriptors, so
+    size_t maxInFlight;
+    // Sensors with queries outstanding, in the order they were issued.  Only
+    // touched on the event loop, a ring just to avoid allocating per poll.
+    SPSCQueue<std::shared_ptr<NVMeSensor>, maxQueueDepth> inFlight;
+    bool reading = false;
+
+    // Shared with the IO thread, which holds its own reference
+    std::shared_ptr<BasicQueryChannel> channel;
+
+    // The IO thread must be destructed after the stream descriptor, so
     // initialise it first. http://eel.is/c++draft/class.base.init#note-6
     //
-    // Providing a stop-source to the thread execution function isn't
-    // particularly useful as it will spend most of its time blocked in a system
-    // call - ioctl() for the actual device communication, or read() and write()
-    // on the pipes associated with reqStream and respStream. Rather than trying
-    // to force a stop, rely on read()/write() failures from closed pipes to
-    // coerce it to exit and thus allow completion of the join().
+    // The thread spends most of its time blocked in a system call - ioctl()
+    // for the actual device communication, or read() on the request eventfd.
+    // Its stop callback signals the eventfd, so the stop requested by the
+    // jthread destructor is noticed once any ongoing ioctl() completes,
+    // allowing the join() to finish.
     std::jthread thread;
 
-    // Destruction of the stream descriptors has the effect of issuing cancel(),
-    // destroying the closure of the callback where we might be carrying
-    // weak_ptrs to `this`.
+    // Signalled by the IO thread as responses are queued.  Destruction of the
+    // stream descriptor has the effect of issuing cancel(), destroying the
+    // closure of the callback where we might be carrying weak_ptrs to `this`.
     // https://www.boost.org/doc/libs/1_79_0/doc/html/boost_asio/reference/posix__basic_descriptor/_basic_descriptor.html
-    boost::asio::posix::stream_descriptor reqStream;
     boost::asio::posix::stream_descriptor respStream;
 
     enum
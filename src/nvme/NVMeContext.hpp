@@ -1,16 +1,24 @@
 #pragma once
 
 #include "NVMeSensor.hpp"
+#include "Tracing.hpp"
 
+#include <boost/asio/error.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/steady_timer.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 #include <memory>
 #include <stdexcept>
 
 class NVMeContext : public std::enable_shared_from_this<NVMeContext>
 {
   public:
+    // Between sweeps while there are no sensors to schedule them by
+    static constexpr std::chrono::seconds idlePeriod{1};
+
     NVMeContext(boost::asio::io_context& io, int rootBus) :
         scanTimer(io), rootBus(rootBus), pollCursor(sensors.end())
     {
@@ -47,7 +55,7 @@ class NVMeContext : public std::enable_shared_from_this<NVMeContext>
 
     // Post-condition: The sensor list does not contain the provided sensor
     // Post-condition: pollCursor is a valid iterator for the sensor list
-    void removeSensor(const std::shared_ptr<NVMeSensor>& sensor)
+    virtual void removeSensor(const std::shared_ptr<NVMeSensor>& sensor)
     {
         // Locate the sensor that we're removing in the sensor list
         auto found = std::find(sensors.begin(), sensors.end(), sensor);
@@ -90,7 +98,46 @@ class NVMeContext : public std::enable_shared_from_this<NVMeContext>
         scanTimer.cancel();
     }
 
-    virtual void pollNVMeDevices() = 0;
+    // Schedule the next sweep over the sensor list, for when the first drive
+    // is next due.  Each sweep only queries the drives that are due.
+    virtual void pollNVMeDevices()
+    {
+        pollCursor = sensors.end();
+
+        /* Drives are due a whole number of their periods on from when they
+         * were first polled, however long each sweep takes */
+        tracing::Clock::time_point next = sweepStarted + idlePeriod;
+        if (!sensors.empty())
+        {
+            next = (*std::min_element(sensors.begin(), sensors.end(),
+                                      [](const auto& lhs, const auto& rhs) {
+                                          return lhs->nextPoll() <
+                                                 rhs->nextPoll();
+                                      }))
+                       ->nextPoll();
+        }
+        scanTimer.expires_at(std::max(next, tracing::Clock::now()));
+        scanTimer.async_wait([weakSelf{weak_from_this()}](
+                                 const boost::system::error_code errorCode) {
+            if (errorCode == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            if (errorCode)
+            {
+                std::cerr << errorCode.message() << "\n";
+                return;
+            }
+
+            if (auto self = weakSelf.lock())
+            {
+                self->sweepStarted = tracing::Clock::now();
+                self->pollCursor = self->sensors.begin();
+                self->readAndProcessNVMeSensor();
+            }
+        });
+    }
 
     virtual void readAndProcessNVMeSensor() = 0;
 
@@ -102,6 +149,7 @@ class NVMeContext : public std::enable_shared_from_this<NVMeContext>
     int rootBus; // Root bus for this drive
     std::list<std::shared_ptr<NVMeSensor>> sensors;
     std::list<std::shared_ptr<NVMeSensor>>::iterator pollCursor;
+    tracing::Clock::time_point sweepStarted = tracing::Clock::now();
 };
 
 using NVMEMap = boost::container::flat_map<int, std::shared_ptr<NVMeContext>>;
@@ -0,0 +1,209 @@
+#include "NVMeMCTPContext.hpp"
+
+#include "NVMeContext.hpp"
+#include "NVMeMI.hpp"
+#include "NVMeSensor.hpp"
+#include "Tracing.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+NVMeMCTPContext::NVMeMCTPContext(boost::asio::io_context& io, int rootBus,
+                                 size_t maxInFlight) :
+    NVMeMCTPContext(io, rootBus, std::make_unique<nvme_mi::MCTPSocket>(io),
+                    maxInFlight)
+{}
+
+NVMeMCTPContext::NVMeMCTPContext(boost::asio::io_context& io, int rootBus,
+                                 std::unique_ptr<nvme_mi::Socket> socket,
+                                 size_t maxInFlight) :
+    NVMeContext::NVMeContext(io, rootBus),
+    client(std::make_shared<nvme_mi::Client>(io, std::move(socket))),
+    maxInFlight(std::max<size_t>(maxInFlight, 1)),
+    request(nvme_mi::encodeHealthStatusPoll())
+{}
+
+void NVMeMCTPContext::addEndpointSensor(
+    const std::shared_ptr<NVMeSensor>& sensor, const std::string& mctpConfig)
+{
+    endpoints.insert_or_assign(sensor->configurationPath,
+                               Endpoint{mctpConfig, std::nullopt, 0});
+    addSensor(sensor);
+}
+
+void NVMeMCTPContext::setEndpoint(const std::shared_ptr<NVMeSensor>& sensor,
+                                  const nvme_mi::Address& address)
+{
+    auto findEndpoint = endpoints.find(sensor->configurationPath);
+    if (findEndpoint == endpoints.end())
+    {
+        return;
+    }
+
+    findEndpoint->second.address = address;
+    sensor->markAvailable(true);
+}
+
+std::vector<std::shared_ptr<NVMeSensor>> NVMeMCTPContext::configuredBy(
+    const std::string& mctpConfig) const
+{
+    std::vector<std::shared_ptr<NVMeSensor>> configured;
+    for (const auto& sensor : sensors)
+    {
+        auto findEndpoint = endpoints.find(sensor->configurationPath);
+        if (findEndpoint != endpoints.end() &&
+            findEndpoint->second.mctpConfig == mctpConfig)
+        {
+            configured.push_back(sensor);
+        }
+    }
+    return configured;
+}
+
+void NVMeMCTPContext::removeSensor(const std::shared_ptr<NVMeSensor>& sensor)
+{
+    endpoints.erase(sensor->configurationPath);
+    NVMeContext::removeSensor(sensor);
+}
+
+void NVMeMCTPContext::readAndProcessNVMeSensor()
+{
+    /* Keep up to maxInFlight polls outstanding across the drives */
+    while (client->outstanding() < maxInFlight && pollCursor != sensors.end())
+    {
+        std::shared_ptr<NVMeSensor> sensor = *pollCursor++;
+
+        /* Drives poll at their own rates, only some are due each sweep */
+        if (!sensor->due(sweepStarted))
+        {
+            continue;
+        }
+
+        /* Left unavailable until mctpreactor has set its endpoint up */
+        auto findEndpoint = endpoints.find(sensor->configurationPath);
+        if (findEndpoint == endpoints.end() || !findEndpoint->second.address)
+        {
+            continue;
+        }
+
+        if (!sensor->readingStateGood())
+        {
+            sensor->markAvailable(false);
+            sensor->updateValue(std::numeric_limits<double>::quiet_NaN());
+            continue;
+        }
+
+        /* Skip empty slots, and back off drives in error or not responding */
+        if (!sensor->sample())
+        {
+            continue;
+        }
+
+        std::error_code ec = client->request(
+            *findEndpoint->second.address, request,
+            [weakSelf{weak_from_this()},
+             sensor](const std::error_code& ec,
+                     std::span<const uint8_t> response) {
+                auto self =
+                    std::static_pointer_cast<NVMeMCTPContext>(weakSelf.lock());
+                if (!self)
+                {
+                    return;
+                }
+
+                if (ec)
+                {
+                    /* No response from the drive, most likely timed out */
+                    sensor->missed();
+                    sensor->incrementError();
+                }
+                else
+                {
+                    sensor->responded();
+                    self->processHealth(sensor, response);
+                }
+
+                /* Top up the polls in flight */
+                self->readAndProcessNVMeSensor();
+            });
+        if (ec)
+        {
+            std::cerr << "Failed to poll " << sensor->name << ": "
+                      << ec.message() << "\n";
+            sensor->incrementError();
+        }
+    }
+
+    if (client->outstanding() == 0 && pollCursor == sensors.end())
+    {
+        tracing::complete("NVMeMISweep", sweepStarted, tracing::Clock::now(),
+                          "i2c-" + std::to_string(rootBus));
+        this->pollNVMeDevices();
+    }
+}
+
+void NVMeMCTPContext::processResponse(std::shared_ptr<NVMeSensor>& sensor,
+                                      void* msg, size_t len)
+{
+    if (msg == nullptr)
+    {
+        sensor->incrementError();
+        return;
+    }
+
+    processHealth(sensor, {static_cast<const uint8_t*>(msg), len});
+}
+
+void NVMeMCTPContext::processHealth(const std::shared_ptr<NVMeSensor>& sensor,
+                                    std::span<const uint8_t> response)
+{
+    std::string error;
+    std::optional<nvme_mi::SubsystemHealth> health =
+        nvme_mi::decodeHealthStatusPoll(response, error);
+    if (!health)
+    {
+        std::cerr << "Invalid health status from " << sensor->name << ": "
+                  << error << "\n";
+        sensor->incrementError();
+        return;
+    }
+
+    auto findEndpoint = endpoints.find(sensor->configurationPath);
+    if (findEndpoint != endpoints.end() &&
+        findEndpoint->second.criticalWarnings != health->criticalWarnings)
+    {
+        std::cerr << sensor->name << " critical warnings: "
+                  << nvme_mi::describeCriticalWarnings(
+                         health->criticalWarnings)
+                  << "\n";
+        findEndpoint->second.criticalWarnings = health->criticalWarnings;
+    }
+
+    if (!health->driveFunctional())
+    {
+        sensor->markFunctional(false);
+        return;
+    }
+
+    double value = health->temperature();
+    if (!std::isfinite(value))
+    {
+        sensor->incrementError();
+        return;
+    }
+
+    sensor->updateValue(value);
+}
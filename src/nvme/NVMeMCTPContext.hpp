@@ -0,0 +1,74 @@
+#pragma once
+
+#include "NVMeContext.hpp"
+#include "NVMeMI.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/container/flat_map.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Polls drives with the NVMe-MI Subsystem Health Status Poll, through the MCTP
+// endpoints set up for them by mctpreactor.  Each poll returns the composite
+// temperature along with the drive's critical warnings, and polls of the
+// drives behind a root bus are pipelined.
+class NVMeMCTPContext : public NVMeContext
+{
+  public:
+    // Polls outstanding across the root bus at any one time
+    static constexpr size_t defaultMaxInFlight = 4;
+
+    // Throws std::system_error if the MCTP socket can't be created
+    NVMeMCTPContext(boost::asio::io_context& io, int rootBus,
+                    size_t maxInFlight = defaultMaxInFlight);
+    NVMeMCTPContext(boost::asio::io_context& io, int rootBus,
+                    std::unique_ptr<nvme_mi::Socket> socket,
+                    size_t maxInFlight = defaultMaxInFlight);
+    ~NVMeMCTPContext() override = default;
+
+    // Add sensor to the sensor list, to be polled once the endpoint set up
+    // for the MCTP configuration at mctpConfig is known
+    void addEndpointSensor(const std::shared_ptr<NVMeSensor>& sensor,
+                           const std::string& mctpConfig);
+
+    // Poll sensor through the endpoint at address from now on
+    void setEndpoint(const std::shared_ptr<NVMeSensor>& sensor,
+                     const nvme_mi::Address& address);
+
+    // The sensors polled through the endpoint set up for mctpConfig
+    std::vector<std::shared_ptr<NVMeSensor>>
+        configuredBy(const std::string& mctpConfig) const;
+
+    void removeSensor(const std::shared_ptr<NVMeSensor>& sensor) override;
+
+    void readAndProcessNVMeSensor() override;
+    void processResponse(std::shared_ptr<NVMeSensor>& sensor, void* msg,
+                         size_t len) override;
+
+  private:
+    void processHealth(const std::shared_ptr<NVMeSensor>& sensor,
+                       std::span<const uint8_t> response);
+
+    struct Endpoint
+    {
+        std::string mctpConfig;
+        // Unset until mctpreactor has set the endpoint up
+        std::optional<nvme_mi::Address> address;
+        // Critical warnings from the last response, to log changes
+        uint8_t criticalWarnings = 0;
+    };
+
+    std::shared_ptr<nvme_mi::Client> client;
+    size_t maxInFlight;
+    // The same for every drive, so only encoded once
+    const std::array<uint8_t, nvme_mi::healthStatusPollRequestSize> request;
+    // By the configuration path of the sensors in the sensor list
+    boost::container::flat_map<std::string, Endpoint> endpoints;
+};
@@ -0,0 +1,374 @@
+#include "NVMeMI.hpp"
+
+#include <sys/socket.h>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+
+extern "C"
+{
+#include <linux/mctp.h>
+}
+
+namespace nvme_mi
+{
+
+// The NVMe-MI Message Type field of the message header
+static constexpr uint8_t nmimtMICommand = 0x1;
+// The Request or Response bit of the message header
+static constexpr uint8_t nmpResponse = 0x80;
+
+static constexpr uint8_t opcodeHealthStatusPoll = 0x01;
+
+static constexpr std::array<uint32_t, 256> crc32cTable = []() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = ((crc & 1U) != 0U) ? (crc >> 1) ^ 0x82f63b78U : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+uint32_t crc32c(std::span<const uint8_t> data)
+{
+    uint32_t crc = 0xffffffffU;
+    for (uint8_t byte : data)
+    {
+        crc = crc32cTable[(crc ^ byte) & 0xffU] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffU;
+}
+
+double SubsystemHealth::temperature() const
+{
+    if (compositeTemperature == static_cast<int8_t>(0x80) ||
+        compositeTemperature == static_cast<int8_t>(0x81))
+    {
+        // 0x80 = No temperature data or temperature data is more the 5 s
+        // old 0x81 = Temperature sensor failure
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    return compositeTemperature;
+}
+
+std::array<uint8_t, healthStatusPollRequestSize> encodeHealthStatusPoll()
+{
+    std::array<uint8_t, healthStatusPollRequestSize> msg{};
+
+    msg[0] = mctpTypeNVMeMI | mctpTypeIntegrityCheck;
+    msg[1] = nmimtMICommand << 3;
+    msg[4] = opcodeHealthStatusPoll;
+    /* NMD1 CS clear: leave the status for others to see changes */
+
+    uint32_t mic = crc32c(std::span(msg).first(msg.size() - 4));
+    for (size_t i = 0; i < 4; i++)
+    {
+        msg[msg.size() - 4 + i] = static_cast<uint8_t>(mic >> (8 * i));
+    }
+
+    return msg;
+}
+
+std::optional<SubsystemHealth>
+    decodeHealthStatusPoll(std::span<const uint8_t> msg, std::string& error)
+{
+    if (msg.size() < healthStatusPollResponseSize)
+    {
+        error = std::format("short response of {} bytes", msg.size());
+        return std::nullopt;
+    }
+
+    std::span<const uint8_t> micBytes = msg.last(4);
+    uint32_t mic = micBytes[0] | (micBytes[1] << 8) | (micBytes[2] << 16) |
+                   (static_cast<uint32_t>(micBytes[3]) << 24);
+    if (mic != crc32c(msg.first(msg.size() - 4)))
+    {
+        error = "message integrity check failed";
+        return std::nullopt;
+    }
+
+    if (msg[0] != (mctpTypeNVMeMI | mctpTypeIntegrityCheck) ||
+        msg[1] != (nmpResponse | (nmimtMICommand << 3)))
+    {
+        error = std::format("unexpected message type {:#04x}/{:#04x}", msg[0],
+                            msg[1]);
+        return std::nullopt;
+    }
+
+    if (msg[4] != 0)
+    {
+        error = std::format("response status {:#04x}", msg[4]);
+        return std::nullopt;
+    }
+
+    std::span<const uint8_t> data = msg.subspan(8, 8);
+    SubsystemHealth health{};
+    health.status = data[0];
+    health.criticalWarnings = static_cast<uint8_t>(~data[1] & 0x3fU);
+    health.compositeTemperature = static_cast<int8_t>(data[2]);
+    health.driveLifeUsed = data[3];
+    health.controllerStatus = static_cast<uint16_t>(data[4] | (data[5] << 8));
+
+    return health;
+}
+
+std::string describeCriticalWarnings(uint8_t warnings)
+{
+    static constexpr std::array<const char*, 6> names = {
+        "available spare below threshold",
+        "temperature threshold exceeded",
+        "reliability degraded",
+        "read only",
+        "volatile memory backup failed",
+        "persistent memory region read only",
+    };
+
+    std::string description;
+    for (size_t bit = 0; bit < names.size(); bit++)
+    {
+        if ((warnings & (1U << bit)) == 0U)
+        {
+            continue;
+        }
+        if (!description.empty())
+        {
+            description += ", ";
+        }
+        description += names[bit];
+    }
+
+    if (description.empty())
+    {
+        return "none";
+    }
+    return description;
+}
+
+MCTPSocket::MCTPSocket(boost::asio::io_context& io) : socket(io)
+{
+    int fd = ::socket(AF_MCTP, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Failed to create MCTP socket");
+    }
+    socket.assign(fd);
+}
+
+std::error_code MCTPSocket::send(const Address& to,
+                                 std::span<const uint8_t> msg)
+{
+    if (msg.empty())
+    {
+        return std::make_error_code(std::errc::invalid_argument);
+    }
+
+    sockaddr_mctp addr{};
+    addr.smctp_family = AF_MCTP;
+    addr.smctp_network = static_cast<unsigned int>(to.network);
+    addr.smctp_addr.s_addr = to.eid;
+    addr.smctp_type = msg[0];
+    addr.smctp_tag = MCTP_TAG_OWNER;
+
+    /* The message type byte is carried in the address */
+    ssize_t rc = ::sendto(socket.native_handle(), msg.data() + 1,
+                          msg.size() - 1, 0,
+                          reinterpret_cast<const sockaddr*>(&addr),
+                          sizeof(addr));
+    if (rc < 0)
+    {
+        return {errno, std::system_category()};
+    }
+    return {};
+}
+
+void MCTPSocket::receive(ReceiveHandler&& handler)
+{
+    socket.async_wait(
+        boost::asio::posix::stream_descriptor::wait_read,
+        [this, handler{std::move(handler)}](
+            const boost::system::error_code& ec) {
+            /* We may have been destroyed if the wait was aborted */
+            if (ec)
+            {
+                handler(ec, {}, {});
+                return;
+            }
+
+            sockaddr_mctp addr{};
+            socklen_t addrlen = sizeof(addr);
+            ssize_t rc = ::recvfrom(socket.native_handle(), buffer.data() + 1,
+                                    buffer.size() - 1, MSG_TRUNC,
+                                    reinterpret_cast<sockaddr*>(&addr),
+                                    &addrlen);
+            if (rc < 0)
+            {
+                handler({errno, boost::system::system_category()}, {}, {});
+                return;
+            }
+
+            if (static_cast<size_t>(rc) > buffer.size() - 1)
+            {
+                handler(boost::asio::error::message_size, {}, {});
+                return;
+            }
+
+            buffer[0] = addr.smctp_type;
+            handler({}, {static_cast<int>(addr.smctp_network),
+                         addr.smctp_addr.s_addr},
+                    std::span(buffer).first(static_cast<size_t>(rc) + 1));
+        });
+}
+
+Client::Client(boost::asio::io_context& io, std::unique_ptr<Socket> socket,
+               std::chrono::milliseconds timeout) :
+    socket(std::move(socket)), timer(io), timeout(timeout)
+{}
+
+bool Client::busy(const Address& to) const
+{
+    return std::ranges::find(pending, to, &Pending::to) != pending.end();
+}
+
+std::error_code Client::request(const Address& to,
+                                std::span<const uint8_t> msg,
+                                Callback&& callback)
+{
+    if (busy(to))
+    {
+        return std::make_error_code(std::errc::device_or_resource_busy);
+    }
+
+    std::error_code ec = socket->send(to, msg);
+    if (ec)
+    {
+        return ec;
+    }
+
+    pending.emplace_back(to, std::chrono::steady_clock::now() + timeout,
+                         std::move(callback));
+
+    if (!receiving)
+    {
+        receive();
+    }
+
+    if (!timing)
+    {
+        armTimer();
+    }
+
+    return {};
+}
+
+void Client::receive()
+{
+    receiving = true;
+
+    socket->receive([weak{weak_from_this()}](
+                        const boost::system::error_code& ec,
+                        const Address& from, std::span<const uint8_t> msg) {
+        if (ec == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+
+        auto self = weak.lock();
+        if (!self)
+        {
+            return;
+        }
+        self->receiving = false;
+
+        if (ec)
+        {
+            std::cerr << "Failed to receive NVMe-MI message: " << ec.message()
+                      << "\n";
+        }
+        else
+        {
+            auto found = std::ranges::find(self->pending, from, &Pending::to);
+            if (found == self->pending.end())
+            {
+                // Most likely a late response to a request that timed out
+                std::cerr << "Dropping unexpected NVMe-MI message from EID "
+                          << static_cast<int>(from.eid) << " on network "
+                          << from.network << "\n";
+            }
+            else
+            {
+                Callback callback = std::move(found->callback);
+                self->pending.erase(found);
+                callback({}, msg);
+            }
+        }
+
+        /* The callback may have issued another request, and so received */
+        if (!self->receiving && !self->pending.empty())
+        {
+            self->receive();
+        }
+    });
+}
+
+void Client::armTimer()
+{
+    timing = true;
+
+    timer.expires_at(pending.front().deadline);
+    timer.async_wait(
+        [weak{weak_from_this()}](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            if (auto self = weak.lock())
+            {
+                self->timing = false;
+                self->expire();
+            }
+        });
+}
+
+void Client::expire()
+{
+    auto now = std::chrono::steady_clock::now();
+    while (!pending.empty() && pending.front().deadline <= now)
+    {
+        Pending expired = std::move(pending.front());
+        pending.erase(pending.begin());
+        expired.callback(std::make_error_code(std::errc::timed_out), {});
+    }
+
+    /* The callbacks may have issued requests, and so armed the timer */
+    if (!timing && !pending.empty())
+    {
+        armTimer();
+    }
+}
+
+} // namespace nvme_mi
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/*
+ * NVMe Management Interface over MCTP
+ *
+ * https://nvmexpress.org/wp-content/uploads/NVM-Express-Management-Interface-Specification-1.2c-2022.10.06-Ratified.pdf
+ *
+ * Messages are handled whole, starting with the MCTP message type byte and
+ * ending with the CRC-32C message integrity check.
+ */
+namespace nvme_mi
+{
+
+constexpr uint8_t mctpTypeNVMeMI = 0x04;
+constexpr uint8_t mctpTypeIntegrityCheck = 0x80;
+
+// Header, opcode, reserved, NMD0, NMD1 and the integrity check
+constexpr size_t healthStatusPollRequestSize = 4 + 1 + 3 + 4 + 4 + 4;
+// Header, status, management response, health data and the integrity check
+constexpr size_t healthStatusPollResponseSize = 4 + 1 + 3 + 8 + 4;
+
+// The NVM Subsystem Health Data Structure returned by a Subsystem Health
+// Status Poll
+struct SubsystemHealth
+{
+    uint8_t status;
+    // As in the SMART / Health Information log, not inverted as on the wire
+    uint8_t criticalWarnings;
+    int8_t compositeTemperature;
+    uint8_t driveLifeUsed;
+    uint16_t controllerStatus;
+
+    enum
+    {
+        NSS_DRIVE_FUNCTIONAL = 0x20,
+    };
+
+    enum
+    {
+        CW_AVAILABLE_SPARE = 0x01,
+        CW_TEMPERATURE = 0x02,
+        CW_RELIABILITY_DEGRADED = 0x04,
+        CW_READ_ONLY = 0x08,
+        CW_VOLATILE_BACKUP_FAILED = 0x10,
+        CW_PMR_READ_ONLY = 0x20,
+    };
+
+    bool driveFunctional() const
+    {
+        return (status & NSS_DRIVE_FUNCTIONAL) != 0;
+    }
+
+    // In degrees Celsius, NaN if the drive has no reading
+    double temperature() const;
+};
+
+uint32_t crc32c(std::span<const uint8_t> data);
+
+std::array<uint8_t, healthStatusPollRequestSize> encodeHealthStatusPoll();
+
+// Returns std::nullopt, describing why in error, if msg isn't a successful
+// response to a Subsystem Health Status Poll
+std::optional<SubsystemHealth>
+    decodeHealthStatusPoll(std::span<const uint8_t> msg, std::string& error);
+
+std::string describeCriticalWarnings(uint8_t warnings);
+
+// An MCTP endpoint as seen through AF_MCTP
+struct Address
+{
+    int network;
+    uint8_t eid;
+
+    bool operator==(const Address&) const = default;
+};
+
+// A datagram socket exchanging MCTP messages.  Only used from the event loop.
+class Socket
+{
+  public:
+    using ReceiveHandler =
+        std::function<void(const boost::system::error_code& ec,
+                           const Address& from, std::span<const uint8_t> msg)>;
+
+    virtual ~Socket() = default;
+
+    // msg starts with the MCTP message type byte
+    virtual std::error_code send(const Address& to,
+                                 std::span<const uint8_t> msg) = 0;
+
+    // Deliver the next message received, one receive outstanding at a time.
+    // The message is only valid for the duration of the handler.
+    virtual void receive(ReceiveHandler&& handler) = 0;
+};
+
+// Requests tagged as owner over an AF_MCTP socket, with the kernel routing
+// the responses back to us.  Throws std::system_error if the socket can't be
+// created.
+class MCTPSocket : public Socket
+{
+  public:
+    explicit MCTPSocket(boost::asio::io_context& io);
+
+    std::error_code send(const Address& to,
+                         std::span<const uint8_t> msg) override;
+    void receive(ReceiveHandler&& handler) override;
+
+  private:
+    boost::asio::posix::stream_descriptor socket;
+    std::array<uint8_t, 1024> buffer{};
+};
+
+// Pipelines requests to any number of endpoints over one socket.
+//
+// Responses are matched to requests by the endpoint they come from, so only
+// one request may be outstanding with each endpoint.  Requests not answered
+// within the timeout complete with std::errc::timed_out.
+class Client : public std::enable_shared_from_this<Client>
+{
+  public:
+    using Callback = std::function<void(const std::error_code& ec,
+                                        std::span<const uint8_t> response)>;
+
+    static constexpr std::chrono::milliseconds defaultTimeout{1000};
+
+    Client(boost::asio::io_context& io, std::unique_ptr<Socket> socket,
+           std::chrono::milliseconds timeout = defaultTimeout);
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+    Client(Client&&) = delete;
+    Client& operator=(Client&&) = delete;
+    ~Client() = default;
+
+    // Fails with std::errc::device_or_resource_busy if a request is already
+    // outstanding with the endpoint.  Once issued, callback is invoked exactly
+    // once from the event loop, unless the client is destroyed first.
+    std::error_code request(const Address& to, std::span<const uint8_t> msg,
+                            Callback&& callback);
+
+    bool busy(const Address& to) const;
+
+    size_t outstanding() const
+    {
+        return pending.size();
+    }
+
+  private:
+    struct Pending
+    {
+        Address to;
+        std::chrono::steady_clock::time_point deadline;
+        Callback callback;
+    };
+
+    void receive();
+    void expire();
+    void armTimer();
+
+    std::unique_ptr<Socket> socket;
+    boost::asio::steady_timer timer;
+    std::chrono::milliseconds timeout;
+    // In the order the requests were issued, so also by deadline
+    std::vector<Pending> pending;
+    bool receiving = false;
+    bool timing = false;
+};
+
+} // namespace nvme_mi
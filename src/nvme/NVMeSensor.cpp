@@ -25,9 +25,15 @@
 #include <sdbusplus/asio/connection.hpp>
 #include <sdbusplus/asio/object_server.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -42,11 +48,19 @@ NVMeSensor::NVMeSensor(sdbusplus::asio::object_server& objectServer,
                        const std::string& sensorName,
                        std::vector<thresholds::Threshold>&& thresholdsIn,
                        const std::string& sensorConfiguration,
-                       const int busNumber, const uint8_t slaveAddr) :
+                       const int busNumber, const uint8_t slaveAddr,
+                       float pollRate,
+                       std::shared_ptr<PresenceGpio> presenceGpio,
+                       std::optional<std::string> pcieSlot) :
     Sensor(escapeName(sensorName), std::move(thresholdsIn), sensorConfiguration,
            NVMeSensor::sensorType, false, false, maxReading, minReading, conn,
            PowerState::on),
-    bus(busNumber), address(slaveAddr), objServer(objectServer)
+    bus(busNumber), address(slaveAddr),
+    pollPeriod(std::max<int64_t>(static_cast<int64_t>(pollRate * 1000), 1)),
+    scanDelayTicks(std::max(
+        static_cast<unsigned int>(std::chrono::minutes(5) / pollPeriod), 1U)),
+    objServer(objectServer), presenceGpio(std::move(presenceGpio)),
+    pcieSlot(std::move(pcieSlot))
 {
     if (bus < 0)
     {
@@ -85,9 +99,76 @@ NVMeSensor::~NVMeSensor()
     objServer.remove_interface(association);
 }
 
+// The presence detect state of the slot the drive is in, from the presence
+// GPIO or the PCIe hotplug slot's adapter attribute.  std::nullopt if neither
+// is configured or readable.
+std::optional<bool> NVMeSensor::present() const
+{
+    if (presenceGpio)
+    {
+        return presenceGpio->isPresent();
+    }
+
+    if (pcieSlot)
+    {
+        std::ifstream adapter("/sys/bus/pci/slots/" + *pcieSlot + "/adapter");
+        int state = 0;
+        if (adapter >> state)
+        {
+            return state != 0;
+        }
+    }
+
+    return std::nullopt;
+}
+
+bool NVMeSensor::due(tracing::Clock::time_point now)
+{
+    if (now < pollAt)
+    {
+        return false;
+    }
+
+    /* Stay in phase with the drive's first poll, unless a sweep fell behind */
+    pollAt += pollPeriod;
+    if (pollAt <= now)
+    {
+        pollAt = now + pollPeriod;
+    }
+    return true;
+}
+
 bool NVMeSensor::sample()
 {
-    if (inError())
+    std::optional<bool> isPresent = present();
+    if (isPresent.has_value() && *isPresent != wasPresent)
+    {
+        wasPresent = *isPresent;
+        std::cerr << name << (wasPresent ? " inserted" : " removed") << "\n";
+        if (wasPresent)
+        {
+            /* Query a newly inserted drive straight away */
+            backoff.responded();
+        }
+        else
+        {
+            markAvailable(false);
+            updateValue(std::numeric_limits<double>::quiet_NaN());
+        }
+    }
+
+    if (!wasPresent)
+    {
+        return false;
+    }
+
+    if (!backoff.due())
+    {
+        return false;
+    }
+
+    /* Drives that respond but report errors are deferred separately */
+    if (backoff.backoff() == 1 && inError())
     {
         if (scanDelay == 0)
         {
@@ -100,6 +181,16 @@ bool NVMeSensor::sample()
     return scanDelay == 0;
 }
 
+void NVMeSensor::missed()
+{
+    backoff.missed();
+}
+
+void NVMeSensor::responded()
+{
+    backoff.responded();
+}
+
 void NVMeSensor::checkThresholds()
 {
     thresholds::checkThresholds(this);
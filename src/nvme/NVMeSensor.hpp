@@ -1,12 +1,22 @@
 #pragma once
 
+#include "PresenceGpio.hpp"
+#include "ProbeBackoff.hpp"
+#include "Tracing.hpp"
+
 #include <boost/asio/io_context.hpp>
 #include <sensor.hpp>
 
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+
 class NVMeSensor : public Sensor
 {
   public:
     static constexpr const char* sensorType = "NVME1000";
+    static constexpr float defaultPollRate = 1.0F;
 
     NVMeSensor(sdbusplus::asio::object_server& objectServer,
                boost::asio::io_context& io,
@@ -14,20 +24,49 @@ class NVMeSensor : public Sensor
                const std::string& sensorName,
                std::vector<thresholds::Threshold>&& thresholds,
                const std::string& sensorConfiguration, int busNumber,
-               uint8_t slaveAddr);
+               uint8_t slaveAddr, float pollRate = defaultPollRate,
+               std::shared_ptr<PresenceGpio> presenceGpio = nullptr,
+               std::optional<std::string> pcieSlot = std::nullopt);
     ~NVMeSensor() override;
 
     NVMeSensor& operator=(const NVMeSensor& other) = delete;
 
+    // Whether the drive is due a poll in the sweep started at now, scheduling
+    // its next poll if so
+    bool due(tracing::Clock::time_point now);
+
+    tracing::Clock::time_point nextPoll() const
+    {
+        return pollAt;
+    }
+
+    // Whether to query the drive this sweep.  Slots known to be empty are
+    // skipped without a query, and are marked unavailable.
     bool sample();
 
+    // The outcome of the query issued after sample()
+    void missed();
+    void responded();
+
     const int bus;
     const uint8_t address;
+    const std::chrono::milliseconds pollPeriod;
 
   private:
-    const unsigned int scanDelayTicks = 5 * 60;
+    std::optional<bool> present() const;
+
+    // Due straight away
+    tracing::Clock::time_point pollAt;
+    // Five minutes' worth of polls
+    const unsigned int scanDelayTicks;
     sdbusplus::asio::object_server& objServer;
     unsigned int scanDelay{0};
+    ProbeBackoff backoff{scanDelayTicks};
+
+    // Cheap presence signals, where configured
+    std::shared_ptr<PresenceGpio> presenceGpio;
+    std::optional<std::string> pcieSlot;
+    bool wasPresent = true;
 
     void checkThresholds() override;
 };
@@ -16,7 +16,11 @@
 
 #include "NVMeBasicContext.hpp"
 #include "NVMeContext.hpp"
+#include "NVMeMCTPContext.hpp"
+#include "NVMeMI.hpp"
 #include "NVMeSensor.hpp"
+#include "PresenceGpio.hpp"
+#include "SensorDaemon.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
 #include "VariantVisitors.hpp"
@@ -25,6 +29,7 @@
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/post.hpp>
 #include <boost/asio/steady_timer.hpp>
+#include <boost/container/flat_map.hpp>
 #include <sdbusplus/asio/connection.hpp>
 #include <sdbusplus/asio/object_server.hpp>
 #include <sdbusplus/bus.hpp>
@@ -34,6 +39,7 @@
 
 #include <algorithm>
 #include <array>
+#include <charconv>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
@@ -44,13 +50,21 @@
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <system_error>
 #include <utility>
 #include <variant>
 #include <vector>
 
 static constexpr uint8_t nvmeMiDefaultSlaveAddr = 0x6A;
 
+static constexpr const char* mctpConfigType = "MCTPI2CTarget";
+
 static NVMEMap nvmeDeviceMap;
+// Contexts polling drives over MCTP, also by root bus
+static NVMEMap nvmeMCTPDeviceMap;
+// By pin name, so that a drive's line is reused when it's reconfigured
+static boost::container::flat_map<std::string, std::weak_ptr<PresenceGpio>>
+    presenceGpios;
 
 NVMEMap& getNVMEMap()
 {
@@ -99,6 +113,209 @@ static std::optional<std::string> extractSensorName(
     return std::get<std::string>(findSensorName->second);
 }
 
+// The queries a root bus may have queued at once, if the drive asks for a
+// depth other than the default
+static std::optional<size_t> extractQueryDepth(
+    const SensorBaseConfigMap& properties)
+{
+    auto findDepth = properties.find("QueryDepth");
+    if (findDepth == properties.end())
+    {
+        return std::nullopt;
+    }
+
+    return std::visit(VariantToUnsignedIntVisitor(), findDepth->second);
+}
+
+// Drives polled with NVMe-MI over an MCTP endpoint set up by mctpreactor,
+// rather than with the basic management command
+static bool extractMCTPTransport(const SensorBaseConfigMap& properties)
+{
+    auto findTransport = properties.find("Transport");
+    if (findTransport == properties.end())
+    {
+        return false;
+    }
+
+    return std::visit(VariantToStringVisitor(), findTransport->second) ==
+           "MCTP";
+}
+
+// A PCIe hotplug slot whose presence detect state tells whether the drive is
+// there, without querying it
+static std::optional<std::string> extractPCIeSlot(
+    const SensorBaseConfigMap& properties)
+{
+    auto findSlot = properties.find("PCIeSlot");
+    if (findSlot == properties.end())
+    {
+        return std::nullopt;
+    }
+
+    return std::visit(VariantToStringVisitor(), findSlot->second);
+}
+
+// The drive's presence GPIO, configured as for fans
+static std::shared_ptr<PresenceGpio> createPresenceGpio(
+    boost::asio::io_context& io, const std::string& sensorName,
+    const SensorData& sensorData)
+{
+    auto presenceConfig = sensorData.find(
+        configInterfaceName(NVMeSensor::sensorType) + std::string(".Presence"));
+    if (presenceConfig == sensorData.end())
+    {
+        return nullptr;
+    }
+
+    auto findPolarity = presenceConfig->second.find("Polarity");
+    auto findPinName = presenceConfig->second.find("PinName");
+    if (findPinName == presenceConfig->second.end() ||
+        findPolarity == presenceConfig->second.end())
+    {
+        std::cerr << "Malformed Presence Configuration for " << sensorName
+                  << "\n";
+        return nullptr;
+    }
+
+    bool inverted = std::visit(VariantToStringVisitor(),
+                               findPolarity->second) == "Low";
+    std::string pinName =
+        std::visit(VariantToStringVisitor(), findPinName->second);
+    if (auto presenceGpio = presenceGpios[pinName].lock())
+    {
+        return presenceGpio;
+    }
+
+    bool polling = false;
+    auto findMonitorType = presenceConfig->second.find("MonitorType");
+    if (findMonitorType != presenceConfig->second.end())
+    {
+        polling = std::visit(VariantToStringVisitor(),
+                             findMonitorType->second) == "Polling";
+    }
+
+    try
+    {
+        std::shared_ptr<PresenceGpio> presenceGpio;
+        if (polling)
+        {
+            presenceGpio = std::make_shared<PollingPresenceGpio>(
+                "NVMe", sensorName, pinName, inverted, io);
+        }
+        else
+        {
+            presenceGpio = std::make_shared<EventPresenceGpio>(
+                "NVMe", sensorName, pinName, inverted, io);
+        }
+        presenceGpio->monitorPresence();
+        presenceGpios[pinName] = presenceGpio;
+        return presenceGpio;
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << "Failed to monitor presence of " << sensorName
+                  << " through " << pinName << ": " << e.what() << "\n";
+    }
+
+    return nullptr;
+}
+
+// The drive's MCTP configuration is exposed alongside its NVMe configuration,
+// on the same bus
+static std::optional<std::string> findMCTPConfiguration(
+    const ManagedObjectType& sensorConfigurations,
+    const sdbusplus::message::object_path& path, int busNumber)
+{
+    sdbusplus::message::object_path parent = path.parent_path();
+    for (const auto& [configPath, configData] : sensorConfigurations)
+    {
+        if (configPath.parent_path() != parent)
+        {
+            continue;
+        }
+
+        auto findMCTP = configData.find(configInterfaceName(mctpConfigType));
+        if (findMCTP == configData.end())
+        {
+            continue;
+        }
+
+        auto findBus = findMCTP->second.find("Bus");
+        if (findBus != findMCTP->second.end() &&
+            std::visit(VariantToIntVisitor(), findBus->second) == busNumber)
+        {
+            return configPath.str;
+        }
+    }
+
+    return std::nullopt;
+}
+
+// mctpd endpoint objects are /au/com/codeconstruct/mctp1/networks/<network>/
+// endpoints/<eid>
+static std::optional<nvme_mi::Address> parseEndpointPath(
+    const sdbusplus::message::object_path& path)
+{
+    std::string eid = path.filename();
+    sdbusplus::message::object_path endpoints = path.parent_path();
+    std::string network = endpoints.parent_path().filename();
+    if (endpoints.filename() != "endpoints")
+    {
+        return std::nullopt;
+    }
+
+    nvme_mi::Address address{};
+    auto [eidEnd, eidErr] =
+        std::from_chars(eid.data(), eid.data() + eid.size(), address.eid);
+    auto [networkEnd, networkErr] = std::from_chars(
+        network.data(), network.data() + network.size(), address.network);
+    if (eidErr != std::errc() || eidEnd != eid.data() + eid.size() ||
+        networkErr != std::errc() ||
+        networkEnd != network.data() + network.size())
+    {
+        return std::nullopt;
+    }
+
+    return address;
+}
+
+// mctpreactor associates the endpoints it sets up with the configuration they
+// were set up for, look the drive's endpoint up through the mapper
+static void resolveMCTPEndpoint(
+    const std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    const std::string& mctpConfig,
+    std::function<void(const nvme_mi::Address&)>&& resolved)
+{
+    dbusConnection->async_method_call(
+        [mctpConfig, resolved{std::move(resolved)}](
+            const boost::system::error_code& ec,
+            const std::variant<std::vector<std::string>>& endpoints) {
+            if (ec)
+            {
+                std::cerr << "No MCTP endpoint configured by " << mctpConfig
+                          << " yet\n";
+                return;
+            }
+
+            for (const std::string& path :
+                 std::get<std::vector<std::string>>(endpoints))
+            {
+                std::optional<nvme_mi::Address> address =
+                    parseEndpointPath(sdbusplus::message::object_path(path));
+                if (address)
+                {
+                    resolved(*address);
+                    return;
+                }
+            }
+
+            std::cerr << "No usable MCTP endpoint configured by " << mctpConfig
+                      << "\n";
+        },
+        mapper::busName, mctpConfig + "/configures", properties::interface,
+        properties::get, "xyz.openbmc_project.Association", "endpoints");
+}
+
 static std::filesystem::path deriveRootBusPath(int busNumber)
 {
     return "/sys/bus/i2c/devices/i2c-" + std::to_string(busNumber) +
@@ -130,8 +347,65 @@ static std::optional<int> deriveRootBus(std::optional<int> busNumber)
     return std::stoi(rootName.substr(0, dash));
 }
 
+// The drives on a root bus share its queue, so it takes the deepest QueryDepth
+// any of them asks for.  Keyed by root bus and whether it's polled over MCTP.
+using QueryDepths = boost::container::flat_map<std::pair<int, bool>, size_t>;
+
+static QueryDepths collectQueryDepths(
+    const ManagedObjectType& sensorConfigurations)
+{
+    QueryDepths depths;
+    for (const auto& [path, sensorData] : sensorConfigurations)
+    {
+        auto sensorBase =
+            sensorData.find(configInterfaceName(NVMeSensor::sensorType));
+        if (sensorBase == sensorData.end())
+        {
+            continue;
+        }
+
+        const SensorBaseConfigMap& sensorConfig = sensorBase->second;
+        std::optional<size_t> depth = extractQueryDepth(sensorConfig);
+        auto findBus = sensorConfig.find("Bus");
+        if (!depth || findBus == sensorConfig.end())
+        {
+            continue;
+        }
+        std::optional<int> rootBus =
+            deriveRootBus(std::visit(VariantToIntVisitor(), findBus->second));
+        if (!rootBus)
+        {
+            continue;
+        }
+
+        auto [findDepth, inserted] = depths.try_emplace(
+            {*rootBus, extractMCTPTransport(sensorConfig)}, *depth);
+        if (!inserted && findDepth->second != *depth)
+        {
+            std::cerr << "Drives on root bus " << *rootBus
+                      << " ask for different query depths, using "
+                      << std::max(findDepth->second, *depth) << "\n";
+            findDepth->second = std::max(findDepth->second, *depth);
+        }
+    }
+
+    return depths;
+}
+
+static size_t queryDepthFor(const QueryDepths& depths, int rootBus, bool mctp)
+{
+    auto findDepth = depths.find({rootBus, mctp});
+    if (findDepth == depths.end())
+    {
+        return mctp ? NVMeMCTPContext::defaultMaxInFlight
+                    : NVMeBasicContext::defaultMaxInFlight;
+    }
+
+    return findDepth->second;
+}
+
 static std::shared_ptr<NVMeContext> provideRootBusContext(
-    boost::asio::io_context& io, NVMEMap& map, int rootBus)
+    boost::asio::io_context& io, NVMEMap& map, int rootBus, size_t queryDepth)
 {
     auto findRoot = map.find(rootBus);
     if (findRoot != map.end())
@@ -140,26 +414,92 @@ static std::shared_ptr<NVMeContext> provideRootBusContext(
     }
 
     std::shared_ptr<NVMeContext> context =
-        std::make_shared<NVMeBasicContext>(io, rootBus);
+        std::make_shared<NVMeBasicContext>(io, rootBus, queryDepth);
     map[rootBus] = context;
 
     return context;
 }
 
+// Throws std::system_error if the MCTP socket can't be created
+static std::shared_ptr<NVMeMCTPContext> provideMCTPContext(
+    boost::asio::io_context& io, NVMEMap& map, int rootBus, size_t queryDepth)
+{
+    auto findRoot = map.find(rootBus);
+    if (findRoot != map.end())
+    {
+        return std::static_pointer_cast<NVMeMCTPContext>(findRoot->second);
+    }
+
+    auto context = std::make_shared<NVMeMCTPContext>(io, rootBus, queryDepth);
+    map[rootBus] = context;
+
+    return context;
+}
+
+static void updateMCTPEndpoint(
+    const std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    const std::shared_ptr<NVMeMCTPContext>& context,
+    const std::shared_ptr<NVMeSensor>& sensor, const std::string& mctpConfig)
+{
+    resolveMCTPEndpoint(
+        dbusConnection, mctpConfig,
+        [weakContext{std::weak_ptr<NVMeMCTPContext>(context)},
+         weakSensor{std::weak_ptr<NVMeSensor>(sensor)}](
+            const nvme_mi::Address& address) {
+            auto context = weakContext.lock();
+            auto sensor = weakSensor.lock();
+            if (context && sensor)
+            {
+                context->setEndpoint(sensor, address);
+            }
+        });
+}
+
+static void addMCTPSensor(
+    boost::asio::io_context& io,
+    const std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    const std::shared_ptr<NVMeSensor>& sensor, const std::string& mctpConfig,
+    int rootBus, size_t queryDepth)
+{
+    std::shared_ptr<NVMeMCTPContext> context;
+    try
+    {
+        context = provideMCTPContext(io, nvmeMCTPDeviceMap, rootBus,
+                                     queryDepth);
+    }
+    catch (const std::system_error& e)
+    {
+        std::cerr << "Failed to poll " << sensor->name
+                  << " over MCTP: " << e.what() << "\n";
+        sensor->markAvailable(false);
+        return;
+    }
+
+    /* Unavailable until its endpoint is known */
+    sensor->markAvailable(false);
+    context->addEndpointSensor(sensor, mctpConfig);
+    updateMCTPEndpoint(dbusConnection, context, sensor, mctpConfig);
+}
+
 static void handleSensorConfigurations(
     boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
     std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
     const ManagedObjectType& sensorConfigurations)
 {
     // todo: it'd be better to only update the ones we care about
-    for (const auto& [_, nvmeContextPtr] : nvmeDeviceMap)
+    for (NVMEMap* map : {&nvmeDeviceMap, &nvmeMCTPDeviceMap})
     {
-        if (nvmeContextPtr)
+        for (const auto& [_, nvmeContextPtr] : *map)
         {
-            nvmeContextPtr->close();
+            if (nvmeContextPtr)
+            {
+                nvmeContextPtr->close();
+            }
         }
+        map->clear();
     }
-    nvmeDeviceMap.clear();
+
+    QueryDepths queryDepths = collectQueryDepths(sensorConfigurations);
 
     // iterate through all found configurations
     for (const auto& [interfacePath, sensorData] : sensorConfigurations)
@@ -192,11 +532,43 @@ static void handleSensorConfigurations(
                       << "\n";
         }
 
+        std::optional<std::string> mctpConfig;
+        if (extractMCTPTransport(sensorConfig))
+        {
+            mctpConfig = findMCTPConfiguration(sensorConfigurations,
+                                               interfacePath, *busNumber);
+            if (!mctpConfig)
+            {
+                std::cerr << "No " << mctpConfigType << " configuration on bus "
+                          << *busNumber << " for " << *sensorName << "\n";
+                continue;
+            }
+        }
+
         try
         {
+            if (mctpConfig)
+            {
+                // May throw for an invalid busNumber
+                std::shared_ptr<NVMeSensor> sensorPtr =
+                    std::make_shared<NVMeSensor>(
+                        objectServer, io, dbusConnection, *sensorName,
+                        std::move(sensorThresholds), interfacePath,
+                        *busNumber, slaveAddr,
+                        getPollRate(sensorConfig, NVMeSensor::defaultPollRate),
+                        createPresenceGpio(io, *sensorName, sensorData),
+                        extractPCIeSlot(sensorConfig));
+
+                addMCTPSensor(io, dbusConnection, sensorPtr, *mctpConfig,
+                              *rootBus,
+                              queryDepthFor(queryDepths, *rootBus, true));
+                continue;
+            }
+
             // May throw for an invalid rootBus
-            std::shared_ptr<NVMeContext> context =
-                provideRootBusContext(io, nvmeDeviceMap, *rootBus);
+            std::shared_ptr<NVMeContext> context = provideRootBusContext(
+                io, nvmeDeviceMap, *rootBus,
+                queryDepthFor(queryDepths, *rootBus, false));
 
             // Construct the sensor after grabbing the context so we don't
             // glitch D-Bus May throw for an invalid busNumber
@@ -204,7 +576,10 @@ static void handleSensorConfigurations(
                 std::make_shared<NVMeSensor>(
                     objectServer, io, dbusConnection, *sensorName,
                     std::move(sensorThresholds), interfacePath, *busNumber,
-                    slaveAddr);
+                    slaveAddr,
+                    getPollRate(sensorConfig, NVMeSensor::defaultPollRate),
+                    createPresenceGpio(io, *sensorName, sensorData),
+                    extractPCIeSlot(sensorConfig));
 
             context->addSensor(sensorPtr);
         }
@@ -215,9 +590,12 @@ static void handleSensorConfigurations(
                       << "\n";
         }
     }
-    for (const auto& [_, context] : nvmeDeviceMap)
+    for (NVMEMap* map : {&nvmeDeviceMap, &nvmeMCTPDeviceMap})
     {
-        context->pollNVMeDevices();
+        for (const auto& [_, context] : *map)
+        {
+            context->pollNVMeDevices();
+        }
     }
 }
 
@@ -231,7 +609,8 @@ void createSensors(boost::asio::io_context& io,
             handleSensorConfigurations(io, objectServer, dbusConnection,
                                        sensorConfigurations);
         });
-    getter->getConfiguration(std::vector<std::string>{NVMeSensor::sensorType});
+    getter->getConfiguration(
+        std::vector<std::string>{NVMeSensor::sensorType, mctpConfigType});
 }
 
 static void interfaceRemoved(sdbusplus::message_t& message, NVMEMap& contexts)
@@ -267,13 +646,13 @@ static void interfaceRemoved(sdbusplus::message_t& message, NVMEMap& contexts)
     }
 }
 
-int main()
+static SensorDaemon::Task nvmeSensorMain(SensorDaemon& daemon)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
     systemBus->request_name("xyz.openbmc_project.NVMeSensor");
-    sdbusplus::asio::object_server objectServer(systemBus, true);
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
+    daemon.addManager("/xyz/openbmc_project/sensors");
 
     boost::asio::post(io,
                       [&]() { createSensors(io, objectServer, systemBus); });
@@ -313,8 +692,40 @@ int main()
             std::string(inventoryPath) + "/'",
         [](sdbusplus::message_t& msg) {
             interfaceRemoved(msg, nvmeDeviceMap);
+            interfaceRemoved(msg, nvmeMCTPDeviceMap);
+        });
+
+    // The mapper adds the configures association once mctpreactor has set up
+    // an endpoint, look it up for the drives behind it
+    auto endpointAddedMatch = std::make_unique<sdbusplus::bus::match_t>(
+        static_cast<sdbusplus::bus_t&>(*systemBus),
+        "type='signal',member='InterfacesAdded',sender='" +
+            std::string(mapper::busName) + "',arg0path='" +
+            std::string(inventoryPath) + "/'",
+        [&systemBus](sdbusplus::message_t& msg) {
+            sdbusplus::message::object_path path;
+            msg.read(path);
+            if (path.filename() != "configures")
+            {
+                return;
+            }
+
+            std::string mctpConfig = path.parent_path();
+            for (const auto& [_, context] : nvmeMCTPDeviceMap)
+            {
+                auto mctpContext =
+                    std::static_pointer_cast<NVMeMCTPContext>(context);
+                for (const auto& sensor : mctpContext->configuredBy(mctpConfig))
+                {
+                    updateMCTPEndpoint(systemBus, mctpContext, sensor,
+                                       mctpConfig);
+                }
+            }
         });
 
     setupManufacturingModeMatch(*systemBus);
-    io.run();
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("nvme", "nvmesensor",
+                                           nvmeSensorMain);
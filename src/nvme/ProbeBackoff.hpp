@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+
+// Decides which sweeps to query a drive slot on.  A slot whose drive doesn't
+// respond, being empty or powered off, is queried exponentially less often
+// until it's only tried once every maxInterval sweeps.  The first response
+// puts it back on every sweep.
+class ProbeBackoff
+{
+  public:
+    explicit ProbeBackoff(unsigned int maxInterval) :
+        maxInterval(std::max(maxInterval, 1U))
+    {}
+
+    // Whether to query the slot this sweep, called once per sweep
+    bool due()
+    {
+        if (skip == 0)
+        {
+            return true;
+        }
+
+        skip--;
+        return false;
+    }
+
+    void missed()
+    {
+        interval = std::min(interval * 2, maxInterval);
+        skip = interval - 1;
+    }
+
+    void responded()
+    {
+        interval = 1;
+        skip = 0;
+    }
+
+    // Sweeps between queries
+    unsigned int backoff() const
+    {
+        return interval;
+    }
+
+  private:
+    const unsigned int maxInterval;
+    unsigned int interval = 1;
+    unsigned int skip = 0;
+};
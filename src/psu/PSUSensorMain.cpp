@@ -18,6 +18,8 @@
 #include "PSUEvent.hpp"
 #include "PSUSensor.hpp"
 #include "PwmSensor.hpp"
+#include "SensorConfig.hpp"
+#include "SensorDaemon.hpp"
 #include "SensorPaths.hpp"
 #include "Thresholds.hpp"
 #include "Utils.hpp"
@@ -52,6 +54,7 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <regex>
 #include <stdexcept>
 #include <string>
@@ -156,6 +159,41 @@ struct DevParams
 
 namespace fs = std::filesystem;
 
+// The fixed keys of a PSU configuration.  The per-label keys (<label>_Name,
+// <label>_Scale and so on) are named after what the driver exposes, so they
+// can't be described up front and are still looked up on the raw map.
+struct PSUConfig
+{
+    uint64_t bus = 0;
+    uint64_t address = 0;
+    std::string name;
+    std::optional<uint64_t> cpuRequired;
+    PowerState readState = PowerState::always;
+    float pollRate = static_cast<float>(PSUSensor::defaultSensorPoll);
+    std::optional<std::vector<std::string>> labels;
+
+    // The configuration type it was exposed as, not part of the schema
+    std::string type;
+
+    bool operator==(const PSUConfig&) const = default;
+};
+
+template <>
+struct sensor_config::Schema<PSUConfig>
+{
+    static constexpr auto fields = std::make_tuple(
+        required("Bus", &PSUConfig::bus),
+        required("Address", &PSUConfig::address),
+        required("Name", &PSUConfig::name),
+        optional("CPURequired", &PSUConfig::cpuRequired),
+        optional("PowerState", &PSUConfig::readState),
+        optional("PollRate", &PSUConfig::pollRate, positive<float>),
+        optional("Labels", &PSUConfig::labels));
+};
+
+// Decoded PSU configuration by configuration path
+using PSUConfigMap = boost::container::flat_map<std::string, PSUConfig>;
+
 static boost::container::flat_map<std::string, std::shared_ptr<PSUSensor>>
     sensors;
 static boost::container::flat_map<std::string, std::unique_ptr<PSUCombineEvent>>
@@ -297,29 +335,18 @@ static void checkPWMSensor(
         name, pwmPathStr, dbusConnection, objectServer, objPath, "PSU");
 }
 
-static void createSensorsCallback(
+static void createSensorsFromPaths(
     boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
     std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
-    const ManagedObjectType& sensorConfigs,
+    const ManagedObjectType& sensorConfigs, const PSUConfigMap& psuConfigs,
+    const std::vector<fs::path>& pmbusPaths, const I2CDeviceMap& devices,
     const std::shared_ptr<boost::container::flat_set<std::string>>&
         sensorsChanged,
-    bool activateOnly)
+    bool activateOnly, boost::container::flat_set<std::string>& directories)
 {
     int numCreated = 0;
     bool firstScan = sensorsChanged == nullptr;
 
-    auto devices = instantiateDevices(sensorConfigs, sensors, sensorTypes);
-
-    std::vector<fs::path> pmbusPaths;
-    findFiles(fs::path("/sys/bus/iio/devices"), "name", pmbusPaths);
-    findFiles(fs::path("/sys/class/hwmon"), "name", pmbusPaths);
-    if (pmbusPaths.empty())
-    {
-        std::cerr << "No PSU sensors in system\n";
-        return;
-    }
-
-    boost::container::flat_set<std::string> directories;
     for (const auto& pmbusPath : pmbusPaths)
     {
         EventPathList eventPathList;
@@ -387,61 +414,34 @@ static void createSensorsCallback(
         const SensorBaseConfigMap* baseConfig = nullptr;
         const SensorData* sensorData = nullptr;
         const std::string* interfacePath = nullptr;
-        std::string sensorType;
+        const PSUConfig* psuConfig = nullptr;
         size_t thresholdConfSize = 0;
 
         for (const auto& [path, cfgData] : sensorConfigs)
         {
-            sensorData = &cfgData;
-            for (const auto& [type, dt] : sensorTypes)
+            auto findConfig = psuConfigs.find(path.str);
+            if (findConfig == psuConfigs.end())
             {
-                auto sensorBase = sensorData->find(configInterfaceName(type));
-                if (sensorBase != sensorData->end())
-                {
-                    baseConfig = &sensorBase->second;
-                    sensorType = type;
-                    break;
-                }
-            }
-            if (baseConfig == nullptr)
-            {
-                std::cerr << "error finding base configuration for "
-                          << deviceName << "\n";
-                continue;
-            }
-
-            auto configBus = baseConfig->find("Bus");
-            auto configAddress = baseConfig->find("Address");
-
-            if (configBus == baseConfig->end() ||
-                configAddress == baseConfig->end())
-            {
-                std::cerr << "error finding necessary entry in configuration\n";
-                continue;
-            }
-
-            const uint64_t* confBus =
-                std::get_if<uint64_t>(&(configBus->second));
-            const uint64_t* confAddr =
-                std::get_if<uint64_t>(&(configAddress->second));
-            if (confBus == nullptr || confAddr == nullptr)
-            {
-                std::cerr
-                    << "Cannot get bus or address, invalid configuration\n";
+                // Already reported when it was decoded
                 continue;
             }
+            const PSUConfig& candidate = findConfig->second;
 
-            if ((*confBus != bus) || (*confAddr != addr))
+            if ((candidate.bus != bus) || (candidate.address != addr))
             {
                 if constexpr (debug)
                 {
-                    std::cerr << "Configuration skipping " << *confBus << "-"
-                              << *confAddr << " because not " << bus << "-"
-                              << addr << "\n";
+                    std::cerr << "Configuration skipping " << candidate.bus
+                              << "-" << candidate.address << " because not "
+                              << bus << "-" << addr << "\n";
                 }
                 continue;
             }
 
+            sensorData = &cfgData;
+            baseConfig = &cfgData.at(configInterfaceName(candidate.type));
+            psuConfig = &candidate;
+
             std::vector<thresholds::Threshold> confThresholds;
             if (!parseThresholdsFromConfig(*sensorData, confThresholds))
             {
@@ -459,6 +459,7 @@ static void createSensorsCallback(
             std::cerr << "failed to find match for " << deviceName << "\n";
             continue;
         }
+        const std::string& sensorType = psuConfig->type;
 
         auto findI2CDev = devices.find(*interfacePath);
 
@@ -472,26 +473,11 @@ static void createSensorsCallback(
             i2cDev = findI2CDev->second.first;
         }
 
-        auto findPSUName = baseConfig->find("Name");
-        if (findPSUName == baseConfig->end())
-        {
-            std::cerr << "could not determine configuration name for "
-                      << deviceName << "\n";
-            continue;
-        }
-        const std::string* psuName =
-            std::get_if<std::string>(&(findPSUName->second));
-        if (psuName == nullptr)
-        {
-            std::cerr << "Cannot find psu name, invalid configuration\n";
-            continue;
-        }
+        const std::string* psuName = &psuConfig->name;
 
-        auto findCPU = baseConfig->find("CPURequired");
-        if (findCPU != baseConfig->end())
+        if (psuConfig->cpuRequired)
         {
-            size_t index = std::visit(VariantToIntVisitor(), findCPU->second);
-            auto presenceFind = cpuPresence.find(index);
+            auto presenceFind = cpuPresence.find(*psuConfig->cpuRequired);
             if (presenceFind == cpuPresence.end() || !presenceFind->second)
             {
                 continue;
@@ -517,19 +503,22 @@ static void createSensorsCallback(
         checkEvent(directory.string(), eventMatch, eventPathList);
         checkGroupEvent(directory.string(), groupEventPathList);
 
-        PowerState readState = getPowerState(*baseConfig);
+        PowerState readState = psuConfig->readState;
         size_t readSlot = getSlotId(*baseConfig);
 
         /* Check if there are more sensors in the same interface */
-        int i = 1;
-        std::vector<std::string> psuNames;
-        do
+        std::vector<std::string> psuNames{escapeName(*psuName)};
+        // Individual string fields: Name1, Name2, Name3, ...
+        for (int i = 1;; i++)
         {
-            // Individual string fields: Name, Name1, Name2, Name3, ...
+            auto findPSUName = baseConfig->find("Name" + std::to_string(i));
+            if (findPSUName == baseConfig->end())
+            {
+                break;
+            }
             psuNames.push_back(
                 escapeName(std::get<std::string>(findPSUName->second)));
-            findPSUName = baseConfig->find("Name" + std::to_string(i++));
-        } while (findPSUName != baseConfig->end());
+        }
 
         std::vector<fs::path> sensorPaths;
         if (!findFiles(directory, devParamMap[devType].matchRegEx, sensorPaths,
@@ -548,16 +537,11 @@ static void createSensorsCallback(
             }
         }
 
-        float pollRate = getPollRate(*baseConfig, PSUSensor::defaultSensorPoll);
+        float pollRate = psuConfig->pollRate;
 
         /* Find array of labels to be exposed if it is defined in config */
-        std::vector<std::string> findLabels;
-        auto findLabelObj = baseConfig->find("Labels");
-        if (findLabelObj != baseConfig->end())
-        {
-            findLabels =
-                std::get<std::vector<std::string>>(findLabelObj->second);
-        }
+        std::vector<std::string> findLabels =
+            psuConfig->labels.value_or(std::vector<std::string>{});
 
         std::regex sensorNameRegEx(devParamMap[devType].nameRegEx);
         std::smatch matches;
@@ -1001,6 +985,87 @@ static void createSensorsCallback(
     }
 }
 
+static void createSensorsCallback(
+    boost::asio::io_context& io, sdbusplus::asio::object_server& objectServer,
+    std::shared_ptr<sdbusplus::asio::connection>& dbusConnection,
+    const ManagedObjectType& sensorConfigs,
+    const std::shared_ptr<boost::container::flat_set<std::string>>&
+        sensorsChanged,
+    bool activateOnly)
+{
+    // Devices are brought up off the event loop, so keep our own copy of the
+    // configuration and of the hwmon directories already dealt with as each
+    // device becomes ready.
+    auto configs = std::make_shared<ManagedObjectType>(sensorConfigs);
+    auto directories =
+        std::make_shared<boost::container::flat_set<std::string>>();
+
+    // Decoded once here, rather than for every device matched against them
+    auto psuConfigs = std::make_shared<PSUConfigMap>();
+    for (const auto& [path, cfgData] : sensorConfigs)
+    {
+        for (const auto& [type, dt] : sensorTypes)
+        {
+            auto sensorBase = cfgData.find(configInterfaceName(type));
+            if (sensorBase == cfgData.end())
+            {
+                continue;
+            }
+            std::string error;
+            std::optional<PSUConfig> config =
+                sensor_config::decode<PSUConfig>(sensorBase->second, error);
+            if (!config)
+            {
+                std::cerr << "Invalid configuration " << path.str << ": "
+                          << error << "\n";
+                break;
+            }
+            config->type = type;
+            psuConfigs->emplace(path.str, std::move(*config));
+            break;
+        }
+    }
+
+    instantiateDevices(
+        io, *configs, sensors, sensorTypes,
+        [&io, &objectServer, &dbusConnection, configs, psuConfigs,
+         sensorsChanged, activateOnly,
+         directories](const std::string& path,
+                                    const I2CDeviceParams& params,
+                                    const std::shared_ptr<I2CDevice>& device) {
+            std::vector<fs::path> pmbusPaths;
+            for (const auto& hwmonDir : params.hwmonDirectories())
+            {
+                pmbusPaths.emplace_back(hwmonDir / "name");
+            }
+            I2CDeviceMap devices;
+            devices.emplace(path, std::make_pair(device, true));
+            createSensorsFromPaths(io, objectServer, dbusConnection, *configs,
+                                   *psuConfigs, pmbusPaths, devices,
+                                   sensorsChanged, activateOnly, *directories);
+        },
+        [&io, &objectServer, &dbusConnection, configs, psuConfigs,
+         sensorsChanged, activateOnly,
+         directories](const I2CDeviceMap& devices) {
+            std::vector<fs::path> pmbusPaths;
+            findFiles(fs::path("/sys/bus/iio/devices"), "name", pmbusPaths);
+            findFiles(fs::path("/sys/class/hwmon"), "name", pmbusPaths);
+            if (pmbusPaths.empty())
+            {
+                std::cerr << "No PSU sensors in system\n";
+                return;
+            }
+
+            // Skip what was already set up as the devices became ready
+            std::erase_if(pmbusPaths, [&directories](const fs::path& path) {
+                return directories->contains(path.parent_path().string());
+            });
+            createSensorsFromPaths(io, objectServer, dbusConnection, *configs,
+                                   *psuConfigs, pmbusPaths, devices,
+                                   sensorsChanged, activateOnly, *directories);
+        });
+}
+
 static void
     getPresentCpus(std::shared_ptr<sdbusplus::asio::connection>& dbusConnection)
 {
@@ -1161,14 +1226,14 @@ static void powerStateChanged(
     }
 }
 
-int main()
+static SensorDaemon::Task psuSensorMain(SensorDaemon& daemon)
 {
-    boost::asio::io_context io;
-    auto systemBus = std::make_shared<sdbusplus::asio::connection>(io);
+    boost::asio::io_context& io = daemon.io;
+    auto& systemBus = daemon.systemBus;
 
-    sdbusplus::asio::object_server objectServer(systemBus, true);
-    objectServer.add_manager("/xyz/openbmc_project/sensors");
-    objectServer.add_manager("/xyz/openbmc_project/control");
+    sdbusplus::asio::object_server& objectServer = daemon.objectServer;
+    daemon.addManager("/xyz/openbmc_project/sensors");
+    daemon.addManager("/xyz/openbmc_project/control");
     systemBus->request_name("xyz.openbmc_project.PSUSensor");
     auto sensorsChanged =
         std::make_shared<boost::container::flat_set<std::string>>();
@@ -1281,5 +1346,7 @@ int main()
     getPresentCpus(systemBus);
 
     setupManufacturingModeMatch(*systemBus);
-    io.run();
+    co_await daemon.run();
 }
+
+static const SensorDaemon::Backend backend("psu", "psusensor", psuSensorMain);
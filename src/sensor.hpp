@@ -4,6 +4,7 @@
 
 #include "SensorPaths.hpp"
 #include "Thresholds.hpp"
+#include "Tracing.hpp"
 #include "Utils.hpp"
 
 #include <sdbusplus/asio/object_server.hpp>
@@ -109,6 +110,11 @@ struct Sensor
     size_t errCount{0};
     std::unique_ptr<SensorInstrumentation> instrumentation;
 
+    // Construction time, for tracing how long it takes to publish the first
+    // valid reading
+    tracing::Clock::time_point created = tracing::Clock::now();
+    bool firstReadingTraced = false;
+
     // This member variable provides a hook that can be used to receive
     // notification whenever this Sensor's value is externally set via D-Bus.
     // If interested, assign your own lambda to this variable, during
@@ -255,6 +261,8 @@ struct Sensor
                               const std::string& label = std::string(),
                               size_t thresholdSize = 0)
     {
+        tracing::Span span("setInitialProperties", name);
+
         if (readState == PowerState::on || readState == PowerState::biosPost ||
             readState == PowerState::chassisOn)
         {
@@ -424,7 +432,7 @@ struct Sensor
         return "";
     }
 
-    bool readingStateGood() const
+    virtual bool readingStateGood() const
     {
         return ::readingStateGood(readState, slotId);
     }
@@ -503,6 +511,13 @@ struct Sensor
         updateValueProperty(newValue);
         updateInstrumentation(newValue);
 
+        if (!firstReadingTraced && std::isfinite(newValue))
+        {
+            firstReadingTraced = true;
+            tracing::complete("firstReading", created, tracing::Clock::now(),
+                              name);
+        }
+
         // Always check thresholds after changing the value,
         // as the test against hysteresisTrigger now takes place in
         // the thresholds::checkThresholds() method,
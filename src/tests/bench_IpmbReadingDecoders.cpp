@@ -0,0 +1,74 @@
+#include "ipmb/IpmbReadingDecoders.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Times each reading decoder over responses carrying every 16 bit code, as
+// the sensors call them: through the Decoder bound for the format.
+
+namespace
+{
+
+constexpr size_t rounds = 64;
+constexpr size_t codes = 0x10000;
+
+constexpr std::array<const char*, 8> formatNames{
+    "byte0",     "byte3",          "nineBit",         "tenBit",
+    "elevenBit", "elevenBitShift", "linearElevenBit", "fifteenBit"};
+
+void benchmark(const char* name, const ipmb_reading::Decoder& decoder)
+{
+    // The shortest response the decoder accepts that holds two bytes, with
+    // the code repeated through it whichever bytes the format reads
+    size_t length = std::min(std::max<size_t>(decoder.minLength, 2),
+                             decoder.maxLength);
+    std::vector<uint8_t> responses(codes * length);
+    for (size_t code = 0; code < codes; code++)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            responses[(code * length) + i] =
+                static_cast<uint8_t>(code >> (8 * (i % 2)));
+        }
+    }
+
+    // Summed so that the decoding can't be optimised away
+    double sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++)
+    {
+        for (size_t code = 0; code < codes; code++)
+        {
+            std::optional<double> value = decoder.decode(
+                std::span(responses).subspan(code * length, length));
+            sum += value.value_or(0);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::printf("%-16s %6.2f ns/reading (checksum %g)\n", name,
+                elapsed.count() / (rounds * codes), sum);
+}
+
+} // namespace
+
+int main()
+{
+    for (size_t format = 0; format < formatNames.size(); format++)
+    {
+        benchmark(formatNames[format],
+                  ipmb_reading::decoderFor(static_cast<ReadingFormat>(format),
+                                           false));
+    }
+    benchmark("sensorReading",
+              ipmb_reading::decoderFor(ReadingFormat::byte0, true));
+    return 0;
+}
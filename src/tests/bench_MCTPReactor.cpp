@@ -0,0 +1,162 @@
+#include "MCTPEndpoint.hpp"
+#include "MCTPReactor.hpp"
+#include "Utils.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// Times the setup of a fully populated chassis through the reactor's setup
+// queue, against devices whose setups are answered in the order they were
+// started as soon as the reactor has dispatched them.
+
+namespace
+{
+
+constexpr int links = 16;
+constexpr int perLink = 32;
+constexpr int rounds = 20;
+
+using Added = std::function<void(const std::error_code& ec,
+                                 const std::shared_ptr<MCTPEndpoint>& ep)>;
+
+struct Outstanding
+{
+    std::shared_ptr<MCTPEndpoint> endpoint;
+    Added added;
+};
+
+class NullAssociationServer : public AssociationServer
+{
+  public:
+    void associate(const std::string& /*path*/,
+                   const std::vector<Association>& /*associations*/) override
+    {}
+    void disassociate(const std::string& /*path*/) override {}
+};
+
+class FakeEndpoint : public MCTPEndpoint
+{
+  public:
+    FakeEndpoint(int network, uint8_t eid) : net(network), id(eid) {}
+
+    int network() const override
+    {
+        return net;
+    }
+    uint8_t eid() const override
+    {
+        return id;
+    }
+    void subscribe(Event&& /*degraded*/, Event&& /*available*/,
+                   Event&& /*removed*/) override
+    {}
+    void remove() override {}
+    std::string describe() const override
+    {
+        return "fake endpoint";
+    }
+    std::shared_ptr<MCTPDevice> device() const override
+    {
+        return dev.lock();
+    }
+
+    std::weak_ptr<MCTPDevice> dev;
+
+  private:
+    int net;
+    uint8_t id;
+};
+
+class FakeDevice : public MCTPDevice
+{
+  public:
+    FakeDevice(std::string link, std::deque<Outstanding>& outstanding) :
+        interface(std::move(link)), outstanding(outstanding)
+    {}
+
+    void setup(Added&& added) override
+    {
+        outstanding.emplace_back(endpoint, std::move(added));
+    }
+    void remove() override {}
+    std::string describe() const override
+    {
+        return "fake device";
+    }
+    std::string link() const override
+    {
+        return interface;
+    }
+
+    std::shared_ptr<FakeEndpoint> endpoint;
+
+  private:
+    std::string interface;
+    std::deque<Outstanding>& outstanding;
+};
+
+std::chrono::steady_clock::duration setupChassis()
+{
+    NullAssociationServer assoc;
+    auto reactor = std::make_shared<MCTPReactor>(assoc);
+    std::deque<Outstanding> outstanding;
+
+    std::vector<std::string> paths;
+    std::vector<std::shared_ptr<FakeDevice>> devices;
+    for (int i = 0; i < links * perLink; i++)
+    {
+        auto device = std::make_shared<FakeDevice>(
+            "mctpi2c" + std::to_string(i % links), outstanding);
+        device->endpoint = std::make_shared<FakeEndpoint>(
+            i % links, static_cast<uint8_t>(8 + (i / links)));
+        device->endpoint->dev = device;
+        paths.push_back("/xyz/openbmc_project/inventory/system/nvme/NVMe_" +
+                        std::to_string(i));
+        devices.push_back(device);
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        reactor->manageMCTPDevice(paths[i], devices[i]);
+    }
+    while (!outstanding.empty())
+    {
+        Outstanding done = std::move(outstanding.front());
+        outstanding.pop_front();
+        done.added({}, done.endpoint);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - started;
+
+    for (const auto& path : paths)
+    {
+        reactor->unmanageMCTPDevice(path);
+    }
+    return elapsed;
+}
+
+} // namespace
+
+int main()
+{
+    std::chrono::duration<double, std::micro> total{};
+    for (int round = 0; round < rounds; round++)
+    {
+        total += setupChassis();
+    }
+
+    std::chrono::duration<double, std::micro> perChassis = total / rounds;
+    std::printf("%d devices on %d links: %.1f us/chassis, %.3f us/device\n",
+                links * perLink, links, perChassis.count(),
+                perChassis.count() / (links * perLink));
+    return 0;
+}
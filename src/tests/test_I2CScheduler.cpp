@@ -0,0 +1,299 @@
+#include "I2CScheduler.hpp"
+
+#include <boost/asio/io_context.hpp>
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+// Records the buses transactions ran on, holding up the first until released
+// so that the rest queue behind it
+struct FakeBus
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    bool released = false;
+    std::vector<int> executed;
+
+    void release()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            released = true;
+        }
+        cv.notify_all();
+    }
+};
+
+class FakeAdapter : public I2CAdapter
+{
+  public:
+    explicit FakeAdapter(std::shared_ptr<FakeBus> fake) : fake(std::move(fake))
+    {}
+
+    void execute(const I2CTransaction& transaction, I2CResult& result) override
+    {
+        std::unique_lock<std::mutex> guard(fake->lock);
+        fake->cv.wait(guard, [this]() { return fake->released; });
+        fake->executed.push_back(transaction.bus);
+        if (transaction.address == 0x7f)
+        {
+            result.error = ENXIO;
+            return;
+        }
+        result.value = transaction.command;
+    }
+
+  private:
+    std::shared_ptr<FakeBus> fake;
+};
+
+// Like the kernel's i2c-stub, a bank of word registers at each address
+// present, with the added ability to hold the bus as a wedged device would
+struct StubDevices
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    std::map<std::pair<int, uint8_t>, std::array<uint16_t, 256>> devices;
+    std::optional<uint8_t> wedged;
+    std::vector<uint8_t> executed;
+
+    void unwedge()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            wedged.reset();
+        }
+        cv.notify_all();
+    }
+};
+
+class StubAdapter : public I2CAdapter
+{
+  public:
+    explicit StubAdapter(std::shared_ptr<StubDevices> stub) :
+        stub(std::move(stub))
+    {}
+
+    void execute(const I2CTransaction& transaction, I2CResult& result) override
+    {
+        std::unique_lock<std::mutex> guard(stub->lock);
+        stub->cv.wait(guard, [this, &transaction]() {
+            return stub->wedged != transaction.address;
+        });
+        stub->executed.push_back(transaction.command);
+
+        auto findDevice =
+            stub->devices.find({transaction.bus, transaction.address});
+        if (findDevice == stub->devices.end())
+        {
+            result.error = ENXIO;
+            return;
+        }
+        result.value = findDevice->second[transaction.command];
+    }
+
+  private:
+    std::shared_ptr<StubDevices> stub;
+};
+
+// Channels 10 and 11 of a mux on bus 1, and bus 2 on its own
+std::vector<int> fakeTopology(int bus)
+{
+    if (bus == 10 || bus == 11)
+    {
+        return {1, bus};
+    }
+    return {bus};
+}
+
+} // namespace
+
+TEST(I2CScheduler, PickNextStaysOnTheCurrentBus)
+{
+    std::array<int, 4> window{11, 10, 11, 10};
+    EXPECT_EQ(I2CScheduler::pickNext(window, 10, 1, 4), 1U);
+    EXPECT_EQ(I2CScheduler::pickNext(window, 11, 1, 4), 0U);
+    EXPECT_EQ(I2CScheduler::pickNext(window, 12, 1, 4), 0U);
+}
+
+TEST(I2CScheduler, PickNextMovesOnAfterABurst)
+{
+    std::array<int, 4> window{10, 10, 11, 10};
+    EXPECT_EQ(I2CScheduler::pickNext(window, 10, 3, 4), 0U);
+    EXPECT_EQ(I2CScheduler::pickNext(window, 10, 4, 4), 2U);
+
+    std::array<int, 2> same{10, 10};
+    EXPECT_EQ(I2CScheduler::pickNext(same, 10, 4, 4), 0U);
+}
+
+TEST(I2CScheduler, ReordersToAvoidMuxSwitches)
+{
+    boost::asio::io_context io;
+    auto fake = std::make_shared<FakeBus>();
+    auto scheduler = std::make_shared<I2CScheduler>(
+        io, [fake]() { return std::make_unique<FakeAdapter>(fake); },
+        fakeTopology, 8, 4);
+
+    std::vector<uint8_t> completed;
+    auto submit = [&](int bus, uint8_t address, uint8_t command) {
+        scheduler->submit(
+            {bus, address, I2CTransaction::Op::readByteData, command},
+            [&completed, address, command](const I2CResult& result) {
+                if (address == 0x7f)
+                {
+                    EXPECT_EQ(result.error, ENXIO);
+                }
+                else
+                {
+                    EXPECT_EQ(result.error, 0);
+                    EXPECT_EQ(result.value, command);
+                }
+                completed.push_back(command);
+            });
+    };
+
+    submit(10, 0x50, 0);
+    submit(11, 0x50, 1);
+    submit(10, 0x50, 2);
+    submit(11, 0x7f, 3);
+    submit(10, 0x50, 4);
+    fake->release();
+
+    while (completed.size() < 5)
+    {
+        ASSERT_EQ(io.run_one(), 1U);
+    }
+
+    /* Whether or not the first was picked up before the rest were queued, the
+     * transactions on bus 10 run back to back */
+    std::vector<int> expected{10, 10, 10, 11, 11};
+    EXPECT_EQ(fake->executed, expected);
+    EXPECT_EQ(completed, (std::vector<uint8_t>{0, 2, 4, 1, 3}));
+
+    auto metrics = scheduler->metrics();
+    ASSERT_EQ(metrics.size(), 1U);
+    EXPECT_EQ(metrics[1].transactions, 5U);
+    EXPECT_EQ(metrics[1].muxSwitches, 2U);
+    EXPECT_EQ(metrics[1].buses[10].transactions, 3U);
+    EXPECT_EQ(metrics[1].buses[11].transactions, 2U);
+}
+
+TEST(I2CScheduler, TreesRunIndependently)
+{
+    boost::asio::io_context io;
+    auto fake = std::make_shared<FakeBus>();
+    fake->release();
+    auto scheduler = std::make_shared<I2CScheduler>(
+        io, [fake]() { return std::make_unique<FakeAdapter>(fake); },
+        fakeTopology);
+
+    size_t completed = 0;
+    for (int bus : {2, 10, 2, 11})
+    {
+        scheduler->submit({bus, 0x50, I2CTransaction::Op::readWordData, 0},
+                          [&completed](const I2CResult&) { completed++; });
+    }
+
+    while (completed < 4)
+    {
+        ASSERT_EQ(io.run_one(), 1U);
+    }
+
+    auto metrics = scheduler->metrics();
+    ASSERT_EQ(metrics.size(), 2U);
+    EXPECT_EQ(metrics[1].transactions, 2U);
+    EXPECT_EQ(metrics[2].transactions, 2U);
+    /* Bus 2 isn't behind a mux */
+    EXPECT_EQ(metrics[2].muxSwitches, 0U);
+}
+
+class I2CSchedulerStub : public testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        stub->devices[{2, 0x4a}][0x01] = 24500;
+        stub->devices[{3, 0x4a}][0x01] = 31000;
+    }
+
+    void read(int bus, uint8_t address, uint8_t reg,
+              std::chrono::milliseconds timeout = {})
+    {
+        scheduler->submit(
+            {bus, address, I2CTransaction::Op::readWordData, reg, true},
+            [this, reg](const I2CResult& result) {
+                results.emplace(reg, result);
+                completions[reg]++;
+            },
+            timeout);
+    }
+
+    void runUntil(size_t count)
+    {
+        while (results.size() < count)
+        {
+            ASSERT_EQ(io.run_one(), 1U);
+        }
+    }
+
+    boost::asio::io_context io;
+    std::shared_ptr<StubDevices> stub = std::make_shared<StubDevices>();
+    std::shared_ptr<I2CScheduler> scheduler = std::make_shared<I2CScheduler>(
+        io, [this]() { return std::make_unique<StubAdapter>(stub); },
+        fakeTopology);
+    std::map<uint8_t, I2CResult> results;
+    std::map<uint8_t, size_t> completions;
+};
+
+TEST_F(I2CSchedulerStub, ReadsWords)
+{
+    read(2, 0x4a, 0x01);
+    read(3, 0x4b, 0x02);
+    runUntil(2);
+
+    EXPECT_EQ(results[0x01].error, 0);
+    EXPECT_EQ(results[0x01].value, 24500);
+    EXPECT_EQ(results[0x02].error, ENXIO);
+}
+
+TEST_F(I2CSchedulerStub, WedgedDeviceTimesOut)
+{
+    stub->wedged = 0x4a;
+    read(2, 0x4a, 0x01, std::chrono::milliseconds(20));
+    read(2, 0x4a, 0x02, std::chrono::milliseconds(20));
+    runUntil(2);
+    EXPECT_EQ(results[0x01].error, ETIMEDOUT);
+    EXPECT_EQ(results[0x02].error, ETIMEDOUT);
+
+    /* Other trees carry on meanwhile */
+    read(3, 0x4c, 0x03, std::chrono::milliseconds(1000));
+    runUntil(3);
+    EXPECT_EQ(results[0x03].error, ENXIO);
+
+    /* Once the bus is released the late result is dropped, and what timed out
+     * before it started is skipped */
+    stub->unwedge();
+    read(2, 0x4a, 0x04);
+    runUntil(4);
+    EXPECT_EQ(results[0x04].error, 0);
+
+    EXPECT_EQ(completions[0x01], 1U);
+    EXPECT_EQ(completions[0x02], 1U);
+    std::lock_guard<std::mutex> guard(stub->lock);
+    EXPECT_EQ(stub->executed, (std::vector<uint8_t>{0x03, 0x01, 0x04}));
+}
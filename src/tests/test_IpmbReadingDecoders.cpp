@@ -0,0 +1,155 @@
+#include "ipmb/IpmbReadingDecoders.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using ipmb_reading::decoderFor;
+
+namespace
+{
+
+// Decodes at compile time
+constexpr std::array<uint8_t, 2> negativeNineBit{0x9c, 0x01};
+static_assert(*decoderFor(ReadingFormat::nineBit, false).decode(
+                  negativeNineBit) == -100.0);
+static_assert(ipmb_reading::linearization(2, 0, 5, 0, 0x10)(3) == 110.0);
+static_assert(ipmb_reading::rawReading(negativeNineBit) == 0x019c);
+
+std::optional<double> decode(ReadingFormat format,
+                             std::span<const uint8_t> data)
+{
+    const ipmb_reading::Decoder& decoder = decoderFor(format, false);
+    EXPECT_GE(data.size(), decoder.minLength);
+    EXPECT_LE(data.size(), decoder.maxLength);
+    return decoder.decode(data);
+}
+
+} // namespace
+
+TEST(IpmbReadingDecoders, SMProFormatsOverAllCodes)
+{
+    for (unsigned int code = 0; code <= 0xffff; code++)
+    {
+        std::array<uint8_t, 2> data{static_cast<uint8_t>(code),
+                                    static_cast<uint8_t>(code >> 8)};
+        std::optional<double> nine = decode(ReadingFormat::nineBit, data);
+        std::optional<double> ten = decode(ReadingFormat::tenBit, data);
+        std::optional<double> fifteen = decode(ReadingFormat::fifteenBit, data);
+
+        if (code == 0xffff)
+        {
+            EXPECT_FALSE(nine);
+            EXPECT_FALSE(ten);
+            EXPECT_FALSE(fifteen);
+            continue;
+        }
+
+        // The sign is the lowest bit of the second byte
+        int expected = (code & 0x100) != 0 ? static_cast<int>(code & 0xff) - 256
+                                           : static_cast<int>(code & 0xff);
+        ASSERT_EQ(nine, expected) << code;
+        ASSERT_EQ(ten, code & 0x3ff) << code;
+        ASSERT_EQ(fifteen, (code & 0x7fff) / 1000.0) << code;
+    }
+}
+
+TEST(IpmbReadingDecoders, PMBusFormatsOverAllCodes)
+{
+    for (unsigned int code = 0; code <= 0xffff; code++)
+    {
+        std::array<uint8_t, 5> data{0xaa, 0xbb, 0xcc,
+                                    static_cast<uint8_t>(code),
+                                    static_cast<uint8_t>(code >> 8)};
+
+        ASSERT_EQ(decode(ReadingFormat::elevenBit, data),
+                  static_cast<int16_t>(code))
+            << code;
+        ASSERT_EQ(decode(ReadingFormat::elevenBitShift, data), code >> 3)
+            << code;
+
+        int linear = static_cast<int>(code & 0x7ff);
+        if ((linear & 0x400) != 0)
+        {
+            linear -= 0x800;
+        }
+        ASSERT_EQ(decode(ReadingFormat::linearElevenBit, data), linear)
+            << code;
+        ASSERT_EQ(decode(ReadingFormat::byte3, data), code & 0xff) << code;
+    }
+}
+
+TEST(IpmbReadingDecoders, SensorReadingAvailability)
+{
+    for (unsigned int reading = 0; reading <= 0xff; reading++)
+    {
+        for (unsigned int status = 0; status <= 0xff; status++)
+        {
+            std::vector<uint8_t> data{static_cast<uint8_t>(reading),
+                                      static_cast<uint8_t>(status), 0};
+            std::optional<double> value =
+                decoderFor(ReadingFormat::byte0, true).decode(data);
+            if ((status & 0x20) != 0)
+            {
+                ASSERT_FALSE(value);
+            }
+            else
+            {
+                ASSERT_EQ(value, reading);
+            }
+            ASSERT_EQ(decoderFor(ReadingFormat::byte0, false).decode(data),
+                      reading);
+        }
+    }
+
+    std::vector<uint8_t> tooShort{0x10, 0x00};
+    EXPECT_FALSE(decoderFor(ReadingFormat::byte0, true).decode(tooShort));
+}
+
+TEST(IpmbReadingDecoders, LinearizationOverAllExponents)
+{
+    for (unsigned int exponents = 0; exponents <= 0xff; exponents++)
+    {
+        int k1 = static_cast<int>(exponents & 0xf);
+        int k2 = static_cast<int>(exponents >> 4);
+        k1 = k1 > 7 ? k1 - 16 : k1;
+        k2 = k2 > 7 ? k2 - 16 : k2;
+
+        // M = -3, B = 300
+        ipmb_reading::Linearization linear = ipmb_reading::linearization(
+            0xfd, 0xc0, 0x2c, 0x40, static_cast<uint8_t>(exponents));
+        ASSERT_EQ(linear.m, -3);
+
+        for (unsigned int raw = 0; raw <= 0xff; raw++)
+        {
+            double expected =
+                (-3.0 * raw + 300.0 * std::pow(10, k1)) * std::pow(10, k2);
+            double value = linear(raw);
+            ASSERT_NEAR(value, expected, std::abs(expected) * 1e-12)
+                << exponents << " " << raw;
+
+            // And back to the raw reading
+            double back = ((value / linear.scale) - linear.b) / linear.m;
+            ASSERT_NEAR(back, raw, 1e-6) << exponents << " " << raw;
+        }
+    }
+}
+
+TEST(IpmbReadingDecoders, RawReadingIsLittleEndian)
+{
+    std::vector<uint8_t> data{1, 2, 3, 4, 5, 6, 7, 8, 9};
+    EXPECT_EQ(ipmb_reading::rawReading(data), 0x0807060504030201U);
+    EXPECT_EQ(ipmb_reading::rawReading(std::span(data).first(2)), 0x0201U);
+}
+
+TEST(IpmbReadingDecoders, UnknownFormatThrows)
+{
+    EXPECT_THROW(decoderFor(static_cast<ReadingFormat>(42), false),
+                 std::out_of_range);
+}
@@ -0,0 +1,230 @@
+#include "Tracing.hpp"
+#include "ipmb/IpmbRequestScheduler.hpp"
+
+#include <boost/system/error_code.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+// Holds on to the requests sent until the test replies to them
+class IpmbRequestSchedulerTest : public testing::Test
+{
+  protected:
+    struct Sent
+    {
+        IpmbRequest request;
+        IpmbRequestScheduler::Reply reply;
+    };
+
+    void submit(const IpmbTarget& target, IpmbPriority priority,
+                uint8_t command)
+    {
+        scheduler->submit(target, priority, {target.commandAddress, 0x04, 0,
+                                             command, {}},
+                          [this, command](const boost::system::error_code&,
+                                          const IpmbMethodType&) {
+                              replied.push_back(command);
+                          });
+    }
+
+    void replyTo(size_t index)
+    {
+        IpmbRequestScheduler::Reply reply = std::move(sent[index].reply);
+        sent.erase(sent.begin() + static_cast<std::ptrdiff_t>(index));
+        reply({}, IpmbMethodType{0, 0, 0, 0, 0, {0x10}});
+    }
+
+    std::shared_ptr<IpmbRequestScheduler> makeScheduler(
+        tracing::Clock::duration joinWindow =
+            IpmbRequestScheduler::defaultJoinWindow)
+    {
+        return std::make_shared<IpmbRequestScheduler>(
+            [this](const IpmbRequest& request,
+                   IpmbRequestScheduler::Reply&& reply) {
+                sent.emplace_back(request, std::move(reply));
+            },
+            joinWindow);
+    }
+
+    std::vector<Sent> sent;
+    std::vector<uint8_t> replied;
+    std::shared_ptr<IpmbRequestScheduler> scheduler = makeScheduler();
+};
+
+const IpmbTarget me{0, 1};
+const IpmbTarget smpro{0, 0};
+
+} // namespace
+
+TEST_F(IpmbRequestSchedulerTest, LimitsRequestsInFlight)
+{
+    for (uint8_t command = 0; command < 5; command++)
+    {
+        submit(me, IpmbPriority::normal, command);
+    }
+    ASSERT_EQ(sent.size(), IpmbRequestScheduler::defaultInFlight);
+    EXPECT_EQ(scheduler->metrics().at(me).queued, 3U);
+
+    replyTo(0);
+    ASSERT_EQ(sent.size(), IpmbRequestScheduler::defaultInFlight);
+    EXPECT_EQ(sent.back().request.command, 2);
+
+    scheduler->setInFlightLimit(me, 4);
+    EXPECT_EQ(sent.size(), 4U);
+    EXPECT_EQ(scheduler->metrics().at(me).queued, 0U);
+}
+
+TEST_F(IpmbRequestSchedulerTest, SendsHigherPriorityFirst)
+{
+    scheduler->setInFlightLimit(me, 1);
+    submit(me, IpmbPriority::low, 0);
+    submit(me, IpmbPriority::low, 1);
+    submit(me, IpmbPriority::normal, 2);
+    submit(me, IpmbPriority::high, 3);
+
+    while (!sent.empty())
+    {
+        replyTo(0);
+    }
+    EXPECT_EQ(replied, (std::vector<uint8_t>{0, 3, 2, 1}));
+}
+
+TEST_F(IpmbRequestSchedulerTest, TargetsQueueIndependently)
+{
+    scheduler->setInFlightLimit(me, 1);
+    submit(me, IpmbPriority::normal, 0);
+    submit(me, IpmbPriority::normal, 1);
+    submit(smpro, IpmbPriority::normal, 2);
+
+    ASSERT_EQ(sent.size(), 2U);
+    EXPECT_EQ(sent[1].request.command, 2);
+
+    replyTo(1);
+    auto metrics = scheduler->metrics();
+    EXPECT_EQ(metrics.at(smpro).requests, 1U);
+    EXPECT_EQ(metrics.at(smpro).inFlight, 0U);
+    EXPECT_EQ(metrics.at(me).inFlight, 1U);
+    EXPECT_EQ(metrics.at(me).queued, 1U);
+}
+
+TEST_F(IpmbRequestSchedulerTest, CoalescesIdenticalRequests)
+{
+    scheduler->setInFlightLimit(me, 1);
+    submit(me, IpmbPriority::normal, 0);
+    submit(me, IpmbPriority::low, 1);
+    submit(me, IpmbPriority::normal, 2);
+    // Joining the one just sent, and the one queued, which then goes ahead
+    // of the other queued
+    submit(me, IpmbPriority::normal, 0);
+    submit(me, IpmbPriority::high, 1);
+
+    while (!sent.empty())
+    {
+        replyTo(0);
+    }
+    EXPECT_EQ(replied, (std::vector<uint8_t>{0, 0, 1, 1, 2}));
+
+    auto metrics = scheduler->metrics().at(me);
+    EXPECT_EQ(metrics.requests, 3U);
+    EXPECT_EQ(metrics.coalesced, 2U);
+}
+
+TEST_F(IpmbRequestSchedulerTest, DoesNotJoinRequestsSentBeforeTheWindow)
+{
+    scheduler = makeScheduler(tracing::Clock::duration::zero());
+    scheduler->setInFlightLimit(me, 1);
+    submit(me, IpmbPriority::normal, 0);
+    submit(me, IpmbPriority::normal, 1);
+    // The one in flight may be answered with a reading from before this
+    submit(me, IpmbPriority::normal, 0);
+    submit(me, IpmbPriority::normal, 1);
+
+    while (!sent.empty())
+    {
+        replyTo(0);
+    }
+    EXPECT_EQ(replied, (std::vector<uint8_t>{0, 1, 1, 0}));
+
+    auto metrics = scheduler->metrics().at(me);
+    EXPECT_EQ(metrics.requests, 3U);
+    EXPECT_EQ(metrics.coalesced, 1U);
+}
+
+TEST_F(IpmbRequestSchedulerTest, SpreadsSensorsOverThePeriod)
+{
+    constexpr std::chrono::milliseconds period(1000);
+    std::set<std::chrono::milliseconds> phases;
+    for (int sensor = 0; sensor < 8; sensor++)
+    {
+        std::chrono::milliseconds phase = scheduler->phase(
+            me, period, {1, 0x04, 0, 0x2d, {static_cast<uint8_t>(sensor)}});
+        EXPECT_GE(phase.count(), 0);
+        EXPECT_LT(phase, period);
+        phases.insert(phase);
+    }
+    ASSERT_EQ(phases.size(), 8U);
+
+    // Reading the same as another sensor
+    EXPECT_TRUE(phases.contains(
+        scheduler->phase(me, period, {1, 0x04, 0, 0x2d, {3}})));
+
+    // No two sensors within half an even share of the period of each other
+    auto previous = phases.begin();
+    for (auto phase = std::next(previous); phase != phases.end(); ++phase)
+    {
+        EXPECT_GE(*phase - *previous, period / 16);
+        previous = phase;
+    }
+}
+
+TEST_F(IpmbRequestSchedulerTest, SpreadsHostsOverThePeriod)
+{
+    // The first sensor of each of four hosts
+    constexpr std::chrono::milliseconds period(1000);
+    std::set<std::chrono::milliseconds> phases;
+    for (uint8_t host = 0; host < 4; host++)
+    {
+        phases.insert(scheduler->phase({host, 1}, period,
+                                       {1, 0x04, 0, 0x2d, {0x10}}));
+    }
+    ASSERT_EQ(phases.size(), 4U);
+
+    auto previous = phases.begin();
+    for (auto phase = std::next(previous); phase != phases.end(); ++phase)
+    {
+        EXPECT_GE(*phase - *previous, period / 8);
+        previous = phase;
+    }
+}
+
+TEST_F(IpmbRequestSchedulerTest, CountsSweepsPerHost)
+{
+    IpmbRequestScheduler::SweepMember first = scheduler->joinSweep(0);
+    IpmbRequestScheduler::SweepMember second = scheduler->joinSweep(0);
+    IpmbRequestScheduler::SweepMember other = scheduler->joinSweep(1);
+
+    scheduler->polled(0, first);
+    scheduler->polled(0, first);
+    scheduler->polled(1, other);
+    EXPECT_EQ(scheduler->sweepMetrics().at(0).sweeps, 0U);
+    EXPECT_EQ(scheduler->sweepMetrics().at(1).sweeps, 1U);
+
+    scheduler->polled(0, second);
+    EXPECT_EQ(scheduler->sweepMetrics().at(0).sweeps, 1U);
+
+    // A sensor that stops polling doesn't hold up the sweeps
+    scheduler->polled(0, first);
+    scheduler->leaveSweep(0, second);
+    scheduler->polled(0, first);
+    EXPECT_EQ(scheduler->sweepMetrics().at(0).sweeps, 2U);
+}
@@ -0,0 +1,116 @@
+#include "ipmb/IpmbSDRCache.hpp"
+#include "ipmb/IpmbSDRSensor.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+class IpmbSDRCacheTest : public testing::Test
+{
+  protected:
+    IpmbSDRCacheTest()
+    {
+        std::string dir = "/tmp/test_ipmb_sdr_cacheXXXXXX";
+        if (mkdtemp(dir.data()) == nullptr)
+        {
+            throw std::runtime_error("Failed to create a temporary directory");
+        }
+        root = dir;
+        path = root / "cache" / "sdr-host1.json";
+
+        SensorInfo& info = records.sensors.emplace_back();
+        info.sensorReadName = "VR_TEMP";
+        info.sensorUnit = 1;
+        info.thresUpperCri = 100.5;
+        info.thresLowerCri = 0;
+        info.sensorNumber = 0x21;
+        info.sensCap = 0x0c;
+        records.conversions[0x21] = {2, 0.5, 0.1, 1};
+    }
+
+    ~IpmbSDRCacheTest() override
+    {
+        std::filesystem::remove_all(root);
+    }
+
+    IpmbSDRCacheTest(const IpmbSDRCacheTest&) = delete;
+    IpmbSDRCacheTest& operator=(const IpmbSDRCacheTest&) = delete;
+    IpmbSDRCacheTest(IpmbSDRCacheTest&&) = delete;
+    IpmbSDRCacheTest& operator=(IpmbSDRCacheTest&&) = delete;
+
+    std::filesystem::path root;
+    std::filesystem::path path;
+    SDRRecords records;
+    SDRRepositoryStamp stamp{1, 0x5f000000, 0x5e000000};
+};
+
+} // namespace
+
+TEST_F(IpmbSDRCacheTest, RoundTrips)
+{
+    ASSERT_TRUE(saveSDRCache(path, stamp, records));
+
+    SDRRecords loaded;
+    ASSERT_TRUE(loadSDRCache(path, stamp, loaded));
+    ASSERT_EQ(loaded.sensors.size(), 1U);
+    EXPECT_EQ(loaded.sensors[0].sensorReadName, "VR_TEMP");
+    EXPECT_EQ(loaded.sensors[0].sensorNumber, 0x21);
+    EXPECT_DOUBLE_EQ(loaded.sensors[0].thresUpperCri, 100.5);
+    ASSERT_EQ(loaded.conversions.size(), 1U);
+    EXPECT_EQ(loaded.conversions[0x21].mValue, 2);
+    EXPECT_DOUBLE_EQ(loaded.conversions[0x21].expoVal, 0.1);
+}
+
+TEST_F(IpmbSDRCacheTest, MissesWhenTheRepositoryChanged)
+{
+    ASSERT_TRUE(saveSDRCache(path, stamp, records));
+
+    SDRRecords loaded;
+    SDRRepositoryStamp added = stamp;
+    added.additionTimestamp++;
+    EXPECT_FALSE(loadSDRCache(path, added, loaded));
+
+    SDRRepositoryStamp erased = stamp;
+    erased.eraseTimestamp++;
+    EXPECT_FALSE(loadSDRCache(path, erased, loaded));
+    EXPECT_TRUE(loaded.sensors.empty());
+}
+
+TEST_F(IpmbSDRCacheTest, SkipsUnspecifiedTimestamps)
+{
+    SDRRepositoryStamp unspecified{1, 0xffffffff, 0xffffffff};
+    EXPECT_FALSE(saveSDRCache(path, unspecified, records));
+    EXPECT_FALSE(std::filesystem::exists(path));
+}
+
+TEST_F(IpmbSDRCacheTest, IgnoresCorruptCache)
+{
+    ASSERT_TRUE(saveSDRCache(path, stamp, records));
+    std::ofstream(path, std::ios::trunc) << "{\"version\": 1, \"sens";
+
+    SDRRecords loaded;
+    EXPECT_FALSE(loadSDRCache(path, stamp, loaded));
+}
+
+TEST_F(IpmbSDRCacheTest, HostsShareIdenticalRecords)
+{
+    SDRRecords copy = records;
+    std::shared_ptr<const SDRRecords> first = shareSDRRecords(std::move(copy));
+    copy = records;
+    std::shared_ptr<const SDRRecords> second = shareSDRRecords(std::move(copy));
+    EXPECT_EQ(first, second);
+
+    copy = records;
+    copy.conversions[0x21].mValue = -2;
+    std::shared_ptr<const SDRRecords> other = shareSDRRecords(std::move(copy));
+    EXPECT_NE(first, other);
+    EXPECT_EQ(*first, records);
+}
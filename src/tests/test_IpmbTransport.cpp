@@ -0,0 +1,311 @@
+#include "ipmb/IpmbTransport.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+constexpr IpmbAddresses addresses{0x10, 0x2c};
+
+// Stands in for the responder at the other end of an ipmb-dev device.  A
+// SOCK_SEQPACKET socket pair keeps the message boundaries the device does.
+class IpmbResponder
+{
+  public:
+    IpmbResponder()
+    {
+        std::array<int, 2> fds{};
+        EXPECT_EQ(::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0,
+                               fds.data()),
+                  0);
+        transportFd = fds[0];
+        fd = fds[1];
+    }
+
+    ~IpmbResponder()
+    {
+        hangUp();
+    }
+
+    IpmbResponder(const IpmbResponder&) = delete;
+    IpmbResponder& operator=(const IpmbResponder&) = delete;
+    IpmbResponder(IpmbResponder&&) = delete;
+    IpmbResponder& operator=(IpmbResponder&&) = delete;
+
+    std::optional<std::vector<uint8_t>> receive() const
+    {
+        std::array<uint8_t, 256> buffer{};
+        ssize_t rc = ::read(fd, buffer.data(), buffer.size());
+        if (rc <= 0)
+        {
+            return std::nullopt;
+        }
+        return std::vector<uint8_t>(buffer.begin(), buffer.begin() + rc);
+    }
+
+    // Answers request as the responder would
+    void respond(const std::vector<uint8_t>& request, uint8_t completionCode,
+                 const std::vector<uint8_t>& data, bool corrupt = false) const
+    {
+        std::vector<uint8_t> frame{
+            0,
+            request[4],
+            static_cast<uint8_t>(request[2] + (1 << 2)),
+            0,
+            request[1],
+            request[5],
+            request[6],
+            completionCode};
+        frame[3] = static_cast<uint8_t>(-(frame[1] + frame[2]));
+        frame.insert(frame.end(), data.begin(), data.end());
+        uint8_t sum = 0;
+        for (size_t i = 4; i < frame.size(); i++)
+        {
+            sum += frame[i];
+        }
+        frame.push_back(static_cast<uint8_t>(-sum + (corrupt ? 1 : 0)));
+        frame[0] = static_cast<uint8_t>(frame.size() - 1);
+        ASSERT_EQ(::write(fd, frame.data(), frame.size()),
+                  static_cast<ssize_t>(frame.size()));
+    }
+
+    // As if the device went away under the transport
+    void hangUp()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    int transportFd = -1;
+
+  private:
+    int fd = -1;
+};
+
+struct Replied
+{
+    boost::system::error_code ec;
+    IpmbMethodType response;
+};
+
+class IpmbDeviceTransportTest : public testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        transport = std::make_shared<IpmbDeviceTransport>(
+            io, responder.transportFd, addresses,
+            std::chrono::milliseconds(50));
+        transport->start();
+    }
+
+    void send(uint8_t command, std::vector<uint8_t> data = {})
+    {
+        transport->send({1, 0x06, 0, command, std::move(data)},
+                        [this](const boost::system::error_code& ec,
+                               const IpmbMethodType& response) {
+                            replies.emplace_back(ec, response);
+                        });
+    }
+
+    void runUntil(size_t count)
+    {
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::seconds(5);
+        while (replies.size() < count &&
+               std::chrono::steady_clock::now() < deadline)
+        {
+            io.run_one_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    boost::asio::io_context io;
+    IpmbResponder responder;
+    std::shared_ptr<IpmbDeviceTransport> transport;
+    std::vector<Replied> replies;
+};
+
+} // namespace
+
+TEST(IpmbFrame, EncodesRequests)
+{
+    std::vector<uint8_t> frame =
+        ipmb_frame::encodeRequest(addresses, 5, {1, 0x06, 0, 0x01, {0xaa}});
+    std::vector<uint8_t> expected{8,    0x58, 0x18, 0x90, 0x20,
+                                  0x14, 0x01, 0xaa, 0x21};
+    EXPECT_EQ(frame, expected);
+}
+
+TEST(IpmbFrame, DecodesResponses)
+{
+    std::vector<uint8_t> frame{9,    0x20, 0x1c, 0xc4, 0x58,
+                               0x15, 0x01, 0x00, 0x51, 0x41};
+    std::optional<ipmb_frame::Response> response =
+        ipmb_frame::decodeResponse(addresses, frame);
+    ASSERT_TRUE(response);
+    EXPECT_EQ(response->netfn, 0x07);
+    EXPECT_EQ(response->lun, 1);
+    EXPECT_EQ(response->sequence, 5);
+    EXPECT_EQ(response->command, 0x01);
+    EXPECT_EQ(response->completionCode, 0x00);
+    EXPECT_EQ(response->data, std::vector<uint8_t>{0x51});
+
+    // Bad checksums, requests, other responders and short frames are dropped
+    std::vector<uint8_t> corrupt = frame;
+    corrupt.back()++;
+    EXPECT_FALSE(ipmb_frame::decodeResponse(addresses, corrupt));
+
+    std::vector<uint8_t> request = frame;
+    request[2] = 0x18;
+    request[3] = 0xc8;
+    EXPECT_FALSE(ipmb_frame::decodeResponse(addresses, request));
+
+    EXPECT_FALSE(ipmb_frame::decodeResponse({0x10, 0x30}, frame));
+    EXPECT_FALSE(ipmb_frame::decodeResponse(
+        addresses, std::span(frame).first(8)));
+}
+
+TEST_F(IpmbDeviceTransportTest, MatchesResponsesBySequence)
+{
+    send(0x01);
+    send(0x02, {0x10});
+    std::optional<std::vector<uint8_t>> first = responder.receive();
+    std::optional<std::vector<uint8_t>> second = responder.receive();
+    ASSERT_TRUE(first);
+    ASSERT_TRUE(second);
+    EXPECT_NE((*first)[5], (*second)[5]);
+
+    // Answered out of order, with a stray response to nothing in between
+    responder.respond(*second, 0x00, {0x22});
+    std::vector<uint8_t> stray = *first;
+    stray[5] = 0x3f << 2;
+    responder.respond(stray, 0x00, {});
+    responder.respond(*first, 0xc1, {0x11});
+    runUntil(2);
+
+    ASSERT_EQ(replies.size(), 2U);
+    EXPECT_FALSE(replies[0].ec);
+    EXPECT_EQ(replies[0].response,
+              (IpmbMethodType{0, 0x07, 0, 0x02, 0x00, {0x22}}));
+    EXPECT_FALSE(replies[1].ec);
+    EXPECT_EQ(replies[1].response,
+              (IpmbMethodType{0, 0x07, 0, 0x01, 0xc1, {0x11}}));
+}
+
+TEST_F(IpmbDeviceTransportTest, TimesOut)
+{
+    send(0x01);
+    std::optional<std::vector<uint8_t>> request = responder.receive();
+    ASSERT_TRUE(request);
+
+    // A corrupt response leaves the request to time out
+    responder.respond(*request, 0x00, {}, true);
+    runUntil(1);
+    ASSERT_EQ(replies.size(), 1U);
+    EXPECT_EQ(replies[0].ec, boost::asio::error::timed_out);
+
+    // The late response is ignored
+    responder.respond(*request, 0x00, {});
+    io.run_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(replies.size(), 1U);
+}
+
+TEST_F(IpmbDeviceTransportTest, StopsOnHardError)
+{
+    size_t failures = 0;
+    transport->setFailureHandler(
+        [&failures](const boost::system::error_code&) { failures++; });
+    send(0x01);
+    ASSERT_TRUE(responder.receive());
+
+    // The pending request fails at once rather than timing out, and the
+    // transport stops instead of retrying the read
+    responder.hangUp();
+    io.run_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(replies.size(), 1U);
+    EXPECT_TRUE(replies[0].ec);
+    EXPECT_NE(replies[0].ec, boost::asio::error::timed_out);
+    EXPECT_EQ(failures, 1U);
+
+    // Later requests fail straight away
+    send(0x02);
+    io.restart();
+    io.run_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(replies.size(), 2U);
+    EXPECT_EQ(replies[1].ec, replies[0].ec);
+    EXPECT_EQ(failures, 1U);
+}
+
+TEST(IpmbChannelTransport, RoutesByChannel)
+{
+    class Recorder : public IpmbTransport
+    {
+      public:
+        void send(const IpmbRequest& request, Reply&&) override
+        {
+            sent.push_back(request.commandAddress);
+        }
+        std::vector<uint8_t> sent;
+    };
+
+    auto bridge = std::make_shared<Recorder>();
+    auto device = std::make_shared<Recorder>();
+    IpmbChannelTransport transport(bridge);
+    transport.setChannel(4, device);
+
+    transport.send({1, 0x06, 0, 0x01, {}}, {});
+    transport.send({4, 0x06, 0, 0x01, {}}, {});
+    transport.setChannel(4, nullptr);
+    transport.send({4, 0x06, 0, 0x01, {}}, {});
+
+    EXPECT_EQ(bridge->sent, (std::vector<uint8_t>{1, 4}));
+    EXPECT_EQ(device->sent, std::vector<uint8_t>{4});
+}
+
+TEST(IpmbChannelTransport, DropsOnlyTheFailedTransport)
+{
+    class Recorder : public IpmbTransport
+    {
+      public:
+        void send(const IpmbRequest& request, Reply&&) override
+        {
+            sent.push_back(request.commandAddress);
+        }
+        std::vector<uint8_t> sent;
+    };
+
+    auto bridge = std::make_shared<Recorder>();
+    auto failed = std::make_shared<Recorder>();
+    auto replacement = std::make_shared<Recorder>();
+    IpmbChannelTransport transport(bridge);
+    transport.setChannel(4, replacement);
+
+    // A transport that was already replaced leaves the channel alone
+    EXPECT_FALSE(transport.dropChannel(4, failed.get()));
+    transport.send({4, 0x06, 0, 0x01, {}}, {});
+    EXPECT_TRUE(transport.dropChannel(4, replacement.get()));
+    transport.send({4, 0x06, 0, 0x01, {}}, {});
+
+    EXPECT_EQ(replacement->sent, std::vector<uint8_t>{4});
+    EXPECT_EQ(bridge->sent, std::vector<uint8_t>{4});
+}
@@ -0,0 +1,142 @@
+#include "LinkMonitor.hpp"
+
+#include <linux/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <boost/asio/io_context.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+// Append an RTM_NEWLINK or RTM_DELLINK message to buffer, as the kernel
+// lays it out
+void appendLink(std::vector<uint8_t>& buffer, uint16_t type, int ifindex,
+                unsigned int flags, const std::string& name)
+{
+    size_t nameLen = RTA_LENGTH(name.size() + 1);
+    size_t len =
+        NLMSG_LENGTH(NLMSG_ALIGN(sizeof(ifinfomsg)) + RTA_ALIGN(nameLen));
+    size_t start = buffer.size();
+    buffer.resize(start + NLMSG_ALIGN(len));
+    uint8_t* message = buffer.data() + start;
+
+    nlmsghdr header{};
+    header.nlmsg_len = len;
+    header.nlmsg_type = type;
+    std::memcpy(message, &header, sizeof(header));
+
+    ifinfomsg info{};
+    info.ifi_index = ifindex;
+    info.ifi_flags = flags;
+    std::memcpy(message + NLMSG_HDRLEN, &info, sizeof(info));
+
+    rtattr attribute{};
+    attribute.rta_len = nameLen;
+    attribute.rta_type = IFLA_IFNAME;
+    uint8_t* attributes = message + NLMSG_HDRLEN +
+                          NLMSG_ALIGN(sizeof(ifinfomsg));
+    std::memcpy(attributes, &attribute, sizeof(attribute));
+    std::memcpy(attributes + RTA_LENGTH(0), name.c_str(), name.size() + 1);
+}
+
+} // namespace
+
+TEST(LinkMonitor, ParsesLinkMessages)
+{
+    std::vector<uint8_t> buffer;
+    unsigned int carrier = static_cast<unsigned int>(IFF_UP) |
+                           static_cast<unsigned int>(IFF_LOWER_UP);
+    appendLink(buffer, RTM_NEWLINK, 2, carrier | IFF_RUNNING, "eth0");
+    appendLink(buffer, RTM_NEWLINK, 3, IFF_UP, "eth1");
+    appendLink(buffer, RTM_DELLINK, 4, 0, "eth2");
+
+    std::vector<LinkEvent> events = parseLinkMessages(buffer);
+    ASSERT_EQ(events.size(), 3U);
+
+    EXPECT_EQ(events[0].ifindex, 2);
+    EXPECT_EQ(events[0].name, "eth0");
+    EXPECT_TRUE(events[0].connected);
+    EXPECT_FALSE(events[0].removed);
+
+    /* Up without a carrier */
+    EXPECT_EQ(events[1].name, "eth1");
+    EXPECT_FALSE(events[1].connected);
+
+    EXPECT_EQ(events[2].ifindex, 4);
+    EXPECT_TRUE(events[2].removed);
+}
+
+TEST(LinkMonitor, SkipsOtherAndMalformedMessages)
+{
+    std::vector<uint8_t> buffer;
+    appendLink(buffer, RTM_NEWADDR, 2, IFF_UP, "eth0");
+    appendLink(buffer, RTM_NEWLINK, 3, IFF_UP, "eth1");
+    EXPECT_EQ(parseLinkMessages(buffer).size(), 1U);
+
+    /* Truncated in the middle of the second message */
+    buffer.resize(buffer.size() - 4);
+    EXPECT_TRUE(parseLinkMessages(buffer).empty());
+
+    std::vector<uint8_t> tooShort(8, 0xff);
+    EXPECT_TRUE(parseLinkMessages(tooShort).empty());
+}
+
+TEST(LinkMonitor, FindsTheEndOfADump)
+{
+    std::vector<uint8_t> buffer;
+    appendLink(buffer, RTM_NEWLINK, 2, IFF_UP, "eth0");
+    EXPECT_FALSE(endsDump(buffer, 1));
+
+    nlmsghdr done{};
+    done.nlmsg_len = NLMSG_LENGTH(sizeof(int));
+    done.nlmsg_type = NLMSG_DONE;
+    done.nlmsg_seq = 1;
+    size_t start = buffer.size();
+    buffer.resize(start + NLMSG_ALIGN(done.nlmsg_len));
+    std::memcpy(buffer.data() + start, &done, sizeof(done));
+
+    /* Only the dump that was asked for */
+    EXPECT_TRUE(endsDump(buffer, 1));
+    EXPECT_FALSE(endsDump(buffer, 2));
+}
+
+TEST(LinkMonitor, DumpsTheLinks)
+{
+    boost::asio::io_context io;
+    std::shared_ptr<LinkMonitor> monitor;
+    try
+    {
+        monitor = std::make_shared<LinkMonitor>(io, [](const LinkEvent&) {});
+    }
+    catch (const std::system_error& e)
+    {
+        GTEST_SKIP() << "No rtnetlink: " << e.what();
+    }
+    monitor->start();
+
+    /* Every network namespace has a loopback interface */
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (monitor->links().empty() &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        io.run_one_for(std::chrono::milliseconds(100));
+    }
+
+    bool foundLoopback = false;
+    for (const auto& [ifindex, link] : monitor->links())
+    {
+        foundLoopback = foundLoopback || link.name == "lo";
+    }
+    EXPECT_TRUE(foundLoopback);
+}
@@ -1,10 +1,20 @@
+#include "MCTPDeviceRepository.hpp"
 #include "MCTPEndpoint.hpp"
 #include "MCTPReactor.hpp"
+#include "Tracing.hpp"
 #include "Utils.hpp"
 
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <system_error>
 #include <vector>
@@ -24,6 +34,7 @@ class MockMCTPDevice : public MCTPDevice
                 (override));
     MOCK_METHOD(void, remove, (), (override));
     MOCK_METHOD(std::string, describe, (), (const, override));
+    MOCK_METHOD(std::string, link, (), (const, override));
 };
 
 class MockMCTPEndpoint : public MCTPEndpoint
@@ -58,10 +69,14 @@ class MCTPReactorFixture : public testing::Test
   protected:
     void SetUp() override
     {
-        reactor = std::make_shared<MCTPReactor>(assoc);
+        reactor = std::make_shared<MCTPReactor>(assoc, [this]() {
+            return now;
+        });
         device = std::make_shared<MockMCTPDevice>();
         EXPECT_CALL(*device, describe())
             .WillRepeatedly(testing::Return("mock device"));
+        EXPECT_CALL(*device, link())
+            .WillRepeatedly(testing::Return("mctpi2c1"));
 
         endpoint = std::make_shared<MockMCTPEndpoint>();
         EXPECT_CALL(*endpoint, device())
@@ -80,6 +95,7 @@ class MCTPReactorFixture : public testing::Test
     }
 
     MockAssociationServer assoc;
+    MCTPReactor::Clock::time_point now;
     std::shared_ptr<MCTPReactor> reactor;
     std::shared_ptr<MockMCTPDevice> device;
     std::shared_ptr<MockMCTPEndpoint> endpoint;
@@ -163,6 +179,108 @@ TEST_F(MCTPReactorFixture, manageMockDeviceDeferredSetup)
     reactor->unmanageMCTPDevice("/test");
 }
 
+TEST_F(MCTPReactorFixture, manageMockDeviceBacksOff)
+{
+    using namespace std::chrono_literals;
+
+    // Each attempt takes 2ms to fail
+    std::vector<MCTPReactor::Clock::time_point> attempts;
+    EXPECT_CALL(*device, remove());
+    EXPECT_CALL(*device, setup(testing::_))
+        .WillRepeatedly(testing::Invoke(
+            [&](std::function<void(const std::error_code& ec,
+                                   const std::shared_ptr<MCTPEndpoint>& ep)>&&
+                    added) {
+                attempts.push_back(now);
+                now += 2ms;
+                added(std::make_error_code(std::errc::no_such_device),
+                      endpoint);
+            }));
+
+    reactor->manageMCTPDevice("/test", device);
+    // The first failure is retried at the next tick
+    reactor->tick();
+    ASSERT_EQ(attempts.size(), 2U);
+
+    // Then with a delay doubling from initialRetryDelay up to maxRetryDelay,
+    // shortened by up to a quarter
+    for (std::chrono::milliseconds delay : {5s, 10s, 20s, 40s, 80s, 160s, 300s})
+    {
+        size_t attempted = attempts.size();
+        auto failed = now;
+        now = failed + delay * 3 / 4 - 1ms;
+        reactor->tick();
+        EXPECT_EQ(attempts.size(), attempted);
+        now = failed + delay;
+        reactor->tick();
+        ASSERT_EQ(attempts.size(), attempted + 1);
+    }
+
+    const MCTPReactor::Metrics& metrics = reactor->metrics();
+    EXPECT_EQ(metrics.attempts, 9U);
+    EXPECT_EQ(metrics.failures, 9U);
+    EXPECT_EQ(metrics.successes, 0U);
+    EXPECT_EQ(metrics.totalLatency, 18ms);
+    EXPECT_EQ(metrics.maxLatency, 2ms);
+
+    // The last tick was well over metricsPeriod after the one before
+    nlohmann::json trace = tracing::chromeTrace();
+    std::optional<double> recordedFailures;
+    for (const auto& event : trace["traceEvents"])
+    {
+        if (event["name"] == "mctp setup failures")
+        {
+            recordedFailures = event["args"]["value"].get<double>();
+        }
+    }
+    EXPECT_EQ(recordedFailures, 9.0);
+
+    reactor->unmanageMCTPDevice("/test");
+}
+
+TEST_F(MCTPReactorFixture, manageMockDeviceRetryNow)
+{
+    std::function<void(const std::shared_ptr<MCTPEndpoint>& ep)> removeHandler;
+
+    std::vector<Association> requiredAssociation{
+        {"configured_by", "configures", "/test"}};
+    EXPECT_CALL(assoc,
+                associate("/au/com/codeconstruct/mctp1/networks/1/endpoints/9",
+                          requiredAssociation));
+    EXPECT_CALL(
+        assoc,
+        disassociate("/au/com/codeconstruct/mctp1/networks/1/endpoints/9"));
+
+    EXPECT_CALL(*endpoint, remove()).WillOnce(testing::Invoke([&]() {
+        removeHandler(endpoint);
+    }));
+    EXPECT_CALL(*endpoint, subscribe(testing::_, testing::_, testing::_))
+        .WillOnce(testing::SaveArg<2>(&removeHandler));
+
+    EXPECT_CALL(*device, remove()).WillOnce(testing::Invoke([&]() {
+        endpoint->remove();
+    }));
+    EXPECT_CALL(*device, setup(testing::_))
+        .WillOnce(testing::InvokeArgument<0>(
+            std::make_error_code(std::errc::no_such_device), endpoint))
+        .WillOnce(testing::InvokeArgument<0>(
+            std::make_error_code(std::errc::no_such_device), endpoint))
+        .WillOnce(testing::InvokeArgument<0>(std::error_code(), endpoint));
+
+    reactor->manageMCTPDevice("/test", device);
+    reactor->tick();
+    // Backing off now, but an event makes it retry regardless
+    reactor->tick();
+    reactor->retryNow();
+
+    const MCTPReactor::Metrics& metrics = reactor->metrics();
+    EXPECT_EQ(metrics.attempts, 3U);
+    EXPECT_EQ(metrics.failures, 2U);
+    EXPECT_EQ(metrics.successes, 1U);
+
+    reactor->unmanageMCTPDevice("/test");
+}
+
 TEST_F(MCTPReactorFixture, manageMockDeviceRemoved)
 {
     std::function<void(const std::shared_ptr<MCTPEndpoint>& ep)> removeHandler;
@@ -232,6 +350,7 @@ TEST(MCTPReactor, replaceConfiguration)
     auto initial = std::make_shared<MockMCTPDevice>();
     EXPECT_CALL(*initial, describe())
         .WillRepeatedly(testing::Return("mock device: initial"));
+    EXPECT_CALL(*initial, link()).WillRepeatedly(testing::Return("mctpi2c1"));
     EXPECT_CALL(*initial, setup(testing::_))
         .WillOnce(testing::InvokeArgument<0>(std::error_code(), endpoint));
     EXPECT_CALL(*initial, remove()).WillOnce(testing::Invoke([&]() {
@@ -241,6 +360,8 @@ TEST(MCTPReactor, replaceConfiguration)
     auto replacement = std::make_shared<MockMCTPDevice>();
     EXPECT_CALL(*replacement, describe())
         .WillRepeatedly(testing::Return("mock device: replacement"));
+    EXPECT_CALL(*replacement, link())
+        .WillRepeatedly(testing::Return("mctpi2c1"));
     EXPECT_CALL(*replacement, setup(testing::_))
         .WillOnce(testing::InvokeArgument<0>(std::error_code(), endpoint));
     EXPECT_CALL(*replacement, remove()).WillOnce(testing::Invoke([&]() {
@@ -262,3 +383,116 @@ TEST(MCTPReactor, replaceConfiguration)
     EXPECT_TRUE(testing::Mock::VerifyAndClearExpectations(replacement.get()));
     EXPECT_TRUE(testing::Mock::VerifyAndClearExpectations(endpoint.get()));
 }
+
+// A fully populated chassis is set up within the limit on outstanding setups,
+// and with at most one outstanding on each link
+TEST(MCTPReactor, setupManyDevices)
+{
+    using Added = std::function<void(const std::error_code& ec,
+                                     const std::shared_ptr<MCTPEndpoint>& ep)>;
+    struct Outstanding
+    {
+        std::string link;
+        std::shared_ptr<MCTPEndpoint> endpoint;
+        Added added;
+    };
+
+    constexpr int links = 16;
+    constexpr int perLink = 32;
+
+    testing::NiceMock<MockAssociationServer> assoc;
+    auto reactor = std::make_shared<MCTPReactor>(assoc);
+
+    std::deque<Outstanding> outstanding;
+    std::map<std::string, size_t> busy;
+    size_t maxInFlight = 0;
+    std::vector<std::string> paths;
+    std::vector<std::shared_ptr<testing::NiceMock<MockMCTPDevice>>> devices;
+    for (int i = 0; i < links * perLink; i++)
+    {
+        std::string link = "mctpi2c" + std::to_string(i % links);
+        auto device = std::make_shared<testing::NiceMock<MockMCTPDevice>>();
+        auto endpoint = std::make_shared<testing::NiceMock<MockMCTPEndpoint>>();
+        ON_CALL(*device, link()).WillByDefault(testing::Return(link));
+        ON_CALL(*device, describe())
+            .WillByDefault(testing::Return("mock device " + std::to_string(i)));
+        ON_CALL(*device, setup(testing::_))
+            .WillByDefault(testing::Invoke([&, link, endpoint](Added&& added) {
+                EXPECT_EQ(++busy[link], 1U);
+                outstanding.emplace_back(link, endpoint, std::move(added));
+                maxInFlight = std::max(maxInFlight, outstanding.size());
+            }));
+        ON_CALL(*endpoint, device()).WillByDefault(testing::Return(device));
+        ON_CALL(*endpoint, network()).WillByDefault(testing::Return(i % links));
+        ON_CALL(*endpoint, eid())
+            .WillByDefault(testing::Return(8 + (i / links)));
+        paths.push_back("/xyz/openbmc_project/inventory/system/nvme/NVMe_" +
+                        std::to_string(i));
+        devices.push_back(device);
+    }
+
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        reactor->manageMCTPDevice(paths[i], devices[i]);
+    }
+    EXPECT_EQ(reactor->metrics().inFlight, MCTPReactor::defaultSetupLimit);
+    EXPECT_EQ(reactor->metrics().queued,
+              devices.size() - MCTPReactor::defaultSetupLimit);
+
+    // A device unmanaged while queued is never set up
+    reactor->unmanageMCTPDevice(paths.back());
+    EXPECT_CALL(*devices.back(), setup(testing::_)).Times(0);
+
+    while (!outstanding.empty())
+    {
+        Outstanding done = std::move(outstanding.front());
+        outstanding.pop_front();
+        busy[done.link]--;
+        done.added({}, done.endpoint);
+    }
+
+    const MCTPReactor::Metrics& metrics = reactor->metrics();
+    EXPECT_EQ(maxInFlight, MCTPReactor::defaultSetupLimit);
+    EXPECT_EQ(metrics.attempts, devices.size() - 1);
+    EXPECT_EQ(metrics.successes, devices.size() - 1);
+    EXPECT_EQ(metrics.queued, 0U);
+    EXPECT_EQ(metrics.inFlight, 0U);
+
+    for (const auto& path : paths)
+    {
+        reactor->unmanageMCTPDevice(path);
+    }
+    // The devices and their endpoints refer to each other through their
+    // actions
+    for (const auto& device : devices)
+    {
+        testing::Mock::VerifyAndClear(device.get());
+    }
+}
+
+// A device is only ever known under one path, whichever way it's looked up
+TEST(MCTPDeviceRepository, addUnderNewPath)
+{
+    MCTPDeviceRepository repository;
+    auto device = std::make_shared<MockMCTPDevice>();
+    EXPECT_CALL(*device, describe())
+        .WillRepeatedly(testing::Return("mock device"));
+
+    repository.add("/first", device);
+    // Adding it again under the same path is harmless
+    repository.add("/first", device);
+    EXPECT_THROW(repository.add("/second", device), std::system_error);
+
+    EXPECT_EQ(repository.deviceFor("/first"), device);
+    EXPECT_EQ(repository.deviceFor("/second"), nullptr);
+    EXPECT_EQ(repository.inventoryFor(device), "/first");
+
+    repository.remove(device);
+    EXPECT_FALSE(repository.contains(device));
+    EXPECT_EQ(repository.deviceFor("/first"), nullptr);
+
+    // Once removed it can be added under another path
+    repository.add("/second", device);
+    EXPECT_EQ(repository.deviceFor("/second"), device);
+    EXPECT_EQ(repository.inventoryFor(device), "/second");
+}
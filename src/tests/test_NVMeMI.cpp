@@ -0,0 +1,291 @@
+#include "NVMeMI.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+// MCTP over a local SOCK_SEQPACKET socket pair, each message prefixed with
+// the EID of the endpoint it's to or from
+class LocalSocket : public nvme_mi::Socket
+{
+  public:
+    LocalSocket(boost::asio::io_context& io, int fd) : socket(io, fd) {}
+
+    std::error_code send(const nvme_mi::Address& to,
+                         std::span<const uint8_t> msg) override
+    {
+        std::vector<uint8_t> packet{to.eid};
+        packet.insert(packet.end(), msg.begin(), msg.end());
+        if (::send(socket.native_handle(), packet.data(), packet.size(), 0) <
+            0)
+        {
+            return {errno, std::system_category()};
+        }
+        return {};
+    }
+
+    void receive(ReceiveHandler&& handler) override
+    {
+        socket.async_wait(
+            boost::asio::posix::stream_descriptor::wait_read,
+            [this, handler{std::move(handler)}](
+                const boost::system::error_code& ec) {
+                if (ec)
+                {
+                    handler(ec, {}, {});
+                    return;
+                }
+                ssize_t rc = ::recv(socket.native_handle(), buffer.data(),
+                                    buffer.size(), 0);
+                if (rc < 1)
+                {
+                    handler(boost::asio::error::eof, {}, {});
+                    return;
+                }
+                handler({}, {1, buffer[0]},
+                        std::span(buffer).subspan(1, rc - 1));
+            });
+    }
+
+  private:
+    boost::asio::posix::stream_descriptor socket;
+    std::array<uint8_t, 256> buffer{};
+};
+
+// The endpoints' end of the socket pair, answering health status polls
+class Simulator
+{
+  public:
+    explicit Simulator(int fd) : fd(fd) {}
+
+    ~Simulator()
+    {
+        ::close(fd);
+    }
+
+    Simulator(const Simulator&) = delete;
+    Simulator& operator=(const Simulator&) = delete;
+    Simulator(Simulator&&) = delete;
+    Simulator& operator=(Simulator&&) = delete;
+
+    // Read the requests sent so far, by EID
+    std::map<uint8_t, std::vector<uint8_t>> requests()
+    {
+        std::map<uint8_t, std::vector<uint8_t>> received;
+        std::array<uint8_t, 256> buffer{};
+        ssize_t rc = 0;
+        while ((rc = ::recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT)) >
+               0)
+        {
+            received[buffer[0]].assign(buffer.begin() + 1, buffer.begin() + rc);
+        }
+        return received;
+    }
+
+    void respond(uint8_t eid, uint8_t temperature, uint8_t smartWarnings)
+    {
+        std::array<uint8_t, 1 + nvme_mi::healthStatusPollResponseSize>
+            packet{};
+        std::span<uint8_t> msg = std::span(packet).subspan(1);
+        packet[0] = eid;
+        msg[0] = 0x84;
+        msg[1] = 0x88;
+        msg[8] = 0x20 | 0x18; /* Drive functional, ports active */
+        msg[9] = smartWarnings;
+        msg[10] = temperature;
+        uint32_t mic = nvme_mi::crc32c(msg.first(msg.size() - 4));
+        std::memcpy(&msg[msg.size() - 4], &mic, sizeof(mic));
+
+        ASSERT_EQ(::send(fd, packet.data(), packet.size(), 0),
+                  static_cast<ssize_t>(packet.size()));
+    }
+
+  private:
+    int fd;
+};
+
+struct Completion
+{
+    std::error_code ec;
+    std::optional<nvme_mi::SubsystemHealth> health;
+};
+
+} // namespace
+
+TEST(NVMeMI, CRC32C)
+{
+    const std::string check = "123456789";
+    std::span<const uint8_t> bytes(
+        reinterpret_cast<const uint8_t*>(check.data()), check.size());
+    EXPECT_EQ(nvme_mi::crc32c(bytes), 0xe3069283U);
+}
+
+TEST(NVMeMI, EncodeHealthStatusPoll)
+{
+    auto msg = nvme_mi::encodeHealthStatusPoll();
+    EXPECT_EQ(msg[0], 0x84);
+    EXPECT_EQ(msg[1], 0x08);
+    EXPECT_EQ(msg[4], 0x01);
+
+    uint32_t mic = 0;
+    std::memcpy(&mic, &msg[msg.size() - 4], sizeof(mic));
+    EXPECT_EQ(mic, nvme_mi::crc32c(std::span(msg).first(msg.size() - 4)));
+}
+
+TEST(NVMeMI, DecodeHealthStatusPoll)
+{
+    std::array<uint8_t, nvme_mi::healthStatusPollResponseSize> msg{};
+    msg[0] = 0x84;
+    msg[1] = 0x88;
+    msg[8] = 0x20;
+    msg[9] = 0xff & ~0x01; /* Available spare warning, inverted */
+    msg[10] = 0xfb;        /* -5 degrees */
+    msg[11] = 42;
+    uint32_t mic = nvme_mi::crc32c(std::span(msg).first(msg.size() - 4));
+    std::memcpy(&msg[msg.size() - 4], &mic, sizeof(mic));
+
+    std::string error;
+    std::optional<nvme_mi::SubsystemHealth> health =
+        nvme_mi::decodeHealthStatusPoll(msg, error);
+    ASSERT_TRUE(health) << error;
+    EXPECT_TRUE(health->driveFunctional());
+    EXPECT_EQ(health->criticalWarnings,
+              nvme_mi::SubsystemHealth::CW_AVAILABLE_SPARE);
+    EXPECT_EQ(health->temperature(), -5.0);
+    EXPECT_EQ(health->driveLifeUsed, 42);
+
+    msg[10] = 0x80;
+    mic = nvme_mi::crc32c(std::span(msg).first(msg.size() - 4));
+    std::memcpy(&msg[msg.size() - 4], &mic, sizeof(mic));
+    health = nvme_mi::decodeHealthStatusPoll(msg, error);
+    ASSERT_TRUE(health) << error;
+    EXPECT_TRUE(std::isnan(health->temperature()));
+
+    msg[10] = 0x81; /* Corrupt without updating the MIC */
+    EXPECT_FALSE(nvme_mi::decodeHealthStatusPoll(msg, error));
+
+    EXPECT_FALSE(
+        nvme_mi::decodeHealthStatusPoll(std::span(msg).first(8), error));
+}
+
+class NVMeMIClient : public testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        std::array<int, 2> fds{};
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0,
+                               fds.data()),
+                  0);
+        simulator = std::make_unique<Simulator>(fds[1]);
+        client = std::make_shared<nvme_mi::Client>(
+            io, std::make_unique<LocalSocket>(io, fds[0]),
+            std::chrono::milliseconds(50));
+    }
+
+    void poll(uint8_t eid)
+    {
+        auto request = nvme_mi::encodeHealthStatusPoll();
+        std::error_code ec = client->request(
+            {1, eid}, request,
+            [this, eid](const std::error_code& ec,
+                        std::span<const uint8_t> response) {
+                Completion& completion = completions[eid];
+                completion.ec = ec;
+                std::string error;
+                if (!ec)
+                {
+                    completion.health =
+                        nvme_mi::decodeHealthStatusPoll(response, error);
+                }
+            });
+        ASSERT_FALSE(ec) << ec.message();
+    }
+
+    boost::asio::io_context io;
+    std::unique_ptr<Simulator> simulator;
+    std::shared_ptr<nvme_mi::Client> client;
+    std::map<uint8_t, Completion> completions;
+};
+
+TEST_F(NVMeMIClient, PipelinesRequests)
+{
+    poll(9);
+    poll(10);
+    poll(11);
+    EXPECT_EQ(client->outstanding(), 3U);
+
+    /* All three are on the wire before any response */
+    auto requests = simulator->requests();
+    ASSERT_EQ(requests.size(), 3U);
+    EXPECT_EQ(requests[9][4], 0x01);
+
+    /* Responses are matched by endpoint, whatever their order */
+    simulator->respond(11, 31, 0xff);
+    simulator->respond(9, 29, 0xff & ~0x02);
+    simulator->respond(10, 30, 0xff);
+
+    while (completions.size() < 3)
+    {
+        ASSERT_EQ(io.run_one(), 1U);
+    }
+
+    for (uint8_t eid : {9, 10, 11})
+    {
+        ASSERT_FALSE(completions[eid].ec);
+        ASSERT_TRUE(completions[eid].health);
+        EXPECT_EQ(completions[eid].health->temperature(), eid + 20.0);
+    }
+    EXPECT_EQ(completions[9].health->criticalWarnings,
+              nvme_mi::SubsystemHealth::CW_TEMPERATURE);
+    EXPECT_EQ(client->outstanding(), 0U);
+}
+
+TEST_F(NVMeMIClient, OneRequestPerEndpoint)
+{
+    poll(9);
+    auto request = nvme_mi::encodeHealthStatusPoll();
+    EXPECT_EQ(client->request({1, 9}, request, {}),
+              std::errc::device_or_resource_busy);
+    EXPECT_TRUE(client->busy({1, 9}));
+    EXPECT_FALSE(client->busy({1, 10}));
+}
+
+TEST_F(NVMeMIClient, UnansweredRequestsTimeOut)
+{
+    poll(9);
+    poll(10);
+    simulator->respond(10, 30, 0xff);
+
+    while (completions.size() < 2)
+    {
+        ASSERT_EQ(io.run_one(), 1U);
+    }
+
+    EXPECT_FALSE(completions[10].ec);
+    EXPECT_EQ(completions[9].ec, std::errc::timed_out);
+    EXPECT_FALSE(client->busy({1, 9}));
+}
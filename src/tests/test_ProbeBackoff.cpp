@@ -0,0 +1,71 @@
+#include "ProbeBackoff.hpp"
+
+#include <cstddef>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(ProbeBackoff, DoublesUpToTheLimit)
+{
+    ProbeBackoff backoff(8);
+    std::vector<size_t> probed;
+    for (size_t sweep = 0; sweep < 40; sweep++)
+    {
+        if (backoff.due())
+        {
+            probed.push_back(sweep);
+            backoff.missed();
+        }
+    }
+
+    std::vector<size_t> expected{0, 2, 6, 14, 22, 30, 38};
+    EXPECT_EQ(probed, expected);
+    EXPECT_EQ(backoff.backoff(), 8U);
+}
+
+TEST(ProbeBackoff, ResponseResets)
+{
+    ProbeBackoff backoff(300);
+    ASSERT_TRUE(backoff.due());
+    backoff.missed();
+    backoff.missed();
+    EXPECT_FALSE(backoff.due());
+
+    backoff.responded();
+    EXPECT_EQ(backoff.backoff(), 1U);
+    EXPECT_TRUE(backoff.due());
+    EXPECT_TRUE(backoff.due());
+}
+
+TEST(ProbeBackoff, SparseBackplane)
+{
+    /* Half the bays of a 24 bay backplane populated */
+    constexpr size_t bays = 24;
+    constexpr size_t sweeps = 3600;
+    std::vector<ProbeBackoff> slots(bays, ProbeBackoff(300));
+
+    size_t queries = 0;
+    for (size_t sweep = 0; sweep < sweeps; sweep++)
+    {
+        for (size_t bay = 0; bay < bays; bay++)
+        {
+            if (!slots[bay].due())
+            {
+                continue;
+            }
+            queries++;
+            if (bay % 2 == 0)
+            {
+                slots[bay].responded();
+            }
+            else
+            {
+                slots[bay].missed();
+            }
+        }
+    }
+
+    /* Within a few percent of querying only the populated bays */
+    size_t populated = sweeps * bays / 2;
+    EXPECT_LT(queries, populated + populated / 50);
+}
@@ -0,0 +1,81 @@
+#include "SPSCQueue.hpp"
+
+#include <cstddef>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+TEST(SPSCQueue, FillAndDrain)
+{
+    SPSCQueue<int, 4> queue;
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(queue.front(), nullptr);
+
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(queue.push(i));
+    }
+    EXPECT_EQ(queue.size(), 4U);
+    EXPECT_EQ(queue.reserve(), nullptr);
+    EXPECT_FALSE(queue.push(4));
+
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_NE(queue.front(), nullptr);
+        EXPECT_EQ(*queue.front(), i);
+        queue.pop();
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(SPSCQueue, SlotsAreReusedInPlace)
+{
+    SPSCQueue<int, 2> queue;
+
+    for (int i = 0; i < 5; i++)
+    {
+        int* slot = queue.reserve();
+        ASSERT_NE(slot, nullptr);
+        *slot = i;
+        queue.commit();
+
+        ASSERT_EQ(queue.front(), slot);
+        EXPECT_EQ(*queue.front(), i);
+        queue.pop();
+    }
+}
+
+TEST(SPSCQueue, CrossThreadOrdering)
+{
+    constexpr size_t count = 10000;
+    SPSCQueue<size_t, 8> queue;
+
+    std::thread producer([&queue]() {
+        for (size_t i = 0; i < count;)
+        {
+            if (queue.push(i))
+            {
+                i++;
+                continue;
+            }
+            std::this_thread::yield();
+        }
+    });
+
+    size_t expected = 0;
+    while (expected < count)
+    {
+        const size_t* value = queue.front();
+        if (value == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        EXPECT_EQ(*value, expected);
+        queue.pop();
+        expected++;
+    }
+
+    producer.join();
+    EXPECT_TRUE(queue.empty());
+}
@@ -0,0 +1,177 @@
+#include "SensorConfig.hpp"
+#include "Utils.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+struct TestConfig
+{
+    std::string name;
+    uint8_t address = 0;
+    float pollRate = 1.0F;
+    PowerState readState = PowerState::always;
+
+    bool operator==(const TestConfig&) const = default;
+};
+
+} // namespace
+
+template <>
+struct sensor_config::Schema<TestConfig>
+{
+    static constexpr auto fields = std::make_tuple(
+        required("Name", &TestConfig::name),
+        required("Address", &TestConfig::address),
+        optional("PollRate", &TestConfig::pollRate, positive<float>),
+        optional("PowerState", &TestConfig::readState));
+};
+
+TEST(SensorConfig, DecodesAllFields)
+{
+    SensorBaseConfigMap data{{"Name", std::string("cpu0")},
+                             {"Address", uint64_t{0x2c}},
+                             {"PollRate", 0.5},
+                             {"PowerState", std::string("On")}};
+
+    std::string error;
+    std::optional<TestConfig> config = sensor_config::decode<TestConfig>(
+        data, error);
+    ASSERT_TRUE(config);
+    EXPECT_EQ(config->name, "cpu0");
+    EXPECT_EQ(config->address, 0x2c);
+    EXPECT_FLOAT_EQ(config->pollRate, 0.5F);
+    EXPECT_EQ(config->readState, PowerState::on);
+}
+
+TEST(SensorConfig, OptionalFieldsKeepDefaults)
+{
+    SensorBaseConfigMap data{{"Name", std::string("cpu0")},
+                             {"Address", uint64_t{1}},
+                             {"PollRate", -1.0}};
+
+    std::string error;
+    std::optional<TestConfig> config = sensor_config::decode<TestConfig>(
+        data, error);
+    ASSERT_TRUE(config);
+    EXPECT_FLOAT_EQ(config->pollRate, 1.0F);
+    EXPECT_EQ(config->readState, PowerState::always);
+}
+
+TEST(SensorConfig, MissingRequiredFieldFails)
+{
+    SensorBaseConfigMap data{{"Name", std::string("cpu0")}};
+
+    std::string error;
+    EXPECT_FALSE(sensor_config::decode<TestConfig>(data, error));
+    EXPECT_EQ(error, "missing Address");
+}
+
+TEST(SensorConfig, OutOfRangeIntegerFails)
+{
+    std::string error;
+    SensorBaseConfigMap data{{"Name", std::string("cpu0")},
+                             {"Address", uint64_t{0x100}}};
+    EXPECT_FALSE(sensor_config::decode<TestConfig>(data, error));
+
+    data["Address"] = -1.0;
+    EXPECT_FALSE(sensor_config::decode<TestConfig>(data, error));
+
+    data["Address"] = 1.5;
+    EXPECT_FALSE(sensor_config::decode<TestConfig>(data, error));
+
+    data["Address"] = 255.0;
+    EXPECT_TRUE(sensor_config::decode<TestConfig>(data, error));
+}
+
+TEST(SensorConfig, CacheReportsChanges)
+{
+    const std::string path = "/xyz/openbmc_project/inventory/board/cpu0";
+    sensor_config::Cache<TestConfig> cache;
+    SensorBaseConfigMap data{{"Name", std::string("cpu0")},
+                             {"Address", uint64_t{1}}};
+
+    EXPECT_EQ(cache.update(path, data), sensor_config::Update::changed);
+    EXPECT_EQ(cache.update(path, data), sensor_config::Update::unchanged);
+
+    data["PollRate"] = 2.0;
+    EXPECT_EQ(cache.update(path, data), sensor_config::Update::changed);
+    ASSERT_NE(cache.find(path), nullptr);
+    EXPECT_FLOAT_EQ(cache.find(path)->pollRate, 2.0F);
+
+    data.erase("Name");
+    EXPECT_EQ(cache.update(path, data), sensor_config::Update::invalid);
+    EXPECT_EQ(cache.find(path), nullptr);
+}
+
+namespace
+{
+
+struct ListConfig
+{
+    std::optional<int> index;
+    std::optional<std::vector<std::string>> labels;
+
+    bool operator==(const ListConfig&) const = default;
+};
+
+} // namespace
+
+template <>
+struct sensor_config::Schema<ListConfig>
+{
+    static constexpr auto fields =
+        std::make_tuple(optional("Index", &ListConfig::index),
+                        optional("Labels", &ListConfig::labels));
+};
+
+TEST(SensorConfig, OptionalMembersTellMissingFromDefault)
+{
+    std::string error;
+    std::optional<ListConfig> config =
+        sensor_config::decode<ListConfig>({}, error);
+    ASSERT_TRUE(config);
+    EXPECT_FALSE(config->index);
+    EXPECT_FALSE(config->labels);
+
+    SensorBaseConfigMap data{
+        {"Index", uint64_t{0}},
+        {"Labels", std::vector<std::string>{"vin", "iout1"}}};
+    config = sensor_config::decode<ListConfig>(data, error);
+    ASSERT_TRUE(config);
+    EXPECT_EQ(config->index, 0);
+    EXPECT_EQ(config->labels, (std::vector<std::string>{"vin", "iout1"}));
+
+    // A single string isn't a list
+    data["Labels"] = std::string("vin");
+    config = sensor_config::decode<ListConfig>(data, error);
+    ASSERT_TRUE(config);
+    EXPECT_FALSE(config->labels);
+}
+
+TEST(SensorConfig, DecodesSingleValues)
+{
+    SensorBaseConfigMap data{{"PollRate", 0.0},
+                             {"PowerState", std::string("BiosPost")}};
+    EXPECT_FLOAT_EQ(sensor_config::decodeValue(data, "PollRate", 2.0F,
+                                               sensor_config::positive<float>),
+                    2.0F);
+    EXPECT_EQ(sensor_config::decodeValue(data, "PowerState",
+                                         PowerState::always),
+              PowerState::biosPost);
+
+    data["PollRate"] = 0.25;
+    EXPECT_FLOAT_EQ(sensor_config::decodeValue(data, "PollRate", 2.0F,
+                                               sensor_config::positive<float>),
+                    0.25F);
+    EXPECT_EQ(sensor_config::decodeValue({}, "PowerState", PowerState::always),
+              PowerState::always);
+}
@@ -0,0 +1,148 @@
+#include "Tracing.hpp"
+
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+size_t eventsNamed(const nlohmann::json& trace, const std::string& name)
+{
+    size_t count = 0;
+    for (const nlohmann::json& event : trace["traceEvents"])
+    {
+        if (event["name"] == name)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+class TracingDumpTest : public testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        std::string pattern =
+            (std::filesystem::temp_directory_path() / "tracing-XXXXXX")
+                .string();
+        ASSERT_NE(::mkdtemp(pattern.data()), nullptr);
+        directory = pattern;
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(directory);
+    }
+
+    std::filesystem::path directory;
+};
+
+} // namespace
+
+TEST(Tracing, RecordsSpansAndCounters)
+{
+    tracing::Clock::time_point start = tracing::Clock::now();
+    tracing::complete("test span", start,
+                      start + std::chrono::microseconds(30), "first");
+    tracing::complete("test span", start + std::chrono::microseconds(40),
+                      start + std::chrono::microseconds(50));
+    tracing::counter("test counter", 7.0);
+
+    nlohmann::json trace = tracing::chromeTrace();
+    EXPECT_EQ(eventsNamed(trace, "test span"), 2U);
+    EXPECT_EQ(eventsNamed(trace, "test counter"), 1U);
+    for (const nlohmann::json& event : trace["traceEvents"])
+    {
+        if (event["name"] == "test span" && event.contains("args"))
+        {
+            EXPECT_EQ(event["ph"], "X");
+            EXPECT_EQ(event["dur"], 30);
+            EXPECT_EQ(event["args"]["detail"], "first");
+        }
+        if (event["name"] == "test counter")
+        {
+            EXPECT_EQ(event["ph"], "C");
+            EXPECT_EQ(event["args"]["value"], 7.0);
+        }
+    }
+
+    EXPECT_EQ(tracing::summary()["counters"]["test counter"], 7.0);
+
+    nlohmann::json phase = tracing::summary()["phases"]["test span"];
+    EXPECT_EQ(phase["count"], 2);
+    EXPECT_EQ(phase["total_us"], 40);
+    EXPECT_EQ(phase["min_us"], 10);
+    EXPECT_EQ(phase["max_us"], 30);
+    EXPECT_EQ(phase["last_end_us"].get<int64_t>() -
+                  phase["first_start_us"].get<int64_t>(),
+              50);
+}
+
+TEST_F(TracingDumpTest, WritesTrace)
+{
+    std::filesystem::path path = directory / "trace.json";
+    ASSERT_TRUE(tracing::dump(path));
+
+    std::ifstream input(path);
+    nlohmann::json trace = nlohmann::json::parse(input);
+    EXPECT_TRUE(trace["traceEvents"].is_array());
+    EXPECT_EQ(std::filesystem::status(path).permissions() &
+                  std::filesystem::perms::all,
+              std::filesystem::perms::owner_read |
+                  std::filesystem::perms::owner_write);
+}
+
+TEST_F(TracingDumpTest, RefusesSymlinks)
+{
+    std::filesystem::path target = directory / "target";
+    {
+        std::ofstream output(target);
+        output << "untouched";
+    }
+    std::filesystem::path path = directory / "trace.json";
+    std::filesystem::create_symlink(target, path);
+
+    EXPECT_FALSE(tracing::dump(path));
+    std::ifstream input(target);
+    std::string contents;
+    std::getline(input, contents);
+    EXPECT_EQ(contents, "untouched");
+}
+
+// In a suite of its own so it runs last, as nothing more is kept in the trace
+// once it's full
+TEST(TracingCap, DropsEventsBeyondTheCap)
+{
+    tracing::Clock::time_point start = tracing::Clock::now();
+    for (size_t i = 0; i < tracing::maxTraceEvents + 5; i++)
+    {
+        tracing::complete("capped span", start, start);
+    }
+
+    nlohmann::json trace = tracing::chromeTrace();
+    // The events plus the process name
+    EXPECT_EQ(trace["traceEvents"].size(), tracing::maxTraceEvents + 1);
+    EXPECT_GE(trace["otherData"]["dropped"].get<size_t>(), 5U);
+
+    // Still aggregated, though
+    EXPECT_EQ(tracing::summary()["phases"]["capped span"]["count"],
+              tracing::maxTraceEvents + 5);
+
+    // And counters still report their latest value
+    tracing::counter("capped counter", 1.0);
+    tracing::counter("capped counter", 2.0);
+    EXPECT_EQ(eventsNamed(tracing::chromeTrace(), "capped counter"), 0U);
+    EXPECT_EQ(tracing::summary()["counters"]["capped counter"], 2.0);
+}
@@ -1,6 +1,7 @@
 #include "Utils.hpp"
 
 #include <array>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
@@ -8,6 +9,7 @@
 #include <fstream>
 #include <iostream>
 #include <new>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -242,3 +244,93 @@ TEST(GetDeviceBusAddrTest, AllValid)
     EXPECT_EQ(bus, 12);
     EXPECT_EQ(addr, 0xaf);
 }
+
+TEST(RequestWindowTest, LimitsOutstanding)
+{
+    RequestWindow<int> window(2);
+    for (int i = 0; i < 5; i++)
+    {
+        window.push(int(i));
+    }
+
+    EXPECT_EQ(window.next(), 0);
+    EXPECT_EQ(window.next(), 1);
+    EXPECT_EQ(window.next(), std::nullopt);
+    EXPECT_EQ(window.outstanding(), 2U);
+    EXPECT_EQ(window.queued(), 3U);
+
+    window.done();
+    EXPECT_EQ(window.next(), 2);
+    EXPECT_EQ(window.next(), std::nullopt);
+}
+
+TEST(RequestWindowTest, RetryQueuesBehindPending)
+{
+    RequestWindow<int> window(1);
+    window.push(1);
+    window.push(2);
+
+    // A failed request is pushed back once its backoff expires
+    EXPECT_EQ(window.next(), 1);
+    window.done();
+    window.push(1);
+
+    EXPECT_EQ(window.next(), 2);
+    window.done();
+    EXPECT_EQ(window.next(), 1);
+    window.done();
+    EXPECT_EQ(window.next(), std::nullopt);
+    EXPECT_EQ(window.outstanding(), 0U);
+}
+
+TEST(ObjectCollectorTest, ReadyOnceAllInterfacesArrive)
+{
+    const std::string base = "xyz.openbmc_project.Configuration.Test";
+    const std::string thresholds = base + ".Thresholds0";
+    ObjectCollector collector;
+    collector.expect("/a");
+    collector.expect("/a");
+    collector.expect("/b");
+
+    // /a isn't handed out without its thresholds
+    EXPECT_FALSE(collector.add("/a", base, {{"Name", std::string("a")}}));
+    EXPECT_TRUE(collector.add("/b", base, {{"Name", std::string("b")}}));
+    EXPECT_TRUE(collector.add("/a", thresholds, {}));
+
+    const ManagedObjectType& collected = collector.collected();
+    ASSERT_EQ(collected.size(), 2U);
+    EXPECT_EQ(collected.at(sdbusplus::message::object_path("/a")).size(), 2U);
+}
+
+TEST(ObjectCollectorTest, AbandonedInterfacesDontHoldObjectsBack)
+{
+    const std::string base = "xyz.openbmc_project.Configuration.Test";
+    ObjectCollector collector;
+    collector.expect("/a");
+    collector.expect("/a");
+    collector.expect("/b");
+
+    EXPECT_FALSE(collector.add("/a", base, {}));
+    EXPECT_TRUE(collector.abandon("/a"));
+
+    // Nothing arrived for /b, so there's nothing to hand out
+    EXPECT_FALSE(collector.abandon("/b"));
+    EXPECT_EQ(collector.collected().size(), 1U);
+}
+
+TEST(GetSensorConfigurationTest, BackoffDoubles)
+{
+    using namespace std::chrono_literals;
+    EXPECT_EQ(GetSensorConfiguration::backoff(0), 250ms);
+    EXPECT_EQ(GetSensorConfiguration::backoff(1), 500ms);
+    EXPECT_EQ(GetSensorConfiguration::backoff(2), 1000ms);
+    EXPECT_EQ(GetSensorConfiguration::backoff(5), 8000ms);
+}
+
+TEST(GetSensorConfigurationTest, BackoffCapped)
+{
+    EXPECT_EQ(GetSensorConfiguration::backoff(6),
+              GetSensorConfiguration::retryMax);
+    EXPECT_EQ(GetSensorConfiguration::backoff(64),
+              GetSensorConfiguration::retryMax);
+}